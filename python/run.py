@@ -74,6 +74,7 @@ commands = [
       "extract_names",
       "build_nametab",
       "build_phrasetab",
+      "build_typeclosure",
     ]
   ),
 
@@ -170,6 +171,10 @@ commands = [
     help="Build alias table",
     package="sling.task.wiki",
   ),
+  Command("build_typeclosure",
+    help="Build type closure for knowledge base",
+    package="sling.task.wiki",
+  ),
 
   # Word embeddings.
   Command("extract_vocabulary",
@@ -180,6 +185,10 @@ commands = [
     help="Train word embeddings",
     package="sling.task.embedding",
   ),
+  Command("build_word_index",
+    help="Build nearest neighbor index for word embeddings",
+    package="sling.task.embedding",
+  ),
 
   # Fact embeddings.
   Command("extract_fact_lexicon",
@@ -194,6 +203,10 @@ commands = [
     help="Train fact and category embeddings",
     package="sling.task.embedding",
   ),
+  Command("build_fact_index",
+    help="Build nearest neighbor index for fact and category embeddings",
+    package="sling.task.embedding",
+  ),
 
   # Fact plausibility.
   Command("train_fact_plausibility",
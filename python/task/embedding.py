@@ -55,6 +55,7 @@ class EmbeddingWorkflow:
                                format="message/word:count",
                                mapper="word-vocabulary-mapper",
                                reducer="word-vocabulary-reducer",
+                               combiner="sum",
                                params={"normalization": "d"})
 
   def train_word_embeddings(self, documents=None, vocabulary=None, output=None,
@@ -173,6 +174,42 @@ class EmbeddingWorkflow:
       trainer.attach_output("catvecs", category_embeddings)
     return fact_embeddings, category_embeddings
 
+  #---------------------------------------------------------------------------
+  # Vector indices
+  #---------------------------------------------------------------------------
+
+  def word_index(self, language=None):
+    """Resource for nearest neighbor index for word embeddings."""
+    if language == None: language = flags.arg.language
+    return self.wf.resource("word-embeddings.idx",
+                            dir=corpora.wikidir(language),
+                            format="repository")
+
+  def fact_index(self):
+    """Resource for nearest neighbor index for fact embeddings."""
+    return self.wf.resource("fact-embeddings.idx",
+                            dir=self.fact_dir(),
+                            format="repository")
+
+  def category_index(self):
+    """Resource for nearest neighbor index for category embeddings."""
+    return self.wf.resource("category-embeddings.idx",
+                            dir=self.fact_dir(),
+                            format="repository")
+
+  def build_vector_index(self, embeddings, output, name):
+    """Build nearest neighbor index for embeddings."""
+    with self.wf.namespace(name):
+      builder = self.wf.task("vector-index-builder")
+      builder.add_params({
+        "neighbors": 16,
+        "ef_construction": 200,
+        "threads": 8,
+      })
+      builder.attach_input("embeddings", embeddings)
+      builder.attach_output("repository", output)
+    return output
+
   #---------------------------------------------------------------------------
   # Fact plausibility model
   #---------------------------------------------------------------------------
@@ -242,6 +279,25 @@ def extract_facts():
   wf.extract_facts()
   run(wf.wf)
 
+def build_word_index():
+  # Build nearest neighbor index for word embeddings.
+  for language in flags.arg.languages:
+    log.info("Build " + language + " word embedding index")
+    wf = EmbeddingWorkflow(language + "-word-index")
+    wf.build_vector_index(wf.word_embeddings(language),
+                          wf.word_index(language),
+                          language + "-word-index")
+    run(wf.wf)
+
+def build_fact_index():
+  # Build nearest neighbor indices for fact and category embeddings.
+  log.info("Build fact and category embedding indices")
+  wf = EmbeddingWorkflow("fact-index")
+  wf.build_vector_index(wf.fact_embeddings(), wf.fact_index(), "fact-index")
+  wf.build_vector_index(wf.category_embeddings(), wf.category_index(),
+                        "category-index")
+  run(wf.wf)
+
 def train_fact_embeddings():
   # Train fact and category embeddings.
   log.info("Train fact and category embeddings")
@@ -80,7 +80,8 @@ class SilverWorkflow:
                     params={
                       "min_document_length": 200,
                       "only_lowercase": True
-                    })
+                    }),
+        combiner="sum"
       )
 
       # Build IDF table.
@@ -138,6 +139,10 @@ class SilverWorkflow:
       mapper.attach_input("aliases", self.wiki.phrase_table(language))
       mapper.attach_input("dictionary", self.idftable(language))
 
+      type_closure = self.wiki.type_closure()
+      if os.path.isfile(type_closure.name):
+        mapper.attach_input("type_closure", type_closure)
+
       config = corpora.repository("data/wiki/" + language + "/silver.sling")
       if os.path.isfile(config):
         mapper.attach_input("commons", self.wf.resource(config,
@@ -204,7 +209,8 @@ class SilverWorkflow:
                     params={
                       "normalization": "l",
                       "skip_section_titles": True,
-                    }))
+                    }),
+        combiner="sum")
 
       # Build vocabulary from words in documents.
       vocab = self.wf.reduce(words, output, "word-vocabulary-reducer")
@@ -216,7 +216,8 @@ class WikiWorkflow:
                              output=self.fanin(),
                              mapper="fact-target-extractor",
                              reducer="item-fanin-reducer",
-                             format="message/int")
+                             format="message/int",
+                             combiner="sum")
 
   #---------------------------------------------------------------------------
   # Wikipedia
@@ -565,7 +566,8 @@ class WikiWorkflow:
     # Reduce link targets.
     with self.wf.namespace("targets"):
       popularity = self.popularity()
-      self.wf.reduce(self.wf.shuffle(targets, shards=length_of(popularity)),
+      self.wf.reduce(self.wf.shuffle(targets, shards=length_of(popularity),
+                                     combiner="sum"),
                      popularity, "item-popularity-reducer")
 
     return wikilinks, popularity
@@ -857,6 +859,27 @@ class WikiWorkflow:
       builder.attach_output("repository", repo)
     return repo
 
+  #---------------------------------------------------------------------------
+  # Type closure
+  #---------------------------------------------------------------------------
+
+  def type_closure(self):
+    """Resource for type closure. This is a repository with the transitive
+    closure of the subclass of relation for all types in the knowledge base."""
+    return self.wf.resource("type-closure.repo",
+                            dir=corpora.wikidir(),
+                            format="repository")
+
+  def build_type_closure(self):
+    """Build type closure for all types in the knowledge base."""
+    with self.wf.namespace("type-closure"):
+      builder = self.wf.task("type-closure-builder")
+      kb = self.knowledge_base()
+      repo = self.type_closure()
+      builder.attach_input("kb", kb)
+      builder.attach_output("repository", repo)
+    return repo
+
 # Commands.
 
 wikidata_import = False
@@ -993,3 +1016,10 @@ def build_phrasetab():
     wf.build_phrase_table(language=language)
     run(wf.wf)
 
+def build_typeclosure():
+  # Build type closure.
+  log.info("Build type closure")
+  wf = WikiWorkflow("type-closure")
+  wf.build_type_closure()
+  run(wf.wf)
+
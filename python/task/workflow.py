@@ -602,8 +602,9 @@ class Workflow(object):
 
     return output
 
-  def shuffle(self, input, shards=None, bufsize=None):
-    """Shard and sort the input messages."""
+  def shuffle(self, input, shards=None, bufsize=None, combiner=None):
+    """Shard and sort the input messages. If a combiner is specified, the
+    values for messages with the same key are combined while sorting."""
     if shards != None:
       # Create sharder and connect input.
       sharder = self.task("sharder")
@@ -615,11 +616,13 @@ class Workflow(object):
       for i in range(shards):
         sorter = self.task("sorter", shard=Shard(i, shards))
         if bufsize is not None: sorter.add_param("sort_buffer_size", bufsize)
+        if combiner is not None: sorter.add_param("combiner", combiner)
         self.connect(pipes[i], sorter)
         sorters.append(sorter)
     else:
       sorters = self.task("sorter")
       if bufsize is not None: sorters.add_param("sort_buffer_size", bufsize)
+      if combiner is not None: sorters.add_param("combiner", combiner)
       self.connect(input, sorters)
 
     # Return output channel from sorters.
@@ -648,7 +651,7 @@ class Workflow(object):
     return reducer
 
   def mapreduce(self, input, output, mapper, reducer=None, params=None,
-                auxin=None, format=None):
+                auxin=None, format=None, combiner=None):
     """Map input files, shuffle, sort, reduce, and output to files."""
     # Determine the number of output shards.
     shards = length_of(output)
@@ -657,7 +660,7 @@ class Workflow(object):
     mapping = self.map(input, mapper, params=params, auxin=auxin, format=format)
 
     # Shuffling of map output.
-    shuffle = self.shuffle(mapping, shards=shards)
+    shuffle = self.shuffle(mapping, shards=shards, combiner=combiner)
 
     # Reduction of shuffled map output.
     self.reduce(shuffle, output, reducer, params=params, auxin=auxin)
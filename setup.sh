@@ -12,7 +12,7 @@ echo
 echo "=== Install SLING dependencies"
 PYVER=3.5
 PYPKGS="python${PYVER} python${PYVER}-dev python3-pip"
-PKGS="pkg-config zip g++ zlib1g-dev unzip lbzip2 ${PYPKGS}"
+PKGS="pkg-config zip g++ zlib1g-dev liblz4-dev libzstd-dev unzip lbzip2 ${PYPKGS}"
 sudo apt-get install ${PKGS}
 
 # Install bazel.
@@ -38,7 +38,7 @@ fi
 # Build SLING.
 echo
 echo "=== Build SLING"
-tools/buildall.sh
+tools/buildall.sh --define zstd_lz4=1
 
 # Install SLING Python API.
 echo
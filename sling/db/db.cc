@@ -18,11 +18,59 @@
 #include <string>
 #include <vector>
 
+#include "sling/file/uring.h"
 #include "sling/string/numbers.h"
 #include "sling/util/fingerprint.h"
 
 namespace sling {
 
+// Number of bytes read for each record in batched reads. Records that are
+// larger than this are read in a second round.
+static const int kBatchReadSize = 4096;
+
+// Number of bytes read from the shard being compacted for each batch of records
+// checked against the index.
+static const int kCompactionBatchSize = 1 << 20;
+
+// Compaction state for data shards.
+struct Database::Compaction {
+  ~Compaction() {
+    delete reader;
+    delete writer;
+  }
+
+  // Relocation of live record in compacted shard.
+  struct Move {
+    uint64 fp;    // record key fingerprint
+    uint64 from;  // position of record in original shard
+    uint64 to;    // position of record in compacted shard
+  };
+
+  // Record read from shard being compacted. The key and value are stored in
+  // the batch buffer.
+  struct Entry {
+    uint64 fp;       // record key fingerprint
+    int64 position;  // position of record in original shard
+    uint64 version;  // record version
+    size_t key;      // offset of key in batch buffer
+    size_t keylen;   // key length
+    size_t vallen;   // value length (value follows key in batch buffer)
+    bool live;       // record is still live
+  };
+
+  std::vector<int> shards;            // shards scheduled for compaction
+  RecordReader *reader = nullptr;     // reader for shard being compacted
+  RecordWriter *writer = nullptr;     // writer for compacted shard
+  std::vector<Move> moves;            // relocated records
+  std::vector<Entry> batch;           // batch of records being copied
+  string buffer;                      // keys and values for batch
+};
+
+Database::Readers::~Readers() {
+  for (RecordReader *reader : shards_) delete reader;
+  for (IOBuffer *buffer : buffers_) delete buffer;
+}
+
 Database::~Database() {
   // Close writer.
   delete writer_;
@@ -30,8 +78,17 @@ Database::~Database() {
   // Close data files.
   for (RecordReader *reader : readers_) delete reader;
 
+  // Stop compaction.
+  if (compaction_ != nullptr) {
+    bool started = compaction_->writer != nullptr;
+    delete compaction_;
+    if (started) File::Delete(CompactionFile());
+  }
+
   // Close index.
+  delete old_index_;
   delete index_;
+  delete keys_;
 }
 
 Status Database::Open(const string &dbdir, bool recover) {
@@ -99,6 +156,12 @@ Status Database::Open(const string &dbdir, bool recover) {
     }
   }
 
+  // Open ordered key index.
+  if (config_.ordered) {
+    st = OpenKeys();
+    if (!st.ok()) return st;
+  }
+
   return Status::OK;
 }
 
@@ -136,6 +199,13 @@ Status Database::Create(const string &dbdir, const string &config) {
   if (!st.ok()) return st;
   dirty_ = true;
 
+  // Create ordered key index.
+  if (config_.ordered) {
+    keys_ = new DatabaseKeys();
+    st = keys_->Open(dbdir_);
+    if (!st.ok()) return st;
+  }
+
   return Status::OK;
 }
 
@@ -147,6 +217,17 @@ Status Database::Flush() {
       if (!st.ok()) return st;
     }
 
+    // Write key changes to ordered key index.
+    if (keys_ != nullptr) {
+      Status st = keys_->Flush(epoch());
+      if (!st.ok()) return st;
+    }
+
+    // The new index is not complete until all the entries have been migrated
+    // from the old index, so the database is kept dirty and the index is not
+    // checkpointed until the migration is done.
+    if (old_index_ != nullptr) return Status::OK;
+
     // Flush index to disk. For a memory-based index, this will just update
     // the epoch in the index header.
     if (index_ != nullptr) {
@@ -164,9 +245,13 @@ Status Database::Bulk(bool enable) {
   if (bulk_ == enable) return Status::OK;
   bulk_ = enable;
 
+  // Complete index migration before switching index.
+  Status st = MigrateIndex(-1);
+  if (!st.ok()) return st;
+
   // Switch index. Use memory-based index in bulk mode.
   DatabaseIndex *newidx = new DatabaseIndex();
-  Status st = newidx->Create(IndexFile(), index_->capacity(), index_->limit());
+  st = newidx->Create(IndexFile(), index_->capacity(), index_->limit());
   if (!st.ok()) return st;
   newidx->CopyFrom(index_);
   delete index_;
@@ -179,8 +264,11 @@ Status Database::Bulk(bool enable) {
 }
 
 Status Database::Backup() {
-  // First flush database to ensure we have a consistent state.
-  Status st = Flush();
+  // First complete index migration and flush database to ensure we have a
+  // consistent state.
+  Status st = MigrateIndex(-1);
+  if (!st.ok()) return st;
+  st = Flush();
   if (!st.ok()) return st;
 
   // Write snapshot of index to backup file.
@@ -191,19 +279,20 @@ Status Database::Backup() {
   return st;
 }
 
-bool Database::Get(const Slice &key, Record *record, bool with_value) {
+bool Database::Get(const Slice &key, Record *record, bool with_value,
+                   Readers *readers) {
   // Compute record key fingerprint.
   uint64 fp = Fingerprint(key.data(), key.size());
 
   // Loop over matching records in index.
-  uint64 pos = DatabaseIndex::NPOS;
+  IndexCursor cursor;
   for (;;) {
     // Get next match in index.
-    uint64 recid = index_->Get(fp, &pos);
+    uint64 recid = Lookup(fp, &cursor);
     if (recid == DatabaseIndex::NVAL) break;
 
     // Read record from data file.
-    Status st = ReadRecord(recid, record, with_value);
+    Status st = ReadRecord(recid, record, with_value, readers);
     if (!st) return false;
 
     // Return record if key matches.
@@ -213,6 +302,123 @@ bool Database::Get(const Slice &key, Record *record, bool with_value) {
   return false;
 }
 
+void Database::Get(const std::vector<Slice> &keys,
+                   std::vector<Record> *records,
+                   Readers *readers) {
+  // Lookup state for each key.
+  struct KeyLookup {
+    uint64 fp;
+    IndexCursor cursor;
+    RecordReader *reader = nullptr;
+    uint64 recid = DatabaseIndex::NVAL;
+    int64 needed = -1;
+  };
+  int num = keys.size();
+  std::vector<KeyLookup> lookups(num);
+  records->clear();
+  records->resize(num);
+  while (readers->buffers_.size() < num) {
+    readers->buffers_.push_back(new IOBuffer());
+  }
+
+  // Find the first matching record in the index for each key and read the
+  // beginning of the records.
+  readers->batch_.resize(num * kBatchReadSize);
+  std::vector<AsyncRead> reads;
+  std::vector<int> pending;
+  for (int i = 0; i < num; ++i) {
+    KeyLookup &l = lookups[i];
+    l.fp = Fingerprint(keys[i].data(), keys[i].size());
+    l.recid = Lookup(l.fp, &l.cursor);
+    if (l.recid == DatabaseIndex::NVAL) continue;
+    if (!GetReader(Shard(l.recid), readers, &l.reader)) continue;
+
+    AsyncRead read;
+    read.file = l.reader->file();
+    read.position = Position(l.recid);
+    read.buffer = &readers->batch_[i * kBatchReadSize];
+    read.size = kBatchReadSize;
+    reads.push_back(read);
+    pending.push_back(i);
+  }
+  AsyncReader *io = AsyncReader::Current();
+  io->Read(&reads);
+
+  // Parse the records and read the remaining part of the records that are
+  // larger than the initial read.
+  std::vector<string> large;
+  std::vector<AsyncRead> rereads;
+  std::vector<int> reread;
+  for (int j = 0; j < pending.size(); ++j) {
+    int i = pending[j];
+    KeyLookup &l = lookups[i];
+    const AsyncRead &read = reads[j];
+    if (!read.status.ok()) continue;
+    Slice data(read.buffer, read.bytes);
+    Status st = l.reader->ParseAt(read.position, data, &(*records)[i],
+                                  readers->buffers_[i], &l.needed);
+    if (!st.ok()) {
+      l.needed = -1;
+    } else if (l.needed > 0) {
+      large.emplace_back(l.needed, 0);
+      reread.push_back(i);
+    }
+  }
+  for (int j = 0; j < reread.size(); ++j) {
+    KeyLookup &l = lookups[reread[j]];
+    AsyncRead read;
+    read.file = l.reader->file();
+    read.position = Position(l.recid);
+    read.buffer = &large[j][0];
+    read.size = large[j].size();
+    rereads.push_back(read);
+  }
+  io->Read(&rereads);
+  for (int j = 0; j < reread.size(); ++j) {
+    int i = reread[j];
+    KeyLookup &l = lookups[i];
+    const AsyncRead &read = rereads[j];
+    l.needed = -1;
+    if (!read.status.ok()) continue;
+    Slice data(read.buffer, read.bytes);
+    Status st = l.reader->ParseAt(read.position, data, &(*records)[i],
+                                  readers->buffers_[i], &l.needed);
+    if (!st.ok()) l.needed = -1;
+  }
+
+  // Records that could not be parsed from the batch reads, or where the key
+  // does not match the record, are read one at a time.
+  for (int i = 0; i < num; ++i) {
+    KeyLookup &l = lookups[i];
+    Record *record = &(*records)[i];
+    IOBuffer *buffer = readers->buffers_[i];
+    bool found = false;
+    while (l.recid != DatabaseIndex::NVAL) {
+      if (l.needed == 0 && keys[i] == record->key) {
+        found = true;
+        break;
+      }
+
+      // Read record if it was not parsed from the batch reads. Otherwise, get
+      // the next match in the index.
+      if (l.needed == 0) {
+        l.recid = Lookup(l.fp, &l.cursor);
+        if (l.recid == DatabaseIndex::NVAL) break;
+      }
+      l.needed = -1;
+      if (!GetReader(Shard(l.recid), readers, &l.reader)) break;
+      if (!l.reader->ReadAt(Position(l.recid), record, buffer)) break;
+      l.needed = 0;
+    }
+
+    // Return empty value if record is not found.
+    if (!found) {
+      *record = Record();
+      record->key = keys[i];
+    }
+  }
+}
+
 uint64 Database::Put(const Record &record, DBMode mode, DBResult *result) {
   // Check if database is read-only.
   if (config_.read_only) return DatabaseIndex::NVAL;
@@ -226,11 +432,11 @@ uint64 Database::Put(const Record &record, DBMode mode, DBResult *result) {
   // Loop over matching records in index to check if there is already a record
   // with a matching key.
   uint64 recid = DatabaseIndex::NVAL;
-  uint64 pos = DatabaseIndex::NPOS;
+  IndexCursor cursor;
   Record rec;
   for (;;) {
     // Get next match in index.
-    recid = index_->Get(fp, &pos);
+    recid = Lookup(fp, &cursor);
     if (recid == DatabaseIndex::NVAL) break;
 
     // Read record from data file and check if keys match. In ADD mode we only
@@ -281,18 +487,21 @@ uint64 Database::Put(const Record &record, DBMode mode, DBResult *result) {
   if (!st) return -1;
 
   // Write new record.
+  uint64 pos;
   st = writer_->Write(record, &pos);
   if (!st) return -1;
+  unflushed_ = true;
   uint64 newid = RecordID(CurrentShard(), pos);
 
   // Update index.
   if (recid == DatabaseIndex::NVAL) {
     // Add new entry to index.
     index_->Add(fp, newid);
+    if (keys_ != nullptr) keys_->Add(record.key);
     if (result != nullptr) *result = DBNEW;
   } else {
     // Update existing index entry to point to the new record.
-    index_->Update(fp, recid, newid);
+    UpdateIndex(fp, recid, newid);
     if (result != nullptr) *result = DBUPDATED;
   }
 
@@ -309,11 +518,11 @@ bool Database::Delete(const Slice &key) {
 
   // Loop over matching records in index to find record to delete.
   uint64 recid = DatabaseIndex::NVAL;
-  uint64 pos = DatabaseIndex::NPOS;
+  IndexCursor cursor;
   Record record;
   for (;;) {
     // Get next match in index.
-    recid = index_->Get(fp, &pos);
+    recid = Lookup(fp, &cursor);
     if (recid == DatabaseIndex::NVAL) return false;
 
     // Read record key from data file and check if keys match.
@@ -329,38 +538,38 @@ bool Database::Delete(const Slice &key) {
   // Write empty record to mark key as deleted.
   record.key = key;
   record.value = Slice();
+  uint64 pos;
   st = writer_->Write(record, &pos);
   if (!st) return false;
+  unflushed_ = true;
 
   // Remove key from index.
-  index_->Delete(fp, recid);
+  DeleteFromIndex(fp, recid);
+  if (keys_ != nullptr) keys_->Remove(key);
 
   dirty_ = true;
   return true;
 }
 
-bool Database::Next(Record *record, uint64 *iterator) {
+bool Database::Next(Record *record, uint64 *iterator, Readers *readers) {
   uint64 shard = Shard(*iterator);
   uint64 pos = Position(*iterator);
   for (;;) {
     // Check for valid shard.
     if (shard >= readers_.size()) return false;
 
-    // Flush writer before reading from the last shard.
-    if (writer_ != nullptr && shard == CurrentShard()) {
-      Status st = writer_->Flush();
-      if (!st) return false;
-      writer_->Sync(readers_.back());
-    }
+    // Get reader for shard.
+    RecordReader *reader;
+    Status st = GetReader(shard, readers, &reader);
+    if (!st) return false;
 
     // Seek to position in shard.
-    RecordReader *reader = readers_[shard];
     if (pos == 0) {
-      Status st = reader->Rewind();
+      st = reader->Rewind();
       if (!st) return false;
       pos = reader->Tell();
     } else {
-      Status st = reader->Seek(pos);
+      st = reader->Seek(pos);
       if (!st) return false;
     }
 
@@ -373,7 +582,7 @@ bool Database::Next(Record *record, uint64 *iterator) {
     }
 
     // Read record.
-    Status st = reader->Read(record);
+    st = reader->Read(record);
     if (!st) return false;
     pos = reader->Tell();
 
@@ -383,7 +592,7 @@ bool Database::Next(Record *record, uint64 *iterator) {
     // Check for stale record.
     uint64 recid = RecordID(shard, record->position);
     uint64 fp = Fingerprint(record->key.data(), record->key.size());
-    if (!index_->Exists(fp, recid)) continue;
+    if (!Indexed(fp, recid)) continue;
 
     // Return next record.
     *iterator = RecordID(shard, pos);
@@ -403,6 +612,11 @@ bool Database::Valid(uint64 recid) {
   return true;
 }
 
+bool Database::Compacted(uint64 recid, uint64 since) const {
+  uint64 shard = Shard(recid);
+  return shard < compacted_.size() && compacted_[shard] > since;
+}
+
 string Database::ConfigFile() const {
   return dbdir_ + "/config";
 }
@@ -413,6 +627,10 @@ string Database::IndexFile() const {
   return dbdir_ + "/index";
 }
 
+string Database::CompactionFile() const {
+  return dbdir_ + "/compacting";
+}
+
 string Database::IndexBackupFile() const {
   return dbdir_ + "/index.bak";
 }
@@ -425,16 +643,11 @@ string Database::DataFile(int shard) const {
   return fn;
 }
 
-Status Database::ReadRecord(uint64 recid, Record *record, bool with_value) {
-  Status st;
-  uint64 shard = Shard(recid);
-  if (writer_ != nullptr && shard == CurrentShard()) {
-    // Flush writer before reading from the last shard.
-    st = writer_->Flush();
-    if (!st) return st;
-    writer_->Sync(readers_.back());
-  }
-  RecordReader *reader = readers_[shard];
+Status Database::ReadRecord(uint64 recid, Record *record, bool with_value,
+                            Readers *readers) {
+  RecordReader *reader;
+  Status st = GetReader(Shard(recid), readers, &reader);
+  if (!st) return st;
 
   st = reader->Seek(Position(recid));
   if (!st) return st;
@@ -448,6 +661,96 @@ Status Database::ReadRecord(uint64 recid, Record *record, bool with_value) {
   return Status::OK;
 }
 
+uint64 Database::Lookup(uint64 fp, IndexCursor *cursor) const {
+  if (cursor->index == nullptr) cursor->index = index_;
+  uint64 recid = cursor->index->Get(fp, &cursor->pos);
+  if (recid == DatabaseIndex::NVAL && cursor->index != old_index_ &&
+      old_index_ != nullptr) {
+    // Continue search in old index.
+    cursor->index = old_index_;
+    cursor->pos = DatabaseIndex::NPOS;
+    recid = old_index_->Get(fp, &cursor->pos);
+  }
+  return recid;
+}
+
+bool Database::Indexed(uint64 fp, uint64 recid) {
+  if (index_->Exists(fp, recid)) return true;
+  return old_index_ != nullptr && old_index_->Exists(fp, recid);
+}
+
+void Database::UpdateIndex(uint64 fp, uint64 oldval, uint64 newval) {
+  uint64 pos = index_->Update(fp, oldval, newval);
+  if (pos == DatabaseIndex::NPOS && old_index_ != nullptr) {
+    old_index_->Update(fp, oldval, newval);
+  }
+}
+
+void Database::DeleteFromIndex(uint64 fp, uint64 recid) {
+  uint64 pos = index_->Delete(fp, recid);
+  if (pos == DatabaseIndex::NPOS && old_index_ != nullptr) {
+    old_index_->Delete(fp, recid);
+  }
+}
+
+Status Database::GetReader(int shard, Readers *readers,
+                           RecordReader **reader) {
+  bool last = writer_ != nullptr && shard == CurrentShard();
+  if (readers == nullptr) {
+    // Flush writer before reading from the last shard.
+    if (last) {
+      Status st = writer_->Flush();
+      if (!st) return st;
+      writer_->Sync(readers_.back());
+    }
+    *reader = readers_[shard];
+    return Status::OK;
+  }
+
+  // If shards have been compacted since the readers were last used, all the
+  // shard readers are reopened.
+  if (readers->compactions_ != compactions_) {
+    for (RecordReader *&r : readers->shards_) {
+      delete r;
+      r = nullptr;
+    }
+    readers->compactions_ = compactions_;
+  }
+
+  // If new shards have been added since the readers were last used, the
+  // reader for the previous last shard is reopened to get the final size.
+  if (readers->num_shards_ != readers_.size()) {
+    int previous = readers->num_shards_ - 1;
+    if (previous >= 0 && previous < readers->shards_.size()) {
+      delete readers->shards_[previous];
+      readers->shards_[previous] = nullptr;
+    }
+    readers->shards_.resize(readers_.size());
+    readers->num_shards_ = readers_.size();
+  }
+
+  // Open reader for shard on demand.
+  RecordReader *&r = readers->shards_[shard];
+  if (r == nullptr) r = new RecordReader(DataFile(shard), config_.record);
+
+  // Flush writer before reading from the last shard. Only one of the
+  // concurrent readers needs to flush the writer.
+  if (last) {
+    if (unflushed_) {
+      MutexLock lock(&flush_mu_);
+      if (unflushed_) {
+        Status st = writer_->Flush();
+        if (!st) return st;
+        unflushed_ = false;
+      }
+    }
+    writer_->Sync(r);
+  }
+
+  *reader = r;
+  return Status::OK;
+}
+
 Status Database::AddDataShard() {
   // Close current writer.
   if (writer_ != nullptr) {
@@ -474,8 +777,194 @@ Status Database::AddDataShard() {
   return Status::OK;
 }
 
+Status Database::ScheduleCompaction(int shard) {
+  // Check if database is read-only.
+  if (config_.read_only) {
+    return Status(E_SHARD, "Read-only database cannot be compacted");
+  }
+
+  // Only sealed shards can be compacted, i.e. not the current shard.
+  std::vector<int> shards;
+  if (shard == -1) {
+    for (int i = 0; i < CurrentShard(); ++i) shards.push_back(i);
+  } else if (shard >= 0 && shard < CurrentShard()) {
+    shards.push_back(shard);
+  }
+  if (shards.empty()) {
+    return Status(E_SHARD, "No sealed data shards to compact in ", dbdir_);
+  }
+
+  // Add shards to compaction queue.
+  if (compaction_ == nullptr) compaction_ = new Compaction();
+  for (int s : shards) {
+    auto &queue = compaction_->shards;
+    if (std::find(queue.begin(), queue.end(), s) == queue.end()) {
+      queue.push_back(s);
+    }
+  }
+
+  return Status::OK;
+}
+
+Status Database::Compact(uint64 limit, SharedMutex *lock, bool *ready) {
+  // Get shard being compacted. The compaction can only be ended by the
+  // compacting thread, but shards can be scheduled concurrently.
+  *ready = false;
+  Compaction *c;
+  int shard;
+  {
+    SharedMutexLock l(lock);
+    c = compaction_;
+    if (c == nullptr) return Status::OK;
+    shard = c->shards.front();
+  }
+
+  // Open compaction reader and writer when starting on a new shard.
+  if (c->writer == nullptr) {
+    LOG(INFO) << "Compact shard " << shard << " of db " << dbdir_;
+    RecordFileOptions options = config_.record;
+    options.append = false;
+    c->reader = new RecordReader(DataFile(shard), options);
+    c->writer = new RecordWriter(CompactionFile(), options);
+    Status st = c->reader->Rewind();
+    if (!st.ok()) return st;
+  }
+
+  // Copy live records to compacted shard in batches.
+  Record record;
+  uint64 start = c->reader->Tell();
+  while (!c->reader->Done() && c->reader->Tell() - start < limit) {
+    // Read next batch of records. The shard is sealed, so it is not changed by
+    // concurrent updates and can be read without holding the lock.
+    c->batch.clear();
+    c->buffer.clear();
+    uint64 begin = c->reader->Tell();
+    while (!c->reader->Done() &&
+           c->reader->Tell() - begin < kCompactionBatchSize) {
+      Status st = c->reader->Read(&record);
+      if (!st.ok()) return st;
+
+      // Deletion records are needed for recovery as long as there can be
+      // records for the key in earlier shards.
+      if (record.value.empty() && shard == 0) continue;
+
+      Compaction::Entry e;
+      e.fp = Fingerprint(record.key.data(), record.key.size());
+      e.position = record.position;
+      e.version = record.version;
+      e.key = c->buffer.size();
+      e.keylen = record.key.size();
+      e.vallen = record.value.size();
+      e.live = true;
+      c->buffer.append(record.key.data(), record.key.size());
+      c->buffer.append(record.value.data(), record.value.size());
+      c->batch.push_back(e);
+    }
+
+    // Skip superseded and deleted records. Records that are superseded after
+    // this check are not relocated when the compaction is committed.
+    {
+      SharedMutexLock l(lock);
+      for (Compaction::Entry &e : c->batch) {
+        if (e.vallen == 0) continue;
+        e.live = Indexed(e.fp, RecordID(shard, e.position));
+      }
+    }
+
+    // Copy live records and keep track of their new positions.
+    for (const Compaction::Entry &e : c->batch) {
+      if (!e.live) continue;
+      const char *key = c->buffer.data() + e.key;
+      Record live(Slice(key, e.keylen), e.version,
+                  Slice(key + e.keylen, e.vallen));
+      uint64 pos;
+      Status st = c->writer->Write(live, &pos);
+      if (!st.ok()) return st;
+      if (e.vallen == 0) continue;
+      c->moves.push_back({e.fp, static_cast<uint64>(e.position), pos});
+    }
+  }
+
+  // Flush compacted shard when all records have been copied.
+  if (c->reader->Done()) {
+    Status st = c->writer->Flush();
+    if (!st.ok()) return st;
+    *ready = true;
+  }
+
+  return Status::OK;
+}
+
+Status Database::CommitCompaction() {
+  Compaction *c = compaction_;
+  if (c == nullptr || c->reader == nullptr || !c->reader->Done()) {
+    return Status(E_COMPACTION, "Compaction not ready for commit");
+  }
+  int shard = c->shards.front();
+
+  // Close compacted shard.
+  uint64 size = c->reader->size();
+  uint64 compacted_size = c->writer->Tell();
+  Status st = c->writer->Close();
+  if (!st.ok()) return st;
+
+  // Changes to the ordered key index are replayed from the key index epoch,
+  // so the key index must be flushed if the epoch is in the compacted shard.
+  if (keys_ != nullptr && Shard(keys_->epoch()) == shard) {
+    st = FlushKeys();
+    if (!st.ok()) return st;
+  }
+
+  // The index is marked as stale on disk while it is being updated, so it
+  // will be recovered from the data shards if the commit is interrupted.
+  st = index_->Invalidate();
+  if (!st.ok()) return st;
+
+  // Update index entries for relocated records. Records that have been
+  // superseded or deleted during compaction are no longer in the index.
+  for (const Compaction::Move &move : c->moves) {
+    UpdateIndex(move.fp, RecordID(shard, move.from), RecordID(shard, move.to));
+  }
+
+  // The index backup refers to the old record positions, so it must be deleted
+  // before the data shard is replaced. Otherwise, recovery after a crash would
+  // use the backup with positions that do not match the compacted shard.
+  if (File::Exists(IndexBackupFile())) {
+    st = File::Delete(IndexBackupFile());
+    if (!st.ok()) return st;
+  }
+
+  // Replace data shard with compacted shard.
+  st = File::Rename(CompactionFile(), DataFile(shard));
+  if (!st.ok()) return st;
+  delete readers_[shard];
+  readers_[shard] = new RecordReader(DataFile(shard), config_.record);
+  compactions_++;
+  if (compacted_.size() <= shard) compacted_.resize(shard + 1);
+  compacted_[shard] = compactions_;
+  reclaimed_ += size - compacted_size;
+  LOG(INFO) << "Shard " << shard << " of db " << dbdir_ << " compacted from "
+            << size << " to " << compacted_size << " bytes";
+
+  // Move on to the next scheduled shard.
+  c->shards.erase(c->shards.begin());
+  delete c->reader;
+  delete c->writer;
+  c->reader = nullptr;
+  c->writer = nullptr;
+  c->moves.clear();
+  if (c->shards.empty()) {
+    delete compaction_;
+    compaction_ = nullptr;
+  }
+
+  // Write updated index to disk.
+  dirty_ = true;
+  return Flush();
+}
+
 Status Database::ExpandIndex(uint64 capacity) {
-  // Rehash index by copying it to a new larger index.
+  // Rehash index by migrating the entries to a new larger index.
   Status st;
   LOG(INFO) << "Expand index to " << capacity << " entries for db " << dbdir_;
   DatabaseIndex *new_index = new DatabaseIndex();
@@ -491,16 +980,36 @@ Status Database::ExpandIndex(uint64 capacity) {
   st = new_index->Create(IndexFile(), capacity, limit);
   if (!st.ok()) return st;
 
-  // Transfer all entries to the new index.
-  index_->TransferTo(new_index);
+  // Switch to new index. The entries in the old index are migrated to the
+  // new index incrementally.
+  CHECK(old_index_ == nullptr);
+  old_index_ = index_;
+  index_ = new_index;
+  migrated_ = 0;
+  dirty_ = true;
+  return Status::OK;
+}
 
-  // Switch to new index.
-  st = index_->Close();
-  if (!st.ok()) return st;
+Status Database::MigrateIndex(uint64 slots) {
+  if (old_index_ == nullptr) return Status::OK;
 
-  delete index_;
-  index_ = new_index;
+  // Move entries in the next slots to the new index.
+  uint64 capacity = old_index_->capacity();
+  uint64 end = slots < capacity - migrated_ ? migrated_ + slots : capacity;
+  old_index_->MoveTo(index_, migrated_, end);
+  migrated_ = end;
   dirty_ = true;
+
+  // Close old index when all entries have been migrated.
+  if (migrated_ == capacity) {
+    VLOG(1) << "Index migration done for db " << dbdir_;
+    Status st = old_index_->Close();
+    delete old_index_;
+    old_index_ = nullptr;
+    migrated_ = 0;
+    if (!st.ok()) return st;
+  }
+
   return Status::OK;
 }
 
@@ -512,10 +1021,27 @@ Status Database::Expand() {
     if (!st.ok()) return st;
   }
 
+  // Migrate the next slice of entries if the index is being expanded.
+  if (old_index_ != nullptr) {
+    Status st = MigrateIndex(config_.index_migration_slice);
+    if (!st.ok()) return st;
+  }
+
+  // Write key changes to disk when the memory table for the ordered key index
+  // is full.
+  if (keys_ != nullptr && keys_->changes() >= config_.key_table_size) {
+    Status st = FlushKeys();
+    if (!st.ok()) return st;
+  }
+
   // Check for index overflow.
   if (index_->full()) {
-    // Rehash index by copying it to a new larger index.
-    Status st = ExpandIndex(index_->capacity() * 2);
+    // Complete any ongoing migration before expanding the index again.
+    Status st = MigrateIndex(-1);
+    if (!st.ok()) return st;
+
+    // Rehash index by migrating it to a new larger index.
+    st = ExpandIndex(index_->capacity() * 2);
     if (!st.ok()) return st;
   }
 
@@ -592,41 +1118,40 @@ Status Database::Recover(uint64 capacity) {
       uint64 fp = Fingerprint(record.key.data(), record.key.size());
       uint64 recid = RecordID(shard, record.position);
 
-      // Empty record indicates deletion.
-      if (record.value.empty()) {
-        idx.Delete(fp, recid);
+      // Try to locate exising record for key in index.
+      bool deleted = record.value.empty();
+      uint64 val = DatabaseIndex::NVAL;
+      uint64 pos = DatabaseIndex::NPOS;
+      string key = record.key.str();
+      for (;;) {
+        // Get next match in index.
+        val = idx.Get(fp, &pos);
+        if (val == DatabaseIndex::NVAL) break;
+
+        // Save current position in reader.
+        uint64 current = reader->Tell();
+
+        // Read record key from data file.
+        st = ReadRecord(val, &record, false);
+        if (!st.ok()) return st;
+
+        // Restore current position in reader.
+        st = reader->Seek(current);
+        if (!st.ok()) return st;
+
+        // Check if key matches.
+        if (record.key == Slice(key)) break;
+      }
+
+      if (deleted) {
+        // Empty record indicates deletion of the existing record.
+        if (val != DatabaseIndex::NVAL) idx.Delete(fp, val);
+      } else if (val == DatabaseIndex::NVAL) {
+        // Add new entry if no existing record with the same key is found.
+        idx.Add(fp, recid);
       } else {
-        // Try to locate exising record for key in index.
-        uint64 val = DatabaseIndex::NVAL;
-        uint64 pos = DatabaseIndex::NPOS;
-        string key = record.key.str();
-        for (;;) {
-          // Get next match in index.
-          val = idx.Get(fp, &pos);
-          if (val == DatabaseIndex::NVAL) break;
-
-          // Save current position in reader.
-          uint64 current = reader->Tell();
-
-          // Read record key from data file.
-          st = ReadRecord(val, &record, false);
-          if (!st.ok()) return st;
-
-          // Restore current position in reader.
-          st = reader->Seek(current);
-          if (!st.ok()) return st;
-
-          // Check if key matches.
-          if (record.key == Slice(key)) break;
-        }
-
-        // If an existing record with the same key is found, update the index
-        // entry, otherwise add a new entry.
-        if (val == DatabaseIndex::NVAL) {
-          idx.Add(fp, recid);
-        } else {
-          idx.Update(fp, val, recid);
-        }
+        // Otherwise, update the index entry for the existing record.
+        idx.Update(fp, val, recid);
       }
     }
   }
@@ -643,6 +1168,57 @@ Status Database::Recover(uint64 capacity) {
   return Status::OK;
 }
 
+Status Database::OpenKeys() {
+  // Open key index. If the key index is invalid, it is rebuilt from scratch.
+  keys_ = new DatabaseKeys();
+  Status st = keys_->Open(dbdir_);
+  if (!st.ok() || keys_->epoch() > epoch()) {
+    LOG(INFO) << "Rebuild key index for " << dbdir_;
+    st = keys_->Clear();
+    if (!st.ok()) return st;
+  }
+
+  // Replay changes to keys after the key index epoch from the data shards.
+  int start_shard = Shard(keys_->epoch());
+  uint64 start_pos = Position(keys_->epoch());
+  Record record;
+  for (int shard = start_shard; shard < readers_.size(); ++shard) {
+    RecordReader *reader = readers_[shard];
+    if (shard == start_shard && start_pos != 0) {
+      st = reader->Seek(start_pos);
+      if (!st.ok()) return st;
+    } else {
+      st = reader->Rewind();
+      if (!st.ok()) return st;
+    }
+    while (!reader->Done()) {
+      st = reader->ReadKey(&record);
+      if (!st.ok()) return st;
+      if (record.value.empty()) {
+        keys_->Remove(record.key);
+      } else {
+        keys_->Add(record.key);
+      }
+
+      // Write key changes to disk when the memory table is full.
+      if (!config_.read_only && keys_->changes() >= config_.key_table_size) {
+        st = keys_->Flush(RecordID(shard, reader->Tell()));
+        if (!st.ok()) return st;
+      }
+    }
+  }
+
+  return Status::OK;
+}
+
+Status Database::FlushKeys() {
+  // Flush last data shard before writing the key index so the key index does
+  // not get ahead of the data shards.
+  Status st = writer_->Flush();
+  if (!st.ok()) return st;
+  return keys_->Flush(epoch());
+}
+
 static int64 ParseNumber(Text number) {
   int64 scaler = 1;
   if (number.ends_with("K")) {
@@ -709,6 +1285,13 @@ bool Database::ParseConfig(Text config) {
         return false;
       }
       config_.index_load_factor = n;
+    } else if (key == "index_migration_slice") {
+      int64 n = ParseNumber(value);
+      if (n <= 0) {
+        LOG(ERROR) << "Invalid index migration slice: " << line;
+        return false;
+      }
+      config_.index_migration_slice = n;
     } else if (key == "data_shard_size") {
       uint64 n = ParseNumber(value);
       if (n <= 0) {
@@ -732,15 +1315,28 @@ bool Database::ParseConfig(Text config) {
       config_.record.chunk_size = n;
     } else if (key == "compression") {
       int n = ParseNumber(value);
-      if (n != RecordFile::UNCOMPRESSED && n != RecordFile::SNAPPY) {
+      if (n != RecordFile::UNCOMPRESSED && n != RecordFile::SNAPPY &&
+          n != RecordFile::ZSTD && n != RecordFile::LZ4) {
         LOG(ERROR) << "Invalid compression: " << line;
         return false;
       }
       config_.record.compression = static_cast<RecordFile::CompressionType>(n);
+    } else if (key == "compression_level") {
+      int n = ParseNumber(value);
+      config_.record.compression_level = n;
     } else if (key == "read_only") {
       config_.read_only = ParseBool(value, false);
     } else if (key == "timestamped") {
       config_.timestamped = ParseBool(value, false);
+    } else if (key == "ordered") {
+      config_.ordered = ParseBool(value, false);
+    } else if (key == "key_table_size") {
+      int64 n = ParseNumber(value);
+      if (n <= 0) {
+        LOG(ERROR) << "Invalid key table size: " << line;
+        return false;
+      }
+      config_.key_table_size = n;
     } else {
       LOG(ERROR) << "Unknown configuration parameter: " << line;
       return false;
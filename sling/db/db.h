@@ -15,6 +15,7 @@
 #ifndef SLING_DB_DB_H_
 #define SLING_DB_DB_H_
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -22,10 +23,13 @@
 #include "sling/base/status.h"
 #include "sling/base/types.h"
 #include "sling/db/dbindex.h"
+#include "sling/db/dbkeys.h"
 #include "sling/db/dbprotocol.h"
 #include "sling/file/file.h"
 #include "sling/file/recordio.h"
 #include "sling/string/text.h"
+#include "sling/util/iobuffer.h"
+#include "sling/util/mutex.h"
 
 namespace sling {
 
@@ -34,7 +38,10 @@ namespace sling {
 // data shards are recordio files and all new records are written sequentially
 // to the data files. Record deletion is performed by writing a record with the
 // deleted key and an empty value. Please notice that the database methods are
-// not thread-safe and requires synchronized access, e.g. using a mutex.
+// not thread-safe and requires synchronized access, e.g. using a mutex. The
+// only exception is reading with separate shard readers (see Readers below),
+// which can be done concurrently from multiple threads, e.g. while holding a
+// shared lock, as long as no other thread is updating the database.
 class Database {
  public:
   // Configuration options for database.
@@ -51,11 +58,50 @@ class Database {
     // Index load factor.
     double index_load_factor = 0.75;
 
+    // Number of index slots migrated to the new index for each update while
+    // the index is being expanded.
+    uint64 index_migration_slice = 1024;
+
     // Read-only mode.
     bool read_only = false;
 
     // Record version number is timestamp.
     bool timestamped = false;
+
+    // Maintain ordered key index for range and prefix scans.
+    bool ordered = false;
+
+    // Maximum number of key changes kept in memory before they are written to
+    // the ordered key index on disk.
+    uint64 key_table_size = 1 << 20;
+  };
+
+  // Record readers for the data shards. Each thread reading from the database
+  // concurrently needs its own readers, since record readers have a file
+  // position and an input buffer. The shard files are opened on demand. The
+  // records returned when reading through the readers are only valid until the
+  // next read using the same readers.
+  class Readers {
+   public:
+    ~Readers();
+
+   private:
+    // Record readers for data shards.
+    std::vector<RecordReader *> shards_;
+
+    // Number of data shards in database when readers were last used.
+    int num_shards_ = 0;
+
+    // Number of compacted shards in database when readers were last used.
+    uint64 compactions_ = 0;
+
+    // Buffers for records read in batches.
+    std::vector<IOBuffer *> buffers_;
+
+    // Buffer for reading the beginning of the records in batches.
+    std::vector<char> batch_;
+
+    friend class Database;
   };
 
   // Deallocate database instance.
@@ -79,7 +125,21 @@ class Database {
   Status Backup();
 
   // Get record from database. Return true if found.
-  bool Get(const Slice &key, Record *record, bool with_value = true);
+  bool Get(const Slice &key, Record *record, bool with_value = true) {
+    return Get(key, record, with_value, nullptr);
+  }
+
+  // Get record from database using separate shard readers. This is safe to
+  // call concurrently with other reads using different readers.
+  bool Get(const Slice &key, Record *record, bool with_value, Readers *readers);
+
+  // Get records for a batch of keys using separate shard readers. The records
+  // are read with many reads in flight using an async reader, so cold records
+  // can be fetched from storage in parallel instead of one at a time. Records
+  // that are not found are returned with the key and an empty value.
+  void Get(const std::vector<Slice> &keys,
+           std::vector<Record> *records,
+           Readers *readers);
 
   // Add or update record in database. Return record id of new record.
   uint64 Put(const Record &record,
@@ -94,25 +154,87 @@ class Database {
   //   uint64 iterator = 0;
   //   Record record;
   //   while (db->Next(&record, &iterator)) { ... }
-  bool Next(Record *record, uint64 *iterator);
+  bool Next(Record *record, uint64 *iterator) {
+    return Next(record, iterator, nullptr);
+  }
+
+  // Get next record using separate shard readers. This is safe to call
+  // concurrently with other reads using different readers.
+  bool Next(Record *record, uint64 *iterator, Readers *readers);
 
   // Check if record id is valid.
   bool Valid(uint64 recid);
 
+  // Return ordered key index or null if the database is not ordered. The keys
+  // can be traversed in sorted order with a key index iterator and the
+  // records can then be looked up with Get(), e.g.
+  //   DatabaseKeys::Iterator it(db->keys());
+  //   for (it.Seek(start); it.Valid(); it.Next()) {
+  //     if (db->Get(it.key(), &record)) { ... }
+  //   }
+  const DatabaseKeys *keys() const { return keys_; }
+
+  // Schedule compaction of sealed data shard. Compaction removes superseded
+  // and deleted records from the shard by copying the live records to a new
+  // data file, which then replaces the shard. All sealed shards are scheduled
+  // for compaction if shard is -1. Please notice that iterator positions in a
+  // shard are no longer valid after the shard has been compacted.
+  Status ScheduleCompaction(int shard);
+
+  // Copy live records from the data shard being compacted until the number of
+  // bytes read reaches the limit. The sealed shard is read and the compacted
+  // shard is written without holding the database lock, which is only held in
+  // shared mode while checking a batch of records against the index. Only one
+  // thread can compact the database at a time. Sets ready to true when the
+  // shard has been copied and the compaction can be committed.
+  Status Compact(uint64 limit, SharedMutex *lock, bool *ready);
+
+  // Replace data shard with the compacted shard and update the index entries
+  // for the live records to point to their new positions.
+  Status CommitCompaction();
+
+  // Check if there are data shards scheduled for compaction.
+  bool compacting() const { return compaction_ != nullptr; }
+
+  // Return number of bytes reclaimed by compaction.
+  uint64 reclaimed() const { return reclaimed_; }
+
+  // Return number of compacted shards.
+  uint64 compactions() const { return compactions_; }
+
+  // Check if the data shard for a record id has been compacted after the
+  // number of compactions given by since. Iterator positions obtained before
+  // that are no longer valid.
+  bool Compacted(uint64 recid, uint64 since) const;
+
   // Return the current epoch for the database.
   uint64 epoch() const { return RecordID(CurrentShard(), writer_->Tell()); }
 
   // Check if database has unflushed changed.
   bool dirty() const { return dirty_; }
 
+  // Check if index entries are being migrated to an expanded index.
+  bool migrating() const { return old_index_ != nullptr; }
+
+  // Migrate entries in the next index slots from the old index to the new
+  // expanded index. All the remaining entries are migrated if slots is -1.
+  Status MigrateIndex(uint64 slots);
+
   // Check if database is read-only.
   bool read_only() const { return config_.read_only; }
 
   // Use timestamps for record version numbers.
   bool timestamped() const { return config_.timestamped; }
 
+  // Check if database has an ordered key index.
+  bool ordered() const { return keys_ != nullptr; }
+
   // Return number of active records.
-  uint64 num_records() const { return index_->num_records(); }
+  uint64 num_records() const {
+    uint64 n = index_->num_records();
+    if (old_index_ != nullptr) n += old_index_->num_records();
+    return n;
+  }
 
   // Return number of deleted records.
   uint64 num_deleted() const { return index_->num_deleted(); }
@@ -136,6 +258,8 @@ class Database {
     E_STALE_INDEX,          // database index is not up-to-date
     E_DB_ALREADY_EXISTS,    // database already exists
     E_CONFIG,               // invalid configuration file
+    E_SHARD,                // invalid data shard
+    E_COMPACTION,           // compaction not ready
   };
 
  private:
@@ -172,8 +296,33 @@ class Database {
   // Return filename for data shard.
   string DataFile(int shard) const;
 
-  // Read data record (key).
-  Status ReadRecord(uint64 recid, Record *record, bool with_value);
+  // Return filename for data shard being compacted.
+  string CompactionFile() const;
+
+  // Look up next match for key fingerprint in the index. During index
+  // migration, the old index is searched after the new index. Returns NVAL
+  // when there are no more matches.
+  struct IndexCursor {
+    DatabaseIndex *index = nullptr;
+    uint64 pos = DatabaseIndex::NPOS;
+  };
+  uint64 Lookup(uint64 fp, IndexCursor *cursor) const;
+
+  // Check if index has entry for record.
+  bool Indexed(uint64 fp, uint64 recid);
+
+  // Update or delete index entry in the index which holds the entry.
+  void UpdateIndex(uint64 fp, uint64 oldval, uint64 newval);
+  void DeleteFromIndex(uint64 fp, uint64 recid);
+
+  // Read data record (key). If readers is null, the database shard readers
+  // are used.
+  Status ReadRecord(uint64 recid, Record *record, bool with_value,
+                    Readers *readers = nullptr);
+
+  // Get record reader for shard. The writer is flushed before reading from the
+  // last shard.
+  Status GetReader(int shard, Readers *readers, RecordReader **reader);
 
   // Add new empty data shard.
   Status AddDataShard();
@@ -187,6 +336,14 @@ class Database {
   // Recover index from data files.
   Status Recover(uint64 capacity);
 
+  // Open ordered key index and replay the changes to the keys in the data
+  // shards after the key index epoch. The key index is rebuilt from the data
+  // shards if it is invalid.
+  Status OpenKeys();
+
+  // Write the key changes in memory to the ordered key index on disk.
+  Status FlushKeys();
+
   // Database directory.
   string dbdir_;
 
@@ -199,9 +356,36 @@ class Database {
   // Record writer for the last shard.
   RecordWriter *writer_ = nullptr;
 
+  // The writer has unflushed records. Concurrent readers use the mutex to
+  // serialize flushing the writer before reading from the last shard.
+  std::atomic<bool> unflushed_{false};
+  Mutex flush_mu_;
+
   // Database index.
   DatabaseIndex *index_ = nullptr;
 
+  // When the index is expanded, the entries are migrated incrementally from
+  // the old index to the new index. Lookups consult both indices until all
+  // the slots in the old index have been migrated.
+  DatabaseIndex *old_index_ = nullptr;
+  uint64 migrated_ = 0;
+
+  // Ordered key index.
+  DatabaseKeys *keys_ = nullptr;
+
+  // Ongoing compaction of data shards.
+  struct Compaction;
+  Compaction *compaction_ = nullptr;
+
+  // Number of compacted shards.
+  uint64 compactions_ = 0;
+
+  // Number of compacted shards when each data shard was last compacted.
+  std::vector<uint64> compacted_;
+
+  // Number of bytes reclaimed by compaction.
+  uint64 reclaimed_ = 0;
+
   // Flag for tracking unwritten changes to database.
   bool dirty_ = false;
 
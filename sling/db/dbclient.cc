@@ -31,16 +31,71 @@ static Status Truncated() {
   return Status(EBADMSG, "packet truncated");
 }
 
-Status DBClient::Connect(const string &database) {
+// Write key to buffer.
+static void EncodeKey(IOBuffer *buffer, const Slice &key) {
+  uint32 size = key.size();
+  buffer->Write(&size, 4);
+  buffer->Write(key.data(), key.size());
+}
+
+// Write record to buffer.
+static void EncodeRecord(IOBuffer *buffer, const DBRecord &record) {
+  uint32 ksize = record.key.size() << 1;
+  if (record.version != 0) ksize |= 1;
+  buffer->Write(&ksize, 4);
+  buffer->Write(record.key.data(), record.key.size());
+
+  if (record.version != 0) {
+    buffer->Write(&record.version, 8);
+  }
+
+  uint32 vsize = record.value.size();
+  buffer->Write(&vsize, 4);
+  buffer->Write(record.value.data(), record.value.size());
+}
+
+// Read record from buffer.
+static Status DecodeRecord(IOBuffer *buffer, DBRecord *record) {
+  // Read key size with version bit.
+  uint32 ksize;
+  if (!buffer->Read(&ksize, 4)) return Truncated();
+  bool has_version = ksize & 1;
+  ksize >>= 1;
+
+  // Read key.
+  if (buffer->available() < ksize) return Truncated();
+  record->key = Slice(buffer->Consume(ksize), ksize);
+
+  // Optionally read version.
+  if (has_version) {
+    if (!buffer->Read(&record->version, 8)) return Truncated();
+  } else {
+    record->version = 0;
+  }
+
+  // Read value size.
+  uint32 vsize;
+  if (!buffer->Read(&vsize, 4)) return Truncated();
+
+  // Read value.
+  if (buffer->available() < vsize) return Truncated();
+  record->value = Slice(buffer->Consume(vsize), vsize);
+
+  return Status::OK;
+}
+
+// Connect to database server and upgrade connection to the SLINGDB protocol.
+// Returns the socket for the connection and the database name.
+static Status ConnectToServer(const string &database, int *sock,
+                              string *dbname) {
   // Parse database specification.
   string hostname = "localhost";
   string portname = "7070";
-  string dbname;
   int slash = database.find('/');
   if (slash == -1) {
-    dbname = database;
+    *dbname = database;
   } else {
-    dbname = database.substr(slash + 1);
+    *dbname = database.substr(slash + 1);
     if (slash > 0) {
       hostname = database.substr(0, slash);
       int colon = hostname.find(':');
@@ -59,50 +114,61 @@ Status DBClient::Connect(const string &database) {
   int err = getaddrinfo(hostname.c_str(), portname.c_str(), &hints, &addrs);
   if (err != 0) return Status(err, gai_strerror(err), hostname);
 
+  int s = -1;
   for(struct addrinfo *addr = addrs; addr != nullptr; addr = addr->ai_next) {
     // Create socket.
-    sock_ = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-    if (sock_ == -1) {
+    s = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (s == -1) {
       err = errno;
       break;
     }
 
     // Connect socket.
-    if (connect(sock_, addr->ai_addr, addr->ai_addrlen) == 0) break;
+    if (connect(s, addr->ai_addr, addr->ai_addrlen) == 0) break;
     err = errno;
-    close(sock_);
-    sock_ = -1;
+    close(s);
+    s = -1;
   }
   freeaddrinfo(addrs);
-  if (sock_ == -1) return Status(err, strerror(err), database);
+  if (s == -1) return Status(err, strerror(err), database);
+  *sock = s;
 
   // Upgrade connection from HTTP to SLINGDB protocol.
-  request_.Clear();
-  request_.Write(
+  IOBuffer request;
+  request.Write(
     "GET / HTTP/1.1\r\n"
     "Host: " + hostname + "\r\n"
     "Connection: upgrade\r\n"
     "Upgrade: slingdb\r\n"
     "\r\n");
-  int rc = send(sock_, request_.begin(), request_.available(), 0);
+  int rc = send(s, request.begin(), request.available(), 0);
   if (rc < 0) return Error("send");
-  if (rc != request_.available()) {
+  if (rc != request.available()) {
     return Status(EBADE, "Upgrade failed in send");
   }
 
-  response_.Clear();
-  while (response_.available() < 12 ||
-         memcmp(response_.end() - 4, "\r\n\r\n", 4) != 0) {
-    response_.Ensure(256);
-    int rc = recv(sock_, response_.end(), response_.remaining(), 0);
+  IOBuffer response;
+  while (response.available() < 12 ||
+         memcmp(response.end() - 4, "\r\n\r\n", 4) != 0) {
+    response.Ensure(256);
+    int rc = recv(s, response.end(), response.remaining(), 0);
     if (rc < 0) return Error("recv");
     if (rc == 0) return Status(EBADE, "Upgrade failed in recv");
-    response_.Append(rc);
+    response.Append(rc);
   }
-  if (!response_.data().starts_with("HTTP/1.1 101")) {
+  if (!response.data().starts_with("HTTP/1.1 101")) {
     return Status(EBADE, "Upgrade failed");
   }
 
+  return Status::OK;
+}
+
+Status DBClient::Connect(const string &database) {
+  // Connect to server.
+  string dbname;
+  Status st = ConnectToServer(database, &sock_, &dbname);
+  if (!st.ok()) return st;
+
   // Switch to database.
   if (!dbname.empty()) {
     return Use(dbname);
@@ -224,53 +290,49 @@ Status DBClient::Epoch(uint64 *epoch) {
   return Status::OK;
 }
 
-void DBClient::WriteKey(const Slice &key) {
-  uint32 size = key.size();
-  request_.Write(&size, 4);
-  request_.Write(key.data(), key.size());
+Status DBClient::Scan(const Slice &start, const Slice &end, int num,
+                      std::vector<DBRecord> *records) {
+  request_.Clear();
+  WriteKey(start);
+  WriteKey(end);
+  request_.Write(&num, 4);
+  Status st = Do(DBSCAN);
+  if (!st.ok()) return st;
+  return ReadRecords(records);
 }
 
-void DBClient::WriteRecord(DBRecord *record) {
-  uint32 ksize = record->key.size() << 1;
-  if (record->version != 0) ksize |= 1;
-  request_.Write(&ksize, 4);
-  request_.Write(record->key.data(), record->key.size());
+Status DBClient::Prefix(const Slice &prefix, const Slice &start, int num,
+                        std::vector<DBRecord> *records) {
+  request_.Clear();
+  WriteKey(prefix);
+  WriteKey(start);
+  request_.Write(&num, 4);
+  Status st = Do(DBPREFIX);
+  if (!st.ok()) return st;
+  return ReadRecords(records);
+}
 
-  if (record->version != 0) {
-    request_.Write(&record->version, 8);
-  }
+void DBClient::WriteKey(const Slice &key) {
+  EncodeKey(&request_, key);
+}
 
-  uint32 vsize = record->value.size();
-  request_.Write(&vsize, 4);
-  request_.Write(record->value.data(), record->value.size());
+void DBClient::WriteRecord(DBRecord *record) {
+  EncodeRecord(&request_, *record);
 }
 
 Status DBClient::ReadRecord(DBRecord *record) {
-  // Read key size with version bit.
-  uint32 ksize;
-  if (!response_.Read(&ksize, 4)) return Truncated();
-  bool has_version = ksize & 1;
-  ksize >>= 1;
-
-  // Read key.
-  if (response_.available() < ksize) return Truncated();
-  record->key = Slice(response_.Consume(ksize), ksize);
+  return DecodeRecord(&response_, record);
+}
 
-  // Optionally read version.
-  if (has_version) {
-    if (!response_.Read(&record->version, 8)) return Truncated();
-  } else {
-    record->version = 0;
+Status DBClient::ReadRecords(std::vector<DBRecord> *records) {
+  records->clear();
+  if (reply_ == DBDONE) return Status(ENOENT, "No more records");
+  DBRecord record;
+  while (!response_.empty()) {
+    Status st = ReadRecord(&record);
+    if (!st.ok()) return st;
+    records->push_back(record);
   }
-
-  // Read value size.
-  uint32 vsize;
-  if (!response_.Read(&vsize, 4)) return Truncated();
-
-  // Read value.
-  if (response_.available() < vsize) return Truncated();
-  record->value = Slice(response_.Consume(vsize), vsize);
-
   return Status::OK;
 }
 
@@ -324,5 +386,267 @@ Status DBClient::Do(DBVerb verb) {
   return Status::OK;
 }
 
-}  // namespace sling
+Status DBAsyncClient::Connect(const string &database) {
+  // Connect to server.
+  string dbname;
+  Status st = ConnectToServer(database, &sock_, &dbname);
+  if (!st.ok()) return st;
+
+  // Start receiver thread.
+  error_ = Status::OK;
+  receiver_ = new ClosureThread([this]() { Receive(); });
+  receiver_->SetJoinable(true);
+  receiver_->Start();
+
+  // Switch to database.
+  if (!dbname.empty()) {
+    return Use(dbname);
+  } else {
+    return Status::OK;
+  }
+}
 
+Status DBAsyncClient::Close() {
+  Status st;
+  if (sock_ != -1) {
+    // Wait for outstanding requests.
+    st = Wait();
+
+    // Shut down connection and stop receiver.
+    shutdown(sock_, SHUT_RDWR);
+    if (receiver_ != nullptr) {
+      receiver_->Join();
+      delete receiver_;
+      receiver_ = nullptr;
+    }
+    if (close(sock_) != 0 && st.ok()) st = Error("close");
+    sock_ = -1;
+  }
+  return st;
+}
+
+Status DBAsyncClient::Use(const string &dbname) {
+  return Do(DBUSE, [&](IOBuffer *request) {
+    request->Write(dbname);
+  });
+}
+
+Status DBAsyncClient::Bulk(bool enable) {
+  uint32 value = enable;
+  return Do(DBBULK, [&](IOBuffer *request) {
+    request->Write(&value, 4);
+  });
+}
+
+Status DBAsyncClient::Get(const std::vector<Slice> &keys,
+                          RecordCallback done) {
+  auto encode = [&](IOBuffer *request) {
+    for (auto &key : keys) EncodeKey(request, key);
+  };
+  int num_keys = keys.size();
+  return Send(DBGET, encode,
+    [num_keys, done](const Status &status, DBVerb reply, IOBuffer *rsp) {
+      std::vector<DBRecord> records;
+      Status st = status;
+      if (st.ok()) {
+        records.resize(num_keys);
+        for (int i = 0; i < num_keys && st.ok(); ++i) {
+          st = DecodeRecord(rsp, &records[i]);
+        }
+      }
+      done(st, &records);
+    });
+}
+
+Status DBAsyncClient::Put(const std::vector<DBRecord> &records, DBMode mode,
+                          ResultCallback done) {
+  auto encode = [&](IOBuffer *request) {
+    request->Write(&mode, 4);
+    for (auto &record : records) EncodeRecord(request, record);
+  };
+  int num_records = records.size();
+  return Send(DBPUT, encode,
+    [num_records, done](const Status &status, DBVerb reply, IOBuffer *rsp) {
+      std::vector<DBResult> results;
+      Status st = status;
+      if (st.ok()) {
+        results.resize(num_records);
+        for (int i = 0; i < num_records; ++i) {
+          if (!rsp->Read(&results[i], 4)) {
+            st = Truncated();
+            break;
+          }
+        }
+      }
+      done(st, &results);
+    });
+}
+
+Status DBAsyncClient::Delete(const Slice &key, DoneCallback done) {
+  auto encode = [&](IOBuffer *request) {
+    EncodeKey(request, key);
+  };
+  return Send(DBDELETE, encode,
+    [done](const Status &status, DBVerb reply, IOBuffer *rsp) {
+      done(status);
+    });
+}
+
+Status DBAsyncClient::Wait() {
+  std::unique_lock<std::mutex> lock(mu_);
+  completed_.wait(lock, [this]() {
+    return pending_.empty() && active_ == 0;
+  });
+  return error_;
+}
+
+Status DBAsyncClient::Send(DBVerb verb, const Encoder &encode,
+                           Handler handler) {
+  // Wait until there is room for more outstanding requests.
+  uint64 id;
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    completed_.wait(lock, [this]() {
+      return pending_.size() < static_cast<size_t>(max_pending_) ||
+             !error_.ok();
+    });
+    if (!error_.ok()) return error_;
+
+    // Register handler for reply.
+    id = next_id_++;
+    pending_[id] = std::move(handler);
+  }
+
+  // Encode tagged request with header and request id.
+  MutexLock lock(&send_mu_);
+  DBHeader hdr;
+  hdr.verb = static_cast<DBVerb>(verb | DBTAGGED);
+  hdr.size = 0;
+  request_.Clear();
+  request_.Write(&hdr, sizeof(DBHeader));
+  request_.Write(&id, sizeof(uint64));
+  encode(&request_);
+  DBHeader::from(request_.begin())->size =
+      request_.available() - sizeof(DBHeader);
+
+  // Send request.
+  while (!request_.empty()) {
+    int rc = send(sock_, request_.begin(), request_.available(), 0);
+    if (rc <= 0) {
+      Status st = rc == 0 ? Status(EIO, "Connection closed") : Error("send");
+      Fail(st);
+      return st;
+    }
+    request_.Consume(rc);
+  }
+
+  return Status::OK;
+}
+
+Status DBAsyncClient::Do(DBVerb verb, const Encoder &encode) {
+  Mutex mu;
+  std::condition_variable done;
+  bool completed = false;
+  Status result;
+  Status st = Send(verb, encode,
+    [&](const Status &status, DBVerb reply, IOBuffer *rsp) {
+      std::unique_lock<std::mutex> lock(mu);
+      result = status;
+      completed = true;
+      done.notify_one();
+    });
+  if (!st.ok()) return st;
+
+  std::unique_lock<std::mutex> lock(mu);
+  done.wait(lock, [&]() { return completed; });
+  return result;
+}
+
+void DBAsyncClient::Receive() {
+  IOBuffer buffer;
+  IOBuffer body;
+  for (;;) {
+    // Receive more data from server.
+    buffer.Flush();
+    buffer.Ensure(4096);
+    int rc = recv(sock_, buffer.end(), buffer.remaining(), 0);
+    if (rc < 0) {
+      Fail(Error("recv"));
+      return;
+    } else if (rc == 0) {
+      Fail(Status(EIO, "Connection closed"));
+      return;
+    }
+    buffer.Append(rc);
+
+    // Dispatch all the complete replies received.
+    for (;;) {
+      if (buffer.available() < sizeof(DBHeader)) break;
+      auto *hdr = DBHeader::from(buffer.begin());
+      size_t size = sizeof(DBHeader) + hdr->size;
+      if (buffer.available() < size) {
+        buffer.Flush();
+        buffer.Ensure(size - buffer.available());
+        break;
+      }
+
+      // Get request id for reply.
+      uint32 verb = hdr->verb;
+      uint32 bodysize = hdr->size;
+      buffer.Consume(sizeof(DBHeader));
+      uint64 id;
+      if ((verb & DBTAGGED) == 0 || !buffer.Read(&id, 8)) {
+        Fail(Status(EBADMSG, "Reply not tagged with request id"));
+        return;
+      }
+      DBVerb reply = static_cast<DBVerb>(verb & ~DBTAGGED);
+      body.Clear();
+      body.Copy(&buffer, bodysize - sizeof(uint64));
+
+      // Remove handler for request from outstanding requests.
+      Handler handler;
+      {
+        MutexLock lock(&mu_);
+        auto f = pending_.find(id);
+        if (f != pending_.end()) {
+          handler = std::move(f->second);
+          pending_.erase(f);
+          active_++;
+        }
+      }
+      if (!handler) {
+        Fail(Status(EBADMSG, "Reply for unknown request"));
+        return;
+      }
+
+      // Call handler for reply.
+      if (reply == DBERROR) {
+        Status st(EINVAL, body.begin(), body.available());
+        handler(st, reply, &body);
+      } else {
+        handler(Status::OK, reply, &body);
+      }
+
+      // Signal completion.
+      MutexLock lock(&mu_);
+      active_--;
+      completed_.notify_all();
+    }
+  }
+}
+
+void DBAsyncClient::Fail(const Status &status) {
+  // Fail all outstanding requests.
+  std::unordered_map<uint64, Handler> failed;
+  {
+    MutexLock lock(&mu_);
+    if (error_.ok()) error_ = status;
+    failed.swap(pending_);
+  }
+  for (auto &it : failed) it.second(status, DBERROR, nullptr);
+
+  MutexLock lock(&mu_);
+  completed_.notify_all();
+}
+
+}  // namespace sling
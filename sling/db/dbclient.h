@@ -15,13 +15,18 @@
 #ifndef SLING_DB_DBCLIENT_H_
 #define SLING_DB_DBCLIENT_H_
 
+#include <condition_variable>
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "sling/base/status.h"
 #include "sling/base/types.h"
 #include "sling/db/dbprotocol.h"
 #include "sling/util/iobuffer.h"
+#include "sling/util/mutex.h"
+#include "sling/util/thread.h"
 
 namespace sling {
 
@@ -82,6 +87,20 @@ class DBClient {
   // value for reading new records from the database.
   Status Epoch(uint64 *epoch);
 
+  // Get up to num records with keys in the range [start, end) in key order.
+  // There is no upper bound if end is empty. The database must be ordered.
+  // Returns ENOENT when there are no more records in the range. To get the
+  // next records, the last key with a zero byte appended is used as the new
+  // start key.
+  Status Scan(const Slice &start, const Slice &end, int num,
+              std::vector<DBRecord> *records);
+
+  // Get up to num records with keys starting with prefix in key order,
+  // starting from the start key if it is after the prefix. The database must
+  // be ordered. Returns ENOENT when there are no more records with the prefix.
+  Status Prefix(const Slice &prefix, const Slice &start, int num,
+                std::vector<DBRecord> *records);
+
  private:
   // Write key to request.
   void WriteKey(const Slice &key);
@@ -92,6 +111,9 @@ class DBClient {
   // Read record from response.
   Status ReadRecord(DBRecord *record);
 
+  // Read records from response.
+  Status ReadRecords(std::vector<DBRecord> *records);
+
   // Send request to server and receive reply.
   Status Do(DBVerb verb);
 
@@ -106,6 +128,116 @@ class DBClient {
   DBVerb reply_ = DBOK;
 };
 
+// Asynchronous database connection to database server. Requests are pipelined
+// on the connection, i.e. new requests are sent to the server without waiting
+// for the replies to the previous requests. Each request is tagged with a
+// request id, and the reply is dispatched to the callback for the request when
+// it is received. The callbacks are called from the receiver thread for the
+// connection and should not block. The records and results passed to the
+// callbacks are only valid during the callback.
+//
+// Please notice that the server processes the requests on a connection one at
+// a time and replies to them in request order, so a slow request delays the
+// replies to all the requests sent after it on the same connection. Use
+// separate connections for independent streams of requests.
+class DBAsyncClient {
+ public:
+  // Callbacks for replies.
+  typedef std::function<void(const Status &status)> DoneCallback;
+  typedef std::function<void(const Status &status,
+                             std::vector<DBRecord> *records)> RecordCallback;
+  typedef std::function<void(const Status &status,
+                             std::vector<DBResult> *results)> ResultCallback;
+
+  ~DBAsyncClient() { Close(); }
+
+  // Connect to database server. The format of the database name is the same
+  // as for DBClient.
+  Status Connect(const string &database);
+
+  // Wait for all outstanding requests and close connection to server.
+  Status Close();
+
+  // Switch to using another database on server. This waits for the reply.
+  Status Use(const string &dbname);
+
+  // Enable/disable bulk mode for database. This waits for the reply.
+  Status Bulk(bool enable);
+
+  // Get record(s) from database.
+  Status Get(const std::vector<Slice> &keys, RecordCallback done);
+
+  // Add or update record(s) in database. The callback receives the outcome for
+  // each of the records.
+  Status Put(const std::vector<DBRecord> &records, DBMode mode,
+             ResultCallback done);
+
+  // Delete record in database.
+  Status Delete(const Slice &key, DoneCallback done);
+
+  // Wait until replies have been received for all outstanding requests.
+  // Returns error if the connection has failed.
+  Status Wait();
+
+  // Maximum number of outstanding requests. New requests block until there is
+  // room for more requests.
+  void set_max_pending(int max_pending) { max_pending_ = max_pending; }
+
+ private:
+  // Handler for reply to request. The handler is called with the reply verb
+  // and a buffer with the reply body.
+  typedef std::function<void(const Status &status,
+                             DBVerb reply,
+                             IOBuffer *body)> Handler;
+
+  // Encoder for writing the request body to the request buffer.
+  typedef std::function<void(IOBuffer *request)> Encoder;
+
+  // Send request to server. The request body is encoded directly into the
+  // request buffer. The handler is called when the reply is received.
+  Status Send(DBVerb verb, const Encoder &encode, Handler handler);
+
+  // Send request to server and wait for the reply.
+  Status Do(DBVerb verb, const Encoder &encode);
+
+  // Receive replies from server and dispatch them to the request handlers.
+  void Receive();
+
+  // Fail all outstanding requests.
+  void Fail(const Status &status);
+
+  // Socket for connection.
+  int sock_ = -1;
+
+  // Handlers for outstanding requests keyed by request id.
+  std::unordered_map<uint64, Handler> pending_;
+
+  // Number of replies being handled by the receiver.
+  int active_ = 0;
+
+  // Next request id.
+  uint64 next_id_ = 1;
+
+  // Maximum number of outstanding requests.
+  int max_pending_ = 64;
+
+  // Connection error.
+  Status error_;
+
+  // Thread for receiving replies from server.
+  ClosureThread *receiver_ = nullptr;
+
+  // Mutex for outstanding requests and signal for completed requests.
+  Mutex mu_;
+  std::condition_variable completed_;
+
+  // Mutex for serializing sending of requests.
+  Mutex send_mu_;
+
+  // Buffer for request being sent.
+  IOBuffer request_;
+};
+
 }  // namespace sling
 
 #endif  // SLING_DB_DBCLIENT_H_
@@ -111,7 +111,7 @@ Status DatabaseIndex::Create(const string &filename,
       return Status(E_MEMMAP, "Unable to map index into memory: ", filename);
     }
   } else {
-    mapped_addr_ = static_cast<char *>(malloc(mapped_size_));
+    mapped_addr_ = static_cast<char *>(calloc(mapped_size_, 1));
     if (mapped_addr_ == nullptr) {
       return Status(E_MEMMAP, "Unable to allocate memory index");
     }
@@ -153,6 +153,14 @@ Status DatabaseIndex::Flush(uint64 epoch) {
   return Status::OK;
 }
 
+Status DatabaseIndex::Invalidate() {
+  header_->epoch = 0;
+  if (file_ != nullptr) {
+    return File::FlushMappedMemory(header_, header_->offset);
+  }
+  return Status::OK;
+}
+
 Status DatabaseIndex::Close() {
   if (file_ != nullptr) {
     // Remove memory mapping.
@@ -252,7 +260,7 @@ uint64 DatabaseIndex::Delete(uint64 key, uint64 value) {
       header_->deletions++;
       header_->size--;
       return pos;
-    } else if (e.value == EMPTY) {
+    } else if (e.key == EMPTY) {
       // No match found.
       return NVAL;
     }
@@ -272,6 +280,20 @@ void DatabaseIndex::TransferTo(DatabaseIndex *index) const {
   }
 }
 
+void DatabaseIndex::MoveTo(DatabaseIndex *index, uint64 begin, uint64 end) {
+  DCHECK_LE(end, header_->capacity);
+  Entry *entry = entries_ + begin;
+  Entry *last = entries_ + end;
+  while (entry < last) {
+    if (entry->key != EMPTY && entry->key != TOMBSTONE) {
+      index->Add(entry->key, entry->value);
+      entry->key = TOMBSTONE;
+      header_->size--;
+    }
+    entry++;
+  }
+}
+
 void DatabaseIndex::CopyFrom(const DatabaseIndex *index) {
   // Check that index sizes match.
   CHECK_EQ(mapped_size_, index->mapped_size_);
@@ -46,6 +46,10 @@ class DatabaseIndex {
   // Flush changes to disk.
   Status Flush(uint64 epoch);
 
+  // Mark index as stale on disk by clearing the epoch in the index header. The
+  // epoch is set again on the next flush.
+  Status Invalidate();
+
   // Flush and close database index.
   Status Close();
 
@@ -75,6 +79,12 @@ class DatabaseIndex {
   // Transfer all used index entries to another index.
   void TransferTo(DatabaseIndex *index) const;
 
+  // Move used index entries in the slot range [begin, end) to another index.
+  // The moved entries are replaced with tombstones to keep the probe sequences
+  // intact for the remaining entries. This is used for migrating the entries
+  // to a larger index incrementally.
+  void MoveTo(DatabaseIndex *index, uint64 begin, uint64 end);
+
   // Copy index from another index. This requires that the other index has the
   // same capacity as this index.
   void CopyFrom(const DatabaseIndex *index);
@@ -96,8 +106,9 @@ class DatabaseIndex {
   // Return limit for current index.
   uint64 limit() const { return header_ != nullptr ? header_->limit : 0; }
 
-  // Return number of active records.
-  uint64 num_records() const { return header_->size - header_->deletions; }
+  // Return number of active records. Deleted entries are not included in the
+  // size.
+  uint64 num_records() const { return header_->size; }
 
   // Return number of deleted records.
   uint64 num_deleted() const { return header_->deletions; }
@@ -0,0 +1,333 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/db/dbkeys.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "sling/base/logging.h"
+
+namespace sling {
+
+DatabaseKeys::Run::~Run() {
+  if (mapped_addr != nullptr) File::FreeMappedMemory(mapped_addr, mapped_size);
+  if (file != nullptr) file->Close();
+}
+
+Status DatabaseKeys::Run::Open(const string &filename) {
+  // Open run file and map it into memory.
+  Status st = File::Open(filename, "r+", &file);
+  if (!st.ok()) return st;
+  mapped_size = file->Size();
+  if (mapped_size < sizeof(Header)) {
+    return Status(E_CORRUPT, "Key index run truncated: ", filename);
+  }
+  mapped_addr = static_cast<char *>(file->MapMemory(0, mapped_size, true));
+  if (mapped_addr == nullptr) {
+    return Status(E_CORRUPT, "Unable to map key index into memory: ", filename);
+  }
+  header = reinterpret_cast<Header *>(mapped_addr);
+
+  // Check that run is valid.
+  if (header->magic != MAGIC) {
+    return Status(E_NOT_KEYS, "Not a key index run: ", filename);
+  }
+  if (header->version != VERSION) {
+    return Status(E_NOT_SUPPORTED, "Unsupported key index version");
+  }
+  uint64 num_blocks = (header->count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  if (header->blocks < sizeof(Header) ||
+      header->blocks + num_blocks * sizeof(uint64) > mapped_size) {
+    return Status(E_CORRUPT, "Key index run truncated: ", filename);
+  }
+  blocks = reinterpret_cast<const uint64 *>(mapped_addr + header->blocks);
+
+  return Status::OK;
+}
+
+DatabaseKeys::Cursor DatabaseKeys::Run::LowerBound(const Slice &key) const {
+  // Find the last block where the first key is not greater than the key.
+  uint64 lo = 0;
+  uint64 hi = (header->count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  while (hi - lo > 1) {
+    uint64 mid = (lo + hi) / 2;
+    Cursor c;
+    c.offset = blocks[mid];
+    if (key < this->key(c)) {
+      hi = mid;
+    } else {
+      lo = mid;
+    }
+  }
+
+  // Scan the block for the first key which is not less than the key.
+  Cursor cursor;
+  cursor.index = lo * BLOCK_SIZE;
+  cursor.offset = lo * BLOCK_SIZE < header->count ? blocks[lo] : sizeof(Header);
+  while (!done(cursor) && this->key(cursor) < key) Next(&cursor);
+  return cursor;
+}
+
+DatabaseKeys::~DatabaseKeys() {
+  for (Run *run : runs_) delete run;
+}
+
+Status DatabaseKeys::Open(const string &dbdir) {
+  dbdir_ = dbdir;
+
+  // Remove runs that were not completed.
+  std::vector<string> files;
+  File::Match(dbdir_ + "/keys-*.tmp", &files);
+  for (const string &file : files) File::Delete(file);
+
+  // Open runs.
+  files.clear();
+  File::Match(dbdir_ + "/keys-*", &files);
+  std::sort(files.begin(), files.end());
+  for (const string &file : files) {
+    Run *run = new Run();
+    runs_.push_back(run);
+    Status st = run->Open(file);
+    if (!st.ok()) return st;
+    next_seq_ = std::max(next_seq_, run->header->seq + 1);
+  }
+
+  // If a merge was interrupted before the merged runs were deleted, the
+  // merged runs are superseded by the newer run.
+  uint64 base = next_seq_;
+  for (int i = runs_.size() - 1; i >= 0; --i) {
+    Run *run = runs_[i];
+    if (run->header->seq >= base) {
+      VLOG(1) << "Remove superseded key index run " << run->header->seq;
+      uint64 seq = run->header->seq;
+      delete run;
+      runs_.erase(runs_.begin() + i);
+      Status st = File::Delete(RunFile(seq));
+      if (!st.ok()) return st;
+    } else {
+      base = run->header->base;
+    }
+  }
+
+  return Status::OK;
+}
+
+Status DatabaseKeys::Clear() {
+  table_.clear();
+  for (Run *run : runs_) delete run;
+  runs_.clear();
+
+  // Remove all run files.
+  std::vector<string> files;
+  File::Match(dbdir_ + "/keys-*", &files);
+  for (const string &file : files) {
+    Status st = File::Delete(file);
+    if (!st.ok()) return st;
+  }
+
+  return Status::OK;
+}
+
+uint64 DatabaseKeys::epoch() const {
+  return runs_.empty() ? 0 : runs_.back()->header->epoch;
+}
+
+Status DatabaseKeys::Flush(uint64 epoch) {
+  // If there are no changes, just update the epoch of the newest run.
+  if (table_.empty() && !runs_.empty()) {
+    Header *header = runs_.back()->header;
+    if (header->epoch == epoch) return Status::OK;
+    header->epoch = epoch;
+    return File::FlushMappedMemory(header, sizeof(Header));
+  }
+
+  // Merge the memory table with the newest runs which are less than twice the
+  // size of the merged run.
+  uint64 size = table_.size();
+  int first = runs_.size();
+  while (first > 0 && runs_[first - 1]->header->count <= 2 * size) {
+    size += runs_[first - 1]->header->count;
+    first--;
+  }
+  return Merge(first, epoch);
+}
+
+bool DatabaseKeys::NextEntry(int first, std::vector<Cursor> *cursors,
+                             std::map<string, bool>::const_iterator *table,
+                             Slice *key, bool *removed) const {
+  // Find the smallest key in the runs and the memory table. The sources are
+  // checked from the oldest to the newest, so the newest entry wins.
+  bool found = false;
+  for (int i = first; i < runs_.size(); ++i) {
+    const Run *run = runs_[i];
+    const Cursor &cursor = (*cursors)[i - first];
+    if (run->done(cursor)) continue;
+    Slice k = run->key(cursor);
+    if (!found || k < *key) {
+      *key = k;
+      found = true;
+      *removed = run->removed(cursor);
+    } else if (k == *key) {
+      *removed = run->removed(cursor);
+    }
+  }
+  if (*table != table_.end()) {
+    Slice k((*table)->first);
+    if (!found || k < *key || k == *key) {
+      *key = k;
+      found = true;
+      *removed = !(*table)->second;
+    }
+  }
+  if (!found) return false;
+
+  // Advance past the key in all sources.
+  for (int i = first; i < runs_.size(); ++i) {
+    const Run *run = runs_[i];
+    Cursor &cursor = (*cursors)[i - first];
+    if (!run->done(cursor) && run->key(cursor) == *key) run->Next(&cursor);
+  }
+  if (*table != table_.end() && Slice((*table)->first) == *key) ++*table;
+
+  return true;
+}
+
+Status DatabaseKeys::Merge(int first, uint64 epoch) {
+  // Open file for new run.
+  uint64 seq = next_seq_++;
+  string filename = RunFile(seq);
+  string tmpfile = filename + ".tmp";
+  File *file;
+  Status st = File::Open(tmpfile, "w", &file);
+  if (!st.ok()) return st;
+
+  // Set up header for new run. Removed keys only need to be kept if there
+  // are older runs which can contain the keys.
+  Header header;
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.epoch = epoch;
+  header.seq = seq;
+  header.base = first < runs_.size() ? runs_[first]->header->base : seq;
+  header.count = 0;
+  header.blocks = 0;
+  bool drop_removed = first == 0;
+
+  // Merge runs and memory table into new run.
+  std::vector<uint64> blocks;
+  std::vector<Cursor> cursors(runs_.size() - first);
+  for (int i = first; i < runs_.size(); ++i) {
+    cursors[i - first].offset = sizeof(Header);
+  }
+  auto table = table_.cbegin();
+  string buffer;
+  buffer.append(reinterpret_cast<char *>(&header), sizeof(Header));
+  uint64 offset = sizeof(Header);
+  Slice key;
+  bool removed;
+  while (NextEntry(first, &cursors, &table, &key, &removed)) {
+    if (removed && drop_removed) continue;
+    if (header.count % BLOCK_SIZE == 0) blocks.push_back(offset);
+    uint32 size = key.size();
+    buffer.push_back(removed ? 1 : 0);
+    buffer.append(reinterpret_cast<char *>(&size), sizeof(uint32));
+    buffer.append(key.data(), key.size());
+    offset += 1 + sizeof(uint32) + size;
+    header.count++;
+
+    if (buffer.size() >= 1 << 20) {
+      st = file->Write(buffer.data(), buffer.size());
+      if (!st.ok()) return st;
+      buffer.clear();
+    }
+  }
+
+  // Write block offsets aligned to eight bytes.
+  while (offset % sizeof(uint64) != 0) {
+    buffer.push_back(0);
+    offset++;
+  }
+  header.blocks = offset;
+  buffer.append(reinterpret_cast<char *>(blocks.data()),
+                blocks.size() * sizeof(uint64));
+  st = file->Write(buffer.data(), buffer.size());
+  if (!st.ok()) return st;
+
+  // Write final header.
+  st = file->PWrite(0, &header, sizeof(Header));
+  if (!st.ok()) return st;
+  st = file->Flush();
+  if (!st.ok()) return st;
+  st = file->Close();
+  if (!st.ok()) return st;
+
+  // Install new run. The merged runs are superseded by the new run, so they
+  // can be deleted when the new run is in place.
+  st = File::Rename(tmpfile, filename);
+  if (!st.ok()) return st;
+  Run *run = new Run();
+  st = run->Open(filename);
+  if (!st.ok()) {
+    delete run;
+    return st;
+  }
+  for (int i = first; i < runs_.size(); ++i) {
+    uint64 merged = runs_[i]->header->seq;
+    delete runs_[i];
+    st = File::Delete(RunFile(merged));
+    if (!st.ok()) LOG(WARNING) << "Error removing key index run: " << st;
+  }
+  runs_.resize(first);
+  runs_.push_back(run);
+  table_.clear();
+
+  VLOG(1) << "Key index run " << seq << " with " << header.count
+          << " keys written for " << dbdir_;
+  return Status::OK;
+}
+
+string DatabaseKeys::RunFile(uint64 seq) const {
+  string fn = dbdir_ + "/keys-";
+  string number = std::to_string(seq);
+  for (int z = 0; z < 8 - number.size(); ++z) fn.push_back('0');
+  fn.append(number);
+  return fn;
+}
+
+void DatabaseKeys::Iterator::Seek(const Slice &key) {
+  const auto &runs = keys_->runs_;
+  cursors_.resize(runs.size());
+  for (int i = 0; i < runs.size(); ++i) {
+    cursors_[i] = runs[i]->LowerBound(key);
+  }
+  table_ = keys_->table_.lower_bound(key.str());
+  Settle();
+}
+
+void DatabaseKeys::Iterator::Settle() {
+  Slice key;
+  bool removed;
+  while (keys_->NextEntry(0, &cursors_, &table_, &key, &removed)) {
+    if (!removed) {
+      key_.assign(key.data(), key.size());
+      valid_ = true;
+      return;
+    }
+  }
+  valid_ = false;
+}
+
+}  // namespace sling
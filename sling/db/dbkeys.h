@@ -0,0 +1,208 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_DB_DBKEYS_H_
+#define SLING_DB_DBKEYS_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sling/base/slice.h"
+#include "sling/base/status.h"
+#include "sling/base/types.h"
+#include "sling/file/file.h"
+
+namespace sling {
+
+// Ordered key index for database. The key index is a log-structured merge
+// tree which keeps track of the set of keys in the database in sorted order.
+// Recent changes are kept in a memory table, and older changes are stored in
+// sorted runs on disk (<dbdir>/keys-99999999). When the memory table is
+// flushed, it is merged with the newest runs until the runs have
+// geometrically increasing sizes, so a key is rewritten a logarithmic number
+// of times. The key index only stores keys; the records are looked up in the
+// database index. Each run records the database epoch when it was written,
+// and changes after that epoch are replayed from the data shards when the
+// key index is opened.
+class DatabaseKeys {
+ public:
+  ~DatabaseKeys();
+
+  // Open key index with the runs in the database directory.
+  Status Open(const string &dbdir);
+
+  // Remove all keys from index and delete the runs.
+  Status Clear();
+
+  // Add key to index.
+  void Add(const Slice &key) { table_[key.str()] = true; }
+
+  // Remove key from index.
+  void Remove(const Slice &key) { table_[key.str()] = false; }
+
+  // Write changes in the memory table to a new run on disk, merging it with
+  // the newest runs that are not much larger. If there are no changes, the
+  // epoch of the newest run is updated.
+  Status Flush(uint64 epoch);
+
+  // Return the database epoch when the key index was last flushed.
+  uint64 epoch() const;
+
+  // Return number of unflushed changes in memory table.
+  size_t changes() const { return table_.size(); }
+
+  // Return number of runs on disk.
+  int num_runs() const { return runs_.size(); }
+
+  // Position of entry in run.
+  struct Cursor {
+    uint64 index = 0;   // entry number
+    uint64 offset = 0;  // file offset of entry
+  };
+
+  // Iterator for traversing the keys in the index in sorted order, e.g.
+  //   DatabaseKeys::Iterator it(keys);
+  //   for (it.Seek(start); it.Valid(); it.Next()) { ... it.key() ... }
+  // The index cannot be changed while it is being iterated.
+  class Iterator {
+   public:
+    explicit Iterator(const DatabaseKeys *keys) : keys_(keys) {}
+
+    // Position iterator at the first key which is not less than key.
+    void Seek(const Slice &key);
+
+    // Advance to next key.
+    void Next() { Settle(); }
+
+    // Check if iterator is positioned at a key.
+    bool Valid() const { return valid_; }
+
+    // Return current key.
+    Slice key() const { return Slice(key_); }
+
+   private:
+    // Move to the next live key in the runs and the memory table.
+    void Settle();
+
+    // Key index being iterated.
+    const DatabaseKeys *keys_;
+
+    // Current position in each of the runs.
+    std::vector<Cursor> cursors_;
+
+    // Current position in the memory table.
+    std::map<string, bool>::const_iterator table_;
+
+    // Current key.
+    string key_;
+    bool valid_ = false;
+  };
+
+  // Error codes.
+  enum Errors {
+    E_NOT_KEYS = 3000,       // not a key index run
+    E_NOT_SUPPORTED,         // unsupported key index version
+    E_CORRUPT,               // corrupt key index run
+  };
+
+ private:
+  // Magic number and version for identifying key index runs.
+  static const uint32 MAGIC = 0x5359454b;  // KEYS
+  static const uint32 VERSION = 1;
+
+  // Number of entries in each block of a run.
+  static const int BLOCK_SIZE = 64;
+
+  // Run file header. The entries follow the header. Each entry has a flag
+  // byte which is 1 for removed keys and 0 otherwise, followed by the key size
+  // (uint32) and the key. The file offsets of the first entry in each block
+  // are stored after the entries.
+  struct Header {
+    uint32 magic;     // magic number for identifying key index run
+    uint32 version;   // key index run format version
+    uint64 epoch;     // database epoch when the run was written
+    uint64 seq;       // run sequence number
+    uint64 base;      // sequence number of the oldest run merged into run
+    uint64 count;     // number of keys in run
+    uint64 blocks;    // file offset of block offset table
+  };
+
+  // Sorted run of keys on disk.
+  struct Run {
+    ~Run();
+
+    // Open run file and map it into memory.
+    Status Open(const string &filename);
+
+    // Check if cursor is at the end of the run.
+    bool done(const Cursor &cursor) const {
+      return cursor.index == header->count;
+    }
+
+    // Return key and removal flag for entry at cursor.
+    Slice key(const Cursor &cursor) const {
+      const char *entry = mapped_addr + cursor.offset;
+      return Slice(entry + 5, *reinterpret_cast<const uint32 *>(entry + 1));
+    }
+    bool removed(const Cursor &cursor) const {
+      return mapped_addr[cursor.offset] != 0;
+    }
+
+    // Move cursor to next entry.
+    void Next(Cursor *cursor) const {
+      cursor->offset += 5 + key(*cursor).size();
+      cursor->index++;
+    }
+
+    // Return cursor for the first key which is not less than key.
+    Cursor LowerBound(const Slice &key) const;
+
+    File *file = nullptr;               // run file
+    char *mapped_addr = nullptr;        // run file mapped into memory
+    uint64 mapped_size = 0;             // size of mapping
+    Header *header = nullptr;           // run header
+    const uint64 *blocks = nullptr;     // offsets for blocks of entries
+  };
+
+  // Get the next entry from the runs starting at first and the memory table
+  // and advance past it. For keys in multiple sources, the entry from the
+  // newest source is returned. Returns false when all sources are exhausted.
+  bool NextEntry(int first, std::vector<Cursor> *cursors,
+                 std::map<string, bool>::const_iterator *table,
+                 Slice *key, bool *removed) const;
+
+  // Write new run by merging the runs starting at first with the memory
+  // table. Removed keys are dropped if all runs are merged.
+  Status Merge(int first, uint64 epoch);
+
+  // Return file name for run.
+  string RunFile(uint64 seq) const;
+
+  // Database directory.
+  string dbdir_;
+
+  // Runs on disk ordered from the oldest to the newest.
+  std::vector<Run *> runs_;
+
+  // Memory table with recent changes. The value is false for removed keys.
+  std::map<string, bool> table_;
+
+  // Sequence number for next run.
+  uint64 next_seq_ = 1;
+};
+
+}  // namespace sling
+
+#endif  // SLING_DB_DBKEYS_H_
@@ -33,6 +33,8 @@ enum DBVerb : uint32 {
   DBNEXT      = 4,     // retrieve the next record(s) from database
   DBBULK      = 5,     // enable/disable bulk mode for database
   DBEPOCH     = 6,     // get epoch for database
+  DBSCAN      = 7,     // retrieve record(s) in key range
+  DBPREFIX    = 8,     // retrieve record(s) with key prefix
 
   // Reply verbs.
   DBOK        = 128,   // success reply
@@ -43,6 +45,9 @@ enum DBVerb : uint32 {
   DBRECID     = 133,   // reply recid for current epoch
 };
 
+// Flag for request and reply verbs tagged with a request id.
+const uint32 DBTAGGED = 1 << 31;
+
 // Update mode for DBPUT.
 enum DBMode : uint32 {
   DBOVERWRITE = 0,     // overwrite existing records
@@ -117,7 +122,9 @@ struct DBHeader {
 // Retrieves the next record(s) for a cursor. The recid is the initial cursor
 // value, which should be zero to start retrieving from the begining of the
 // database, and next is the next cursor value for retrieving more records.
-// Returns DBDONE when there are no more records to retrieve.
+// Returns DBDONE when there are no more records to retrieve. Returns DBERROR
+// if the data shard for the cursor has been compacted since the cursor was
+// last used on the connection.
 //
 // DBBULK enable:uint32 -> DBOK
 //
@@ -129,7 +136,32 @@ struct DBHeader {
 // Enable/disable bulk mode for database. In bulk mode, there is no periodical
 // forced checkpoints.
 //
+// DBSCAN start:key end:key num:uint32 -> DBRECORD {record}* | DBDONE
+//
+// Retrieves up to num records with keys in the range [start, end) in key
+// order. There is no upper bound if the end key is empty. The scan can be
+// continued by using the last key returned with a zero byte appended as the
+// new start key. Returns DBDONE when there are no more records in the range.
+// This requires that the database has an ordered key index.
+//
+// DBPREFIX prefix:key start:key num:uint32 -> DBRECORD {record}* | DBDONE
+//
+// Retrieves up to num records with keys starting with prefix in key order. The
+// scan starts at the start key if it is after the prefix. Otherwise, the scan
+// starts at the prefix. Returns DBDONE when there are no more records with
+// the prefix. This requires that the database has an ordered key index.
+//
 // All requests can return a DBERROR message:char[] reply if an error occurs.
+//
+// Tagged requests:
+//
+// If the DBTAGGED flag is set in the request verb, the request body starts
+// with a request id:uint64 followed by the verb-specific body. The reply to a
+// tagged request also has the DBTAGGED flag set in the reply verb and starts
+// with the same request id. This allows clients to pipeline requests, i.e.
+// send new requests before the replies to the previous requests have been
+// received, and match the replies to the requests. Clients should not depend
+// on replies to tagged requests being returned in request order.
 
 }  // namespace sling
 
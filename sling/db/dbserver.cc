@@ -17,6 +17,7 @@
 #include <unistd.h>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "sling/base/flags.h"
 #include "sling/base/init.h"
@@ -32,6 +33,10 @@ DEFINE_int32(port, 7070, "HTTP server port");
 DEFINE_string(dbdir, "/var/data/db", "Database directory");
 DEFINE_bool(recover, false, "Recover databases when loading");
 DEFINE_bool(auto_mount, false, "Automatically mount databases in db dir");
+DEFINE_int32(migration_slice, 1 << 20,
+             "Index slots migrated per second by background index migration");
+DEFINE_int64(compaction_rate, 32 << 20,
+             "Bytes read per second by background data shard compaction");
 
 using namespace sling;
 
@@ -72,6 +77,14 @@ class DBService {
     for (auto &it : mounts_) {
       DBMount *mount = it.second;
       mount->Acquire();
+      if (mount->db.migrating()) {
+        LOG(INFO) << "Completing index migration for " << mount->name;
+        Status st = mount->db.MigrateIndex(-1);
+        if (!st.ok()) {
+          LOG(ERROR) << "Index migration failed for db " << mount->name
+                     << ": " << st;
+        }
+      }
       if (mount->db.dirty()) {
         LOG(INFO) << "Flushing database " << mount->name << " to disk";
         Status st = mount->db.Flush();
@@ -151,6 +164,8 @@ class DBService {
           Unmount(request, response);
         } else if (strcmp(cmd, "backup") == 0) {
           Backup(request, response);
+        } else if (strcmp(cmd, "compact") == 0) {
+          Compact(request, response);
         } else {
           response->SendError(501, nullptr, "Unknown DB command");
         }
@@ -184,7 +199,7 @@ class DBService {
   // Get database record.
   void Get(HTTPRequest *request, HTTPResponse *response, bool body) {
     // Get database and resource from request.
-    DBLock l(this, request->path());
+    DBLock l(this, request->path(), true);
     if (l.mount() == nullptr) {
       response->SendError(404, nullptr, "Database not found");
       return;
@@ -194,7 +209,7 @@ class DBService {
     Record record;
     if (!l.resource().empty()) {
       // Fetch record from database.
-      if (!l.db()->Get(l.resource(), &record, body)) {
+      if (!l.db()->Get(l.resource(), &record, body, l.readers())) {
         response->SendError(404, nullptr, "Record not found");
         return;
       }
@@ -227,7 +242,7 @@ class DBService {
 
       if (batch == 1) {
         // Fetch next record from database.
-        if (!l.db()->Next(&record, &recid)) {
+        if (!l.db()->Next(&record, &recid, l.readers())) {
           response->SendError(404, nullptr, "Record not found");
           return;
         }
@@ -236,7 +251,7 @@ class DBService {
         ReturnSingle(response, record, body, true, timestamped, recid);
       } else {
         // Fetch multiple records.
-        ReturnMultiple(response, l.db(), recid, batch, body);
+        ReturnMultiple(response, l.db(), l.readers(), recid, batch, body);
       }
     }
   }
@@ -272,7 +287,8 @@ class DBService {
   }
 
   // Return multiple records.
-  void ReturnMultiple(HTTPResponse *response, Database *db,
+  void ReturnMultiple(HTTPResponse *response,
+                      Database *db, Database::Readers *readers,
                       uint64 recid, int batch, bool body) {
     string boundary = std::to_string(FingerprintCat(db->epoch(), time(0)));
     Record record;
@@ -280,7 +296,7 @@ class DBService {
     int num_recs = 0;
     for (int n = 0; n < batch; ++n) {
       // Fetch next record.
-      if (!db->Next(&record, &recid)) break;
+      if (!db->Next(&record, &recid, readers)) break;
       next = recid;
       num_recs++;
 
@@ -472,7 +488,7 @@ class DBService {
     }
 
     // Database-specific information.
-    DBLock l(this, request->path());
+    DBLock l(this, request->path(), true);
     if (l.mount() == nullptr) {
       response->SendError(404, nullptr, "Database not found");
       return;
@@ -484,8 +500,12 @@ class DBService {
     AddPair(response, "dbdir", db->dbdir());
     AddBoolPair(response, "dirty", db->dirty());
     AddBoolPair(response, "bulk", db->bulk());
+    AddBoolPair(response, "migrating", db->migrating());
+    AddBoolPair(response, "compacting", db->compacting());
+    AddNumPair(response, "reclaimed", db->reclaimed());
     AddBoolPair(response, "read_only", db->read_only());
     AddBoolPair(response, "timestamped", db->timestamped());
+    AddBoolPair(response, "ordered", db->ordered());
     AddNumPair(response, "records", db->num_records());
     AddNumPair(response, "deletions", db->num_deleted());
     AddNumPair(response, "index_capacity", db->index_capacity(), true);
@@ -613,9 +633,11 @@ class DBService {
       if (client->mount_ == mount) client->mount_ = nullptr;
     }
 
-    // Shut down database.
+    // Shut down database. Any ongoing index migration is completed first to
+    // leave a consistent index on disk.
     LOG(INFO) << "Unmounting database: " << name;
-    Status st = mount->db.Flush();
+    Status st = mount->db.MigrateIndex(-1);
+    if (st.ok()) st = mount->db.Flush();
     if (!st.ok()) {
       LOG(ERROR) << "Error flushing " << mount->name << ": " << st;
     }
@@ -655,6 +677,32 @@ class DBService {
     response->SendError(200, nullptr, "Database backed up");
   }
 
+  // Schedule compaction of database data shards.
+  void Compact(HTTPRequest *request, HTTPResponse *response) {
+    // Get parameters.
+    URLQuery query(request->query());
+    string name = query.Get("name").str();
+    int shard = query.Get("shard", -1);
+
+    // Lock database.
+    DBLock l(this, name);
+    if (l.mount() == nullptr) {
+      response->SendError(404, nullptr, "Database not found");
+      return;
+    }
+
+    // Schedule compaction. The compaction is done in the background by the
+    // monitor thread.
+    Status st = l.db()->ScheduleCompaction(shard);
+    if (!st.ok()) {
+      response->SendError(400, nullptr, st.message());
+      return;
+    }
+
+    LOG(INFO) << "Compaction scheduled for database: " << name;
+    response->SendError(200, nullptr, "Database compaction scheduled");
+  }
+
   // Check that database name is valid.
   static bool ValidDatabaseName(const string &name) {
     if (name.empty() || name.size() > MAX_DBNAME_SIZE) return false;
@@ -676,26 +724,55 @@ class DBService {
       last_update = last_flush = time(0);
     }
 
+    ~DBMount() {
+      for (auto *readers : pool) delete readers;
+    }
+
     // Get exclusive access to mounted database to acquiring the database lock
     // and releasing it again. If the caller is holding the global lock, this
-    // will ensure exclusive access.
+    // will ensure exclusive access. This also waits for the background
+    // compaction to finish copying the current slice.
     void Acquire() {
+      compact_mu.Lock();
+      compact_mu.Unlock();
       mu.Lock();
       mu.Unlock();
     }
 
+    // Get shard readers for concurrent reading from the database.
+    Database::Readers *AcquireReaders() {
+      MutexLock lock(&pool_mu);
+      if (pool.empty()) return new Database::Readers();
+      Database::Readers *readers = pool.back();
+      pool.pop_back();
+      return readers;
+    }
+
+    // Return shard readers to pool.
+    void ReleaseReaders(Database::Readers *readers) {
+      MutexLock lock(&pool_mu);
+      pool.push_back(readers);
+    }
+
     string name;          // database name
     Database db;          // mounted database
-    Mutex mu;             // mutex for serializing access to database
+    SharedMutex mu;       // lock for shared reads and exclusive updates
+    Mutex compact_mu;     // lock held while compacting without database lock
     time_t last_update;   // time of last database update
     time_t last_flush;    // time of last database flush
+
+    // Pool of shard readers for concurrent reads.
+    std::vector<Database::Readers *> pool;
+    Mutex pool_mu;
   };
 
-  // Lock on database.
+  // Lock on database. Read-only requests can use a shared lock, which allows
+  // multiple requests to read from the database concurrently using separate
+  // shard readers. All other requests need an exclusive lock.
   class DBLock {
    public:
     // Look up database from URL path and lock it.
-    DBLock(DBService *dbs, const char *path) {
+    DBLock(DBService *dbs, const char *path, bool shared = false) {
       if (path == nullptr) return;
 
       // Get database name from path.
@@ -711,8 +788,7 @@ class DBService {
       if (f == dbs->mounts_.end()) return;
 
       // Lock database.
-      mount_ = f->second;
-      mount_->mu.Lock();
+      Lock(f->second, shared);
 
       // Get resource name from path.
       if (*p == '/') p++;
@@ -728,28 +804,44 @@ class DBService {
       if (f == dbs->mounts_.end()) return;
 
       // Lock database.
-      mount_ = f->second;
-      mount_->mu.Lock();
+      Lock(f->second, false);
     }
 
     // Lock database.
-    DBLock(DBMount *mount) {
-      mount_ = mount;
-      if (mount_ != nullptr) mount_->mu.Lock();
+    DBLock(DBMount *mount, bool shared = false) {
+      if (mount != nullptr) Lock(mount, shared);
     }
 
     // Unlock database.
     ~DBLock() {
-      if (mount_ != nullptr) mount_->mu.Unlock();
+      if (mount_ != nullptr) {
+        if (readers_ != nullptr) mount_->ReleaseReaders(readers_);
+        mount_->mu.Unlock();
+      }
     }
 
     DBMount *mount() { return mount_; }
     Database *db() { return &mount_->db; }
     const string &resource() { return resource_; }
 
+    // Shard readers for shared lock. This is null for exclusive locks.
+    Database::Readers *readers() { return readers_; }
+
    private:
-    DBMount *mount_ = nullptr;       // database for resource
-    string resource_;                // resource name
+    // Acquire shared or exclusive lock on database.
+    void Lock(DBMount *mount, bool shared) {
+      mount_ = mount;
+      if (shared) {
+        mount_->mu.LockShared();
+        readers_ = mount_->AcquireReaders();
+      } else {
+        mount_->mu.Lock();
+      }
+    }
+
+    DBMount *mount_ = nullptr;                // database for resource
+    string resource_;                         // resource name
+    Database::Readers *readers_ = nullptr;    // shard readers for shared lock
   };
 
   // Database client connection that uses the binary SLINGDB protocol.
@@ -776,45 +868,69 @@ class DBService {
     // Return protocol name.
     const char *Name() override { return "DB"; }
 
-    // Process SLINGDB database request.
+    // Process SLINGDB database requests. All the complete request packets
+    // received are processed, so clients can pipeline requests. The responses
+    // are added to the response body in request order.
     Continuation Process(SocketConnection *conn) override {
-      // Check if we have received a complete header.
       auto *req = conn->request();
-      if (req->available() < sizeof(DBHeader)) return CONTINUE;
-
-      // Check if request body has been received.
-      auto *hdr = DBHeader::from(req->begin());
-      if (req->available() < hdr->size + sizeof(DBHeader)) return CONTINUE;
-
-      // Dispatch request.
-      req->Consume(sizeof(DBHeader));
-      if (req->available() != hdr->size) return TERMINATE;
-      Continuation cont = TERMINATE;
-      switch (hdr->verb) {
-        case DBUSE: cont = Use(); break;
-        case DBGET: cont = Get(); break;
-        case DBPUT: cont = Put(); break;
-        case DBDELETE: cont = Delete(); break;
-        case DBNEXT: cont = Next(); break;
-        case DBBULK: cont = Bulk(); break;
-        case DBEPOCH: cont = Epoch(); break;
-        default: return Error("command verb not supported");
+      bool processed = false;
+      for (;;) {
+        // Check if we have received a complete header.
+        if (req->available() < sizeof(DBHeader)) break;
+
+        // Check if request body has been received.
+        auto *hdr = DBHeader::from(req->begin());
+        if (req->available() < hdr->size + sizeof(DBHeader)) break;
+
+        // Move request packet into request buffer.
+        uint32 verb = hdr->verb;
+        uint32 size = hdr->size;
+        req->Consume(sizeof(DBHeader));
+        request_.Clear();
+        request_.Copy(req, size);
+
+        // Get request id for tagged request.
+        tagged_ = (verb & DBTAGGED) != 0;
+        verb &= ~DBTAGGED;
+        if (tagged_ && !request_.Read(&reqid_, 8)) return TERMINATE;
+
+        // Add response header. The header is filled in when the response is
+        // complete.
+        auto *rsp = conn->response_body();
+        response_start_ = rsp->available();
+        rsp->append<DBHeader>();
+        if (tagged_) rsp->Write(&reqid_, 8);
+
+        // Dispatch request.
+        Continuation cont = TERMINATE;
+        switch (verb) {
+          case DBUSE: cont = Use(); break;
+          case DBGET: cont = Get(); break;
+          case DBPUT: cont = Put(); break;
+          case DBDELETE: cont = Delete(); break;
+          case DBNEXT: cont = Next(); break;
+          case DBBULK: cont = Bulk(); break;
+          case DBEPOCH: cont = Epoch(); break;
+          case DBSCAN: cont = Scan(false); break;
+          case DBPREFIX: cont = Scan(true); break;
+          default: cont = Error("command verb not supported");
+        }
+        if (cont != RESPOND) return cont;
+        processed = true;
       }
 
-      // Make sure the whole request has been consumed.
-      if (req->available() > 0) req->Consume(req->available());
-
-      return cont;
+      return processed ? RESPOND : CONTINUE;
     }
 
     // Switch to using another database.
     Continuation Use() {
-      auto *req = conn_->request();
+      auto *req = &request_;
       int namelen = req->available();
       string dbname(req->Consume(namelen), namelen);
       DBLock l(dbs_, dbname);
       if (l.mount() == nullptr) return Error("database not found");
       mount_ = l.mount();
+      compactions_ = l.db()->compactions();
 
       return Response(DBOK);
     }
@@ -823,7 +939,7 @@ class DBService {
     Continuation Bulk() {
       if (mount_ == nullptr) return Error("no database");
       DBLock l(mount_);
-      auto *req = conn_->request();
+      auto *req = &request_;
       uint32 enable;
       if (!req->Read(&enable, 4)) return TERMINATE;
 
@@ -842,22 +958,32 @@ class DBService {
     // Get record(s) from database.
     Continuation Get() {
       if (mount_ == nullptr) return Error("no database");
-      DBLock l(mount_);
-      auto *req = conn_->request();
+      DBLock l(mount_, true);
+      auto *req = &request_;
+
+      // Read keys for records.
+      std::vector<Slice> keys;
       while (!req->empty()) {
-        // Read key for next record.
         Slice key;
         if (!ReadKey(&key)) return TERMINATE;
+        keys.push_back(key);
+      }
 
-        // Read record from database.
-        Record record;
-        if (!l.db()->Get(key, &record)) {
-          // Return empty value if record is not found.
-          record.key = key;
-          record.value.clear();
+      // Read records from database. Records that are not found are returned
+      // with empty values.
+      std::vector<Record> records;
+      if (keys.size() == 1) {
+        records.resize(1);
+        if (!l.db()->Get(keys[0], &records[0], true, l.readers())) {
+          records[0].key = keys[0];
+          records[0].value.clear();
         }
+      } else {
+        l.db()->Get(keys, &records, l.readers());
+      }
 
-        // Add record to response.
+      // Add records to response.
+      for (const Record &record : records) {
         WriteRecord(record);
       }
 
@@ -868,7 +994,7 @@ class DBService {
     Continuation Put() {
       if (mount_ == nullptr) return Error("no database");
       DBLock l(mount_);
-      auto *req = conn_->request();
+      auto *req = &request_;
       auto *rsp = conn_->response_body();
 
       DBMode mode;
@@ -902,7 +1028,7 @@ class DBService {
     Continuation Delete() {
       if (mount_ == nullptr) return Error("no database");
       DBLock l(mount_);
-      auto *req = conn_->request();
+      auto *req = &request_;
       while (!req->empty()) {
         // Read next key.
         Slice key;
@@ -919,8 +1045,8 @@ class DBService {
     // Retrieve the next record(s) for a cursor.
     Continuation Next() {
       if (mount_ == nullptr) return Error("no database");
-      DBLock l(mount_);
-      auto *req = conn_->request();
+      DBLock l(mount_, true);
+      auto *req = &request_;
       auto *rsp = conn_->response_body();
 
       uint64 iterator;
@@ -928,10 +1054,17 @@ class DBService {
       uint32 num;
       if (!req->Read(&num, 4)) return TERMINATE;
 
+      // Cursor positions in a shard are no longer valid after the shard has
+      // been compacted.
+      if (iterator != 0 && l.db()->Compacted(iterator, compactions_)) {
+        return Error("cursor invalidated by compaction");
+      }
+      compactions_ = l.db()->compactions();
+
       Record record;
       for (int n = 0; n < num; ++n) {
         // Fetch next record.
-        if (!l.db()->Next(&record, &iterator)) {
+        if (!l.db()->Next(&record, &iterator, l.readers())) {
           if (n == 0) return Response(DBDONE);
           break;
         }
@@ -948,36 +1081,84 @@ class DBService {
     // Return current epoch for database.
     Continuation Epoch() {
       if (mount_ == nullptr) return Error("no database");
-      DBLock l(mount_);
+      DBLock l(mount_, true);
       uint64 epoch = l.db()->epoch();
       conn_->response_body()->Write(&epoch, 8);
       return Response(DBRECID);
     }
 
+    // Retrieve record(s) in key order for key range or key prefix.
+    Continuation Scan(bool prefix) {
+      if (mount_ == nullptr) return Error("no database");
+      DBLock l(mount_, true);
+      const DatabaseKeys *keys = l.db()->keys();
+      if (keys == nullptr) return Error("database not ordered");
+
+      // Get key range.
+      Slice start, end;
+      if (prefix) {
+        if (!ReadKey(&end)) return TERMINATE;
+        if (!ReadKey(&start)) return TERMINATE;
+        if (start < end) start = end;
+      } else {
+        if (!ReadKey(&start)) return TERMINATE;
+        if (!ReadKey(&end)) return TERMINATE;
+      }
+      uint32 num;
+      if (!request_.Read(&num, 4)) return TERMINATE;
+
+      // Look up records for keys in range.
+      DatabaseKeys::Iterator it(keys);
+      Record record;
+      int n = 0;
+      for (it.Seek(start); it.Valid() && n < num; it.Next()) {
+        // Check for end of range.
+        Slice key = it.key();
+        if (prefix) {
+          if (!key.starts_with(end)) break;
+        } else {
+          if (!end.empty() && !(key < end)) break;
+        }
+
+        // Add record to response.
+        if (!l.db()->Get(key, &record, true, l.readers())) continue;
+        WriteRecord(record);
+        n++;
+      }
+
+      return Response(n == 0 ? DBDONE : DBRECORD);
+    }
+
     // Return error message to client.
     Continuation Error(const char *msg) {
       // Clear existing (partial) response.
-      conn_->response_header()->Clear();
-      conn_->response_body()->Clear();
+      auto *rsp = conn_->response_body();
+      rsp->Unwrite(rsp->available() - response_start_ - ResponseHeaderSize());
 
       // Return error message.
       int msgsize = strlen(msg);
-      conn_->response_body()->Write(msg, msgsize);
+      rsp->Write(msg, msgsize);
 
       return Response(DBERROR);
     }
 
-    // Add header to response.
+    // Fill in header for response.
     Continuation Response(DBVerb verb) {
-      DBHeader *hdr = conn_->response_header()->append<DBHeader>();
-      hdr->verb = verb;
-      hdr->size = conn_->response_body()->available();
+      auto *rsp = conn_->response_body();
+      DBHeader *hdr = DBHeader::from(rsp->begin() + response_start_);
+      hdr->verb = tagged_ ? static_cast<DBVerb>(verb | DBTAGGED) : verb;
+      hdr->size = rsp->available() - response_start_ - sizeof(DBHeader);
       return RESPOND;
     }
 
+    // Size of response header including request id for tagged requests.
+    int ResponseHeaderSize() const {
+      return sizeof(DBHeader) + (tagged_ ? 8 : 0);
+    }
+
     // Read key from request.
     bool ReadKey(Slice *key) {
-      auto *req = conn_->request();
+      auto *req = &request_;
       uint32 len;
       if (!req->Read(&len, 4)) return false;
       if (req->available() < len) return false;
@@ -988,7 +1169,7 @@ class DBService {
     // Read record from request.
     bool ReadRecord(Record *record) {
       // Read key size with version bit.
-      auto *req = conn_->request();
+      auto *req = &request_;
       uint32 ksize;
       if (!req->Read(&ksize, 4)) return false;
       bool has_version = ksize & 1;
@@ -1037,6 +1218,13 @@ class DBService {
     DBService *dbs_;                // database server
     SocketConnection *conn_;        // client connection
     DBMount *mount_ = nullptr;      // active database for client
+    uint64 compactions_ = 0;        // compactions when cursor was last used
+
+    // Current request packet.
+    IOBuffer request_;              // request body
+    bool tagged_ = false;           // request is tagged with request id
+    uint64 reqid_ = 0;              // request id for tagged request
+    size_t response_start_ = 0;     // start of response in response body
 
     // Client list.
     DBClient *next_;
@@ -1055,6 +1243,23 @@ class DBService {
       sleep(1);
       if (terminate_) return;
 
+      // Migrate index entries for databases that are expanding their index.
+      // This is done in slices to avoid blocking readers for long periods.
+      mu_.Lock();
+      for (auto &it : mounts_) {
+        DBMount *m = it.second;
+        if (!m->db.migrating()) continue;
+        DBLock l(m);
+        Status st = m->db.MigrateIndex(FLAGS_migration_slice);
+        if (!st.ok()) {
+          LOG(ERROR) << "Index migration failed for " << m->name << ": " << st;
+        }
+      }
+      mu_.Unlock();
+
+      // Compact data shards in the background.
+      Compact();
+
       // Find next database that needs to be flushed.
       mu_.Lock();
       time_t now = time(0);
@@ -1093,6 +1298,53 @@ class DBService {
     }
   }};
 
+  // Copy the next slice of live records for a database that is being
+  // compacted. The records are copied without holding the database lock, which
+  // is only held briefly for checking batches of records against the index, so
+  // neither readers nor writers are blocked. The exclusive lock is only needed
+  // for committing the compacted shard.
+  void Compact() {
+    // Find database that is being compacted.
+    mu_.Lock();
+    DBMount *mount = nullptr;
+    for (auto &it : mounts_) {
+      if (it.second->db.compacting()) {
+        mount = it.second;
+        break;
+      }
+    }
+    if (mount == nullptr) {
+      mu_.Unlock();
+      return;
+    }
+
+    // Copy live records. The compaction lock keeps the database from being
+    // unmounted while copying.
+    bool ready = false;
+    {
+      MutexLock compact(&mount->compact_mu);
+      mu_.Unlock();
+      Status st = mount->db.Compact(FLAGS_compaction_rate, &mount->mu, &ready);
+      if (!st.ok()) {
+        LOG(ERROR) << "Compaction failed for " << mount->name << ": " << st;
+        return;
+      }
+    }
+    if (!ready) return;
+
+    // Commit compacted shard unless the database has been unmounted.
+    MutexLock lock(&mu_);
+    for (auto &it : mounts_) {
+      if (it.second != mount) continue;
+      DBLock l(mount);
+      Status st = mount->db.CommitCompaction();
+      if (!st.ok()) {
+        LOG(ERROR) << "Compaction failed for " << mount->name << ": " << st;
+      }
+      mount->last_flush = time(0);
+    }
+  }
+
   // Mounted databases.
   std::unordered_map<string, DBMount *> mounts_;
 
@@ -335,6 +335,10 @@ void *File::MapMemory(uint64 pos, size_t size, bool writable) {
   return nullptr;
 }
 
+void *File::MapCopyOnWrite(uint64 pos, size_t size) {
+  return nullptr;
+}
+
 Status File::FlushMappedMemory(void *data, size_t size) {
   if (default_file_system == nullptr) return NoFileSystem("mmunmap");
   return default_file_system->FlushMappedMemory(data, size);
@@ -75,6 +75,11 @@ class File {
   // Map file region into memory. Return null on error or if not supported.
   virtual void *MapMemory(uint64 pos, size_t size, bool writable = false);
 
+  // Map file region copy-on-write into memory. The pages are shared with the
+  // page cache and are only read in on demand until they are modified. Return
+  // null on error or if not supported.
+  virtual void *MapCopyOnWrite(uint64 pos, size_t size);
+
   // Resize file.
   virtual Status Resize(uint64 size) = 0;
 
@@ -108,6 +113,10 @@ class File {
   // Return the file name.
   virtual string filename() const = 0;
 
+  // Return the operating system file descriptor for the file, or -1 if the
+  // file is not backed by a file descriptor.
+  virtual int descriptor() const { return -1; }
+
   // Initialize file systems. This can be called multiple times.
   static void Init();
 
@@ -120,6 +120,12 @@ class PosixFile : public File {
     return mapping == MAP_FAILED ? nullptr : mapping;
   }
 
+  void *MapCopyOnWrite(uint64 pos, size_t size) override {
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                         fd_, pos);
+    return mapping == MAP_FAILED ? nullptr : mapping;
+  }
+
   Status Resize(uint64 size) override {
     if (ftruncate(fd_, size) == -1) return IOError(filename_, errno);
     return Status::OK;
@@ -182,6 +188,8 @@ class PosixFile : public File {
 
   string filename() const override { return filename_; }
 
+  int descriptor() const override { return fd_; }
+
  private:
   // File descriptor.
   int fd_;
@@ -15,14 +15,29 @@
 #include "sling/file/recordio.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "sling/base/logging.h"
 #include "sling/base/types.h"
 #include "sling/util/fingerprint.h"
+#include "sling/util/mutex.h"
 #include "sling/util/snappy.h"
+#include "sling/util/threadpool.h"
 #include "sling/util/varint.h"
 
+#ifdef SLING_ZSTD_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
 namespace sling {
 
 namespace {
@@ -82,8 +97,430 @@ class BufferSink : public snappy::Sink {
   IOBuffer *buffer_;
 };
 
+// The zstd and lz4 compressed record values are prefixed with the uncompressed
+// size like for snappy, so the size of the record value can be determined
+// without decompressing it.
+const char *ReadUncompressedSize(const Slice &data, uint32 *size) {
+  return Varint::Parse32WithLimit(data.data(), data.data() + data.size(),
+                                  size);
+}
+
+#ifdef SLING_ZSTD_LZ4
+void WriteUncompressedSize(uint32 size, IOBuffer *output) {
+  output->Ensure(Varint::kMax32);
+  char *end = Varint::Encode32(output->end(), size);
+  output->Append(end - output->end());
+}
+
+// Compress data with lz4. Positive compression levels use the high
+// compression mode.
+Status LZ4Compress(const Slice &input, int level, IOBuffer *output) {
+  WriteUncompressedSize(input.size(), output);
+  if (input.empty()) return Status::OK;
+  int bound = LZ4_compressBound(input.size());
+  output->Ensure(bound);
+  int n;
+  if (level > 0) {
+    n = LZ4_compress_HC(input.data(), output->end(), input.size(), bound,
+                        level);
+  } else {
+    n = LZ4_compress_default(input.data(), output->end(), input.size(), bound);
+  }
+  if (n <= 0) return Status(1, "lz4 compression failed");
+  output->Append(n);
+  return Status::OK;
+}
+
+// Decompress lz4 compressed data.
+Status LZ4Decompress(const Slice &input, IOBuffer *output) {
+  uint32 size;
+  const char *data = ReadUncompressedSize(input, &size);
+  if (data == nullptr) return Status(1, "Corrupt lz4 compressed record");
+  if (size == 0) return Status::OK;
+  int compressed_size = input.data() + input.size() - data;
+  output->Ensure(size);
+  int n = LZ4_decompress_safe(data, output->end(), compressed_size, size);
+  if (n != size) return Status(1, "Corrupt lz4 compressed record");
+  output->Append(n);
+  return Status::OK;
+}
+
+#else
+
+// The zstd and lz4 codecs are only available when building with
+// --define zstd_lz4=1.
+Status CodecNotSupported(const char *codec) {
+  return Status(1, codec, " compression not supported in this build");
+}
+
+Status LZ4Compress(const Slice &input, int level, IOBuffer *output) {
+  return CodecNotSupported("lz4");
+}
+
+Status LZ4Decompress(const Slice &input, IOBuffer *output) {
+  return CodecNotSupported("lz4");
+}
+
+#endif
+
+// Read data at position in file until all the requested data has been read.
+Status PReadFully(File *file, uint64 pos, char *data, size_t size) {
+  while (size > 0) {
+    uint64 read;
+    Status st = file->PRead(pos, data, size, &read);
+    if (!st.ok()) return st;
+    if (read == 0) return Status(1, "Record file truncated");
+    pos += read;
+    data += read;
+    size -= read;
+  }
+  return Status::OK;
+}
+
 }  // namespace
 
+#ifdef SLING_ZSTD_LZ4
+// Compression context for zstd compression. The contexts are reused across
+// records, and the dictionary is only digested once. Decompression is
+// thread-safe; each decompression borrows a context from a pool of contexts.
+class RecordFile::ZstdCodec {
+ public:
+  ZstdCodec(int level, const string &dictionary)
+      : level_(level), dictionary_(dictionary) {}
+
+  ~ZstdCodec() {
+    ZSTD_freeCCtx(cctx_);
+    for (ZSTD_DCtx *dctx : dctxs_) ZSTD_freeDCtx(dctx);
+    ZSTD_freeCDict(cdict_);
+    ZSTD_freeDDict(ddict_);
+  }
+
+  // Compress data and append it to output buffer.
+  Status Compress(const Slice &input, IOBuffer *output) {
+    if (cctx_ == nullptr) {
+      cctx_ = ZSTD_createCCtx();
+      if (!dictionary_.empty()) {
+        cdict_ = ZSTD_createCDict(dictionary_.data(), dictionary_.size(),
+                                  level_);
+      }
+    }
+
+    WriteUncompressedSize(input.size(), output);
+    if (input.empty()) return Status::OK;
+    size_t bound = ZSTD_compressBound(input.size());
+    output->Ensure(bound);
+    size_t n;
+    if (cdict_ != nullptr) {
+      n = ZSTD_compress_usingCDict(cctx_, output->end(), bound,
+                                   input.data(), input.size(), cdict_);
+    } else {
+      n = ZSTD_compressCCtx(cctx_, output->end(), bound,
+                            input.data(), input.size(), level_);
+    }
+    if (ZSTD_isError(n)) {
+      return Status(1, "zstd compression failed: ", ZSTD_getErrorName(n));
+    }
+    output->Append(n);
+    return Status::OK;
+  }
+
+  // Decompress data and append it to output buffer.
+  Status Decompress(const Slice &input, IOBuffer *output) {
+    // Get decompression context from pool.
+    ZSTD_DCtx *dctx = nullptr;
+    {
+      MutexLock lock(&mu_);
+      if (ddict_ == nullptr && !dictionary_.empty()) {
+        ddict_ = ZSTD_createDDict(dictionary_.data(), dictionary_.size());
+      }
+      if (!dctxs_.empty()) {
+        dctx = dctxs_.back();
+        dctxs_.pop_back();
+      }
+    }
+    if (dctx == nullptr) dctx = ZSTD_createDCtx();
+
+    // Decompress data and return context to pool.
+    Status st = Decompress(dctx, input, output);
+    MutexLock lock(&mu_);
+    dctxs_.push_back(dctx);
+    return st;
+  }
+
+  // Compression dictionary.
+  const string &dictionary() const { return dictionary_; }
+
+ private:
+  // Decompress data using decompression context.
+  Status Decompress(ZSTD_DCtx *dctx, const Slice &input, IOBuffer *output) {
+    uint32 size;
+    const char *data = ReadUncompressedSize(input, &size);
+    if (data == nullptr) return Status(1, "Corrupt zstd compressed record");
+    if (size == 0) return Status::OK;
+    size_t compressed_size = input.data() + input.size() - data;
+    output->Ensure(size);
+    size_t n;
+    if (ddict_ != nullptr) {
+      n = ZSTD_decompress_usingDDict(dctx, output->end(), size,
+                                     data, compressed_size, ddict_);
+    } else {
+      n = ZSTD_decompressDCtx(dctx, output->end(), size,
+                              data, compressed_size);
+    }
+    if (ZSTD_isError(n) || n != size) {
+      return Status(1, "Corrupt zstd compressed record");
+    }
+    output->Append(n);
+    return Status::OK;
+  }
+
+  int level_;
+  string dictionary_;
+  ZSTD_CCtx *cctx_ = nullptr;
+  ZSTD_CDict *cdict_ = nullptr;
+  ZSTD_DDict *ddict_ = nullptr;
+
+  // Pool of decompression contexts.
+  std::vector<ZSTD_DCtx *> dctxs_;
+  Mutex mu_;
+};
+
+#else
+
+class RecordFile::ZstdCodec {
+ public:
+  ZstdCodec(int level, const string &dictionary) : dictionary_(dictionary) {}
+
+  Status Compress(const Slice &input, IOBuffer *output) {
+    return CodecNotSupported("zstd");
+  }
+
+  Status Decompress(const Slice &input, IOBuffer *output) {
+    return CodecNotSupported("zstd");
+  }
+
+  const string &dictionary() const { return dictionary_; }
+
+ private:
+  string dictionary_;
+};
+
+#endif
+
+// Prefetcher for reading records in read-ahead mode. Records never cross chunk
+// boundaries, so each chunk of the record file can be read and decoded
+// independently of the other chunks. The next chunks are read and their record
+// values decompressed by a pool of worker threads, while the records in the
+// current chunk are returned to the reader in file order.
+class RecordReader::Prefetcher {
+ public:
+  Prefetcher(RecordReader *reader, int chunks, int threads)
+      : reader_(reader), max_chunks_(chunks), pool_(threads, chunks) {
+    pool_.StartWorkers();
+  }
+
+  ~Prefetcher() { Stop(); }
+
+  // Check if chunks are being prefetched.
+  bool active() const { return active_; }
+
+  // Read next record from the prefetched chunks. Prefetching starts at the
+  // current position of the reader.
+  Status Read(Record *record);
+
+  // Wait for outstanding chunks and discard all prefetched chunks.
+  void Stop();
+
+ private:
+  // Record in decoded chunk. The key is stored in the chunk data and the value
+  // is stored in either the chunk data or the decompressed data for the chunk.
+  struct Entry {
+    RecordType type;
+    uint64 version;
+    uint64 position;     // position of record in file
+    uint64 end;          // position after record in file
+    size_t key;          // offset of key in chunk data
+    size_t key_size;     // key size
+    size_t value;        // offset of value in chunk or decompressed data
+    size_t value_size;   // (decompressed) value size
+  };
+
+  // Chunk of records prefetched from the file.
+  struct Chunk {
+    uint64 start;                 // position of chunk in file
+    uint64 end;                   // position of end of chunk in file
+    string data;                  // chunk data read from file
+    IOBuffer decompressed;        // decompressed record values
+    std::vector<Entry> entries;   // records in chunk
+    size_t next = 0;              // next record to return from chunk
+    Status status;                // status for reading and decoding chunk
+    bool ready = false;           // chunk has been read and decoded
+  };
+
+  // Schedule more chunks for prefetching.
+  void Schedule();
+
+  // Read chunk from file and decode records. This is run by the workers.
+  void Decode(Chunk *chunk);
+  Status Load(Chunk *chunk);
+
+  // Record reader for file.
+  RecordReader *reader_;
+
+  // Maximum number of prefetched chunks.
+  size_t max_chunks_;
+
+  // Worker threads for reading and decoding chunks.
+  ThreadPool pool_;
+
+  // Prefetched chunks in file order. This is only accessed by the reader.
+  std::deque<Chunk *> chunks_;
+
+  // Position of next chunk to prefetch.
+  uint64 next_ = 0;
+
+  // Chunks are being prefetched.
+  bool active_ = false;
+
+  // Mutex and signal for decoded chunks.
+  Mutex mu_;
+  std::condition_variable ready_;
+};
+
+Status RecordReader::Prefetcher::Read(Record *record) {
+  // Start prefetching from the current position.
+  if (!active_) {
+    next_ = reader_->position_;
+    active_ = true;
+    Schedule();
+  }
+
+  while (!chunks_.empty()) {
+    // Wait until the next chunk has been decoded.
+    Chunk *chunk = chunks_.front();
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      ready_.wait(lock, [chunk]() { return chunk->ready; });
+    }
+    if (!chunk->status.ok()) return chunk->status;
+
+    // Return next record in chunk.
+    if (chunk->next < chunk->entries.size()) {
+      const Entry &entry = chunk->entries[chunk->next++];
+      const char *values = reader_->info_.compression == UNCOMPRESSED
+                               ? chunk->data.data()
+                               : chunk->decompressed.begin();
+      record->type = entry.type;
+      record->version = entry.version;
+      record->position = entry.position;
+      record->key = Slice(chunk->data.data() + entry.key, entry.key_size);
+      record->value = Slice(values + entry.value, entry.value_size);
+      reader_->position_ = entry.end;
+      return Status::OK;
+    }
+
+    // Discard the consumed chunk and prefetch the next chunk.
+    reader_->position_ = chunk->end;
+    chunks_.pop_front();
+    delete chunk;
+    Schedule();
+  }
+
+  return Status(1, "No more records");
+}
+
+void RecordReader::Prefetcher::Stop() {
+  // Wait for workers to complete the outstanding chunks.
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (Chunk *chunk : chunks_) {
+      ready_.wait(lock, [chunk]() { return chunk->ready; });
+    }
+  }
+
+  for (Chunk *chunk : chunks_) delete chunk;
+  chunks_.clear();
+  active_ = false;
+}
+
+void RecordReader::Prefetcher::Schedule() {
+  uint64 chunk_size = reader_->info_.chunk_size;
+  uint64 size = reader_->size_;
+  while (chunks_.size() < max_chunks_ && next_ < size) {
+    Chunk *chunk = new Chunk();
+    chunk->start = next_;
+    chunk->end = std::min((next_ / chunk_size + 1) * chunk_size, size);
+    next_ = chunk->end;
+    chunks_.push_back(chunk);
+    pool_.Schedule([this, chunk]() { Decode(chunk); });
+  }
+}
+
+void RecordReader::Prefetcher::Decode(Chunk *chunk) {
+  Status st = Load(chunk);
+  MutexLock lock(&mu_);
+  chunk->status = st;
+  chunk->ready = true;
+  ready_.notify_all();
+}
+
+Status RecordReader::Prefetcher::Load(Chunk *chunk) {
+  // Read chunk from file. The chunk data is zero-padded so the record headers
+  // can be parsed without checking for the end of the chunk.
+  size_t size = chunk->end - chunk->start;
+  chunk->data.resize(size + MAX_HEADER_LEN);
+  char *data = &chunk->data[0];
+  Status st = PReadFully(reader_->file_, chunk->start, data, size);
+  if (!st.ok()) return st;
+
+  // Decode records in chunk.
+  bool compressed = reader_->info_.compression != UNCOMPRESSED;
+  size_t offset = 0;
+  while (offset < size) {
+    // Read record header.
+    Header hdr;
+    ssize_t hdrsize = ReadHeader(data + offset, &hdr);
+    if (hdrsize < 0) return Status(1, "Corrupt record header");
+
+    // Skip filler and dictionary records.
+    if (hdr.record_type == FILLER_RECORD) {
+      if (hdr.record_size == 0) return Status(1, "Corrupt filler record");
+      offset += hdr.record_size;
+      continue;
+    } else if (hdr.record_type == DICTIONARY_RECORD) {
+      offset += hdrsize + hdr.record_size;
+      continue;
+    }
+    if (offset + hdrsize + hdr.record_size > size) {
+      return Status(1, "Record truncated");
+    }
+
+    Entry entry;
+    entry.type = hdr.record_type;
+    entry.version = hdr.version;
+    entry.position = chunk->start + offset;
+    entry.key = offset + hdrsize;
+    entry.key_size = hdr.key_size;
+    offset += hdrsize + hdr.record_size;
+    entry.end = chunk->start + offset;
+
+    // Decompress record value.
+    entry.value = entry.key + hdr.key_size;
+    entry.value_size = hdr.record_size - hdr.key_size;
+    if (compressed) {
+      IOBuffer *output = &chunk->decompressed;
+      Slice value(data + entry.value, entry.value_size);
+      entry.value = output->available();
+      Status st = reader_->Decompress(value, output);
+      if (!st.ok()) return st;
+      entry.value_size = output->available() - entry.value;
+    }
+    chunk->entries.push_back(entry);
+  }
+
+  return Status::OK;
+}
+
 RecordFile::IndexPage::IndexPage(uint64 pos, const Slice &data) {
   position = pos;
   size_t bytes = data.size();
@@ -165,6 +602,32 @@ size_t RecordFile::WriteHeader(const Header &header, char *data) {
   return p - data;
 }
 
+Status RecordFile::TrainDictionary(const std::vector<string> &samples,
+                                   size_t size, string *dictionary) {
+#ifdef SLING_ZSTD_LZ4
+  // Concatenate samples.
+  string data;
+  std::vector<size_t> sizes;
+  for (const string &sample : samples) {
+    data.append(sample);
+    sizes.push_back(sample.size());
+  }
+
+  // Train dictionary.
+  dictionary->resize(size);
+  size_t n = ZDICT_trainFromBuffer(&(*dictionary)[0], size, data.data(),
+                                   sizes.data(), sizes.size());
+  if (ZDICT_isError(n)) {
+    dictionary->clear();
+    return Status(1, "Dictionary training failed: ", ZDICT_getErrorName(n));
+  }
+  dictionary->resize(n);
+  return Status::OK;
+#else
+  return CodecNotSupported("zstd");
+#endif
+}
+
 RecordReader::RecordReader(File *file,
                            const RecordFileOptions &options,
                            bool owned)
@@ -195,6 +658,29 @@ RecordReader::RecordReader(File *file,
   } else {
     CHECK(file_->GetSize(&size_));
   }
+
+  // Read compression dictionary.
+  string dictionary;
+  if (info_.flags & DICTIONARY) {
+    CHECK(Fill(MAX_HEADER_LEN));
+    Header hdr;
+    ssize_t hdrsize = ReadHeader(input_.begin(), &hdr);
+    CHECK(hdrsize > 0 && hdr.record_type == DICTIONARY_RECORD)
+        << "Compression dictionary missing: " << file->filename();
+    input_.Consume(hdrsize);
+    CHECK(Ensure(hdr.record_size));
+    dictionary.assign(input_.Consume(hdr.record_size), hdr.record_size);
+    position_ += hdrsize + hdr.record_size;
+  }
+
+  // Set up decompression.
+  if (info_.compression == ZSTD) zstd_ = new ZstdCodec(0, dictionary);
+
+  // Set up read-ahead. This requires that records do not cross chunks.
+  if (options.prefetch_chunks > 0 && info_.chunk_size > 0) {
+    prefetcher_ = new Prefetcher(this, options.prefetch_chunks,
+                                 options.prefetch_threads);
+  }
 }
 
 RecordReader::RecordReader(const string &filename,
@@ -209,9 +695,17 @@ RecordReader::RecordReader(const string &filename)
 
 RecordReader::~RecordReader() {
   CHECK(Close());
+  delete prefetcher_;
+  delete zstd_;
+}
+
+const string &RecordReader::dictionary() const {
+  static const string empty;
+  return zstd_ != nullptr ? zstd_->dictionary() : empty;
 }
 
 Status RecordReader::Close() {
+  if (prefetcher_ != nullptr) prefetcher_->Stop();
   if (owned_ && file_) {
     Status s = file_->Close();
     file_ = nullptr;
@@ -220,6 +714,13 @@ Status RecordReader::Close() {
   return Status::OK;
 }
 
+Status RecordReader::StopPrefetch() {
+  prefetcher_->Stop();
+  input_.Clear();
+  readahead_ = false;
+  return file_->Seek(position_);
+}
+
 Status RecordReader::Fill(uint64 needed) {
   // Flush input buffer to make room for more data.
   input_.Flush();
@@ -262,7 +763,35 @@ Status RecordReader::Ensure(uint64 size) {
   return Status::OK;
 }
 
+Status RecordReader::Decompress(const Slice &data, IOBuffer *output) const {
+  switch (info_.compression) {
+    case SNAPPY: {
+      snappy::ByteArraySource source(data.data(), data.size());
+      BufferSink sink(output);
+      if (!snappy::Uncompress(&source, &sink)) {
+        return Status(1, "Corrupt snappy compressed record");
+      }
+      return Status::OK;
+    }
+    case ZSTD:
+      return zstd_->Decompress(data, output);
+    case LZ4:
+      return LZ4Decompress(data, output);
+    default:
+      return Status(1, "Unknown compression type");
+  }
+}
+
 Status RecordReader::Read(Record *record) {
+  // Read prefetched records in read-ahead mode.
+  if (prefetcher_ != nullptr) {
+    if (position_ < size_) return prefetcher_->Read(record);
+    if (prefetcher_->active()) {
+      Status s = StopPrefetch();
+      if (!s.ok()) return s;
+    }
+  }
+
   for (;;) {
     // Fill input buffer if it is nearly empty.
     if (input_.available() < MAX_HEADER_LEN) {
@@ -275,11 +804,15 @@ Status RecordReader::Read(Record *record) {
     ssize_t hdrsize = ReadHeader(input_.begin(), &hdr);
     if (hdrsize < 0) return Status(1, "Corrupt record header");
 
-    // Skip filler records.
+    // Skip filler and dictionary records.
     if (hdr.record_type == FILLER_RECORD) {
       Status s = Skip(hdr.record_size);
       if (!s.ok()) return s;
       continue;
+    } else if (hdr.record_type == DICTIONARY_RECORD) {
+      Status s = Skip(hdrsize + hdr.record_size);
+      if (!s.ok()) return s;
+      continue;
     } else {
       input_.Consume(hdrsize);
       record->position = position_;
@@ -301,17 +834,15 @@ Status RecordReader::Read(Record *record) {
 
     // Get record value.
     size_t value_size = hdr.record_size - hdr.key_size;
-    if (info_.compression == SNAPPY) {
+    if (info_.compression == UNCOMPRESSED) {
+      record->value = Slice(input_.Consume(value_size), value_size);
+    } else {
       // Decompress record value.
       buffer_.Clear();
-      snappy::ByteArraySource source(input_.Consume(value_size), value_size);
-      BufferSink sink(&buffer_);
-      CHECK(snappy::Uncompress(&source, &sink));
+      Slice data(input_.Consume(value_size), value_size);
+      Status s = Decompress(data, &buffer_);
+      if (!s.ok()) return s;
       record->value = buffer_.data();
-    } else if (info_.compression == UNCOMPRESSED) {
-      record->value = Slice(input_.Consume(value_size), value_size);
-    } else {
-      return Status(1, "Unknown compression type");
     }
 
     position_ += hdr.record_size;
@@ -322,6 +853,15 @@ Status RecordReader::Read(Record *record) {
 }
 
 Status RecordReader::ReadKey(Record *record) {
+  // Read prefetched records in read-ahead mode.
+  if (prefetcher_ != nullptr) {
+    if (position_ < size_) return prefetcher_->Read(record);
+    if (prefetcher_->active()) {
+      Status s = StopPrefetch();
+      if (!s.ok()) return s;
+    }
+  }
+
   for (;;) {
     // Fill input buffer if it is nearly empty.
     if (input_.available() < MAX_HEADER_LEN) {
@@ -334,11 +874,15 @@ Status RecordReader::ReadKey(Record *record) {
     ssize_t hdrsize = ReadHeader(input_.begin(), &hdr);
     if (hdrsize < 0) return Status(1, "Corrupt record header");
 
-    // Skip filler records.
+    // Skip filler and dictionary records.
     if (hdr.record_type == FILLER_RECORD) {
       Status s = Skip(hdr.record_size);
       if (!s.ok()) return s;
       continue;
+    } else if (hdr.record_type == DICTIONARY_RECORD) {
+      Status s = Skip(hdrsize + hdr.record_size);
+      if (!s.ok()) return s;
+      continue;
     } else {
       input_.Consume(hdrsize);
       record->position = position_;
@@ -379,6 +923,19 @@ Status RecordReader::ReadKey(Record *record) {
         // Skip remaining part of record value.
         s = Skip(value_size - l);
         if (!s.ok()) return s;
+      } else if (info_.compression == ZSTD || info_.compression == LZ4) {
+        // Get decompressed length from the size prefix and skip the value.
+        size_t l = Varint::kMax32;
+        if (l > value_size) l = value_size;
+        Status s = Ensure(l);
+        if (!s.ok()) return s;
+        uint32 size;
+        if (ReadUncompressedSize(Slice(input_.begin(), l), &size) == nullptr) {
+          return Status(1, "Corrupt record value");
+        }
+        vsize = size;
+        s = Skip(value_size);
+        if (!s.ok()) return s;
       } else if (info_.compression == UNCOMPRESSED) {
         vsize = value_size;
         Status s = Skip(value_size);
@@ -403,6 +960,13 @@ Status RecordReader::Seek(uint64 pos) {
   // Check if we can skip to position in input buffer.
   if (pos == 0) pos = info_.hdrlen;
   if (pos == position_) return Status::OK;
+
+  // Stop read-ahead when seeking to a new position.
+  if (prefetcher_ != nullptr && prefetcher_->active()) {
+    position_ = pos;
+    return StopPrefetch();
+  }
+
   int64 offset = pos - position_;
   position_ = pos;
   if (offset > 0 && offset <= input_.available()) {
@@ -416,88 +980,375 @@ Status RecordReader::Seek(uint64 pos) {
   return file_->Seek(pos);
 }
 
+Status RecordReader::ReadAt(uint64 position, Record *record,
+                            IOBuffer *buffer) {
+  Header hdr;
+  ssize_t hdrsize;
+  Status st;
+  for (;;) {
+    // Read record header. The header can be shorter than the maximum header
+    // length at the end of the file.
+    char header[MAX_HEADER_LEN];
+    uint64 read;
+    st = file_->PRead(position, header, MAX_HEADER_LEN, &read);
+    if (!st.ok()) return st;
+    memset(header + read, 0, MAX_HEADER_LEN - read);
+    hdrsize = ReadHeader(header, &hdr);
+    if (hdrsize <= 0 || hdrsize > read) {
+      return Status(1, "Corrupt record header");
+    }
+
+    // Skip filler and dictionary records. The index pages can be preceded by
+    // a filler record.
+    if (hdr.record_type == FILLER_RECORD) {
+      if (hdr.record_size == 0) return Status(1, "Corrupt filler record");
+      position += hdr.record_size;
+    } else if (hdr.record_type == DICTIONARY_RECORD) {
+      position += hdrsize + hdr.record_size;
+    } else {
+      break;
+    }
+  }
+  record->position = position;
+  record->type = hdr.record_type;
+  record->version = hdr.version;
+
+  // Read record key and value.
+  buffer->Clear();
+  size_t value_size = hdr.record_size - hdr.key_size;
+  if (info_.compression == UNCOMPRESSED) {
+    char *data = buffer->Append(hdr.record_size);
+    st = PReadFully(file_, position + hdrsize, data, hdr.record_size);
+    if (!st.ok()) return st;
+    record->key = Slice(data, hdr.key_size);
+    record->value = Slice(data + hdr.key_size, value_size);
+  } else {
+    // Read the compressed record and decompress the value after the key in
+    // the buffer.
+    string data;
+    data.resize(hdr.record_size);
+    st = PReadFully(file_, position + hdrsize, &data[0], hdr.record_size);
+    if (!st.ok()) return st;
+    buffer->Write(data.data(), hdr.key_size);
+    st = Decompress(Slice(data.data() + hdr.key_size, value_size), buffer);
+    if (!st.ok()) return st;
+    record->key = Slice(buffer->begin(), hdr.key_size);
+    record->value = Slice(buffer->begin() + hdr.key_size, buffer->end());
+  }
+
+  return Status::OK;
+}
+
+Status RecordReader::ParseAt(uint64 position, const Slice &data,
+                             Record *record, IOBuffer *buffer, int64 *needed) {
+  // Parse record header. Records that are preceded by filler or dictionary
+  // records need to be read using ReadAt().
+  Header hdr;
+  char header[MAX_HEADER_LEN];
+  size_t size = std::min(data.size(), static_cast<size_t>(MAX_HEADER_LEN));
+  memcpy(header, data.data(), size);
+  memset(header + size, 0, MAX_HEADER_LEN - size);
+  ssize_t hdrsize = ReadHeader(header, &hdr);
+  if (hdrsize <= 0 || hdrsize > size ||
+      hdr.record_type == FILLER_RECORD ||
+      hdr.record_type == DICTIONARY_RECORD) {
+    *needed = -1;
+    return Status::OK;
+  }
+
+  // Check that the whole record is in the data.
+  uint64 total = hdrsize + hdr.record_size;
+  if (total > data.size()) {
+    *needed = total;
+    return Status::OK;
+  }
+  *needed = 0;
+  record->position = position;
+  record->type = hdr.record_type;
+  record->version = hdr.version;
+
+  // Get record key and value.
+  buffer->Clear();
+  const char *key = data.data() + hdrsize;
+  const char *value = key + hdr.key_size;
+  size_t value_size = hdr.record_size - hdr.key_size;
+  buffer->Write(key, hdr.key_size);
+  if (info_.compression == UNCOMPRESSED) {
+    buffer->Write(value, value_size);
+  } else {
+    Status st = Decompress(Slice(value, value_size), buffer);
+    if (!st.ok()) return st;
+  }
+  record->key = Slice(buffer->begin(), hdr.key_size);
+  record->value = Slice(buffer->begin() + hdr.key_size, buffer->end());
+
+  return Status::OK;
+}
+
 RecordFile::IndexPage *RecordReader::ReadIndexPage(uint64 position) {
   Record record;
-  CHECK(Seek(position));
-  CHECK(Read(&record));
+  IOBuffer buffer;
+  CHECK(ReadAt(position, &record, &buffer));
   return new IndexPage(position, record.value);
 }
 
+// Cache shard with index pages in LRU order.
+struct RecordIndexCache::Shard {
+  // Cached index page.
+  struct Entry {
+    uint64 file;
+    RecordFile::IndexPage *page;
+    int refs;
+    std::list<Entry *>::iterator lru;
+  };
+
+  // Key for page in cache.
+  typedef std::pair<uint64, uint64> Key;
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return key.second ^ (key.first * 0x9E3779B97F4A7C15ULL);
+    }
+  };
+
+  ~Shard() {
+    for (auto &it : pages) {
+      delete it.second->page;
+      delete it.second;
+    }
+  }
+
+  // Evict unpinned pages until the shard is within budget.
+  void Evict() {
+    auto it = lru.end();
+    while (size > budget && it != lru.begin()) {
+      Entry *entry = *--it;
+      if (entry->refs > 0) continue;
+      size -= PageSize(entry->page);
+      pages.erase(Key(entry->file, entry->page->position));
+      it = lru.erase(it);
+      delete entry->page;
+      delete entry;
+    }
+  }
+
+  // Return memory used by page.
+  static size_t PageSize(const RecordFile::IndexPage *page) {
+    return sizeof(RecordFile::IndexPage) +
+           page->size * sizeof(RecordFile::IndexEntry);
+  }
+
+  std::unordered_map<Key, Entry *, KeyHash> pages;
+  std::list<Entry *> lru;    // most recently used pages first
+  size_t size = 0;           // total size of pages in shard
+  size_t budget = 0;         // memory budget for shard
+  mutable Mutex mu;
+};
+
+RecordIndexCache::RecordIndexCache(size_t budget, int num_shards) {
+  CHECK_GT(num_shards, 0);
+  for (int i = 0; i < num_shards; ++i) {
+    Shard *shard = new Shard();
+    shard->budget = budget / num_shards;
+    shards_.push_back(shard);
+  }
+}
+
+RecordIndexCache::~RecordIndexCache() {
+  for (Shard *shard : shards_) delete shard;
+}
+
+uint64 RecordIndexCache::FileId(const string &filename) {
+  MutexLock lock(&mu_);
+  for (int i = 0; i < files_.size(); ++i) {
+    if (files_[i] == filename) return i;
+  }
+  files_.push_back(filename);
+  return files_.size() - 1;
+}
+
+RecordIndexCache::Shard *RecordIndexCache::shard(uint64 file,
+                                                 uint64 position) const {
+  uint64 hash = Shard::KeyHash()(Shard::Key(file, position));
+  return shards_[(hash >> 32) % shards_.size()];
+}
+
+const RecordFile::IndexPage *RecordIndexCache::Acquire(uint64 file,
+                                                       uint64 position,
+                                                       RecordReader *reader) {
+  // Try to find index page in cache.
+  Shard *s = shard(file, position);
+  Shard::Key key(file, position);
+  {
+    MutexLock lock(&s->mu);
+    auto f = s->pages.find(key);
+    if (f != s->pages.end()) {
+      Shard::Entry *entry = f->second;
+      entry->refs++;
+      s->lru.splice(s->lru.begin(), s->lru, entry->lru);
+      return entry->page;
+    }
+  }
+
+  // Read index page without holding the lock.
+  RecordFile::IndexPage *page = reader->ReadIndexPage(position);
+
+  // Insert page into cache unless another thread has already added it.
+  MutexLock lock(&s->mu);
+  auto f = s->pages.find(key);
+  if (f != s->pages.end()) {
+    delete page;
+    Shard::Entry *entry = f->second;
+    entry->refs++;
+    s->lru.splice(s->lru.begin(), s->lru, entry->lru);
+    return entry->page;
+  }
+  Shard::Entry *entry = new Shard::Entry();
+  entry->file = file;
+  entry->page = page;
+  entry->refs = 1;
+  s->lru.push_front(entry);
+  entry->lru = s->lru.begin();
+  s->pages[key] = entry;
+  s->size += Shard::PageSize(page);
+  s->Evict();
+  return page;
+}
+
+void RecordIndexCache::Release(uint64 file,
+                               const RecordFile::IndexPage *page) {
+  Shard *s = shard(file, page->position);
+  MutexLock lock(&s->mu);
+  auto f = s->pages.find(Shard::Key(file, page->position));
+  CHECK(f != s->pages.end());
+  if (--f->second->refs == 0 && s->size > s->budget) s->Evict();
+}
+
+size_t RecordIndexCache::size() const {
+  size_t total = 0;
+  for (Shard *shard : shards_) {
+    MutexLock lock(&shard->mu);
+    total += shard->size;
+  }
+  return total;
+}
+
+namespace {
+
+// Index page which is pinned in the index page cache while in scope.
+class PinnedPage {
+ public:
+  PinnedPage(RecordIndexCache *cache, uint64 file, uint64 position,
+             RecordReader *reader)
+      : cache_(cache), file_(file),
+        page_(cache->Acquire(file, position, reader)) {}
+  ~PinnedPage() { cache_->Release(file_, page_); }
+
+  const RecordFile::IndexPage *operator->() const { return page_; }
+
+ private:
+  RecordIndexCache *cache_;
+  uint64 file_;
+  const RecordFile::IndexPage *page_;
+};
+
+}  // namespace
+
 RecordIndex::RecordIndex(RecordReader *reader,
                          const RecordFileOptions &options) {
   reader_ = reader;
-  cache_size_ = std::max(options.index_cache_size, 2);
   if (reader->info().index_root != 0 && reader->info().index_depth == 3) {
     root_ = reader->ReadIndexPage(reader->info().index_root);
   } else {
     root_ = nullptr;
   }
+
+  // Use shared index page cache or set up a private cache for the index.
+  cache_ = options.index_cache;
+  if (cache_ == nullptr) {
+    size_t page_size = sizeof(IndexPage) +
+                       reader->info().index_page_size * sizeof(IndexEntry);
+    size_t pages = std::max(options.index_cache_size, 2);
+    cache_ = owned_cache_ = new RecordIndexCache(pages * page_size, 1);
+  }
+  file_ = cache_->FileId(reader->file()->filename());
 }
 
 RecordIndex::~RecordIndex() {
   delete root_;
-  for (auto *p : cache_) delete p;
+  delete owned_cache_;
 }
 
 bool RecordIndex::Lookup(const Slice &key, Record *record, uint64 fp) {
-  if (root_ != nullptr) {
-    // Look up key in index. Multiple keys can have the same fingerprint so we
-    // move forward until a match is found.
-    for (int l1 = root_->Find(fp); l1 < root_->size; ++l1) {
-      if (root_->entries[l1].fingerprint > fp) return false;
-      IndexPage *dir = GetIndexPage(root_->entries[l1].position);
-      for (int l2 = dir->Find(fp); l2 < dir->size; ++l2) {
-        if (dir->entries[l2].fingerprint > fp) return false;
-        IndexPage *leaf = GetIndexPage(access(dir)->entries[l2].position);
-        for (int l3 = leaf->Find(fp); l3 < leaf->size; ++l3) {
-          if (leaf->entries[l3].fingerprint > fp) return false;
-          if (leaf->entries[l3].fingerprint == fp) {
-            CHECK(reader_->Seek(leaf->entries[l3].position));
+  return Find(key, record, fp, nullptr);
+}
+
+bool RecordIndex::Lookup(const Slice &key, Record *record) {
+  return Lookup(key, record, Fingerprint(key.data(), key.size()));
+}
+
+bool RecordIndex::Lookup(const Slice &key, Record *record, uint64 fp,
+                         IOBuffer *buffer) {
+  return Find(key, record, fp, buffer);
+}
+
+bool RecordIndex::Find(const Slice &key, Record *record, uint64 fp,
+                       IOBuffer *buffer) {
+  if (root_ == nullptr) return Scan(key, record, buffer);
+
+  // Look up key in index. Multiple keys can have the same fingerprint so we
+  // move forward until a match is found.
+  for (int l1 = root_->Find(fp); l1 < root_->size; ++l1) {
+    if (root_->entries[l1].fingerprint > fp) return false;
+    PinnedPage dir(cache_, file_, root_->entries[l1].position, reader_);
+    for (int l2 = dir->Find(fp); l2 < dir->size; ++l2) {
+      if (dir->entries[l2].fingerprint > fp) return false;
+      PinnedPage leaf(cache_, file_, dir->entries[l2].position, reader_);
+      for (int l3 = leaf->Find(fp); l3 < leaf->size; ++l3) {
+        if (leaf->entries[l3].fingerprint > fp) return false;
+        if (leaf->entries[l3].fingerprint == fp) {
+          uint64 position = leaf->entries[l3].position;
+          if (buffer != nullptr) {
+            CHECK(reader_->ReadAt(position, record, buffer));
+          } else {
+            CHECK(reader_->Seek(position));
             CHECK(reader_->Read(record));
-            if (record->key == key) return true;
           }
+          if (record->key == key) return true;
         }
       }
     }
-  } else {
-    // No index; find record using sequential scanning.
-    CHECK(reader_->Rewind());
-    while (!reader_->Done()) {
-      CHECK(reader_->Read(record));
-      if (record->key == key) return true;
-    }
   }
 
   return false;
 }
 
-bool RecordIndex::Lookup(const Slice &key, Record *record) {
-  return Lookup(key, record, Fingerprint(key.data(), key.size()));
-}
-
-RecordFile::IndexPage *RecordIndex::GetIndexPage(uint64 position) {
-  // Try to find index page in cache.
-  for (auto *p : cache_) {
-    if (p->position == position) return access(p);
+bool RecordIndex::Scan(const Slice &key, Record *record, IOBuffer *buffer) {
+  // No index; find record using sequential scanning. The reader is shared, so
+  // the scans are serialized when called from multiple threads.
+  if (buffer == nullptr) {
+    CHECK(reader_->Rewind());
+    while (!reader_->Done()) {
+      CHECK(reader_->Read(record));
+      if (record->key == key) return true;
+    }
+    return false;
   }
 
-  // Read new index page.
-  IndexPage *page = access(reader_->ReadIndexPage(position));
-
-  // Insert or replace page in cache.
-  if (cache_.size() < cache_size_) {
-    cache_.push_back(page);
-  } else {
-    // Replace oldest entry in cache.
-    int oldest = 0;
-    for (int i = 1; i < cache_.size(); ++i) {
-      if (cache_[i]->lru < cache_[oldest]->lru) oldest = i;
+  MutexLock lock(&mu_);
+  CHECK(reader_->Rewind());
+  while (!reader_->Done()) {
+    CHECK(reader_->Read(record));
+    if (record->key == key) {
+      // Copy record to buffer.
+      buffer->Clear();
+      buffer->Write(record->key);
+      buffer->Write(record->value);
+      record->key = Slice(buffer->begin(), key.size());
+      record->value = Slice(buffer->begin() + key.size(), buffer->end());
+      return true;
     }
-    delete cache_[oldest];
-    cache_[oldest] = page;
   }
-
-  return page;
+  return false;
 }
 
 RecordDatabase::RecordDatabase(const string &filepattern,
@@ -553,6 +1404,13 @@ bool RecordDatabase::Lookup(const Slice &key, Record *record) {
   return shards_[current_shard_]->Lookup(key, record, fp);
 }
 
+bool RecordDatabase::Lookup(const Slice &key, Record *record,
+                            IOBuffer *buffer) {
+  uint64 fp = Fingerprint(key.data(), key.size());
+  int shard = fp % shards_.size();
+  return shards_[shard]->Lookup(key, record, fp, buffer);
+}
+
 bool RecordDatabase::Next(Record *record) {
   CHECK(!Done());
   RecordReader *reader = shards_[current_shard_]->reader();
@@ -588,6 +1446,23 @@ RecordWriter::RecordWriter(File *file, const RecordFileOptions &options)
     CHECK_EQ(info_.hdrlen, sizeof(FileHeader));
     CHECK(info_.index_start == 0) << "Cannot append to indexed record file";
 
+    // Read compression dictionary.
+    string dictionary;
+    if (info_.flags & DICTIONARY) {
+      char data[MAX_HEADER_LEN];
+      uint64 read;
+      CHECK(file->Seek(info_.hdrlen));
+      CHECK(file->Read(data, MAX_HEADER_LEN, &read));
+      Header hdr;
+      ssize_t hdrsize = ReadHeader(data, &hdr);
+      CHECK(hdrsize > 0 && hdr.record_type == DICTIONARY_RECORD)
+          << "Compression dictionary missing: " << file->filename();
+      dictionary.resize(hdr.record_size);
+      CHECK(file->Seek(info_.hdrlen + hdrsize));
+      CHECK(file->Read(&dictionary[0], hdr.record_size));
+    }
+    InitCompression(options, dictionary);
+
     // Seek to end of file.
     CHECK(file_->Seek(size));
     position_ = size;
@@ -601,8 +1476,29 @@ RecordWriter::RecordWriter(File *file, const RecordFileOptions &options)
     if (options.indexed) {
       info_.index_page_size = options.index_page_size;
     }
+    if (options.compression == ZSTD && !options.dictionary.empty()) {
+      info_.flags |= DICTIONARY;
+    }
     output_.Write(&info_, sizeof(info_));
     position_ += sizeof(info_);
+
+    // Write compression dictionary as the first record.
+    if (info_.flags & DICTIONARY) {
+      Header hdr;
+      hdr.record_type = DICTIONARY_RECORD;
+      hdr.record_size = options.dictionary.size();
+      hdr.key_size = 0;
+      hdr.version = 0;
+      CHECK(info_.chunk_size == 0 ||
+            position_ + MAX_HEADER_LEN + hdr.record_size <= info_.chunk_size)
+          << "Compression dictionary too big";
+      output_.Ensure(MAX_HEADER_LEN + hdr.record_size);
+      size_t hdrsize = WriteHeader(hdr, output_.end());
+      output_.Append(hdrsize);
+      output_.Write(options.dictionary);
+      position_ += hdrsize + hdr.record_size;
+    }
+    InitCompression(options, options.dictionary);
   }
 }
 
@@ -627,10 +1523,20 @@ RecordWriter::RecordWriter(RecordReader *reader,
     info_.index_page_size = options.index_page_size;
   }
   position_ = reader->size();
+  InitCompression(options, reader->dictionary());
 }
 
 RecordWriter::~RecordWriter() {
   CHECK(Close());
+  delete zstd_;
+}
+
+void RecordWriter::InitCompression(const RecordFileOptions &options,
+                                   const string &dictionary) {
+  compression_level_ = options.compression_level;
+  if (info_.compression == ZSTD) {
+    zstd_ = new ZstdCodec(compression_level_, dictionary);
+  }
 }
 
 Status RecordWriter::Close() {
@@ -679,6 +1585,18 @@ Status RecordWriter::Write(const Record &record, uint64 *position) {
     BufferSink sink(&buffer_);
     snappy::Compress(&source, &sink);
     value = buffer_.data();
+  } else if (info_.compression == ZSTD) {
+    // Compress record value.
+    buffer_.Clear();
+    Status s = zstd_->Compress(record.value, &buffer_);
+    if (!s.ok()) return s;
+    value = buffer_.data();
+  } else if (info_.compression == LZ4) {
+    // Compress record value.
+    buffer_.Clear();
+    Status s = LZ4Compress(record.value, compression_level_, &buffer_);
+    if (!s.ok()) return s;
+    value = buffer_.data();
   } else if (info_.compression == UNCOMPRESSED) {
     // Store uncompressed record value.
     value = record.value;
@@ -15,6 +15,7 @@
 #ifndef SLING_FILE_RECORDIO_H_
 #define SLING_FILE_RECORDIO_H_
 
+#include <string>
 #include <vector>
 
 #include "sling/base/slice.h"
@@ -22,19 +23,23 @@
 #include "sling/base/types.h"
 #include "sling/file/file.h"
 #include "sling/util/iobuffer.h"
+#include "sling/util/mutex.h"
 
 namespace sling {
 
+class RecordIndexCache;
+
 // Record types.
 enum RecordType {
   DATA_RECORD   = 1,     // data record with key and value
   FILLER_RECORD = 2,     // filler record to avoid records crossing chunks
   INDEX_RECORD  = 3,     // index page
   VDATA_RECORD = 4,      // versioned data record
+  DICTIONARY_RECORD = 5, // compression dictionary
 };
 
 inline bool ValidRecordType(RecordType type) {
-  return type >= DATA_RECORD && type <= VDATA_RECORD;
+  return type >= DATA_RECORD && type <= DICTIONARY_RECORD;
 }
 
 // Record with key and value.
@@ -64,10 +69,20 @@ class RecordFile {
   static const uint32 MAGIC1 = 0x46434552;  // RECF
   static const uint32 MAGIC2 = 0x44434552;  // RECD
 
-  // Compression types.
+  // Compression types. The zstd and lz4 codecs are only available when built
+  // with --define zstd_lz4=1.
   enum CompressionType {
     UNCOMPRESSED = 0,
     SNAPPY = 1,
+    ZSTD = 2,
+    LZ4 = 3,
+  };
+
+  // File header flags.
+  enum Flags {
+    // The first record in the file is a DICTIONARY_RECORD with the zstd
+    // compression dictionary for the record values.
+    DICTIONARY = 1,
   };
 
   // File header information.
@@ -113,7 +128,6 @@ class RecordFile {
     uint64 position;
     int size;
     IndexEntry *entries;
-    uint64 lru;
   };
 
   // Parse header from data. Returns the number of bytes read or -1 on error.
@@ -121,6 +135,15 @@ class RecordFile {
 
   // Write header to data. Returns number of bytes written.
   static size_t WriteHeader(const Header &header, char *data);
+
+  // Train zstd compression dictionary of up to size bytes from a sample of
+  // record values.
+  static Status TrainDictionary(const std::vector<string> &samples,
+                                size_t size, string *dictionary);
+
+ protected:
+  // Compression context for zstd compression of record values.
+  class ZstdCodec;
 };
 
 // Configuration options for record file.
@@ -134,6 +157,16 @@ struct RecordFileOptions {
   // Record compression.
   RecordFile::CompressionType compression = RecordFile::SNAPPY;
 
+  // Compression level for zstd and lz4 compression. The default level is used
+  // if the level is zero. For lz4, a positive level selects the high
+  // compression mode.
+  int compression_level = 0;
+
+  // Dictionary for zstd compression, e.g. trained with TrainDictionary() on
+  // sample record values. The dictionary is stored in the record file, so it
+  // is not needed for reading the file.
+  string dictionary;
+
   // Record files can be indexed for fast retrieval by key.
   bool indexed = false;
 
@@ -145,6 +178,20 @@ struct RecordFileOptions {
 
   // Number of pages in index page cache.
   int index_cache_size = 256;
+
+  // Shared index page cache (not owned). If this is null, each record index
+  // has its own cache with room for index_cache_size pages.
+  RecordIndexCache *index_cache = nullptr;
+
+  // Number of chunks to prefetch when reading records sequentially. In
+  // read-ahead mode, the next chunks are read and their records decompressed
+  // by background threads while the current chunk is being consumed. This
+  // requires memory for holding the prefetched chunks and is disabled if zero
+  // or if the record file is not chunked.
+  int prefetch_chunks = 0;
+
+  // Number of worker threads for reading and decoding prefetched chunks.
+  int prefetch_threads = 2;
 };
 
 // Reader for reading records from a record file.
@@ -169,6 +216,22 @@ class RecordReader : public RecordFile {
   // Read key from next record and skip value.
   Status ReadKey(Record *record);
 
+  // Read record at position using positional reads. This does not change the
+  // current position of the reader and is thread-safe. The key and value of
+  // the record are stored in the buffer.
+  Status ReadAt(uint64 position, Record *record, IOBuffer *buffer);
+
+  // Parse record at position from data that has already been read from the
+  // file at that position, e.g. using an async reader. If the data does not
+  // contain the whole record, *needed is set to the number of bytes needed for
+  // parsing the record. If the record cannot be parsed from the data, e.g.
+  // because it is preceded by a filler record, *needed is set to -1 and the
+  // record must be read with ReadAt() instead. Otherwise, *needed is set to
+  // zero and the key and value of the record are stored in the buffer. This is
+  // thread-safe.
+  Status ParseAt(uint64 position, const Slice &data,
+                 Record *record, IOBuffer *buffer, int64 *needed);
+
   // Return current position in record file.
   uint64 Tell() { return position_; }
 
@@ -182,11 +245,16 @@ class RecordReader : public RecordFile {
   Status Skip(int64 n) { return Seek(position_ + n); }
 
   // Read index page. Ownership of the index page is transferred to the caller.
+  // This does not change the current position of the reader and is
+  // thread-safe.
   IndexPage *ReadIndexPage(uint64 position);
 
   // Record file header information.
   const FileHeader &info() const { return info_; }
 
+  // Compression dictionary for record file or empty if there is none.
+  const string &dictionary() const;
+
   // Underlying file object for reader.
   File *file() const { return file_; }
 
@@ -194,12 +262,22 @@ class RecordReader : public RecordFile {
   uint64 size() const { return size_; }
 
  private:
+  // Prefetcher for reading and decoding chunks in the background.
+  class Prefetcher;
+
+  // Stop prefetching and resume reading from the file at the current position.
+  Status StopPrefetch();
+
   // Fill input buffer.
   Status Fill(uint64 needed);
 
   // Ensure that at least 'size' bytes are available in input buffer.
   Status Ensure(uint64 size);
 
+  // Decompress record value and append it to output buffer. This is
+  // thread-safe.
+  Status Decompress(const Slice &data, IOBuffer *output) const;
+
   // Input file.
   File *file_;
 
@@ -225,31 +303,83 @@ class RecordReader : public RecordFile {
   // Buffer for decompressed record data.
   IOBuffer buffer_;
 
+  // Decompression context for zstd compressed records.
+  ZstdCodec *zstd_ = nullptr;
+
+  // Prefetcher for read-ahead mode or null if read-ahead is disabled.
+  Prefetcher *prefetcher_ = nullptr;
+
   friend class RecordWriter;
 };
 
+// Thread-safe cache for index pages. The cache can be shared between the
+// record indices for a set of record files, e.g. by multiple record databases
+// for the same files, and all the cached index pages share one memory budget.
+// The cache is divided into shards with separate locks and LRU lists to reduce
+// lock contention. Pages are pinned while they are being used, and only
+// unpinned pages are evicted from the cache.
+class RecordIndexCache {
+ public:
+  // Initialize cache with a memory budget in bytes for the index pages.
+  explicit RecordIndexCache(size_t budget, int num_shards = 16);
+  ~RecordIndexCache();
+
+  // Return file id for record file. Record indices for the same file share the
+  // cached index pages.
+  uint64 FileId(const string &filename);
+
+  // Get index page at position in file and pin it in the cache. The page is
+  // read from the record file if it is not in the cache.
+  const RecordFile::IndexPage *Acquire(uint64 file, uint64 position,
+                                       RecordReader *reader);
+
+  // Release pinned index page.
+  void Release(uint64 file, const RecordFile::IndexPage *page);
+
+  // Total size of the pages in the cache.
+  size_t size() const;
+
+ private:
+  struct Shard;
+
+  // Get shard for page.
+  Shard *shard(uint64 file, uint64 position) const;
+
+  // Cache shards.
+  std::vector<Shard *> shards_;
+
+  // File ids for record files.
+  std::vector<string> files_;
+  Mutex mu_;
+};
+
 // Index for looking up records in an indexed record file.
 class RecordIndex : public RecordFile {
  public:
   RecordIndex(RecordReader *reader, const RecordFileOptions &options);
   ~RecordIndex();
 
-  // Look up record by key. Returns false if no matching record is found.
+  // Look up record by key. Returns false if no matching record is found. The
+  // record is read with the record reader, which is positioned after the
+  // record.
   bool Lookup(const Slice &key, Record *record, uint64 fp);
   bool Lookup(const Slice &key, Record *record);
 
+  // Look up record by key using positional reads. This can be called from
+  // multiple threads at the same time. The key and value of the record are
+  // stored in the buffer.
+  bool Lookup(const Slice &key, Record *record, uint64 fp, IOBuffer *buffer);
+
   // Return record reader.
   RecordReader *reader() const { return reader_; }
 
  private:
-  // Get index page at position.
-  IndexPage *GetIndexPage(uint64 position);
+  // Find record by key in index. The record is read with the reader if buffer
+  // is null. Otherwise, it is read with positional reads into the buffer.
+  bool Find(const Slice &key, Record *record, uint64 fp, IOBuffer *buffer);
 
-  // Mark index page as accessed.
-  IndexPage *access(IndexPage *page) {
-    page->lru = epoch_++;
-    return page;
-  }
+  // Find record by sequential scanning if the record file has no index.
+  bool Scan(const Slice &key, Record *record, IOBuffer *buffer);
 
   // Record file with index (not owned).
   RecordReader *reader_;
@@ -257,14 +387,15 @@ class RecordIndex : public RecordFile {
   // Root index page.
   IndexPage *root_;
 
-  // Maximum index page cache size.
-  int cache_size_;
+  // Index page cache and file id for record file in cache.
+  RecordIndexCache *cache_;
+  uint64 file_;
 
-  // Epoch for LRU cache eviction.
-  uint64 epoch_ = 0;
+  // Cache owned by the index if no shared cache is used.
+  RecordIndexCache *owned_cache_ = nullptr;
 
-  // Index page cache.
-  std::vector<RecordFile::IndexPage *> cache_;
+  // Mutex for serializing sequential scanning for unindexed record files.
+  Mutex mu_;
 };
 
 // A record database is a sharded set of indexed record files where records can
@@ -283,6 +414,12 @@ class RecordDatabase {
   // Look up record by key. Returns false if no matching record is found.
   bool Lookup(const Slice &key, Record *record);
 
+  // Thread-safe look up of record by key. The key and value of the record are
+  // stored in the buffer, which must not be shared between threads. For
+  // indexed record files, this does not change the current shard and the
+  // positions of the shards.
+  bool Lookup(const Slice &key, Record *record, IOBuffer *buffer);
+
   // Retrieve the next record from the current shard.
   bool Next(Record *record);
 
@@ -363,6 +500,10 @@ class RecordWriter : public RecordFile {
   // Write one level of the index to file.
   Status WriteIndexLevel(const Index &level, Index *parent, int page_size);
 
+  // Set up compression of record values.
+  void InitCompression(const RecordFileOptions &options,
+                       const string &dictionary);
+
   // Output file.
   File *file_;
 
@@ -378,6 +519,12 @@ class RecordWriter : public RecordFile {
   // Buffer for compressed record data.
   IOBuffer buffer_;
 
+  // Compression level for zstd and lz4 compression.
+  int compression_level_ = 0;
+
+  // Compression context for zstd compression.
+  ZstdCodec *zstd_ = nullptr;
+
   // Index entries for building index.
   Index index_;
 
@@ -0,0 +1,418 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/file/uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define SLING_IO_URING 1
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "sling/base/logging.h"
+#include "sling/file/file.h"
+
+namespace sling {
+
+#ifdef SLING_IO_URING
+
+// The io_uring interface is used through the raw system calls to avoid a
+// dependency on liburing.
+struct AsyncReader::Ring {
+  ~Ring() {
+    if (sqes != nullptr) munmap(sqes, sqes_size);
+    if (cq_ptr != nullptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+    if (sq_ptr != nullptr) munmap(sq_ptr, sq_size);
+    if (fd != -1) close(fd);
+  }
+
+  // Set up submission and completion queues.
+  bool Init(int depth) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, depth, &params);
+    if (fd < 0) {
+      VLOG(1) << "io_uring not available: " << strerror(errno);
+      fd = -1;
+      return false;
+    }
+    entries = params.sq_entries;
+
+    // Map queues into memory.
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sq_size = cq_size = std::max(sq_size, cq_size);
+    sq_ptr = Map(sq_size, IORING_OFF_SQ_RING);
+    if (sq_ptr == nullptr) return false;
+    if (single) {
+      cq_ptr = sq_ptr;
+    } else {
+      cq_ptr = Map(cq_size, IORING_OFF_CQ_RING);
+      if (cq_ptr == nullptr) return false;
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(Map(sqes_size, IORING_OFF_SQES));
+    if (sqes == nullptr) return false;
+
+    // Get queue pointers.
+    char *sq = static_cast<char *>(sq_ptr);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  // Map ring region into memory.
+  void *Map(size_t size, uint64 offset) {
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  // Submit requests to the kernel and wait for completions.
+  int Enter(unsigned submit, unsigned wait) {
+    int flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+  }
+
+  // Ring file descriptor.
+  int fd = -1;
+
+  // Number of submission queue entries.
+  unsigned entries = 0;
+
+  // Memory mapped queues.
+  void *sq_ptr = nullptr;
+  size_t sq_size = 0;
+  void *cq_ptr = nullptr;
+  size_t cq_size = 0;
+  io_uring_sqe *sqes = nullptr;
+  size_t sqes_size = 0;
+
+  // Submission queue.
+  unsigned *sq_tail = nullptr;
+  unsigned sq_mask = 0;
+  unsigned *sq_array = nullptr;
+
+  // Completion queue.
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  io_uring_cqe *cqes = nullptr;
+};
+
+AsyncReader::AsyncReader(int depth) {
+  ring_ = new Ring();
+  if (!ring_->Init(depth)) {
+    delete ring_;
+    ring_ = nullptr;
+  }
+}
+
+AsyncReader::~AsyncReader() {
+  delete ring_;
+}
+
+Status AsyncReader::Read(AsyncRead *requests, int num) {
+  Status result;
+  int next = 0;
+  int inflight = 0;
+  unsigned unsubmitted = 0;
+  iov_.resize(num);
+  while (next < num || inflight > 0) {
+    // Add requests to submission queue.
+    if (ring_ != nullptr) {
+      unsigned tail = *ring_->sq_tail;
+      while (next < num && inflight + unsubmitted < ring_->entries) {
+        AsyncRead *r = &requests[next];
+        int fd = r->file->descriptor();
+        if (fd == -1) break;
+        unsigned slot = tail & ring_->sq_mask;
+        io_uring_sqe *sqe = &ring_->sqes[slot];
+        memset(sqe, 0, sizeof(io_uring_sqe));
+        iov_[next].iov_base = r->buffer;
+        iov_[next].iov_len = r->size;
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = reinterpret_cast<uint64>(&iov_[next]);
+        sqe->len = 1;
+        sqe->fd = fd;
+        sqe->off = r->position;
+        sqe->user_data = next;
+        ring_->sq_array[slot] = slot;
+        tail++;
+        unsubmitted++;
+        next++;
+      }
+      __atomic_store_n(ring_->sq_tail, tail, __ATOMIC_RELEASE);
+    }
+
+    // Do synchronous read if the request cannot be queued.
+    if (next < num && inflight + unsubmitted == 0) {
+      AsyncRead *r = &requests[next++];
+      r->bytes = 0;
+      r->status = r->file->PRead(r->position, r->buffer, r->size, &r->bytes);
+      if (result.ok() && !r->status.ok()) result = r->status;
+      continue;
+    }
+
+    // Submit queued requests and wait for at least one to complete.
+    int rc = ring_->Enter(unsubmitted, 1);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EBUSY) {
+        LOG(FATAL) << "io_uring_enter failed: " << strerror(errno);
+      }
+
+      // The kernel cannot take more requests right now. Wait for some of the
+      // reads in flight to complete and reap them before submitting again,
+      // or back off briefly if there are no reads in flight.
+      if (inflight > 0) {
+        ring_->Enter(0, 1);
+      } else {
+        usleep(100);
+      }
+      rc = 0;
+    }
+    unsubmitted -= rc;
+    inflight += rc;
+
+    // Collect completed requests.
+    unsigned head = *ring_->cq_head;
+    unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      io_uring_cqe *cqe = &ring_->cqes[head & ring_->cq_mask];
+      AsyncRead *r = &requests[cqe->user_data];
+      if (cqe->res < 0) {
+        r->bytes = 0;
+        r->status = Status(-cqe->res, r->file->filename().c_str(),
+                           strerror(-cqe->res));
+        if (result.ok()) result = r->status;
+      } else {
+        r->bytes = cqe->res;
+        r->status = Status::OK;
+      }
+      head++;
+      inflight--;
+    }
+    __atomic_store_n(ring_->cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  return result;
+}
+
+#else
+
+// Synchronous fallback for systems without io_uring.
+struct AsyncReader::Ring {};
+
+AsyncReader::AsyncReader(int depth) {}
+
+AsyncReader::~AsyncReader() {}
+
+Status AsyncReader::Read(AsyncRead *requests, int num) {
+  Status result;
+  for (int i = 0; i < num; ++i) {
+    AsyncRead *r = &requests[i];
+    r->bytes = 0;
+    r->status = r->file->PRead(r->position, r->buffer, r->size, &r->bytes);
+    if (result.ok() && !r->status.ok()) result = r->status;
+  }
+  return result;
+}
+
+#endif
+
+AsyncReader *AsyncReader::Current() {
+  static thread_local AsyncReader reader;
+  return &reader;
+}
+
+// File where positional reads are done through the async reader for the
+// current thread. All other operations are delegated to the underlying file.
+class UringFile : public File {
+ public:
+  UringFile(File *file) : file_(file) {}
+
+  Status PRead(uint64 pos, void *buffer, size_t size, uint64 *read) override {
+    AsyncRead request;
+    request.file = file_;
+    request.position = pos;
+    request.buffer = buffer;
+    request.size = size;
+    Status st = AsyncReader::Current()->Read(&request, 1);
+    if (!st.ok()) return st;
+    if (read) *read = request.bytes;
+    return Status::OK;
+  }
+
+  Status Read(void *buffer, size_t size, uint64 *read) override {
+    return file_->Read(buffer, size, read);
+  }
+
+  Status PWrite(uint64 pos, const void *buffer, size_t size) override {
+    return file_->PWrite(pos, buffer, size);
+  }
+
+  Status Write(const void *buffer, size_t size) override {
+    return file_->Write(buffer, size);
+  }
+
+  void *MapMemory(uint64 pos, size_t size, bool writable) override {
+    return file_->MapMemory(pos, size, writable);
+  }
+
+  void *MapCopyOnWrite(uint64 pos, size_t size) override {
+    return file_->MapCopyOnWrite(pos, size);
+  }
+
+  Status Resize(uint64 size) override {
+    return file_->Resize(size);
+  }
+
+  Status Seek(uint64 pos) override {
+    return file_->Seek(pos);
+  }
+
+  Status Skip(uint64 n) override {
+    return file_->Skip(n);
+  }
+
+  Status GetPosition(uint64 *pos) override {
+    return file_->GetPosition(pos);
+  }
+
+  Status GetSize(uint64 *size) override {
+    return file_->GetSize(size);
+  }
+
+  Status Stat(FileStat *stat) override {
+    return file_->Stat(stat);
+  }
+
+  Status Close() override {
+    Status st = file_->Close();
+    delete this;
+    return st;
+  }
+
+  Status Flush() override {
+    return file_->Flush();
+  }
+
+  string filename() const override { return "/uring" + file_->filename(); }
+
+  int descriptor() const override { return file_->descriptor(); }
+
+ private:
+  // Underlying file.
+  File *file_;
+};
+
+// File system for files named /uring/<path>, where positional reads are done
+// using io_uring. The files are opened as /<path> through the default file
+// system, so /uring/var/data/x.rec refers to /var/data/x.rec.
+class UringFileSystem : public FileSystem {
+ public:
+  void Init() override {}
+
+  bool IsDefaultFileSystem() override { return false; }
+
+  Status Open(const string &name, const char *mode, File **f) override {
+    File *file;
+    Status st = File::Open(Path(name), mode, &file);
+    if (!st.ok()) return st;
+    *f = new UringFile(file);
+    return Status::OK;
+  }
+
+  bool FileExists(const string &filename) override {
+    return File::Exists(Path(filename));
+  }
+
+  Status GetFileSize(const string &filename, uint64 *size) override {
+    return File::GetSize(Path(filename), size);
+  }
+
+  Status DeleteFile(const string &filename) override {
+    return File::Delete(Path(filename));
+  }
+
+  Status RenameFile(const string &source, const string &target) override {
+    return File::Rename(Path(source), Path(target));
+  }
+
+  Status CreateTempFile(File **f) override {
+    File *file = File::TempFile();
+    if (file == nullptr) return Status(EIO, "Cannot create temp file");
+    *f = new UringFile(file);
+    return Status::OK;
+  }
+
+  Status CreateTempDir(string *dir) override {
+    return File::CreateTempDir(dir);
+  }
+
+  Status Stat(const string &name, FileStat *stat) override {
+    return File::Stat(Path(name), stat);
+  }
+
+  Status CreateDir(const string &dirname) override {
+    return File::Mkdir(Path(dirname));
+  }
+
+  Status DeleteDir(const string &dirname) override {
+    return File::Rmdir(Path(dirname));
+  }
+
+  Status Match(const string &pattern,
+               std::vector<string> *filenames) override {
+    std::vector<string> matches;
+    Status st = File::Match(Path(pattern), &matches);
+    if (!st.ok()) return st;
+    for (const string &match : matches) filenames->push_back("/uring" + match);
+    return Status::OK;
+  }
+
+  Status FlushMappedMemory(void *data, size_t size) override {
+    return File::FlushMappedMemory(data, size);
+  }
+
+  Status FreeMappedMemory(void *data, size_t size) override {
+    return File::FreeMappedMemory(data, size);
+  }
+
+ private:
+  // Return absolute path in the default file system for file name relative to
+  // the /uring/ prefix.
+  static string Path(const string &name) { return "/" + name; }
+};
+
+REGISTER_FILE_SYSTEM_TYPE("uring", UringFileSystem);
+
+}  // namespace sling
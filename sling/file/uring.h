@@ -0,0 +1,77 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_FILE_URING_H_
+#define SLING_FILE_URING_H_
+
+#include <sys/uio.h>
+#include <vector>
+
+#include "sling/base/status.h"
+#include "sling/base/types.h"
+#include "sling/file/file.h"
+
+namespace sling {
+
+// Positional read request for asynchronous reader.
+struct AsyncRead {
+  File *file = nullptr;    // file to read from
+  uint64 position = 0;     // position in file to read from
+  void *buffer = nullptr;  // buffer for receiving the data
+  size_t size = 0;         // number of bytes to read
+  uint64 bytes = 0;        // number of bytes read (less than size at eof)
+  Status status;           // outcome of read
+};
+
+// Asynchronous reader for doing batches of positional reads with many reads in
+// flight. On Linux, the reads are submitted to the kernel through an io_uring
+// submission queue, so reads for cold data can be served by the storage device
+// in parallel instead of one at a time. Reads from files that are not backed
+// by a file descriptor, or on systems where io_uring is not supported, fall
+// back to synchronous PRead() calls. An async reader is not thread-safe, so
+// each thread should use its own reader.
+class AsyncReader {
+ public:
+  // Initialize reader with a maximum number of reads in flight.
+  explicit AsyncReader(int depth = 64);
+  ~AsyncReader();
+
+  // Check if reads are done asynchronously.
+  bool async() const { return ring_ != nullptr; }
+
+  // Perform batch of reads. This returns when all the reads have completed.
+  // The outcome of each read is stored in the request, and the first error
+  // is returned.
+  Status Read(AsyncRead *requests, int num);
+  Status Read(std::vector<AsyncRead> *requests) {
+    return Read(requests->data(), requests->size());
+  }
+
+  // Return async reader for the current thread.
+  static AsyncReader *Current();
+
+ private:
+  // Submission and completion queues shared with the kernel.
+  struct Ring;
+
+  // Kernel queues or null if reads are synchronous.
+  Ring *ring_ = nullptr;
+
+  // I/O vectors for reads.
+  std::vector<iovec> iov_;
+};
+
+}  // namespace sling
+
+#endif  // SLING_FILE_URING_H_
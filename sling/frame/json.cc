@@ -14,7 +14,12 @@
 
 #include "sling/frame/json.h"
 
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#include <string.h>
 #include <string>
+#include <vector>
 
 #include "sling/base/logging.h"
 #include "sling/frame/store.h"
@@ -213,5 +218,512 @@ void JSONWriter::WriteFloat(float number) {
   output_->Write(str, strlen(str));
 }
 
+namespace {
+
+// Character classes for the structural index.
+enum CharClass : uint8 {
+  QUOTE     = 0x01,   // double quote
+  BACKSLASH = 0x02,   // backslash
+  OPERATOR  = 0x04,   // braces, brackets, colon, and comma
+  SPACE     = 0x08,   // space, tab, newline, vertical tab, form feed, return
+  SPECIAL   = 0x10,   // quote, backslash, and newline for string scanning
+};
+
+// Character class table.
+struct CharClassTable {
+  CharClassTable() {
+    memset(table, 0, sizeof(table));
+    table['"'] = QUOTE | SPECIAL;
+    table['\\'] = BACKSLASH | SPECIAL;
+    for (uint8 c : {'{', '}', '[', ']', ':', ','}) table[c] = OPERATOR;
+    for (uint8 c : {' ', '\t', '\n', '\v', '\f', '\r'}) table[c] = SPACE;
+    table['\n'] |= SPECIAL;
+  }
+  uint8 table[256];
+};
+
+const CharClassTable char_class;
+
+inline uint8 Class(char c) {
+  return char_class.table[static_cast<uint8>(c)];
+}
+
+// Bit masks for the character classes in a 64-byte block of input.
+struct BlockMasks {
+  uint64 quote;
+  uint64 backslash;
+  uint64 op;
+  uint64 space;
+};
+
+// Computes character class masks for a 64-byte block.
+void ClassifyGeneric(const char *block, BlockMasks *masks) {
+  uint64 quote = 0, backslash = 0, op = 0, space = 0;
+  for (int i = 0; i < 64; ++i) {
+    uint8 cls = Class(block[i]);
+    uint64 bit = 1ULL << i;
+    if (cls & QUOTE) quote |= bit;
+    if (cls & BACKSLASH) backslash |= bit;
+    if (cls & OPERATOR) op |= bit;
+    if (cls & SPACE) space |= bit;
+  }
+  masks->quote = quote;
+  masks->backslash = backslash;
+  masks->op = op;
+  masks->space = space;
+}
+
+// Returns the position of the first special string character in [p;end), or
+// end if there are none.
+const char *FindSpecialGeneric(const char *p, const char *end) {
+  while (p < end && !(Class(*p) & SPECIAL)) p++;
+  return p;
+}
+
+#ifdef __x86_64__
+
+// AVX2 version of the character classification. Each 32-byte half of the
+// block is compared against the class characters in parallel.
+__attribute__((target("avx2")))
+inline void ClassifyHalfAVX2(__m256i v, BlockMasks *masks, int shift) {
+  __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+  __m256i backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+  __m256i op = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']'))));
+  op = _mm256_or_si256(op,
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+
+  // Control whitespace characters are in the range 9-13.
+  __m256i ctrl = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+  __m256i space = _mm256_or_si256(
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8(4)), ctrl));
+
+  masks->quote |= static_cast<uint64>(
+      static_cast<uint32>(_mm256_movemask_epi8(quote))) << shift;
+  masks->backslash |= static_cast<uint64>(
+      static_cast<uint32>(_mm256_movemask_epi8(backslash))) << shift;
+  masks->op |= static_cast<uint64>(
+      static_cast<uint32>(_mm256_movemask_epi8(op))) << shift;
+  masks->space |= static_cast<uint64>(
+      static_cast<uint32>(_mm256_movemask_epi8(space))) << shift;
+}
+
+__attribute__((target("avx2")))
+void ClassifyAVX2(const char *block, BlockMasks *masks) {
+  masks->quote = masks->backslash = masks->op = masks->space = 0;
+  const __m256i *data = reinterpret_cast<const __m256i *>(block);
+  ClassifyHalfAVX2(_mm256_loadu_si256(data), masks, 0);
+  ClassifyHalfAVX2(_mm256_loadu_si256(data + 1), masks, 32);
+}
+
+__attribute__((target("avx2")))
+const char *FindSpecialAVX2(const char *p, const char *end) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i special = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                        _mm256_cmpeq_epi8(v, backslash)),
+        _mm256_cmpeq_epi8(v, newline));
+    uint32 mask = _mm256_movemask_epi8(special);
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return FindSpecialGeneric(p, end);
+}
+
+const bool has_avx2 = __builtin_cpu_supports("avx2");
+
+inline void Classify(const char *block, BlockMasks *masks) {
+  if (has_avx2) {
+    ClassifyAVX2(block, masks);
+  } else {
+    ClassifyGeneric(block, masks);
+  }
+}
+
+inline const char *FindSpecial(const char *p, const char *end) {
+  return has_avx2 ? FindSpecialAVX2(p, end) : FindSpecialGeneric(p, end);
+}
+
+#else
+
+inline void Classify(const char *block, BlockMasks *masks) {
+  ClassifyGeneric(block, masks);
+}
+
+inline const char *FindSpecial(const char *p, const char *end) {
+  return FindSpecialGeneric(p, end);
+}
+
+#endif
+
+// Computes the prefix xor of the bits in the mask, i.e. bit i in the result
+// is the xor of the bits 0 to i in the input.
+inline uint64 PrefixXor(uint64 bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+// Converts hex digit to value. Returns -1 for invalid hex digits.
+inline int HexDigit(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  return -1;
+}
+
+// Appends Unicode code point to string in UTF-8 encoding.
+void AppendUTF8(uint32 code, string *str) {
+  if (code <= 0x7f) {
+    str->push_back(code);
+  } else if (code <= 0x7ff) {
+    str->push_back(0xc0 | (code >> 6));
+    str->push_back(0x80 | (code & 0x3f));
+  } else if (code <= 0xffff) {
+    str->push_back(0xe0 | (code >> 12));
+    str->push_back(0x80 | ((code >> 6) & 0x3f));
+    str->push_back(0x80 | (code & 0x3f));
+  } else {
+    str->push_back(0xf0 | (code >> 18));
+    str->push_back(0x80 | ((code >> 12) & 0x3f));
+    str->push_back(0x80 | ((code >> 6) & 0x3f));
+    str->push_back(0x80 | (code & 0x3f));
+  }
+}
+
+}  // namespace
+
+Handle JSONReader::Parse(Text text) {
+  data_ = text.data();
+  size_ = text.size();
+  if (!BuildIndex()) return Handle::error();
+
+  // Parse the first value in the input.
+  Handle handle = ParseValue();
+  stack_.reset();
+  return handle;
+}
+
+bool JSONReader::BuildIndex() {
+  index_.clear();
+  next_ = 0;
+  if (size_ > 0xffffffffLL) return false;
+
+  // Carry-over state between blocks.
+  uint64 escape_carry = 0;  // first character in block is escaped
+  uint64 string_carry = 0;  // all ones if block starts inside a string
+  uint64 scalar_carry = 0;  // last character in previous block was scalar
+
+  char tail[64];
+  BlockMasks masks;
+  for (int64 base = 0; base < size_; base += 64) {
+    // Classify characters in block. The last block is padded with spaces.
+    if (size_ - base >= 64) {
+      Classify(data_ + base, &masks);
+    } else {
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, data_ + base, size_ - base);
+      Classify(tail, &masks);
+    }
+
+    // Find escaped characters. A backslash escapes the next character unless
+    // it is escaped itself.
+    uint64 escaped = escape_carry;
+    escape_carry = 0;
+    uint64 backslash = masks.backslash & ~escaped;
+    while (backslash != 0) {
+      int i = __builtin_ctzll(backslash);
+      if (i == 63) {
+        escape_carry = 1;
+        backslash = 0;
+      } else {
+        escaped |= 1ULL << (i + 1);
+        backslash &= ~(3ULL << i);
+      }
+    }
+
+    // Find the characters inside strings. The mask includes the opening
+    // quote but not the closing quote.
+    uint64 quotes = masks.quote & ~escaped;
+    uint64 instring = PrefixXor(quotes) ^ string_carry;
+    string_carry = static_cast<uint64>(static_cast<int64>(instring) >> 63);
+
+    // Find the start of all scalars, i.e. numbers and literals.
+    uint64 scalar = ~(masks.space | masks.op | masks.quote) & ~instring;
+    uint64 starts = scalar & ~((scalar << 1) | scalar_carry);
+    scalar_carry = scalar >> 63;
+
+    // Add structural positions to index.
+    uint64 structurals = (masks.op & ~instring) | (quotes & instring) | starts;
+    while (structurals != 0) {
+      index_.push_back(base + __builtin_ctzll(structurals));
+      structurals &= structurals - 1;
+    }
+  }
+
+  // Fail on unterminated string.
+  return string_carry == 0;
+}
+
+Handle JSONReader::ParseValue() {
+  int64 pos = Next();
+  if (pos < 0) return Handle::error();
+  switch (data_[pos]) {
+    case '{':
+      return ParseObject();
+
+    case '[':
+      return ParseArray();
+
+    case '"': {
+      Text str;
+      if (!ParseString(pos, &str)) return Handle::error();
+      return store_->AllocateString(str);
+    }
+
+    case '}': case ']': case ':': case ',':
+      return Handle::error();
+
+    default:
+      return ParseScalar(pos);
+  }
+}
+
+Handle JSONReader::ParseObject() {
+  // Put slots on the stack while parsing.
+  Word mark = Mark();
+
+  for (;;) {
+    int64 pos = Next();
+    if (pos < 0) return Handle::error();
+    if (data_[pos] == '}') break;
+
+    // Parse slot name. Only string names are supported.
+    if (data_[pos] != '"') return Handle::error();
+    Text key;
+    if (!ParseString(pos, &key)) return Handle::error();
+    Handle name = store_->Lookup(key);
+    if (name.IsId()) name = store_->Lookup("_id");
+    Push(name);
+
+    // Skip colon between slot name and value.
+    pos = Next();
+    if (pos < 0 || data_[pos] != ':') return Handle::error();
+
+    // Parse slot value.
+    Handle value = ParseValue();
+    if (value.IsError()) return Handle::error();
+    Push(value);
+
+    // Skip commas between slots.
+    if (Peek() == ',') next_++;
+  }
+
+  // Create new frame from slots.
+  Slot *begin = reinterpret_cast<Slot *>(stack_.address(mark));
+  Slot *end = reinterpret_cast<Slot *>(stack_.end());
+  Handle handle = store_->AllocateFrame(begin, end);
+  Release(mark);
+  return handle;
+}
+
+Handle JSONReader::ParseArray() {
+  // Put elements on the stack while parsing.
+  Word mark = Mark();
+
+  for (;;) {
+    int next = Peek();
+    if (next < 0) return Handle::error();
+    if (next == ']') {
+      next_++;
+      break;
+    }
+
+    // Parse next element and push it on the stack.
+    Handle element = ParseValue();
+    if (element.IsError()) return Handle::error();
+    Push(element);
+
+    // Skip commas between elements.
+    if (Peek() == ',') next_++;
+  }
+
+  // Create new array from elements.
+  Handle handle = store_->AllocateArray(stack_.address(mark), stack_.end());
+  Release(mark);
+  return handle;
+}
+
+bool JSONReader::ParseString(int64 pos, Text *str) {
+  const char *start = data_ + pos + 1;
+  const char *end = data_ + size_;
+
+  // Fast path for strings without escape sequences.
+  const char *p = FindSpecial(start, end);
+  if (p == end || *p == '\n') return false;
+  if (*p == '"') {
+    *str = Text(start, p - start);
+    return true;
+  }
+
+  // Decode escape sequences into string buffer.
+  buffer_.assign(start, p - start);
+  while (p < end) {
+    char ch = *p++;
+    if (ch == '"') {
+      *str = Text(buffer_);
+      return true;
+    } else if (ch == '\n') {
+      return false;
+    } else if (ch != '\\') {
+      buffer_.push_back(ch);
+      continue;
+    }
+
+    if (p == end) return false;
+    switch (ch = *p++) {
+      case 'a': buffer_.push_back('\a'); break;
+      case 'b': buffer_.push_back('\b'); break;
+      case 'f': buffer_.push_back('\f'); break;
+      case 'n': buffer_.push_back('\n'); break;
+      case 'r': buffer_.push_back('\r'); break;
+      case 't': buffer_.push_back('\t'); break;
+      case 'v': buffer_.push_back('\v'); break;
+      case 'x': {
+        // Parse hex escape (\x00).
+        if (end - p < 2) return false;
+        int hi = HexDigit(p[0]);
+        int lo = HexDigit(p[1]);
+        if (hi < 0 || lo < 0) return false;
+        buffer_.push_back((hi << 4) + lo);
+        p += 2;
+        break;
+      }
+      case 'u':
+      case 'U': {
+        // Parse unicode hex escape (\u0000 or \U00000000).
+        int digits = ch == 'u' ? 4 : 8;
+        if (end - p < digits) return false;
+        uint32 code = 0;
+        for (int i = 0; i < digits; ++i) {
+          int digit = HexDigit(p[i]);
+          if (digit < 0) return false;
+          code = (code << 4) + digit;
+          if (code > 0x10ffff) return false;
+        }
+        AppendUTF8(code, &buffer_);
+        p += digits;
+        break;
+      }
+      default:
+        // Just escape the next character.
+        buffer_.push_back(ch);
+    }
+  }
+
+  return false;
+}
+
+Handle JSONReader::ParseScalar(int64 pos) {
+  // Find the end of the scalar.
+  const char *start = data_ + pos;
+  const char *end = data_ + size_;
+  const char *p = start;
+  while (p < end && !(Class(*p) & (QUOTE | OPERATOR | SPACE))) p++;
+  Text token(start, p - start);
+
+  // Parse literals.
+  switch (token.size()) {
+    case 3:
+      if (token == "nil") return Handle::nil();
+      break;
+    case 4:
+      if (token == "null") return Handle::nil();
+      if (token == "true") return Handle::Bool(true);
+      break;
+    case 5:
+      if (token == "false") return Handle::Bool(false);
+      break;
+  }
+
+  // Parse number using the same syntax as the tokenizer, i.e. an optional
+  // sign, an integral part, a decimal part, and an exponent.
+  p = start;
+  bool negative = false;
+  if (p < end && *p == '-') {
+    negative = true;
+    p++;
+  }
+  const char *integral = p;
+  while (p < end && *p >= '0' && *p <= '9') p++;
+  int integral_digits = p - integral;
+  bool fractional = false;
+  if (p < end && *p == '.') {
+    fractional = true;
+    p++;
+  }
+
+  if (fractional || (p < end && (*p == 'e' || *p == 'E'))) {
+    const char *decimal = p;
+    while (p < end && *p >= '0' && *p <= '9') p++;
+    int decimal_digits = p - decimal;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      p++;
+      if (p < end && (*p == '-' || *p == '+')) p++;
+      const char *exponent = p;
+      while (p < end && *p >= '0' && *p <= '9') p++;
+      if (p == exponent) return Handle::error();
+    }
+    if (integral_digits == 0 && decimal_digits == 0) return Handle::error();
+    if (p != start + token.size()) return Handle::error();
+
+    string number(token.data(), token.size());
+    for (char &c : number) if (c == 'E') c = 'e';
+    float value;
+    if (!safe_strtof(number, &value)) return Handle::error();
+    return Handle::Float(value);
+  } else {
+    if (integral_digits == 0) return Handle::error();
+    if (p != start + token.size()) return Handle::error();
+
+    // Fast path for small integers.
+    if (integral_digits <= 8) {
+      int value = 0;
+      for (const char *d = integral; d < p; ++d) value = value * 10 + *d - '0';
+      return Handle::Integer(negative ? -value : value);
+    }
+
+    // Large integers that cannot be represented as integer handles are
+    // returned as strings.
+    string number(token.data(), token.size());
+    int64 value;
+    float fvalue;
+    if (safe_strto64(number, &value)) {
+      if (value >= Handle::kMinInt && value <= Handle::kMaxInt) {
+        return Handle::Integer(value);
+      } else {
+        return store_->AllocateString(token);
+      }
+    } else if (safe_strtof(number, &fvalue)) {
+      return Handle::Float(fvalue);
+    } else {
+      return Handle::error();
+    }
+  }
+}
+
 }  // namespace sling
 
@@ -16,11 +16,14 @@
 #define SLING_FRAME_JSON_H_
 
 #include <string>
+#include <vector>
 
 #include "sling/base/macros.h"
+#include "sling/base/types.h"
 #include "sling/frame/object.h"
 #include "sling/frame/store.h"
 #include "sling/stream/output.h"
+#include "sling/string/text.h"
 
 namespace sling {
 
@@ -107,6 +110,90 @@ class JSONWriter {
   DISALLOW_IMPLICIT_CONSTRUCTORS(JSONWriter);
 };
 
+// The JSON reader parses JSON text into objects in a store. The objects are
+// the same as the ones produced by a Reader in JSON mode, but the JSON reader
+// does not tokenize the input one character at a time through an input stream.
+// Instead, the input is parsed in two stages.
+// The first stage builds an index of the positions of all the structural
+// characters and the start of all the strings and scalars in the input. This
+// is done 64 bytes at a time using bit masks, which are computed using AVX2
+// instructions if available. The second stage walks the structural index and
+// builds the objects directly in the store. The JSON reader only handles
+// standard JSON and returns an error if the input contains anything else, e.g.
+// comments or symbol names, in which case the input can be parsed with the
+// Reader instead.
+class JSONReader {
+ public:
+  // Initializes reader with store.
+  explicit JSONReader(Store *store) : store_(store), stack_(store) {}
+
+  // Parses the first JSON value in the input text. Returns an error handle if
+  // the input could not be parsed.
+  Handle Parse(Text text);
+
+  // Parses JSON value and returns it as an object.
+  Object Read(Text text) { return Object(store_, Parse(text)); }
+
+ private:
+  // Builds structural index for input. Returns false if the input has an
+  // unterminated string or is too big to be indexed.
+  bool BuildIndex();
+
+  // Parses JSON value, object, or array at the next structural position.
+  Handle ParseValue();
+  Handle ParseObject();
+  Handle ParseArray();
+
+  // Parses string with the start quote at position. The string text points
+  // either into the input or into the string buffer if the string has escape
+  // sequences. Returns false if the string is invalid.
+  bool ParseString(int64 pos, Text *str);
+
+  // Parses scalar value, i.e. number, boolean, or null, at position.
+  Handle ParseScalar(int64 pos);
+
+  // Returns the next structural position or -1 at the end of the index.
+  int64 Next() {
+    if (next_ == index_.size()) return -1;
+    return index_[next_++];
+  }
+
+  // Returns the next structural character without consuming it.
+  int Peek() const {
+    if (next_ == index_.size()) return -1;
+    return data_[index_[next_]];
+  }
+
+  // Marks the current top of the stack.
+  Word Mark() { return stack_.offset(stack_.end()); }
+
+  // Pops elements off the stack.
+  void Release(Word mark) { stack_.set_end(stack_.address(mark)); }
+
+  // Pushes handle on the stack.
+  void Push(Handle h) { *stack_.push() = h; }
+
+  // Object store for parsed objects.
+  Store *store_;
+
+  // Input text.
+  const char *data_ = nullptr;
+  int64 size_ = 0;
+
+  // Structural index with the positions of the structural characters and the
+  // start of the strings and scalars in the input.
+  std::vector<uint32> index_;
+  size_t next_ = 0;
+
+  // Buffer for strings with escape sequences.
+  string buffer_;
+
+  // Stack for slots and elements while parsing objects and arrays.
+  HandleSpace stack_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(JSONReader);
+};
+
 }  // namespace sling
 
 #endif  // SLING_FRAME_JSON_H_
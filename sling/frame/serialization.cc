@@ -14,10 +14,14 @@
 
 #include "sling/frame/serialization.h"
 
+#include "sling/base/flags.h"
 #include "sling/base/logging.h"
 #include "sling/frame/snapshot.h"
 #include "sling/frame/wire.h"
 
+DEFINE_bool(map_snapshots, false,
+            "Memory-map frame store snapshots instead of reading them");
+
 namespace sling {
 
 InputParser::InputParser(Store *store, InputStream *stream,
@@ -95,7 +99,8 @@ string Encode(const Object &object) {
 
 void LoadStore(const string &filename, Store *store) {
   if (store->Pristine() && Snapshot::Valid(filename)) {
-    Status st = Snapshot::Read(store, filename);
+    Status st = FLAGS_map_snapshots ? Snapshot::Map(store, filename)
+                                    : Snapshot::Read(store, filename);
     if (st.ok()) {
       VLOG(1) << "Loaded " << filename << " from snapshot";
       return;
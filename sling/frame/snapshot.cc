@@ -14,6 +14,8 @@
 
 #include "sling/frame/snapshot.h"
 
+#include <vector>
+
 #include "sling/base/logging.h"
 #include "sling/base/status.h"
 #include "sling/base/types.h"
@@ -66,13 +68,7 @@ Status Snapshot::Read(Store *store, const string &filename) {
   if (hdr.version != VERSION) return Status(1, "unsupported version", filename);
 
   // Delete existing heaps.
-  Heap *heap = store->first_heap_;
-  while (heap != nullptr) {
-    Heap *next = heap->next();
-    delete heap;
-    heap = next;
-  }
-  store->first_heap_ = store->last_heap_ = store->current_heap_ = heap;
+  DeleteHeaps(store);
 
   // Read heaps from snapshot.
   Heap *symheap = nullptr;
@@ -85,10 +81,7 @@ Status Snapshot::Read(Store *store, const string &filename) {
     // Allocate new heap.
     Heap *heap = new Heap();
     heap->reserve(heapsize);
-    store->current_heap_ = heap;
-    if (store->first_heap_ == nullptr) store->first_heap_ = heap;
-    if (store->last_heap_ != nullptr) store->last_heap_->set_next(heap);
-    store->last_heap_ = heap;
+    AddHeap(store, heap);
 
     // Read heap into memory.
     st = file->Read(heap->base(), heapsize);
@@ -102,18 +95,10 @@ Status Snapshot::Read(Store *store, const string &filename) {
   }
 
   // Allocate handle table.
-  size_t handle_table_size = hdr.handles * sizeof(Store::Reference);
-  auto &handles = store->handles_;
-  handles.reserve(handle_table_size);
-  handles.set_end(handles.base() + hdr.handles);
-  store->pools_[Handle::kGlobal] = handles.base();
-
-  // Clear handle table, leaving the nil entry intact.
-  memset(handles.base() + 1, 0, (hdr.handles - 1) * sizeof(Store::Reference));
+  AllocateHandles(store, hdr.handles);
 
   // Restore handle table from self handles in objects. If snapshot has a
   // separate heap for the symbol table, all the other heaps are frozen.
-  store->free_handle_ = nullptr;
   for (Heap *heap = store->first_heap_; heap != nullptr; heap = heap->next()) {
     bool freeze = (symheap != nullptr && heap != symheap);
     Datum *object = heap->base();
@@ -143,6 +128,129 @@ Status Snapshot::Read(Store *store, const string &filename) {
   return file->Close();
 }
 
+Status Snapshot::Map(Store *store, const string &filename) {
+  // Only global stores can be restored from snapshot.
+  if (store->globals() != nullptr) {
+    return Status(1, "local store cannot be loaded from snapshot");
+  }
+
+  // Read snapshot header.
+  File *file;
+  Status st = File::Open(Filename(filename), "r", &file);
+  if (!st.ok()) return st;
+
+  Header hdr;
+  st = file->Read(&hdr, sizeof(Header));
+  if (!st.ok()) return st;
+
+  if (hdr.magic != MAGIC) return Status(1, "invalid snapshot", filename);
+  if (hdr.version != VERSION) return Status(1, "unsupported version", filename);
+
+  // Without a separate symbol heap, none of the heaps are frozen, so the
+  // snapshot is read into memory instead.
+  if (hdr.symheap == -1) {
+    st = file->Close();
+    if (!st.ok()) return st;
+    return Read(store, filename);
+  }
+
+  // Check symbol heap and handle table size.
+  if (hdr.symheap < 0 || hdr.symheap >= hdr.heaps || hdr.handles < 1) {
+    file->Close();
+    return Status(1, "invalid snapshot header", filename);
+  }
+  if (store->symbols_.bits != hdr.symtab) {
+    file->Close();
+    return Status(1, "invalid symbol table handle", filename);
+  }
+
+  // Map snapshot file into memory.
+  uint64 size;
+  st = file->GetSize(&size);
+  if (!st.ok()) return st;
+  Byte *mapping = static_cast<Byte *>(file->MapCopyOnWrite(0, size));
+  st = file->Close();
+  if (!st.ok()) return st;
+  if (mapping == nullptr) return Status(1, "cannot map snapshot", filename);
+
+  // Check heap sizes and handle table against the size of the snapshot before
+  // changing the store, so the store is left unchanged if the snapshot is
+  // truncated.
+  std::vector<uint64> heapsizes(hdr.heaps);
+  uint64 pos = sizeof(Header);
+  bool truncated = false;
+  for (int i = 0; i < hdr.heaps && !truncated; ++i) {
+    if (pos + sizeof(uint64) > size) {
+      truncated = true;
+      break;
+    }
+    heapsizes[i] = *reinterpret_cast<uint64 *>(mapping + pos);
+    pos += sizeof(uint64);
+    if (heapsizes[i] > size - pos) truncated = true;
+    pos += heapsizes[i];
+  }
+  if (truncated || hdr.handles * sizeof(uint64) > size - pos) {
+    File::FreeMappedMemory(mapping, size);
+    return Status(1, "truncated", filename);
+  }
+
+  // Delete existing heaps and transfer ownership of the mapping to the store.
+  DeleteHeaps(store);
+  store->mapping_ = mapping;
+  store->mapping_size_ = size;
+
+  // Set up heaps from snapshot. The symbol heap is copied into memory since
+  // the symbol table is updated when new symbols are added to the store. All
+  // the other heaps point directly into the mapped snapshot.
+  pos = sizeof(Header);
+  uint64 symbegin = 0;
+  uint64 symend = 0;
+  Heap *symheap = nullptr;
+  for (int i = 0; i < hdr.heaps; ++i) {
+    uint64 heapsize = heapsizes[i];
+    pos += sizeof(uint64);
+    Datum *data = reinterpret_cast<Datum *>(mapping + pos);
+
+    Heap *heap = new Heap();
+    if (hdr.symheap == i) {
+      heap->reserve(heapsize);
+      memcpy(heap->base(), data, heapsize);
+      heap->set_end(heap->address(heapsize));
+      symheap = heap;
+      symbegin = pos;
+      symend = pos + heapsize;
+    } else {
+      heap->Attach(data, heapsize);
+      heap->set_frozen(true);
+    }
+    AddHeap(store, heap);
+    pos += heapsize;
+  }
+
+  // Restore handle table from the object offsets in the snapshot.
+  const uint64 *offsets = reinterpret_cast<uint64 *>(mapping + pos);
+  AllocateHandles(store, hdr.handles);
+  Store::Reference *handles = store->handles_.base();
+  Byte *symbase = reinterpret_cast<Byte *>(symheap->base());
+  for (int i = 1; i < hdr.handles; ++i) {
+    uint64 offset = offsets[i];
+    if (offset == 0) continue;
+    Byte *object;
+    if (offset >= symbegin && offset < symend) {
+      object = symbase + (offset - symbegin);
+    } else {
+      object = mapping + offset;
+    }
+    handles[i].object = reinterpret_cast<Datum *>(object);
+  }
+
+  // Set up symbol table.
+  store->num_symbols_ = hdr.symbols;
+  store->num_buckets_ = hdr.buckets;
+
+  return Status::OK;
+}
+
 Status Snapshot::Write(Store *store, const string &filename) {
   // Only global stores can be snapshot.
   if (store->globals() != nullptr) {
@@ -175,19 +283,80 @@ Status Snapshot::Write(Store *store, const string &filename) {
     return st;
   }
 
-  // Write heaps.
+  // Write heaps and compute the file offsets for the objects in the heaps.
+  std::vector<uint64> offsets(hdr.handles);
+  uint64 pos = sizeof(Header);
   for (Heap *heap = store->first_heap_; heap != nullptr; heap = heap->next()) {
     uint64 heapsize = heap->size();
+    pos += sizeof(uint64);
+
+    // Objects in heaps that will be frozen are written with the mark bit set.
+    // The marks are only set temporarily unless the heap is already frozen.
+    bool freeze = (symheap != nullptr && heap != symheap);
+    bool premark = freeze && !heap->frozen();
+    for (Datum *object = heap->base(); object < heap->end();
+         object = object->next()) {
+      if (object->IsInvalid()) continue;
+      DCHECK_LT(object->self.idx(), static_cast<uint32>(hdr.handles));
+      offsets[object->self.idx()] = pos + Region::size(heap->base(), object);
+      if (premark) object->mark();
+    }
+
     st = file->Write(&heapsize, sizeof(uint64));
     if (st.ok()) st = file->Write(heap->base(), heapsize);
+
+    if (premark) {
+      for (Datum *object = heap->base(); object < heap->end();
+           object = object->next()) {
+        if (!object->IsInvalid()) object->unmark();
+      }
+    }
+
     if (!st) {
       file->Close();
       return st;
     }
+    pos += heapsize;
+  }
+
+  // Write handle table.
+  st = file->Write(offsets.data(), offsets.size() * sizeof(uint64));
+  if (!st) {
+    file->Close();
+    return st;
   }
 
   return file->Close();
 }
 
-}  // namespace sling
+void Snapshot::DeleteHeaps(Store *store) {
+  Heap *heap = store->first_heap_;
+  while (heap != nullptr) {
+    Heap *next = heap->next();
+    delete heap;
+    heap = next;
+  }
+  store->first_heap_ = store->last_heap_ = store->current_heap_ = nullptr;
+}
+
+void Snapshot::AddHeap(Store *store, Heap *heap) {
+  store->current_heap_ = heap;
+  if (store->first_heap_ == nullptr) store->first_heap_ = heap;
+  if (store->last_heap_ != nullptr) store->last_heap_->set_next(heap);
+  store->last_heap_ = heap;
+}
+
+void Snapshot::AllocateHandles(Store *store, int handles) {
+  // Allocate handle table.
+  size_t handle_table_size = handles * sizeof(Store::Reference);
+  auto &table = store->handles_;
+  table.reserve(handle_table_size);
+  table.set_end(table.base() + handles);
+  store->pools_[Handle::kGlobal] = table.base();
 
+  // Clear handle table, leaving the nil entry intact.
+  memset(table.base() + 1, 0, (handles - 1) * sizeof(Store::Reference));
+  store->free_handle_ = nullptr;
+}
+
+}  // namespace sling
@@ -37,13 +37,27 @@ class Snapshot {
   // Read snapshot into empty global store.
   static Status Read(Store *store, const string &filename);
 
+  // Map snapshot into empty global store. The frozen heaps are memory-mapped
+  // copy-on-write directly from the snapshot file instead of being read into
+  // memory, so processes loading the same snapshot share the pages in the
+  // page cache until they are modified. Only the symbol heap and the handle
+  // table are allocated. Falls back to reading the snapshot if it does not
+  // have a separate symbol heap.
+  static Status Map(Store *store, const string &filename);
+
   // Write store to snapshot file.
   static Status Write(Store *store, const string &filename);
 
  private:
   // Current magic and version for snapshots.
   static const int MAGIC = 0x50414e53;
-  static const int VERSION = 2;
+  static const int VERSION = 3;
+
+  // A snapshot file consists of a header followed by the heaps, each prefixed
+  // with its size. Objects in heaps other than the symbol heap are stored with
+  // the mark bit set, so they can be used without modification. The heaps are
+  // followed by the handle table, which holds the file offset of the object
+  // for each handle (or zero for unused handles).
 
   // Snapshot file header.
   struct Header {
@@ -56,6 +70,15 @@ class Snapshot {
     int buckets;    // number of hash buckets in the symbol table
     int symheap;    // heap for symbol table (-1 means no separate heap)
   };
+
+  // Delete all heaps in store.
+  static void DeleteHeaps(Store *store);
+
+  // Add heap to store.
+  static void AddHeap(Store *store, Heap *heap);
+
+  // Allocate handle table for store with all handles except nil cleared.
+  static void AllocateHandles(Store *store, int handles);
 };
 
 }  // namespace sling
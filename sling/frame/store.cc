@@ -14,6 +14,8 @@
 
 #include "sling/frame/store.h"
 
+#include <sys/mman.h>
+
 #include <string>
 
 #include "sling/base/clock.h"
@@ -211,10 +213,44 @@ Store::~Store() {
     heap = next;
   }
 
+  // Release memory mapping for snapshot.
+  if (mapping_ != nullptr) munmap(mapping_, mapping_size_);
+
   // Release reference to shared global store.
   if (globals_ != nullptr && globals_->shared()) globals_->Release();
 }
 
+void Store::Reset() {
+  // Only local stores can be reset.
+  CHECK(globals_ != nullptr) << "Only local stores can be reset";
+  CHECK(refs_ <= 0) << "Reset with live references to store";
+  CHECK_EQ(gc_locks_, 0);
+
+  // Detach remaining roots and externals from the store.
+  roots_.Unlink();
+  externals_.Unlink();
+  externals_.prev_ = externals_.next_ = &externals_;
+
+  // Empty all heaps and the handle table.
+  for (Heap *heap = first_heap_; heap != nullptr; heap = heap->next()) {
+    heap->reset();
+  }
+  current_heap_ = first_heap_;
+  handles_.reset();
+  free_handle_ = nullptr;
+
+  // Reset statistics.
+  num_gcs_ = 0;
+  gc_time_ = 0;
+  gc_pending_ = false;
+
+  // Allocate new symbol map with a single bucket.
+  num_symbols_ = 0;
+  num_buckets_ = 1;
+  symbols_ = AllocateArray(num_buckets_);
+  roots_.handle_ = symbols_;
+}
+
 void Store::Share() {
   CHECK(!shared()) << "Store is already shared";
   refs_ = 1;
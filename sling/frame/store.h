@@ -892,7 +892,10 @@ struct MemoryUsage {
 // leaving a contiguous area at the end of the heap for allocating new objects.
 class Heap : public Space<Datum> {
  public:
-  Heap() : next_(nullptr), frozen_(false) {}
+  Heap() : next_(nullptr), frozen_(false), mapped_(false) {}
+
+  // Heaps backed by mapped memory do not own their memory.
+  ~Heap() { if (mapped_) base_ = nullptr; }
 
   // Next heap in store.
   Heap *next() const { return next_; }
@@ -902,6 +905,18 @@ class Heap : public Space<Datum> {
   bool frozen() const { return frozen_; }
   void set_frozen(bool frozen) { frozen_ = frozen; }
 
+  // Heap backed by external memory, e.g. a memory-mapped snapshot.
+  bool mapped() const { return mapped_; }
+
+  // Uses external memory for the heap. The memory is not owned by the heap and
+  // all the space in the heap is marked as used, so it is never resized.
+  void Attach(Datum *base, size_t size) {
+    DCHECK(base_ == nullptr);
+    base_ = reinterpret_cast<Address>(base);
+    end_ = limit_ = base_ + size;
+    mapped_ = true;
+  }
+
  private:
   // Next heap for store. All the heaps for a store are linked together in a
   // linked list.
@@ -910,6 +925,9 @@ class Heap : public Space<Datum> {
   // A heap can be frozen making the objects in the heap read-only.
   bool frozen_;
 
+  // Mapped heaps point into memory owned by the store.
+  bool mapped_;
+
   DISALLOW_COPY_AND_ASSIGN(Heap);
 };
 
@@ -1073,6 +1091,13 @@ class Store {
   // the store read-only.
   void Freeze();
 
+  // Deletes all objects in a local store, but keeps the heaps and the handle
+  // table for allocating new objects. This is much faster than deleting the
+  // store and creating a new one when a local store is used for processing a
+  // stream of messages. Like when the store is deleted, roots and externals
+  // still linked to the store are detached from it.
+  void Reset();
+
   // Merges occurrences of the same string. This saves memory by only keeping
   // one copy of each string value. This uses hashing, so it is not guaranteed
   // to find all identical strings.
@@ -1392,6 +1417,11 @@ class Store {
   Heap *first_heap_;
   Heap *last_heap_;
 
+  // Memory mapping for stores loaded from memory-mapped snapshots. Mapped
+  // heaps point into this memory, which is released when the store is deleted.
+  void *mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+
   // The handle table is used for storing references to objects. All access to
   // objects go through the handle table, which provides a level of indirection
   // that allows object to move dynamically, e.g. during garbage collection and
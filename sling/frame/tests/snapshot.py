@@ -0,0 +1,73 @@
+# Copyright 2018 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+
+"""Check that frames in mapped snapshots can be redefined and modified."""
+
+import os
+import sys
+import tempfile
+import sling
+
+errors = 0
+
+def check(name, actual, expected):
+  global errors
+  if actual != expected:
+    print(name, "failed: expected", expected, "but got", actual)
+    errors += 1
+
+tmpdir = tempfile.mkdtemp()
+basefn = os.path.join(tmpdir, "base.sling")
+extrafn = os.path.join(tmpdir, "extra.sling")
+
+# Make store with some frames and write it with a snapshot.
+kb = sling.Store()
+kb.parse("""
+  {=a name: "A" value: 1}
+  {=b name: "B" value: 2 ref: a}
+""")
+kb.save(basefn, binary=True)
+kb.snapshot(basefn)
+
+# Second file that redefines one of the frames in the snapshot.
+with open(extrafn, "w") as f:
+  f.write('{=a name: "A2" value: 3}\n')
+
+for mapped in [False, True]:
+  mode = "map" if mapped else "read"
+
+  # Load snapshot and then the file that redefines a frame from it.
+  kb = sling.Store()
+  kb.load(basefn, map=mapped)
+  check(mode + " snapshot", kb["a"]["value"], 1)
+  kb.load(extrafn)
+  check(mode + " redefine name", kb["a"]["name"], "A2")
+  check(mode + " redefine value", kb["a"]["value"], 3)
+  check(mode + " unchanged", kb["b"]["value"], 2)
+  check(mode + " reference", kb["b"]["ref"], kb["a"])
+
+  # Modify frame in the snapshot in place.
+  kb["b"]["value"] = 4
+  kb["b"].append("extra", 5)
+  check(mode + " set", kb["b"]["value"], 4)
+  check(mode + " add", kb["b"]["extra"], 5)
+
+for fn in [basefn, basefn + ".snap", extrafn]: os.remove(fn)
+os.rmdir(tmpdir)
+
+if errors > 0:
+  print("*****", errors, "snapshot tests failed *****")
+  sys.exit(1)
+print("==== ALL TESTS PASSED ====")
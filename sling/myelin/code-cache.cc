@@ -0,0 +1,452 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/myelin/code-cache.h"
+
+#include <link.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/file/file.h"
+#include "sling/myelin/compute.h"
+#include "sling/string/printf.h"
+#include "sling/util/fingerprint.h"
+#include "third_party/jit/cpu.h"
+
+namespace sling {
+namespace myelin {
+
+namespace {
+
+// Magic number and version for cached code files.
+const uint32 kCodeCacheMagic = 0x434a594d;
+const uint32 kCodeCacheVersion = 2;
+
+// Maximum size of constant tensors whose values are added to the cache key.
+// Kernels only read the values of small constants, like scalars and axis
+// arguments, when generating code. Larger constants are referenced by address.
+const size_t kMaxKeyedConstantSize = 1024;
+
+// Relocation types for external references in cached code.
+enum RelocationType {
+  RELOC_TENSOR = 0,  // data address of global tensor
+  RELOC_MODULE = 1,  // address in loaded executable or shared object
+};
+
+// Counter for making temporary file names unique.
+std::atomic<int> temp_counter(0);
+
+// Loaded executable or shared object.
+struct Module {
+  string name;      // file name of module (empty for main executable)
+  uint64 base = 0;  // load address of module
+};
+
+// Search for loaded module by address or by name.
+struct ModuleSearch {
+  uint64 address = 0;            // address in module
+  const string *name = nullptr;  // module name
+  Module *module;                // module found
+};
+
+int FindModuleCallback(struct dl_phdr_info *info, size_t size, void *data) {
+  ModuleSearch *search = static_cast<ModuleSearch *>(data);
+  if (search->name != nullptr) {
+    // Match module name.
+    if (*search->name != info->dlpi_name) return 0;
+  } else {
+    // Check if address is inside one of the segments of the module.
+    bool inside = false;
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+      const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+      if (phdr.p_type != PT_LOAD) continue;
+      uint64 start = info->dlpi_addr + phdr.p_vaddr;
+      uint64 end = start + phdr.p_memsz;
+      if (search->address >= start && search->address < end) inside = true;
+    }
+    if (!inside) return 0;
+  }
+  search->module->name = info->dlpi_name;
+  search->module->base = info->dlpi_addr;
+  return 1;
+}
+
+// Find module containing address.
+bool FindModule(uint64 address, Module *module) {
+  ModuleSearch search;
+  search.address = address;
+  search.module = module;
+  return dl_iterate_phdr(FindModuleCallback, &search) != 0;
+}
+
+// Find module by name.
+bool FindModule(const string &name, Module *module) {
+  ModuleSearch search;
+  search.name = &name;
+  search.module = module;
+  return dl_iterate_phdr(FindModuleCallback, &search) != 0;
+}
+
+// Return identity of module file. Code addresses in a module are only valid
+// for the same version of the module, so the file size and modification time
+// are used for detecting changes to the module.
+string ModuleIdentity(const Module &module) {
+  const char *filename = module.name.empty() ? "/proc/self/exe"
+                                             : module.name.c_str();
+  struct stat st;
+  if (stat(filename, &st) != 0) return "";
+  return StringPrintf("%s:%lld:%lld",
+                      module.name.c_str(),
+                      static_cast<long long>(st.st_size),
+                      static_cast<long long>(st.st_mtime));
+}
+
+// Output buffer for cache signatures and cached code files.
+class Writer {
+ public:
+  void Write(const void *data, size_t size) {
+    data_.append(static_cast<const char *>(data), size);
+  }
+  void WriteInt(uint32 n) { Write(&n, sizeof(uint32)); }
+  void WriteLong(uint64 n) { Write(&n, sizeof(uint64)); }
+  void WriteString(const string &str) {
+    WriteInt(str.size());
+    data_.append(str);
+  }
+  void WriteShape(const Shape &shape) {
+    WriteInt(shape.rank());
+    for (int d = 0; d < shape.rank(); ++d) WriteInt(shape.dim(d));
+  }
+
+  const string &data() const { return data_; }
+
+ private:
+  string data_;
+};
+
+// Input parser for cached code files. Reads fail on truncated input.
+class Reader {
+ public:
+  explicit Reader(const string &data)
+      : ptr_(data.data()), end_(data.data() + data.size()) {}
+
+  const char *Get(size_t size) {
+    if (end_ - ptr_ < size) return nullptr;
+    const char *p = ptr_;
+    ptr_ += size;
+    return p;
+  }
+  bool ReadInt(uint32 *n) { return Read(n, sizeof(uint32)); }
+  bool ReadLong(uint64 *n) { return Read(n, sizeof(uint64)); }
+  bool ReadString(string *str) {
+    uint32 size;
+    if (!ReadInt(&size)) return false;
+    const char *p = Get(size);
+    if (p == nullptr) return false;
+    str->assign(p, size);
+    return true;
+  }
+
+ private:
+  bool Read(void *data, size_t size) {
+    const char *p = Get(size);
+    if (p == nullptr) return false;
+    memcpy(data, p, size);
+    return true;
+  }
+
+  const char *ptr_;
+  const char *end_;
+};
+
+// Add tensor layout to signature.
+void AddTensorSignature(const Tensor *tensor, Writer *sig) {
+  sig->WriteString(tensor->name());
+  sig->WriteInt(tensor->type());
+  sig->WriteShape(tensor->shape());
+  sig->WriteShape(tensor->aligned());
+  sig->WriteShape(tensor->stride());
+  sig->WriteInt(tensor->order());
+  sig->WriteLong(tensor->offset());
+  sig->WriteLong(tensor->size());
+  sig->WriteLong(tensor->space());
+  sig->WriteInt(tensor->byte_alignment());
+  sig->WriteInt(tensor->ref());
+  sig->WriteInt(tensor->dynamic());
+  sig->WriteInt(tensor->constant());
+  sig->WriteInt(tensor->IsLocal());
+  sig->WriteString(tensor->cell() != nullptr ? tensor->cell()->name() : "");
+}
+
+}  // namespace
+
+bool CodeCache::Key(const Network *network, uint64 *key) const {
+  // Only JIT-generated host code is cached.
+  const Options &options = network->options();
+  if (options.aot || options.pic || options.debug || options.profiling) {
+    return false;
+  }
+  for (const Step *step : network->steps()) {
+    if (step->placement() != HOST) return false;
+  }
+
+  // Add the binary with the code generators, the CPU features, the runtime,
+  // and the compiler options to the signature.
+  Writer sig;
+  sig.WriteInt(kCodeCacheVersion);
+  Module self;
+  if (!FindModule(reinterpret_cast<uint64>(&FindModuleCallback), &self)) {
+    return false;
+  }
+  sig.WriteString(ModuleIdentity(self));
+  sig.WriteInt(jit::CPU::SupportedFeatures());
+  sig.WriteInt(jit::CPU::CacheLineSize());
+  Runtime *runtime = network->runtime();
+  sig.WriteString(typeid(*runtime).name());
+  sig.WriteString(runtime->Description());
+  sig.WriteInt(options.parameter_element_order);
+  sig.WriteInt(options.external_profiler);
+  sig.WriteInt(options.global_profiler);
+  sig.WriteInt(options.dynamic_allocation);
+  sig.WriteInt(options.shared_tensors);
+  sig.WriteInt(options.sync_steps);
+  sig.WriteInt(options.fast_math);
+  sig.WriteInt(options.sparse_threshold);
+  sig.WriteInt(options.flops_address != nullptr);
+
+  // Add tensor layouts.
+  for (const Tensor *tensor : network->globals()) {
+    AddTensorSignature(tensor, &sig);
+  }
+  for (const Tensor *tensor : network->parameters()) {
+    AddTensorSignature(tensor, &sig);
+  }
+
+  // Add cell instance layouts.
+  for (const Cell *cell : network->cells()) {
+    sig.WriteString(cell->name());
+    sig.WriteLong(cell->instance_size());
+    sig.WriteInt(cell->instance_alignment());
+    sig.WriteLong(cell->data_start());
+    sig.WriteInt(cell->num_tasks());
+    for (int i = 0; i < cell->num_tasks(); ++i) {
+      sig.WriteInt(cell->task(i));
+      sig.WriteLong(cell->task_offset(i));
+    }
+  }
+
+  // Add steps and their kernels.
+  for (const Step *step : network->steps()) {
+    sig.WriteString(step->cell()->name());
+    sig.WriteString(step->name());
+    sig.WriteString(step->type());
+    sig.WriteString(step->kernel()->Name());
+    sig.WriteInt(step->task_index());
+    sig.WriteInt(step->size());
+    for (const Attribute &attr : *step) {
+      sig.WriteString(attr.name);
+      sig.WriteString(attr.value);
+    }
+    sig.WriteInt(step->indegree());
+    for (const Tensor *input : step->inputs()) sig.WriteString(input->name());
+    sig.WriteInt(step->outdegree());
+    for (const Tensor *output : step->outputs()) {
+      sig.WriteString(output->name());
+    }
+  }
+
+  // Kernels can use the values of small constant tensors for generating code,
+  // so these are also added to the key.
+  uint64 fp = Fingerprint(sig.data().data(), sig.data().size());
+  for (const Tensor *tensor : network->globals()) {
+    if (tensor->constant() && tensor->data() != nullptr &&
+        tensor->size() <= kMaxKeyedConstantSize) {
+      fp = FingerprintCat(fp, Fingerprint(tensor->data(), tensor->size()));
+    }
+  }
+  *key = fp;
+  return true;
+}
+
+bool CodeCache::Load(uint64 key, const Cell *cell, jit::Code *code) const {
+  // Read cached code file.
+  string filename = Filename(key, cell);
+  if (!File::Exists(filename)) return false;
+  string data;
+  if (!File::ReadContents(filename, &data).ok()) return false;
+  Reader in(data);
+
+  // Check header.
+  uint32 magic, version;
+  uint64 filekey;
+  string name;
+  if (!in.ReadInt(&magic) || magic != kCodeCacheMagic) return false;
+  if (!in.ReadInt(&version) || version != kCodeCacheVersion) return false;
+  if (!in.ReadLong(&filekey) || filekey != key) return false;
+  if (!in.ReadString(&name) || name != cell->name()) return false;
+
+  // Get generated code.
+  uint32 size;
+  if (!in.ReadInt(&size)) return false;
+  const char *generated = in.Get(size);
+  if (generated == nullptr) return false;
+  string buffer(generated, size);
+
+  // Relocate external references.
+  const Network *network = cell->network();
+  std::unordered_map<string, uint64> bases;
+  uint32 num_relocs;
+  if (!in.ReadInt(&num_relocs)) return false;
+  for (int i = 0; i < num_relocs; ++i) {
+    // Resolve address of external reference.
+    uint32 type;
+    uint64 address;
+    if (!in.ReadInt(&type)) return false;
+    if (type == RELOC_TENSOR) {
+      string symbol;
+      if (!in.ReadString(&symbol)) return false;
+      Tensor *tensor = network->LookupParameter(symbol);
+      if (tensor == nullptr || !tensor->IsGlobal()) return false;
+      address = reinterpret_cast<uint64>(tensor->data());
+    } else if (type == RELOC_MODULE) {
+      string module_name, identity;
+      uint64 offset;
+      if (!in.ReadString(&module_name)) return false;
+      if (!in.ReadString(&identity)) return false;
+      if (!in.ReadLong(&offset)) return false;
+      auto f = bases.find(identity);
+      if (f == bases.end()) {
+        Module module;
+        if (!FindModule(module_name, &module)) return false;
+        if (ModuleIdentity(module) != identity) return false;
+        f = bases.emplace(identity, module.base).first;
+      }
+      address = f->second + offset;
+    } else {
+      return false;
+    }
+
+    // Patch references in code.
+    uint32 num_refs;
+    if (!in.ReadInt(&num_refs)) return false;
+    for (int j = 0; j < num_refs; ++j) {
+      uint32 offset;
+      if (!in.ReadInt(&offset)) return false;
+      if (offset + sizeof(uint64) > size) return false;
+      memcpy(&buffer[offset], &address, sizeof(uint64));
+    }
+  }
+
+  // Get the step information that is otherwise recorded during code
+  // generation.
+  uint32 num_steps;
+  if (!in.ReadInt(&num_steps) || num_steps != cell->steps().size()) {
+    return false;
+  }
+  std::vector<uint32> noops(num_steps);
+  std::vector<string> variants(num_steps);
+  for (int i = 0; i < num_steps; ++i) {
+    if (!in.ReadInt(&noops[i])) return false;
+    if (!in.ReadString(&variants[i])) return false;
+  }
+
+  // Allocate executable code object.
+  code->Allocate(&buffer[0], size);
+  for (int i = 0; i < num_steps; ++i) {
+    Step *step = cell->steps()[i];
+    step->noop_ = noops[i];
+    step->set_variant(variants[i]);
+  }
+  return true;
+}
+
+void CodeCache::Store(uint64 key, const Cell *cell,
+                      jit::CodeGenerator *generator) const {
+  // Build relocations for external references.
+  const Network *network = cell->network();
+  Writer relocs;
+  for (const jit::Extern &e : generator->externs()) {
+    uint64 address = reinterpret_cast<uint64>(e.address);
+    Tensor *tensor = network->LookupParameter(e.symbol);
+    if (tensor != nullptr && tensor->IsGlobal() &&
+        reinterpret_cast<uint64>(tensor->data()) == address) {
+      relocs.WriteInt(RELOC_TENSOR);
+      relocs.WriteString(e.symbol);
+    } else {
+      Module module;
+      if (!FindModule(address, &module)) {
+        VLOG(5) << "Code for " << cell->name() << " not cached because "
+                << e.symbol << " cannot be relocated";
+        return;
+      }
+      relocs.WriteInt(RELOC_MODULE);
+      relocs.WriteString(module.name);
+      relocs.WriteString(ModuleIdentity(module));
+      relocs.WriteLong(address - module.base);
+    }
+    relocs.WriteInt(e.refs.size());
+    for (const jit::Extern::Ref &ref : e.refs) {
+      if (ref.relative) return;
+      relocs.WriteInt(ref.offset);
+    }
+  }
+
+  // Build cached code file.
+  Writer out;
+  out.WriteInt(kCodeCacheMagic);
+  out.WriteInt(kCodeCacheVersion);
+  out.WriteLong(key);
+  out.WriteString(cell->name());
+  out.WriteInt(generator->size());
+  out.Write(generator->begin(), generator->size());
+  out.WriteInt(generator->externs().size());
+  out.Write(relocs.data().data(), relocs.data().size());
+  out.WriteInt(cell->steps().size());
+  for (const Step *step : cell->steps()) {
+    out.WriteInt(step->noop());
+    out.WriteString(step->variant());
+  }
+
+  // Write code to temporary file and rename it, so concurrent readers never
+  // see a partially written file.
+  if (!File::Exists(dir_)) File::Mkdir(dir_);
+  string filename = Filename(key, cell);
+  string tmpname = StringPrintf("%s.%d.%d", filename.c_str(), getpid(),
+                                temp_counter++);
+  Status st = File::WriteContents(tmpname, out.data());
+  if (st.ok()) st = File::Rename(tmpname, filename);
+  if (!st.ok()) {
+    LOG(WARNING) << "Error writing code for " << cell->name()
+                 << " to code cache: " << st;
+    File::Delete(tmpname);
+  }
+}
+
+string CodeCache::Filename(uint64 key, const Cell *cell) const {
+  uint64 fp = FingerprintCat(key, Fingerprint(cell->name().data(),
+                                              cell->name().size()));
+  return StringPrintf("%s/%016llx.jit", dir_.c_str(),
+                      static_cast<unsigned long long>(fp));
+}
+
+}  // namespace myelin
+}  // namespace sling
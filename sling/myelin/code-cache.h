@@ -0,0 +1,74 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_MYELIN_CODE_CACHE_H_
+#define SLING_MYELIN_CODE_CACHE_H_
+
+#include <string>
+
+#include "sling/base/types.h"
+#include "third_party/jit/code.h"
+
+namespace sling {
+namespace myelin {
+
+class Network;
+class Cell;
+
+// Persistent on-disk cache for generated code. The code for each cell is
+// stored in a file keyed by a fingerprint of the network, which covers the
+// steps and their kernels, the tensor layouts and instance offsets, the values
+// of small constant tensors, the compiler options, the CPU features, and the
+// binary containing the kernel generators. Only the values of constants that
+// kernels can embed in the code are keyed; kernels must not generate code that
+// depends on the values of larger constants. Absolute references in the code
+// to global tensors and to functions and data in loaded modules are stored as
+// relocations and resolved when the code is loaded in another process, so a
+// warm start can skip code generation. Code with references that cannot be
+// relocated, e.g. to heap-allocated runtime objects, is not cached.
+//
+// The no-op flags and kernel variants of the steps are stored with the code
+// and restored when it is loaded. Other side effects of code generation, like
+// the register usage of the steps, are not restored. The code cache is
+// thread-safe.
+class CodeCache {
+ public:
+  // Initialize code cache in directory.
+  explicit CodeCache(const string &dir) : dir_(dir) {}
+
+  // Compute cache key for network. This must be called after the tensors have
+  // been laid out and the instances have been allocated. Returns false if the
+  // code for the network cannot be cached.
+  bool Key(const Network *network, uint64 *key) const;
+
+  // Load code for cell from cache. Returns false if the cell is not in the
+  // cache or the code could not be relocated.
+  bool Load(uint64 key, const Cell *cell, jit::Code *code) const;
+
+  // Store generated code for cell in cache.
+  void Store(uint64 key, const Cell *cell,
+             jit::CodeGenerator *generator) const;
+
+ private:
+  // Return file name for cached cell code.
+  string Filename(uint64 key, const Cell *cell) const;
+
+  // Cache directory.
+  string dir_;
+};
+
+}  // namespace myelin
+}  // namespace sling
+
+#endif  // SLING_MYELIN_CODE_CACHE_H_
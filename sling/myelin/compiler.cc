@@ -26,6 +26,7 @@
 #include "sling/myelin/elf-linker.h"
 #include "sling/myelin/flow.h"
 #include "sling/myelin/graph.h"
+#include "sling/myelin/multi-process.h"
 #include "sling/myelin/profile.h"
 #include "sling/myelin/cuda/cuda-runtime.h"
 #include "sling/myelin/kernel/cuda.h"
@@ -42,6 +43,7 @@ DEFINE_string(input_graph, "", "File for saving raw input flow as SVG file");
 DEFINE_string(graph, "", "File for saving analyzed flow as SVG file");
 DEFINE_string(dot, "", "File for saving analyzed flow as DOT file");
 DEFINE_string(jit_code, "", "File for saving JIT generated code");
+DEFINE_string(jit_cache, "", "Directory for persistent cache of JIT code");
 DEFINE_bool(dump_input_flow, false, "Dump raw input flow to log");
 DEFINE_bool(dump_flow, false, "Dump final analyzed flow to log");
 DEFINE_bool(dump_cells, false, "Dump cells after compilation");
@@ -51,6 +53,9 @@ DEFINE_bool(param_stats, false, "Dump model parameter statistics");
 DEFINE_bool(check_flow_consistency, false, "Check that flow is consistent");
 DEFINE_bool(dynamic_instance_allocation, false, "Dynamic instance allocation");
 DEFINE_bool(mkl, false, "Use Intel Math Kernel Library");
+DEFINE_bool(quantize, false, "Quantize constant weight matrices to int8");
+DEFINE_string(weight_type, "", "Storage type for constant weights (float16 or "
+              "bfloat16)");
 DEFINE_bool(sync_steps, false, "Synchronize all compute steps");
 DEFINE_bool(fast_math, false, "Fast approximate math ops");
 DEFINE_bool(graph_all_vars, false, "Include all variables in DOT graph");
@@ -59,6 +64,8 @@ DEFINE_bool(graph_optimizer, false, "Include optimizer in DOT graph");
 DEFINE_string(graph_layout, "", "DOT graph layout");
 DEFINE_string(data_profile, "", "File name prefix for data instance diagrams");
 DEFINE_bool(jit_debug, false, "Debug break in jit code");
+DEFINE_int32(loop_threads, 1, "Number of threads for parallel kernel loops "
+             "(0 for one per CPU core)");
 DEFINE_int32(cuda_device, -1, "CUDA device number");
 DEFINE_int32(cuda_context_flags, 0, "CUDA context flags");
 DEFINE_int32(sparse_threshold, 64, "Minimum dimension size for sparse update");
@@ -72,10 +79,16 @@ namespace myelin {
 static myelin::CUDARuntime *cudart = nullptr;
 static int cudart_refs = 0;
 
+// Multi-processor runtime for parallel kernel loops.
+static myelin::MultiProcessorRuntime *mprt = nullptr;
+
 Compiler::Compiler() {
-  // Register standard kernels.
+  // Register standard kernels. Matrix multiplications are not fused with
+  // element-wise ops when these are computed by CUDA or MKL kernels.
   library_ = new Library();
-  RegisterStandardLibrary(library_);
+  int flags = 0;
+  if (FLAGS_gpu || FLAGS_mkl) flags |= LIBRARY_NOMATMULFUSION;
+  RegisterStandardLibrary(library_, flags);
 
   // Parse CPU feature flags and enable/disable CPU features.
   if (!FLAGS_cpu.empty()) SetCPUFeatures(FLAGS_cpu);
@@ -89,16 +102,33 @@ Compiler::Compiler() {
     runtime_ = cudart;
     cudart_refs++;
     RegisterCUDALibrary(library_);
+  } else if (FLAGS_loop_threads != 1) {
+    // Use multi-processor runtime for splitting kernel loops across threads.
+    if (mprt == nullptr) {
+      mprt = new myelin::MultiProcessorRuntime(FLAGS_loop_threads);
+    }
+    runtime_ = mprt;
   }
 
   // Add extra kernels.
   if (FLAGS_mkl) RegisterMKLLibrary(library_);
+  if (FLAGS_quantize) RegisterQuantizeTransforms(library_);
+  if (!FLAGS_weight_type.empty()) {
+    Type type = TypeTraits::of(FLAGS_weight_type).type();
+    CHECK(type == DT_HALF || type == DT_BFLOAT16)
+        << "Unsupported weight type: " << FLAGS_weight_type;
+    RegisterHalfTransforms(library_, type);
+  }
+
+  // Set up persistent code cache.
+  if (!FLAGS_jit_cache.empty()) code_cache_ = new CodeCache(FLAGS_jit_cache);
 }
 
 Compiler::~Compiler() {
   // Kernel library cannot be deallocated when profiling is enabled since the
   // profiler needs to be able to access the registered kernels.
   if (!FLAGS_profile) delete library_;
+  delete code_cache_;
 
   if (--cudart_refs == 0) {
     delete cudart;
@@ -168,6 +198,7 @@ void Compiler::Compile(Flow *flow, Network *net) {
   if (FLAGS_fast_math) net->options().fast_math = true;
   if (FLAGS_separate_tensors) net->options().shared_tensors = false;
   net->options().sparse_threshold = FLAGS_sparse_threshold;
+  if (code_cache_ != nullptr) net->set_code_cache(code_cache_);
 
   CHECK(net->Compile(*flow, *library_));
 
@@ -288,6 +319,7 @@ void SetCPUFeatures(const string &features) {
     jit::CPU::Disable(jit::AVX);
     jit::CPU::Disable(jit::AVX2);
     jit::CPU::Disable(jit::AVX512F);
+    jit::CPU::Disable(jit::AVX512VNNI);
     jit::CPU::Disable(jit::FMA3);
   }
 
@@ -321,6 +353,8 @@ void SetCPUFeatures(const string &features) {
       feature = jit::AVX2;
     } else if (name == "avx512") {
       feature = jit::AVX512F;
+    } else if (name == "avx512vnni") {
+      feature = jit::AVX512VNNI;
     } else if (name == "fma3") {
       feature = jit::FMA3;
     } else {
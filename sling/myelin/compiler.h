@@ -15,6 +15,7 @@
 #ifndef SLING_MYELIN_COMPILER_H_
 #define SLING_MYELIN_COMPILER_H_
 
+#include "sling/myelin/code-cache.h"
 #include "sling/myelin/compute.h"
 #include "sling/myelin/flow.h"
 
@@ -56,6 +57,9 @@ class Compiler {
 
   // Enable perf FLOP counter.
   bool perf_flopctr_ = true;
+
+  // Persistent cache for generated code.
+  CodeCache *code_cache_ = nullptr;
 };
 
 // Enable/disable CPU features for compiler.
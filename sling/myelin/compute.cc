@@ -24,6 +24,7 @@
 #include "sling/base/logging.h"
 #include "sling/base/types.h"
 #include "sling/file/file.h"
+#include "sling/myelin/code-cache.h"
 #include "sling/myelin/macro-assembler.h"
 #include "sling/string/printf.h"
 
@@ -1857,10 +1858,25 @@ bool Network::Compile(const Flow &flow, const Library &library) {
     }
   }
 
+  // Compute key for looking up generated code in code cache. The code cache
+  // can only be used with the JIT linker.
+  uint64 cache_key = 0;
+  bool cached = false;
+  if (code_cache_ != nullptr && linker_ == &jit_linker) {
+    cached = code_cache_->Key(this, &cache_key);
+  }
+
   // Compile each cell computation.
   for (Cell *cell : cells_) {
+    // Try to load code for cell from code cache.
+    if (cached && code_cache_->Load(cache_key, cell, &cell->code_)) {
+      VLOG(5) << cell->name() << " loaded from code cache";
+      continue;
+    }
+
     // Start code generation for cell.
     linker_->BeginCell(cell);
+    int num_resources = resources_.size();
 
     // Create macro assembler for code generation.
     MacroAssembler masm(nullptr, 0, options_);
@@ -2156,6 +2172,12 @@ bool Network::Compile(const Flow &flow, const Library &library) {
             << " entry address: " << cell->code_.entry()
             << " code size: " << cell->code_.size()
             << " data size: " << cell->instance_size();
+
+    // Store generated code in code cache. Code that depends on resources
+    // allocated by the kernels cannot be reused in another process.
+    if (cached && resources_.size() == num_resources) {
+      code_cache_->Store(cache_key, cell, &masm);
+    }
   }
 
   // Notify linker that compilation of network has completed.
@@ -32,6 +32,7 @@ class MacroAssembler;
 class Network;
 class Cell;
 class Step;
+class CodeCache;
 class Instance;
 class Tensor;
 class TensorData;
@@ -189,6 +190,9 @@ class Runtime {
  public:
   typedef void (*TaskFunc)(Task *);
   typedef void (*InstanceFunc)(void *);
+  typedef void (*LoopFunc)(void *data, int64 begin, int64 end);
+  typedef void (*ParallelFunc)(LoopFunc body, void *data,
+                               int64 size, int64 grain);
 
   virtual ~Runtime() = default;
 
@@ -238,6 +242,12 @@ class Runtime {
   // can return null if no synchronization is needed.
   virtual InstanceFunc SyncMainFunc() { return nullptr; }
 
+  // Return runtime function for running a parallel loop in a kernel. The loop
+  // body is called with the instance data and sub-ranges of [0;size), which
+  // are at least grain iterations except for the last one. This can return
+  // null if the runtime does not support parallel loops.
+  virtual ParallelFunc ParallelLoopFunc() { return nullptr; }
+
   // Return the size of extra instance data needed by runtime. This extra data
   // will be allocated at the beginning of the instance block at offset 0.
   virtual int ExtraInstanceData(Cell *cell) { return 0; }
@@ -831,6 +841,7 @@ class Step : public Attributes {
   bool noop_ = false;
 
   friend class Network;
+  friend class CodeCache;
 };
 
 // A tensor data object is a reference to a tensor value. It does not own the
@@ -1481,6 +1492,10 @@ class Network {
   Linker *linker() const { return linker_; }
   void set_linker(Linker *linker) { linker_ = linker; }
 
+  // Persistent cache for generated code (not owned).
+  CodeCache *code_cache() const { return code_cache_; }
+  void set_code_cache(CodeCache *code_cache) { code_cache_ = code_cache; }
+
   // Compiler options.
   Options &options() { return options_; }
   const Options &options() const { return options_; }
@@ -1549,6 +1564,9 @@ class Network {
   // Linker for linking code and data.
   Linker *linker_;
 
+  // Code cache for reusing generated code across processes.
+  CodeCache *code_cache_ = nullptr;
+
   // Compiler options.
   Options options_;
 
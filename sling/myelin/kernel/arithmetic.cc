@@ -131,7 +131,7 @@ static Express::OpType OpType(const string &op) {
 }
 
 // Check if operation is a candidate for Calculate ops.
-static bool IsCalculateOp(Flow::Operation *op) {
+bool IsCalculateOp(Flow::Operation *op) {
   return op->type == "Calculate" || OpType(op->type) != Express::INVALID;
 }
 
@@ -141,7 +141,7 @@ static bool IsAssignmentOp(Flow::Operation *op) {
 }
 
 // Initialize expression for flow operation.
-static void InitExpression(Flow::Operation *op, Express *expr) {
+void InitExpression(Flow::Operation *op, Express *expr) {
   if (op->type == "Calculate") {
     // Build expression from expression recipe attribute on op.
     const string &recipe = op->GetAttr("expr");
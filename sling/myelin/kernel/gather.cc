@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "sling/myelin/compute.h"
 #include "sling/myelin/macro-assembler.h"
 #include "sling/myelin/simd-assembler.h"
@@ -266,6 +268,11 @@ class MultiGather : public Kernel {
   }
 };
 
+// Minimum number of operations for splitting a pooling gather across threads,
+// and minimum number of operations for each thread.
+static const int64 kParallelMinOps = 1 << 18;
+static const int64 kParallelGrainOps = 1 << 14;
+
 // Look up multiple features in embedding with pooling.
 class PoolingGather : public Kernel {
  public:
@@ -317,9 +324,46 @@ class PoolingGather : public Kernel {
     if (pooling_ == AVG) regs++;
     if (args.batch.elements() > 1) regs++;
     step->SetRegisterUsage(regs);
+
+    // Reserve registers for batch range in parallel gather.
+    if (step->cell()->runtime()->ParallelLoopFunc() != nullptr &&
+        Parallel(args)) {
+      step->SetRegisterUsage(regs + 2);
+      step->SetPreservedRegisterUsage(2);
+    }
   }
 
   void Generate(Step *step, MacroAssembler *masm) override {
+    GatherArgs args(step, true);
+    if (Parallel(args) && masm->SupportsParallelLoops()) {
+      // Split batches across threads.
+      Register begin = masm->rr().alloc_preserved();
+      Register end = masm->rr().alloc_preserved();
+      int64 ops = args.outer_elements() * args.slice_elements();
+      int batches = args.batch.elements();
+      int64 grain = std::max<int64>(kParallelGrainOps * batches / ops, 1);
+      __ ParallelLoop(batches, grain, begin, end, [&]() {
+        GenerateBatches(step, masm, begin, end);
+      });
+      masm->rr().release(begin);
+      masm->rr().release(end);
+      step->set_variant(step->variant() + "P");
+    } else {
+      GenerateBatches(step, masm);
+    }
+  }
+
+  // Check if gather should be split across threads.
+  static bool Parallel(const GatherArgs &args) {
+    if (args.batch.elements() < 2) return false;
+    int64 ops = args.outer_elements() * args.slice_elements();
+    return ops >= kParallelMinOps;
+  }
+
+  // Generate code for pooled lookup of features for batches. If begin and end
+  // are given, only the batches in this range are computed.
+  void GenerateBatches(Step *step, MacroAssembler *masm,
+                       Register begin = no_reg, Register end = no_reg) {
     // Get inputs and outputs.
     GatherArgs args(step, true);
 
@@ -357,7 +401,16 @@ class PoolingGather : public Kernel {
 
     // Loop over batches.
     Label lb;
-    if (batched) {
+    if (begin.is_valid()) {
+      // Only compute the batches in the range.
+      __ movq(batch, begin);
+      __ imulq(acc, begin, Immediate(args.feature.elements() * args.n *
+                                     sizeof(int32)));
+      __ addq(indices, acc);
+      __ imulq(acc, begin, Immediate(args.slice_size()));
+      __ addq(result, acc);
+      __ bind(&lb);
+    } else if (batched) {
       __ xorq(batch, batch);
       __ bind(&lb);
     }
@@ -548,7 +601,11 @@ class PoolingGather : public Kernel {
     if (batched) {
       __ addq(result, Immediate(args.slice_size()));
       __ incq(batch);
-      __ cmpq(batch, Immediate(args.batch.elements()));
+      if (end.is_valid()) {
+        __ cmpq(batch, end);
+      } else {
+        __ cmpq(batch, Immediate(args.batch.elements()));
+      }
       __ j(less, &lb);
     }
   }
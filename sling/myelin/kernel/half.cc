@@ -0,0 +1,608 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <immintrin.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/myelin/compute.h"
+#include "sling/myelin/flow.h"
+#include "sling/myelin/macro-assembler.h"
+#include "sling/myelin/kernel/library.h"
+
+#define __ masm->
+
+namespace sling {
+namespace myelin {
+
+using namespace jit;
+
+namespace {
+
+// Pooling operations for gather.
+enum Pooling {NONE, SUM, AVG, MAX};
+
+// Minimum number of elements for storing weights in half precision.
+const int kMinHalfElements = 256;
+
+// Convert IEEE half-precision number to single precision.
+float HalfToFloat(uint16 h) {
+  uint32 sign = (h & 0x8000) << 16;
+  uint32 exponent = (h >> 10) & 0x1f;
+  uint32 mantissa = h & 0x3ff;
+  uint32 bits;
+  if (exponent == 0x1f) {
+    // Infinity or NaN.
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    // Normal number.
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa != 0) {
+    // Subnormal number.
+    exponent = 113;
+    while ((mantissa & 0x400) == 0) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  } else {
+    // Zero.
+    bits = sign;
+  }
+  float f;
+  memcpy(&f, &bits, sizeof(float));
+  return f;
+}
+
+// Convert single-precision number to IEEE half precision with rounding to
+// nearest even.
+uint16 FloatToHalf(float value) {
+  uint32 f;
+  memcpy(&f, &value, sizeof(float));
+  uint32 sign = (f >> 16) & 0x8000;
+  f &= 0x7fffffff;
+
+  // Infinity and NaN.
+  if (f >= 0x7f800000) return sign | 0x7c00 | (f > 0x7f800000 ? 0x200 : 0);
+
+  // Overflow to infinity.
+  if (f >= 0x477ff000) return sign | 0x7c00;
+
+  // Subnormal numbers and underflow to zero.
+  if (f < 0x38800000) {
+    if (f < 0x33000000) return sign;
+    uint32 mantissa = (f & 0x7fffff) | 0x800000;
+    int shift = 126 - (f >> 23);
+    uint32 h = mantissa >> shift;
+    uint32 rest = mantissa & ((1 << shift) - 1);
+    uint32 halfway = 1 << (shift - 1);
+    if (rest > halfway || (rest == halfway && (h & 1))) h++;
+    return sign | h;
+  }
+
+  // Normal numbers.
+  uint32 h = (f >> 13) - (112 << 10);
+  uint32 rest = f & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+  return sign | h;
+}
+
+// Convert bfloat16 number to single precision.
+float BFloat16ToFloat(uint16 h) {
+  uint32 bits = h << 16;
+  float f;
+  memcpy(&f, &bits, sizeof(float));
+  return f;
+}
+
+// Convert single-precision number to bfloat16 with rounding to nearest even.
+uint16 FloatToBFloat16(float value) {
+  uint32 f;
+  memcpy(&f, &value, sizeof(float));
+  if ((f & 0x7fffffff) > 0x7f800000) return (f >> 16) | 0x40;
+  return (f + 0x7fff + ((f >> 16) & 1)) >> 16;
+}
+
+// Portable versions of the widening vector operations.
+void WidenGeneric(float *dst, const uint16 *src, int n, bool bf16) {
+  if (bf16) {
+    for (int i = 0; i < n; ++i) dst[i] = BFloat16ToFloat(src[i]);
+  } else {
+    for (int i = 0; i < n; ++i) dst[i] = HalfToFloat(src[i]);
+  }
+}
+
+void AxpyGeneric(float *dst, const uint16 *src, float alpha, int n,
+                 bool bf16) {
+  if (bf16) {
+    for (int i = 0; i < n; ++i) dst[i] += alpha * BFloat16ToFloat(src[i]);
+  } else {
+    for (int i = 0; i < n; ++i) dst[i] += alpha * HalfToFloat(src[i]);
+  }
+}
+
+// Load eight half-precision numbers and widen them to single precision. IEEE
+// half-precision numbers are converted with F16C and bfloat16 numbers are
+// widened by shifting them into the upper half of the single-precision number.
+__attribute__((target("avx2,f16c")))
+inline __m256 Load8(const uint16 *src, bool bf16) {
+  __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+  if (bf16) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+  } else {
+    return _mm256_cvtph_ps(h);
+  }
+}
+
+// AVX2 versions of the widening vector operations.
+__attribute__((target("avx2,f16c")))
+void WidenAVX2(float *dst, const uint16 *src, int n, bool bf16) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(dst + i, Load8(src + i, bf16));
+  }
+  if (i < n) WidenGeneric(dst + i, src + i, n - i, bf16);
+}
+
+__attribute__((target("avx2,f16c,fma")))
+void AxpyAVX2(float *dst, const uint16 *src, float alpha, int n, bool bf16) {
+  __m256 a = _mm256_set1_ps(alpha);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 y = _mm256_loadu_ps(dst + i);
+    _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(a, Load8(src + i, bf16), y));
+  }
+  if (i < n) AxpyGeneric(dst + i, src + i, alpha, n - i, bf16);
+}
+
+const bool has_f16c =
+    __builtin_cpu_supports("avx2") &&
+    __builtin_cpu_supports("f16c") &&
+    __builtin_cpu_supports("fma");
+
+// Widen half-precision vector, dst = src.
+void Widen(float *dst, const uint16 *src, int n, bool bf16) {
+  if (has_f16c) {
+    WidenAVX2(dst, src, n, bf16);
+  } else {
+    WidenGeneric(dst, src, n, bf16);
+  }
+}
+
+// Add scaled half-precision vector, dst += alpha * src.
+void Axpy(float *dst, const uint16 *src, float alpha, int n, bool bf16) {
+  if (has_f16c) {
+    AxpyAVX2(dst, src, alpha, n, bf16);
+  } else {
+    AxpyGeneric(dst, src, alpha, n, bf16);
+  }
+}
+
+// Widened vector for max pooling for the current thread.
+thread_local std::vector<float> widened;
+
+// Argument for checking if an operation is supported by the half-precision
+// kernels. The checks are shared between the weight transformation, which
+// inspects flow variables, and the kernels, which inspect tensors, so weights
+// are only converted when a kernel can use them. The type of the weights is
+// not checked since it is only converted by the transformation.
+struct HalfArg {
+  HalfArg(const Flow::Variable *var)
+      : type(var->type), shape(var->shape), dynamic(var->dynamic()) {}
+  HalfArg(const Tensor *tensor)
+      : type(tensor->type()), shape(tensor->shape()),
+        dynamic(tensor->dynamic()) {}
+
+  Type type;
+  Shape shape;
+  bool dynamic;
+};
+
+// Check if matrix multiplication C = A * B with half-precision weights B is
+// supported.
+bool HalfMatMulSupported(const Attributes &attrs,
+                         const HalfArg &a, const HalfArg &b, const HalfArg &c) {
+  // Check types and ranks.
+  if (a.type != DT_FLOAT || a.shape.rank() != 2) return false;
+  if (b.shape.rank() != 2) return false;
+  if (c.type != DT_FLOAT || c.shape.rank() != 2) return false;
+
+  // Transposed arguments are not supported.
+  if (attrs.GetAttr("transpose_a", false)) return false;
+  if (attrs.GetAttr("transpose_b", false)) return false;
+  if (attrs.GetAttr("transpose_c", false)) return false;
+
+  // Check shapes.
+  if (a.shape.dim(1) != b.shape.dim(0)) return false;
+  if (c.shape.dim(0) != a.shape.dim(0)) return false;
+  if (c.shape.dim(1) != b.shape.dim(1)) return false;
+  if (a.dynamic || c.dynamic) return false;
+
+  return true;
+}
+
+// Check if gather from half-precision embedding is supported. The oov vector
+// is optional and is only supported without pooling.
+bool HalfGatherSupported(const Attributes &attrs, Pooling pooling,
+                         const HalfArg &params, const HalfArg &indices,
+                         const HalfArg *oov, const HalfArg &result) {
+  // Check types.
+  if (indices.type != DT_INT32) return false;
+  if (result.type != DT_FLOAT) return false;
+  if (oov != nullptr) {
+    if (pooling != NONE) return false;
+    if (oov->type != DT_FLOAT) return false;
+  }
+
+  // Only single index dimension without batch supported.
+  if (attrs.GetAttr("batch", 0) != 0) return false;
+  if (params.shape.rank() != 2) return false;
+  if (indices.shape.rank() == 0 || indices.shape.dim(-1) != 1) return false;
+
+  // Check shapes.
+  int elements = params.shape.dim(1);
+  if (oov != nullptr && oov->shape.elements() != elements) return false;
+  if (result.shape.rank() == 0 || result.shape.dim(-1) != elements) {
+    return false;
+  }
+  if (pooling == NONE) {
+    if (result.shape.elements() != indices.shape.elements() * elements) {
+      return false;
+    }
+  } else {
+    if (result.shape.elements() != elements) return false;
+  }
+
+  return true;
+}
+
+// Get pooling operation for gather op type. Returns false if the op is not a
+// gather.
+bool GatherPooling(const string &type, Pooling *pooling) {
+  if (type == "Gather") {
+    *pooling = NONE;
+  } else if (type == "GatherSum") {
+    *pooling = SUM;
+  } else if (type == "GatherAvg") {
+    *pooling = AVG;
+  } else if (type == "GatherMax") {
+    *pooling = MAX;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+// Matrix multiplication with half-precision weight matrix, C = A * B, where
+// the rows of B are widened to single precision on the fly. The type is either
+// DT_HALF or DT_BFLOAT16.
+extern "C" void myelin_half_matmul(
+    const float *a, const uint16 *b, float *c,
+    int64 m, int64 k, int64 n, int64 lda, int64 ldb, int64 ldc, int64 type) {
+  bool bf16 = type == DT_BFLOAT16;
+  for (int64 i = 0; i < m; ++i) {
+    const float *arow = a + i * lda;
+    float *crow = c + i * ldc;
+    memset(crow, 0, n * sizeof(float));
+    const uint16 *brow = b;
+    for (int64 j = 0; j < k; ++j) {
+      Axpy(crow, brow, arow[j], n, bf16);
+      brow += ldb;
+    }
+  }
+}
+
+// Look up features in half-precision embedding. Negative indices are looked up
+// in the oov vector if present and otherwise zeroed.
+extern "C" void myelin_half_gather(
+    const uint16 *params, const int32 *indices, float *result,
+    const float *oov, int64 features, int64 elements,
+    int64 stride, int64 type) {
+  bool bf16 = type == DT_BFLOAT16;
+  for (int64 f = 0; f < features; ++f) {
+    int32 index = indices[f];
+    float *dst = result + f * elements;
+    if (index >= 0) {
+      Widen(dst, params + index * stride, elements, bf16);
+    } else if (oov != nullptr) {
+      memcpy(dst, oov, elements * sizeof(float));
+    } else {
+      memset(dst, 0, elements * sizeof(float));
+    }
+  }
+}
+
+// Look up features in half-precision embedding and pool the embeddings.
+// Negative indices are ignored.
+extern "C" void myelin_half_gather_pooled(
+    const uint16 *params, const int32 *indices, float *result,
+    int64 features, int64 elements, int64 stride,
+    int64 pooling, int64 type) {
+  bool bf16 = type == DT_BFLOAT16;
+  int count = 0;
+  for (int64 f = 0; f < features; ++f) {
+    int32 index = indices[f];
+    if (index < 0) continue;
+    const uint16 *src = params + index * stride;
+    if (count == 0) {
+      Widen(result, src, elements, bf16);
+    } else if (pooling == MAX) {
+      std::vector<float> &v = widened;
+      if (v.size() < elements) v.resize(elements);
+      Widen(v.data(), src, elements, bf16);
+      for (int64 i = 0; i < elements; ++i) {
+        result[i] = std::max(result[i], v[i]);
+      }
+    } else {
+      Axpy(result, src, 1.0, elements, bf16);
+    }
+    count++;
+  }
+
+  if (count == 0) {
+    memset(result, 0, elements * sizeof(float));
+  } else if (pooling == AVG && count > 1) {
+    float scale = 1.0 / count;
+    for (int64 i = 0; i < elements; ++i) result[i] *= scale;
+  }
+}
+
+// Store constant weight matrices in half precision. Weight matrices used as
+// the second argument of matrix multiplications or as embeddings in gather ops
+// are converted to either IEEE half precision or bfloat16. The kernels widen
+// the weights to single precision on the fly.
+class HalfPrecisionWeights : public Transformer {
+ public:
+  HalfPrecisionWeights(Type type) : type_(type) {}
+
+  string Name() override { return "HalfPrecisionWeights"; }
+
+  bool Transform(Flow *flow) override {
+    int updates = 0;
+    for (Flow::Variable *var : flow->vars()) {
+      // Weights must be constant float matrix.
+      if (var->type != DT_FLOAT || var->rank() != 2) continue;
+      if (!var->constant() || var->learnable()) continue;
+      if (var->in() || var->out()) continue;
+      if (var->elements() < kMinHalfElements) continue;
+      if (var->size != var->elements() * sizeof(float)) continue;
+
+      // All consumers must support half-precision weights.
+      if (var->consumers.empty()) continue;
+      bool supported = true;
+      for (Flow::Operation *op : var->consumers) {
+        if (!Supports(op, var)) supported = false;
+      }
+      if (!supported) continue;
+
+      // Convert weights to half precision.
+      VLOG(5) << "Store " << var->name << " as "
+              << TypeTraits::of(type_).name();
+      int elements = var->elements();
+      const float *weights = reinterpret_cast<const float *>(var->data);
+      uint16 *half = reinterpret_cast<uint16 *>(
+          flow->AllocateMemory(elements * sizeof(uint16)));
+      for (int i = 0; i < elements; ++i) {
+        if (type_ == DT_BFLOAT16) {
+          half[i] = FloatToBFloat16(weights[i]);
+        } else {
+          half[i] = FloatToHalf(weights[i]);
+        }
+      }
+      var->type = type_;
+      var->data = reinterpret_cast<char *>(half);
+      var->size = elements * sizeof(uint16);
+      updates++;
+    }
+    return updates > 0;
+  }
+
+ private:
+  // Check if op supports half-precision weights for variable.
+  static bool Supports(Flow::Operation *op, Flow::Variable *var) {
+    if (op->outdegree() != 1) return false;
+    Flow::Variable *output = op->outputs[0];
+    Pooling pooling;
+    if (op->type == "MatMul") {
+      if (op->indegree() != 2) return false;
+      if (op->inputs[0] == var || op->inputs[1] != var) return false;
+      if (!HalfMatMulSupported(*op, op->inputs[0], var, output)) return false;
+
+      // A transposed output would be factored out by swapping the inputs.
+      for (Flow::Operation *consumer : output->consumers) {
+        if (consumer->type == "Transpose") return false;
+      }
+      return true;
+    } else if (GatherPooling(op->type, &pooling)) {
+      if (op->indegree() != 2 && op->indegree() != 3) return false;
+      if (op->inputs[0] != var) return false;
+      for (int i = 1; i < op->indegree(); ++i) {
+        if (op->inputs[i] == var) return false;
+      }
+      HalfArg oov(op->indegree() == 3 ? op->inputs[2] : var);
+      return HalfGatherSupported(*op, pooling, var, op->inputs[1],
+                                 op->indegree() == 3 ? &oov : nullptr,
+                                 output);
+    }
+    return false;
+  }
+
+  // Storage type for weights.
+  Type type_;
+};
+
+// Matrix multiplication with half-precision weights.
+class HalfMatMul : public Kernel {
+ public:
+  string Name() override { return "HalfMatMul"; }
+  string Operation() override { return "MatMul"; }
+
+  bool Supports(Step *step) override {
+    // Check inputs and outputs.
+    if (step->indegree() != 2 || step->outdegree() != 1) return false;
+    Tensor *a = step->input(0);
+    Tensor *b = step->input(1);
+    Tensor *c = step->output(0);
+    if (b->type() != DT_HALF && b->type() != DT_BFLOAT16) return false;
+    return HalfMatMulSupported(*step, a, b, c);
+  }
+
+  void Adjust(Step *step) override {
+    // All matrices are row-major.
+    step->input(0)->RequireOrder(ROW_MAJOR);
+    step->input(1)->RequireOrder(ROW_MAJOR);
+    step->output(0)->RequireOrder(ROW_MAJOR);
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Tensor *a = step->input(0);
+    Tensor *b = step->input(1);
+    Tensor *c = step->output(0);
+    int lda = a->stride(0) / sizeof(float);
+    int ldb = b->stride(0) / sizeof(uint16);
+    int ldc = c->stride(0) / sizeof(float);
+    step->set_variant(b->type() == DT_BFLOAT16 ? "BF16" : "FP16");
+
+    // Set up arguments to half-precision matmul function.
+    __ pushq(Immediate(b->type()));
+    __ pushq(Immediate(ldc));
+    __ pushq(Immediate(ldb));
+    __ pushq(Immediate(lda));
+    __ LoadTensorAddress(arg_reg_1, a);
+    __ LoadTensorAddress(arg_reg_2, b);
+    __ LoadTensorAddress(arg_reg_3, c);
+    __ movq(arg_reg_4, Immediate(a->dim(0)));
+    __ movq(arg_reg_5, Immediate(a->dim(1)));
+    __ movq(arg_reg_6, Immediate(b->dim(1)));
+
+    // Call half-precision matmul function.
+    __ call_extern(reinterpret_cast<void *>(myelin_half_matmul),
+                   "myelin_half_matmul");
+    __ addq(rsp, Immediate(4 * 8));
+  }
+
+  int64 Complexity(const Step *step) override {
+    Tensor *a = step->input(0);
+    Tensor *c = step->output(0);
+    return c->dim(0) * c->dim(1) * a->dim(1) * 2;
+  }
+};
+
+// Look up features in half-precision embedding with optional pooling.
+class HalfGather : public Kernel {
+ public:
+  HalfGather(Pooling pooling) : pooling_(pooling) {}
+
+  string Name() override { return "Half" + Operation(); }
+  string Operation() override {
+    switch (pooling_) {
+      case NONE: return "Gather";
+      case SUM: return "GatherSum";
+      case AVG: return "GatherAvg";
+      case MAX: return "GatherMax";
+      default: return "???";
+    }
+  }
+
+  bool Supports(Step *step) override {
+    // Check inputs and outputs.
+    if (step->indegree() != 2 && step->indegree() != 3) return false;
+    if (step->outdegree() != 1) return false;
+    Tensor *params = step->input(0);
+    if (params->type() != DT_HALF && params->type() != DT_BFLOAT16) {
+      return false;
+    }
+    HalfArg oov(step->indegree() == 3 ? step->input(2) : params);
+    return HalfGatherSupported(*step, pooling_, params, step->input(1),
+                               step->indegree() == 3 ? &oov : nullptr,
+                               step->output(0));
+  }
+
+  void Adjust(Step *step) override {
+    // All tensors are row-major.
+    step->input(0)->RequireOrder(ROW_MAJOR);
+    step->output(0)->RequireOrder(ROW_MAJOR);
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Tensor *params = step->input(0);
+    Tensor *indices = step->input(1);
+    Tensor *oov = step->indegree() == 3 ? step->input(2) : nullptr;
+    Tensor *result = step->output(0);
+    int stride = params->stride(0) / sizeof(uint16);
+    step->set_variant(params->type() == DT_BFLOAT16 ? "BF16" : "FP16");
+
+    // Set up arguments to half-precision gather function.
+    if (pooling_ == NONE) {
+      __ pushq(Immediate(params->type()));
+      __ pushq(Immediate(stride));
+      __ LoadTensorAddress(arg_reg_1, params);
+      __ LoadTensorAddress(arg_reg_2, indices);
+      __ LoadTensorAddress(arg_reg_3, result);
+      if (oov != nullptr) {
+        __ LoadTensorAddress(arg_reg_4, oov);
+      } else {
+        __ xorq(arg_reg_4, arg_reg_4);
+      }
+      __ movq(arg_reg_5, Immediate(indices->elements()));
+      __ movq(arg_reg_6, Immediate(params->dim(1)));
+      __ call_extern(reinterpret_cast<void *>(myelin_half_gather),
+                     "myelin_half_gather");
+    } else {
+      __ pushq(Immediate(params->type()));
+      __ pushq(Immediate(pooling_));
+      __ LoadTensorAddress(arg_reg_1, params);
+      __ LoadTensorAddress(arg_reg_2, indices);
+      __ LoadTensorAddress(arg_reg_3, result);
+      __ movq(arg_reg_4, Immediate(indices->elements()));
+      __ movq(arg_reg_5, Immediate(params->dim(1)));
+      __ movq(arg_reg_6, Immediate(stride));
+      __ call_extern(reinterpret_cast<void *>(myelin_half_gather_pooled),
+                     "myelin_half_gather_pooled");
+    }
+    __ addq(rsp, Immediate(2 * 8));
+  }
+
+  int64 Complexity(const Step *step) override {
+    if (pooling_ == NONE) return 0;
+    return step->input(1)->elements() * step->input(0)->dim(1);
+  }
+
+ private:
+  Pooling pooling_;  // pooling operation for embeddings
+};
+
+// Register half-precision kernels.
+void RegisterHalfKernels(Library *library) {
+  library->Register(new HalfMatMul());
+  library->Register(new HalfGather(NONE));
+  library->Register(new HalfGather(SUM));
+  library->Register(new HalfGather(AVG));
+  library->Register(new HalfGather(MAX));
+}
+
+// Register transformation for storing weights in half precision.
+void RegisterHalfTransforms(Library *library, Type type) {
+  CHECK(type == DT_HALF || type == DT_BFLOAT16);
+  library->RegisterTransformer(new HalfPrecisionWeights(type));
+}
+
+}  // namespace myelin
+}  // namespace sling
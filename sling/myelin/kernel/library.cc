@@ -26,6 +26,9 @@ static std::once_flag gradients_initialized;
 // Register standard kernels.
 void RegisterStandardLibrary(Library *library, int flags) {
   RegisterArithmeticTransforms(library);
+  if ((flags & LIBRARY_NOMATMULFUSION) == 0) {
+    RegisterSIMDMatMulTransforms(library);
+  }
   RegisterGenericLibrary(library);
   RegisterConcatKernels(library);
   RegisterGatherKernels(library);
@@ -34,6 +37,8 @@ void RegisterStandardLibrary(Library *library, int flags) {
   RegisterArrayKernels(library);
   RegisterArgMax(library);
   RegisterSIMDMatMulLibrary(library);
+  RegisterQuantizeKernels(library);
+  RegisterHalfKernels(library);
   RegisterArithmeticLibrary(library);
   if ((flags & LIBRARY_NOPRECOMPUTE) == 0) {
     RegisterPrecomputeLibrary(library);
@@ -24,6 +24,7 @@ namespace myelin {
 // Library registration flags.
 enum LibraryOptions {
   LIBRARY_NOPRECOMPUTE = 1,
+  LIBRARY_NOMATMULFUSION = 2,
 };
 
 // argmax.cc
@@ -33,6 +34,8 @@ void RegisterArgMax(Library *library);
 void RegisterArithmeticLibrary(Library *library);
 void RegisterArithmeticTransforms(Library *library);
 void InitExpression(const Step *step, Express *expr);
+void InitExpression(Flow::Operation *op, Express *expr);
+bool IsCalculateOp(Flow::Operation *op);
 
 // array.cc
 void RegisterArrayKernels(Library *library);
@@ -50,9 +53,17 @@ void RegisterGenericLibrary(Library *library);
 // gradients.cc
 void RegisterStandardGradients();
 
+// half.cc
+void RegisterHalfKernels(Library *library);
+void RegisterHalfTransforms(Library *library, Type type);
+
 // precompute.cc
 void RegisterPrecomputeLibrary(Library *library);
 
+// quantize.cc
+void RegisterQuantizeKernels(Library *library);
+void RegisterQuantizeTransforms(Library *library);
+
 // reduce.cc
 void RegisterReduceKernels(Library *library);
 
@@ -62,6 +73,7 @@ void RegisterTransposeKernels(Library *library);
 
 // simd-matmul.cc
 void RegisterSIMDMatMulLibrary(Library *library);
+void RegisterSIMDMatMulTransforms(Library *library);
 
 // Register standard kernel library.
 void RegisterStandardLibrary(Library *library, int flags = 0);
@@ -0,0 +1,508 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/myelin/compute.h"
+#include "sling/myelin/flow.h"
+#include "sling/myelin/macro-assembler.h"
+#include "sling/myelin/kernel/library.h"
+
+#define __ masm->
+
+namespace sling {
+namespace myelin {
+
+using namespace jit;
+
+// Minimum inner dimension for quantizing a weight matrix.
+static const int kMinQuantizeSize = 16;
+
+// The rows of the quantized weight matrix are padded to a multiple of the
+// AVX-512 vector size in bytes.
+static const int kQuantizeAlign = 64;
+
+// Quantize constant float weight matrices for matrix multiplications to int8
+// with a per-output scale. A MatMul op computing C = A * B where B is a
+// constant [k,n] matrix is replaced with a QuantizedMatMul op with inputs
+// (A, Q, S, W), where Q is the [n,k'] int8 matrix with B^T quantized row by
+// row and zero-padded to k' columns, S holds the [n] row scales, i.e.
+// B[i,j] ~ Q[j,i] * S[j], and W holds the [n] row sums of Q.
+class QuantizeMatMul : public Transformer {
+ public:
+  string Name() override { return "QuantizeMatMul"; }
+
+  bool Transform(Flow *flow) override {
+    // The quantized matmul kernel requires AVX2 support.
+    if (!CPU::Enabled(AVX2)) return false;
+
+    int updates = 0;
+    for (Flow::Operation *op : flow->Find("MatMul")) {
+      if (op->indegree() != 2 || op->outdegree() != 1) continue;
+      if (op->GetAttr("transpose_a", false)) continue;
+      if (op->GetAttr("transpose_c", false)) continue;
+      Flow::Variable *a = op->inputs[0];
+      Flow::Variable *b = op->inputs[1];
+      Flow::Variable *c = op->outputs[0];
+      if (a->type != DT_FLOAT || a->rank() != 2) continue;
+      if (c->type != DT_FLOAT || c->rank() != 2) continue;
+
+      // Weight matrix must be a constant float matrix only used by this op.
+      if (b->type != DT_FLOAT || b->rank() != 2) continue;
+      if (!b->constant() || b->learnable()) continue;
+      if (b->consumers.size() != 1 || b->in() || b->out()) continue;
+      bool transposed = op->GetAttr("transpose_b", false);
+      int k = transposed ? b->dim(1) : b->dim(0);
+      int n = transposed ? b->dim(0) : b->dim(1);
+      if (k < kMinQuantizeSize) continue;
+      if (b->size != k * n * sizeof(float)) continue;
+      int kpad = (k + kQuantizeAlign - 1) / kQuantizeAlign * kQuantizeAlign;
+
+      // Quantize weight matrix.
+      Flow::Variable *q =
+          flow->AddVariable(b->name + "/int8", DT_INT8, {n, kpad});
+      Flow::Variable *s = flow->AddVariable(b->name + "/scale", DT_FLOAT, {n});
+      Flow::Variable *w = flow->AddVariable(b->name + "/sum", DT_INT32, {n});
+      q->size = n * kpad * sizeof(int8);
+      q->data = flow->AllocateMemory(q->size);
+      s->size = n * sizeof(float);
+      s->data = flow->AllocateMemory(s->size);
+      w->size = n * sizeof(int32);
+      w->data = flow->AllocateMemory(w->size);
+      const float *weights = reinterpret_cast<const float *>(b->data);
+      int8 *quantized = reinterpret_cast<int8 *>(q->data);
+      float *scales = reinterpret_cast<float *>(s->data);
+      int32 *sums = reinterpret_cast<int32 *>(w->data);
+      int istride = transposed ? 1 : n;
+      int jstride = transposed ? k : 1;
+      for (int j = 0; j < n; ++j) {
+        const float *column = weights + j * jstride;
+        float maxabs = 0.0;
+        for (int i = 0; i < k; ++i) {
+          maxabs = std::max(maxabs, fabsf(column[i * istride]));
+        }
+        float scale = maxabs / 127.0;
+        float inverse = maxabs == 0.0 ? 0.0 : 127.0 / maxabs;
+        int8 *row = quantized + j * kpad;
+        int32 sum = 0;
+        for (int i = 0; i < kpad; ++i) {
+          long v = 0;
+          if (i < k) {
+            v = lrintf(column[i * istride] * inverse);
+            v = std::max(-127L, std::min(127L, v));
+          }
+          row[i] = v;
+          sum += v;
+        }
+        scales[j] = scale;
+        sums[j] = sum;
+      }
+
+      // Replace matrix multiplication with quantized version.
+      VLOG(5) << "Quantize " << b->name << " " << b->shape.ToString()
+              << " for " << op->name;
+      op->ReplaceInput(b, q);
+      op->AddInput(s);
+      op->AddInput(w);
+      op->RemoveAttr("transpose_b");
+      op->type = "QuantizedMatMul";
+      if (b->detached()) flow->DeleteVariable(b);
+      updates++;
+    }
+    return updates > 0;
+  }
+};
+
+// Matrix multiplication with int8 quantized weights, C = A * Q^T * diag(S).
+// Each row of A is quantized to int8 with its own symmetric scale into a
+// buffer on the stack. The dot products with the rows of Q are computed for
+// blocks of eight output columns at a time, so each quantized input block is
+// loaded once for all eight columns. With AVX-512 VNNI, the input is offset by
+// 128 to make it unsigned, so vpdpbusd can be used for accumulating the int8
+// products, and the offset is subtracted afterwards using the row sums W.
+// With AVX2, the sign of the input is moved to the weights with vpsignb, and
+// the products are accumulated with vpmaddubsw and vpmaddwd.
+class QuantizedMatMul : public Kernel {
+ public:
+  // Number of output columns computed in each pass over the input row.
+  static const int kBlockSize = 8;
+
+  string Name() override { return "QuantizedMatMul"; }
+  string Operation() override { return "QuantizedMatMul"; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with AVX2 support.
+    if (!CPU::Enabled(AVX2)) return false;
+
+    // Check inputs and outputs.
+    if (step->indegree() != 4 || step->outdegree() != 1) return false;
+    Tensor *a = step->input(0);
+    Tensor *q = step->input(1);
+    Tensor *s = step->input(2);
+    Tensor *w = step->input(3);
+    Tensor *c = step->output(0);
+    if (a->type() != DT_FLOAT || a->rank() != 2) return false;
+    if (q->type() != DT_INT8 || q->rank() != 2) return false;
+    if (s->type() != DT_FLOAT || s->rank() != 1) return false;
+    if (w->type() != DT_INT32 || w->rank() != 1) return false;
+    if (c->type() != DT_FLOAT || c->rank() != 2) return false;
+    if (!q->constant() || !s->constant() || !w->constant()) return false;
+
+    // Check shapes. The rows of Q must be padded to the vector size.
+    if (q->dim(1) % kQuantizeAlign != 0) return false;
+    if (a->dim(1) > q->dim(1)) return false;
+    if (q->dim(0) != s->dim(0) || q->dim(0) != w->dim(0)) return false;
+    if (c->dim(0) != a->dim(0) || c->dim(1) != q->dim(0)) return false;
+    if (a->dynamic() || c->dynamic()) return false;
+
+    return true;
+  }
+
+  void Adjust(Step *step) override {
+    // All matrices are row-major.
+    step->input(0)->RequireOrder(ROW_MAJOR);
+    step->input(1)->RequireOrder(ROW_MAJOR);
+    step->output(0)->RequireOrder(ROW_MAJOR);
+
+    // Reserve registers.
+    step->SetRegisterUsage(10);
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Tensor *a = step->input(0);
+    Tensor *q = step->input(1);
+    Tensor *s = step->input(2);
+    Tensor *w = step->input(3);
+    Tensor *c = step->output(0);
+    int m = a->dim(0);
+    int k = a->dim(1);
+    int n = q->dim(0);
+    int kpad = q->dim(1);
+    int ldq = q->stride(0);
+
+    // Use AVX-512 VNNI if available. The quantized input is then stored with
+    // an offset of 128 to make it unsigned.
+    bool vnni = CPU::Enabled(AVX512F) && CPU::Enabled(AVX512VNNI);
+    int vecsize = vnni ? 64 : 32;
+    step->set_variant(vnni ? "VNNI" : "AVX2");
+
+    // Allocate registers.
+    Register arow = masm->rr().alloc();
+    Register crow = masm->rr().alloc();
+    Register buf = masm->rr().alloc();
+    Register qptr = masm->rr().alloc();
+    Register sptr = masm->rr().alloc();
+    Register wptr = masm->rr().alloc();
+    Register cptr = masm->rr().alloc();
+    Register ofs = masm->rr().alloc();
+    Register col = masm->rr().alloc();
+    Register row = masm->rr().alloc();
+
+    YMMRegister acc[kBlockSize];
+    for (int j = 0; j < kBlockSize; ++j) acc[j] = masm->mm().allocy();
+    YMMRegister input = masm->mm().allocy();
+    YMMRegister sign = masm->mm().allocy();
+    YMMRegister temp = masm->mm().allocy();
+    YMMRegister ones = masm->mm().allocy();
+    YMMRegister inverse = masm->mm().allocy();
+    YMMRegister scale = masm->mm().allocy();
+
+    // Registers used for quantizing the input row.
+    YMMRegister maxabs = acc[0];
+    YMMRegister elem = acc[1];
+    YMMRegister high = acc[2];
+    XMMRegister xmaxabs = XMMRegister::from_code(maxabs.code());
+    XMMRegister xelem = XMMRegister::from_code(elem.code());
+    XMMRegister xhigh = XMMRegister::from_code(high.code());
+    XMMRegister xinverse = XMMRegister::from_code(inverse.code());
+
+    // Allocate buffer for quantized input row on the stack.
+    __ subq(rsp, Immediate(kpad));
+    __ movq(buf, rsp);
+    if (!vnni) {
+      __ vmovdqu(ones, Operand(masm->GetConstant<int16>(1, 16)->address()));
+    }
+
+    // Loop over rows in A.
+    Label lrow;
+    __ LoadTensorAddress(arow, a);
+    __ LoadTensorAddress(crow, c);
+    __ xorq(row, row);
+    __ bind(&lrow);
+
+    // Find maximum absolute value in input row.
+    int kvec = k / 8 * 8;
+    auto absmask = masm->GetConstant<int32>(0x7fffffff, 8);
+    __ vxorps(maxabs, maxabs, maxabs);
+    if (kvec > 0) {
+      Label lmax;
+      __ xorq(ofs, ofs);
+      __ bind(&lmax);
+      __ vmovups(elem, Operand(arow, ofs, times_4));
+      __ vandps(elem, elem, Operand(absmask->address()));
+      __ vmaxps(maxabs, maxabs, elem);
+      __ addq(ofs, Immediate(8));
+      __ cmpq(ofs, Immediate(kvec));
+      __ j(less, &lmax);
+    }
+    __ vextractf128(xhigh, maxabs, 1);
+    __ vmaxps(xmaxabs, xmaxabs, xhigh);
+    __ vpermilps(xhigh, xmaxabs, 0x4E);
+    __ vmaxps(xmaxabs, xmaxabs, xhigh);
+    __ vpermilps(xhigh, xmaxabs, 0xB1);
+    __ vmaxps(xmaxabs, xmaxabs, xhigh);
+    for (int i = kvec; i < k; ++i) {
+      __ vmovss(xelem, Operand(arow, i * sizeof(float)));
+      __ vandps(xelem, xelem, Operand(absmask->address()));
+      __ vmaxss(xmaxabs, xmaxabs, xelem);
+    }
+
+    // Compute input scale and its inverse. The maximum is clamped to avoid
+    // division by zero for all-zero input rows.
+    __ vmaxss(xmaxabs, xmaxabs,
+              Operand(masm->GetConstant<float>(1e-30)->address()));
+    __ vbroadcastss(maxabs, maxabs);
+    __ vmulps(scale, maxabs,
+              Operand(masm->GetConstant<float>(1.0 / 127.0, 8)->address()));
+    __ vmovaps(inverse,
+               Operand(masm->GetConstant<float>(127.0, 8)->address()));
+    __ vdivps(inverse, inverse, maxabs);
+
+    // Quantize input row to int8, eight elements at a time.
+    if (kvec > 0) {
+      Label lquant;
+      __ xorq(ofs, ofs);
+      __ bind(&lquant);
+      __ vmulps(elem, inverse, Operand(arow, ofs, times_4));
+      __ vcvtps2dq(elem, elem);
+      __ vextractf128(xhigh, elem, 1);
+      __ vpackssdw(xelem, xelem, xhigh);
+      __ vpacksswb(xelem, xelem, xelem);
+      if (vnni) {
+        auto offset = masm->GetConstant<int8>(-128, 16);
+        __ vpaddb(xelem, xelem, Operand(offset->address()));
+      }
+      __ vmovq(Operand(buf, ofs, times_1), xelem);
+      __ addq(ofs, Immediate(8));
+      __ cmpq(ofs, Immediate(kvec));
+      __ j(less, &lquant);
+    }
+    for (int i = kvec; i < k; ++i) {
+      __ vmulss(xelem, xinverse, Operand(arow, i * sizeof(float)));
+      __ vcvtps2dq(xelem, xelem);
+      __ vmovd(col, xelem);
+      if (vnni) __ addl(col, Immediate(128));
+      __ movb(Operand(buf, i), col);
+    }
+
+    // Compute blocks of output columns.
+    int blocks = n / kBlockSize;
+    int remaining = n % kBlockSize;
+    __ LoadTensorAddress(qptr, q);
+    __ LoadTensorAddress(sptr, s);
+    __ LoadTensorAddress(wptr, w);
+    __ movq(cptr, crow);
+    if (blocks > 0) {
+      Label lblock;
+      if (blocks > 1) {
+        __ xorq(col, col);
+        __ bind(&lblock);
+      }
+
+      // Compute dot products between input row and block of weight rows.
+      for (int j = 0; j < kBlockSize; ++j) {
+        __ vxorps(acc[j], acc[j], acc[j]);
+      }
+      Label ldot;
+      __ xorq(ofs, ofs);
+      __ bind(&ldot);
+      LoadInput(input, sign, buf, ofs, vnni, masm);
+      for (int j = 0; j < kBlockSize; ++j) {
+        MultiplyAdd(acc[j], input, sign, temp, ones,
+                    Operand(qptr, ofs, times_1, j * ldq), vnni, masm);
+      }
+      __ addq(ofs, Immediate(vecsize));
+      __ cmpq(ofs, Immediate(kpad));
+      __ j(less, &ldot);
+
+      // Sum the accumulators into one vector with the eight dot products.
+      if (vnni) {
+        for (int j = 0; j < kBlockSize; ++j) {
+          ZMMRegister zacc = ZMMRegister::from_code(acc[j].code());
+          ZMMRegister ztemp = ZMMRegister::from_code(temp.code());
+          __ vshufi64x2(ztemp, zacc, zacc, 0x4E);
+          __ vpaddd(zacc, zacc, ztemp);
+        }
+      }
+      __ vphaddd(acc[0], acc[0], acc[1]);
+      __ vphaddd(acc[2], acc[2], acc[3]);
+      __ vphaddd(acc[4], acc[4], acc[5]);
+      __ vphaddd(acc[6], acc[6], acc[7]);
+      __ vphaddd(acc[0], acc[0], acc[2]);
+      __ vphaddd(acc[4], acc[4], acc[6]);
+      __ vperm2i128(acc[1], acc[0], acc[4], 0x20);
+      __ vperm2i128(acc[3], acc[0], acc[4], 0x31);
+      __ vpaddd(acc[0], acc[1], acc[3]);
+
+      // Remove input offset and scale the dot products.
+      if (vnni) {
+        __ vmovdqu(temp, Operand(wptr));
+        __ vpslld(temp, temp, 7);
+        __ vpsubd(acc[0], acc[0], temp);
+      }
+      __ vcvtdq2ps(acc[0], acc[0]);
+      __ vmulps(acc[0], acc[0], Operand(sptr));
+      __ vmulps(acc[0], acc[0], scale);
+      __ vmovups(Operand(cptr), acc[0]);
+
+      // Next block.
+      __ addq(qptr, Immediate(kBlockSize * ldq));
+      __ addq(sptr, Immediate(kBlockSize * sizeof(float)));
+      __ addq(wptr, Immediate(kBlockSize * sizeof(int32)));
+      __ addq(cptr, Immediate(kBlockSize * sizeof(float)));
+      if (blocks > 1) {
+        __ incq(col);
+        __ cmpq(col, Immediate(blocks));
+        __ j(less, &lblock);
+      }
+    }
+
+    // Compute remaining output columns one at a time.
+    if (remaining > 0) {
+      XMMRegister xacc = XMMRegister::from_code(acc[0].code());
+      XMMRegister xtemp = XMMRegister::from_code(temp.code());
+      XMMRegister xscale = XMMRegister::from_code(scale.code());
+      Label lcol;
+      if (remaining > 1) {
+        __ xorq(col, col);
+        __ bind(&lcol);
+      }
+
+      // Compute dot product between input row and weight row.
+      __ vxorps(acc[0], acc[0], acc[0]);
+      Label ldot;
+      __ xorq(ofs, ofs);
+      __ bind(&ldot);
+      LoadInput(input, sign, buf, ofs, vnni, masm);
+      MultiplyAdd(acc[0], input, sign, temp, ones,
+                  Operand(qptr, ofs, times_1), vnni, masm);
+      __ addq(ofs, Immediate(vecsize));
+      __ cmpq(ofs, Immediate(kpad));
+      __ j(less, &ldot);
+
+      // Sum the accumulator.
+      if (vnni) {
+        ZMMRegister zacc = ZMMRegister::from_code(acc[0].code());
+        ZMMRegister ztemp = ZMMRegister::from_code(temp.code());
+        __ vshufi64x2(ztemp, zacc, zacc, 0x4E);
+        __ vpaddd(zacc, zacc, ztemp);
+      }
+      __ vextractf128(xtemp, acc[0], 1);
+      __ vpaddd(xacc, xacc, xtemp);
+      __ vphaddd(xacc, xacc, xacc);
+      __ vphaddd(xacc, xacc, xacc);
+
+      // Remove input offset and scale the dot product.
+      if (vnni) {
+        __ vmovd(xtemp, Operand(wptr));
+        __ vpslld(xtemp, xtemp, 7);
+        __ vpsubd(xacc, xacc, xtemp);
+      }
+      __ vcvtdq2ps(xacc, xacc);
+      __ vmulss(xacc, xacc, Operand(sptr));
+      __ vmulss(xacc, xacc, xscale);
+      __ vmovss(Operand(cptr), xacc);
+
+      // Next column.
+      __ addq(qptr, Immediate(ldq));
+      __ addq(sptr, Immediate(sizeof(float)));
+      __ addq(wptr, Immediate(sizeof(int32)));
+      __ addq(cptr, Immediate(sizeof(float)));
+      if (remaining > 1) {
+        __ incq(col);
+        __ cmpq(col, Immediate(remaining));
+        __ j(less, &lcol);
+      }
+    }
+
+    // Next row.
+    if (m > 1) {
+      __ addq(arow, Immediate(a->stride(0)));
+      __ addq(crow, Immediate(c->stride(0)));
+      __ incq(row);
+      __ cmpq(row, Immediate(m));
+      __ j(less, &lrow);
+    }
+
+    // Release input buffer.
+    __ addq(rsp, Immediate(kpad));
+  }
+
+  int64 Complexity(const Step *step) override {
+    Tensor *q = step->input(1);
+    Tensor *c = step->output(0);
+    return c->dim(0) * c->dim(1) * q->dim(1) * 2;
+  }
+
+ private:
+  // Load block of quantized input. For AVX2, the absolute value of the input
+  // is loaded into the input register and the input with its sign is loaded
+  // into the sign register.
+  static void LoadInput(YMMRegister input, YMMRegister sign, Register buf,
+                        Register ofs, bool vnni, MacroAssembler *masm) {
+    if (vnni) {
+      ZMMRegister zinput = ZMMRegister::from_code(input.code());
+      __ vmovdqu32(zinput, Operand(buf, ofs, times_1));
+    } else {
+      __ vmovdqu(sign, Operand(buf, ofs, times_1));
+      __ vpsignb(input, sign, sign);
+    }
+  }
+
+  // Multiply block of quantized input with block of weights and add the
+  // products to the accumulator.
+  static void MultiplyAdd(YMMRegister acc, YMMRegister input, YMMRegister sign,
+                          YMMRegister temp, YMMRegister ones,
+                          const Operand &weights, bool vnni,
+                          MacroAssembler *masm) {
+    if (vnni) {
+      ZMMRegister zacc = ZMMRegister::from_code(acc.code());
+      ZMMRegister zinput = ZMMRegister::from_code(input.code());
+      __ vpdpbusd(zacc, zinput, weights);
+    } else {
+      __ vmovdqu(temp, weights);
+      __ vpsignb(temp, temp, sign);
+      __ vpmaddubsw(temp, input, temp);
+      __ vpmaddwd(temp, temp, ones);
+      __ vpaddd(acc, acc, temp);
+    }
+  }
+};
+
+// Register quantized matmul kernel.
+void RegisterQuantizeKernels(Library *library) {
+  library->Register(new QuantizedMatMul());
+}
+
+// Register weight quantization transformation.
+void RegisterQuantizeTransforms(Library *library) {
+  library->RegisterTransformer(new QuantizeMatMul());
+}
+
+}  // namespace myelin
+}  // namespace sling
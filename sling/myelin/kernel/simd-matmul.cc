@@ -12,13 +12,19 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <string>
 #include <utility>
 
 #include "sling/base/logging.h"
 #include "sling/myelin/compute.h"
+#include "sling/myelin/express.h"
+#include "sling/myelin/flow.h"
 #include "sling/myelin/macro-assembler.h"
 #include "sling/myelin/simd-assembler.h"
+#include "sling/myelin/generator/expression.h"
+#include "sling/myelin/generator/index.h"
+#include "sling/myelin/kernel/library.h"
 
 #define __ masm->
 
@@ -230,16 +236,246 @@ class MatMulArgs {
   bool accumulate_;
 };
 
+// Minimum number of operations for splitting a matrix multiplication across
+// threads, and minimum number of operations for each thread.
+static const int64 kParallelMinOps = 1 << 20;
+static const int64 kParallelGrainOps = 1 << 16;
+
+// Index generator for the element-wise expression in a fused matrix
+// multiplication. Input 0 in the expression is the result of the matrix
+// multiplication and input i > 0 is input i + 1 of the step, i.e. the inputs
+// following the A and B matrices. These are either scalars or row vectors that
+// are broadcast over the rows of the result. The expression is computed for
+// one row of the result at a time.
+class FusedIndexGenerator : public IndexGenerator {
+ public:
+  FusedIndexGenerator(const Step *step, MacroAssembler *masm)
+      : IndexGenerator(masm), step_(step) {}
+
+  void Initialize(size_t vecsize) override {
+    vecsize_ = vecsize;
+  }
+
+  bool EnableSparse(Tensor *sparse) override {
+    return false;
+  }
+
+  bool AllocateRegisters() override {
+    // Allocate temp vars.
+    if (!IndexGenerator::AllocateRegisters()) return false;
+
+    // Allocate base registers for non-constant inputs.
+    if (step_ == nullptr) return true;
+    base_.resize(step_->indegree() - 1);
+    for (int i = 1; i < base_.size(); ++i) {
+      Tensor *tensor = input(i);
+      if (tensor->constant() && tensor->elements() == 1) continue;
+      base_[i] = masm_->rr().try_alloc();
+      if (!base_[i].is_valid()) return false;
+    }
+    return true;
+  }
+
+  // Load base addresses for inputs.
+  void LoadBaseRegisters() {
+    for (int i = 1; i < base_.size(); ++i) {
+      if (base_[i].is_valid()) masm_->LoadTensorAddress(base_[i], input(i));
+    }
+  }
+
+  jit::Operand addr(Express::Var *var) override {
+    switch (var->type) {
+      case Express::NUMBER:
+        // System-defined constant.
+        if (type() == DT_DOUBLE) {
+          double number = Express::NumericFlt64(var->id);
+          return masm_->GetConstant(number, vecsize_ / sizeof(double))
+                      ->address();
+        } else {
+          float number = Express::NumericFlt32(var->id);
+          return masm_->GetConstant(number, vecsize_ / sizeof(float))
+                      ->address();
+        }
+      case Express::CONST: {
+        // Scalar constant in code block, vectorized if needed.
+        int size = input(var->id)->element_size();
+        return masm_->GetData(data(var), size, vecsize_ / size)->address();
+      }
+      case Express::INPUT:
+        if (var->id > 0) {
+          if (input(var->id)->elements() == 1) {
+            // Scalar input.
+            return Operand(base_[var->id]);
+          } else {
+            // Row vector input.
+            return Operand(base_[var->id], offset_);
+          }
+        }
+        FALLTHROUGH_INTENDED;
+      case Express::OUTPUT:
+        // The expression is computed in-place in the result row.
+        return Operand(row_, offset_);
+      default:
+        LOG(FATAL) << "Unsupported variable type";
+        return Operand(no_reg);
+    }
+  }
+
+  bool NeedsBroadcast(Express::Var *var) override {
+    if (var->type != Express::INPUT || var->id == 0) return false;
+    Tensor *tensor = input(var->id);
+    return tensor->elements() == 1 && vecsize_ > tensor->element_size();
+  }
+
+  const void *data(Express::Var *var) override {
+    DCHECK_EQ(var->type, Express::CONST);
+    return input(var->id)->data();
+  }
+
+  // Set row in result and offset within row for expression computation.
+  void set_row(Register row) { row_ = row; }
+  void set_offset(Register offset) { offset_ = offset; }
+
+ private:
+  // Return tensor for expression input.
+  Tensor *input(int id) const {
+    return id == 0 ? step_->output(0) : step_->input(id + 1);
+  }
+
+  // Element type for expression.
+  Type type() const { return step_->output(0)->type(); }
+
+  const Step *step_;            // fused matmul step
+  size_t vecsize_ = 0;          // vector size in bytes
+  std::vector<Register> base_;  // base registers for inputs
+  Register row_ = no_reg;       // start of result row
+  Register offset_ = no_reg;    // offset within row
+};
+
+// Element-wise expression computed on the result of a fused matrix
+// multiplication.
+struct FusedExpression {
+  // Initialize expression for fused matmul step.
+  FusedExpression(const Step *step, MacroAssembler *masm)
+      : index(step, masm) {
+    Tensor *c = step->output(0);
+    type = c->type();
+    width = c->dim(c->rank() - 1);
+    expr.Parse(step->GetAttr("expr"));
+
+    // Mark scalar inputs.
+    for (int i = 2; i < step->indegree(); ++i) {
+      Tensor *input = step->input(i);
+      if (input->elements() == 1 && !input->constant()) {
+        Express::Var *var = expr.Lookup(Express::INPUT, i - 1);
+        if (var != nullptr) var->single = true;
+      }
+    }
+
+    // Select and initialize expression generator.
+    generator = ExpressionGenerator::Select(expr, type, width);
+    CHECK(generator != nullptr);
+    if (masm != nullptr) generator->set_approx(masm->options().fast_math);
+    generator->Initialize(expr, type, 0, &index);
+  }
+
+  ~FusedExpression() { delete generator; }
+
+  // Allocate registers.
+  bool AllocateRegisters() {
+    return index.AllocateRegisters();
+  }
+
+  // Generate loop-invariant code for expression.
+  void GenerateInit(MacroAssembler *masm) {
+    index.LoadBaseRegisters();
+    generator->GenerateInit(masm);
+  }
+
+  // Generate code for computing the expression on a row in the result.
+  void GenerateRow(MacroAssembler *masm, Register row, Register ofs) {
+    int vecsize = generator->VectorSize();
+    int rowsize = width * TypeTraits::of(type).size();
+    index.set_row(row);
+    index.set_offset(ofs);
+    __ xorq(ofs, ofs);
+    Label l;
+    __ bind(&l);
+    generator->GenerateBody(masm);
+    if (rowsize > vecsize) {
+      __ addq(ofs, Immediate(vecsize));
+      __ cmpq(ofs, Immediate(rowsize));
+      __ j(less, &l);
+    }
+  }
+
+  // Check that there are enough registers left for the matrix multiplication
+  // after allocating the registers for the fused expression.
+  static bool Fits(const Express &expr, Type type, int width, int inputs,
+                   const Options &options) {
+    ExpressionGenerator *generator =
+        ExpressionGenerator::Select(expr, type, width);
+    if (generator == nullptr) return false;
+
+    // Perform dry-run to determine the number of free registers.
+    MacroAssembler masm(nullptr, 0, options);
+    masm.AllocateFunctionRegisters();
+    masm.rr().reserve_all();
+    FusedIndexGenerator index(nullptr, &masm);
+    generator->set_approx(options.fast_math);
+    generator->Initialize(expr, type, 0, &index);
+    bool ok = index.AllocateRegisters();
+    delete generator;
+    if (!ok) return false;
+
+    bool extended = CPU::Enabled(AVX512F);
+    int mmfree = 0;
+    while (masm.mm().try_alloc(extended) != -1) mmfree++;
+    if (mmfree < kMatMulSIMDRegisters) return false;
+    if (masm.rr().num_free() < kMatMulRegisters + inputs) return false;
+    return true;
+  }
+
+  // Return the number of general registers used by the fused expression.
+  static int RegisterUsage(const Step *step, const Options &options) {
+    MacroAssembler masm(nullptr, 0, options);
+    masm.AllocateFunctionRegisters();
+    masm.rr().reserve_all();
+    FusedExpression expression(step, &masm);
+    int before = masm.rr().num_free();
+    CHECK(expression.AllocateRegisters())
+        << "Register overflow in " << step->name();
+    int after = masm.rr().num_free();
+    return before - after;
+  }
+
+  // Number of general and SIMD registers needed by matrix multiplication in
+  // addition to the registers for the fused expression.
+  static const int kMatMulRegisters = 10;
+  static const int kMatMulSIMDRegisters = 2 * SIMDStrategy::kMaxUnrolls + 2;
+
+  Express expr;                // expression to be computed
+  FusedIndexGenerator index;   // index generator for expression
+  ExpressionGenerator *generator;  // code generator for expression
+  Type type;                   // element type
+  int width;                   // number of elements in result row
+};
+
 // General matrix multiplication using SIMD code generators. It supports
-// transposed inputs and output as well as output accumulation.
+// transposed inputs and output as well as output accumulation. A fused matrix
+// multiplication computes an element-wise expression on each row of the result
+// right after it has been computed, while it is still in the cache.
 class SIMDMatMul : public Kernel {
  public:
-  SIMDMatMul(bool accumulate) : accumulate_(accumulate) {}
+  SIMDMatMul(bool accumulate, bool fused = false)
+      : accumulate_(accumulate), fused_(fused) {}
 
   string Name() override {
+    if (fused_) return "SIMDFusedMatMul";
     return accumulate_ ? "SIMDAccMatMul" : "SIMDMatMul";
   }
   string Operation() override {
+    if (fused_) return "FusedMatMul";
     return accumulate_ ? "AssignAddMatMul" : "MatMul";
   }
 
@@ -259,10 +495,46 @@ class SIMDMatMul : public Kernel {
     if (args.a().type() != type) return false;
     if (args.b().type() != type) return false;
 
+    // Check fused expression.
+    if (fused_ && !SupportsExpression(step, args)) return false;
+
     return true;
   }
 
-  void Adjust(Step *step) override {
+  // Check that the fused expression can be computed on the rows of the
+  // result.
+  static bool SupportsExpression(Step *step, const MatMulArgs &args) {
+    // Only unbatched float matrix multiplications are supported.
+    Tensor *c = step->output(0);
+    Type type = c->type();
+    if (type != DT_FLOAT && type != DT_DOUBLE) return false;
+    if (c->rank() != 2 || args.a().batch_size() != 1) return false;
+    if (step->outdegree() != 1) return false;
+
+    // Inputs must be scalars or row vectors.
+    int width = c->dim(1);
+    int inputs = 0;
+    for (int i = 2; i < step->indegree(); ++i) {
+      Tensor *input = step->input(i);
+      if (input->type() != type) return false;
+      if (input->elements() != 1) {
+        if (input->elements() != width) return false;
+        if (input->dim(input->rank() - 1) != width) return false;
+      }
+      if (!input->constant() || input->elements() != 1) inputs++;
+    }
+
+    // Reductions are not supported in the expression.
+    Express expr;
+    expr.Parse(step->GetAttr("expr"));
+    for (Express::Op *op : expr.ops()) {
+      if (op->reduction()) return false;
+    }
+
+    return FusedExpression::Fits(expr, type, width, inputs, Options());
+  }
+
+  void Adjust(Step *step, const Options &options) override {
     // Set required order for output.
     MatMulArgs args(step);
     args.RequireOrder(ROW_MAJOR);
@@ -283,7 +555,28 @@ class SIMDMatMul : public Kernel {
     // Reserve registers.
     int regs = SIMDAssembler::RegisterUsage(type) + 8;
     if (args.a().batch_size() > 1) regs++;
+
+    if (fused_) {
+      // The fused expression is computed on dense rows of the result.
+      FusedExpression expression(step, nullptr);
+      int alignment = expression.generator->VectorSize();
+      args.c().tensor->SetMiniumAlignment(alignment);
+      args.c().tensor->RequireDense();
+      for (int i = 2; i < step->indegree(); ++i) {
+        Tensor *input = step->input(i);
+        if (input->rank() > 0) input->SetMiniumAlignment(alignment);
+        input->RequireDense();
+        input->RequireStandardOrder();
+      }
+      regs += FusedExpression::RegisterUsage(step, options);
+    }
     step->SetRegisterUsage(regs);
+
+    // Reserve registers for loop range in parallel matrix multiplication.
+    if (step->cell()->runtime()->ParallelLoopFunc() != nullptr &&
+        ParallelRows(args) > 0) {
+      step->SetPreservedRegisterUsage(2);
+    }
   }
 
   void Generate(Step *step, MacroAssembler *masm) override {
@@ -292,6 +585,25 @@ class SIMDMatMul : public Kernel {
     auto &a = args.a();
     auto &b = args.b();
 
+    // Allocate registers for loop range in parallel matrix multiplication.
+    int rows = ParallelRows(args);
+    bool parallel = rows > 0 && masm->SupportsParallelLoops();
+    Register begin = no_reg;
+    Register end = no_reg;
+    if (parallel) {
+      begin = masm->rr().alloc_preserved();
+      end = masm->rr().alloc_preserved();
+    }
+
+    // Allocate registers for fused expression.
+    FusedExpression *expr = nullptr;
+    if (fused_) {
+      expr = new FusedExpression(step, masm);
+      CHECK(expr->AllocateRegisters()) << "Register overflow";
+    }
+    Registers rr = masm->rr();
+    bool vertical = false;
+
     // Check for vector product.
     if (a.vector() && a.dense() &&
         b.vector() && b.dense() &&
@@ -308,12 +620,26 @@ class SIMDMatMul : public Kernel {
       // Use the input element order to choose matrix multiplication algorithm.
       Order oa = a.order();
       Order ob = b.order();
-      if (oa == ROW_MAJOR && ob == ROW_MAJOR) {
-        GenerateVertical(step, masm, args, false);
+      if (parallel) {
+        // Split the rows/columns of A across threads for large matrices.
+        int64 ops = 2LL * a.rows() * a.columns() * b.columns();
+        int64 grain = std::max<int64>(kParallelGrainOps * rows / ops, 1);
+        __ ParallelLoop(rows, grain, begin, end, [&]() {
+          GenerateVertical(step, masm, args, oa == COLUMN_MAJOR, expr,
+                           begin, end);
+        });
+        masm->rr().release(begin);
+        masm->rr().release(end);
+        step->set_variant(step->variant() + "P");
+        vertical = true;
+      } else if (oa == ROW_MAJOR && ob == ROW_MAJOR) {
+        GenerateVertical(step, masm, args, false, expr);
+        vertical = true;
       } else if (oa == ROW_MAJOR && ob == COLUMN_MAJOR) {
         GenerateHorizontal(step, masm, args);
       } else if (oa == COLUMN_MAJOR && ob == ROW_MAJOR) {
-        GenerateVertical(step, masm, args, true);
+        GenerateVertical(step, masm, args, true, expr);
+        vertical = true;
       } else if (oa == COLUMN_MAJOR && ob == COLUMN_MAJOR) {
         GenerateColCol(step, masm, args);
       } else {
@@ -326,13 +652,77 @@ class SIMDMatMul : public Kernel {
     if (batch_size > 1) {
       step->set_variant(step->variant() + "*" + std::to_string(batch_size));
     }
+
+    if (expr != nullptr) {
+      // The vertical algorithm computes the fused expression on each row of
+      // the result. Otherwise, compute the expression on the rows of the result
+      // after the matrix multiplication, reusing the general registers from
+      // the matrix multiplication.
+      if (!vertical) {
+        masm->rr() = rr;
+        GenerateExpression(masm, args, expr);
+      }
+      step->set_variant(step->variant() + "+" + expr->generator->Name());
+      delete expr;
+    }
+  }
+
+  // Compute fused expression on all the rows of the result.
+  void GenerateExpression(MacroAssembler *masm, const MatMulArgs &args,
+                          FusedExpression *expr) {
+    Register row = masm->rr().alloc();
+    Register ofs = masm->rr().alloc();
+    Register end = masm->rr().alloc();
+    expr->GenerateInit(masm);
+    __ LoadTensorAddress(row, args.c().tensor);
+    int rows = args.c().tensor->dim(0);
+    Label l;
+    if (rows > 1) {
+      __ leaq(end, Operand(row, args.c().tensor->size()));
+      __ bind(&l);
+    }
+    expr->GenerateRow(masm, row, ofs);
+    if (rows > 1) {
+      __ addq(row, Immediate(args.c().tensor->stride(0)));
+      __ cmpq(row, end);
+      __ j(less, &l);
+    }
+  }
+
+  // Return the number of rows/columns in A for splitting a matrix
+  // multiplication across threads, or zero if it should not be split. Only
+  // the vertical algorithm for unbatched matrices supports splitting. The
+  // element order of the inputs might not have been decided yet when this is
+  // called from Adjust(), so an undecided order must not rule out splitting.
+  static int ParallelRows(const MatMulArgs &args) {
+    auto &a = args.a();
+    auto &b = args.b();
+    if (a.batch_size() != 1) return 0;
+    if (a.vector() && a.dense() && b.vector() && b.dense()) return 0;
+    if (b.order() == COLUMN_MAJOR) return 0;
+    int rows;
+    if (a.order() == ROW_MAJOR) {
+      rows = a.height();
+    } else if (a.order() == COLUMN_MAJOR) {
+      rows = a.width();
+    } else {
+      rows = std::max(a.height(), a.width());
+    }
+    if (rows < 2) return 0;
+    int64 ops = 2LL * a.rows() * a.columns() * b.columns();
+    if (ops < kParallelMinOps) return 0;
+    return rows;
   }
 
   // Compute dot products between rows/columns in A and column blocks in B using
   // vertical summing. The vectors in A can either be traverse from top to
-  // bottom (strided) or from left ro right (consecutive).
+  // bottom (strided) or from left ro right (consecutive). If begin and end are
+  // given, only the rows/columns in A in this range are computed. The fused
+  // expression, if any, is computed on each row of the result.
   void GenerateVertical(Step *step, MacroAssembler *masm,
-                        const MatMulArgs &args, bool strided) {
+                        const MatMulArgs &args, bool strided,
+                        FusedExpression *expr,
+                        Register begin = no_reg, Register end = no_reg) {
     // Create SIMD code generators.
     Type type = args.c().type();
     int dsize = TypeTraits::of(type).size();
@@ -364,6 +754,7 @@ class SIMDMatMul : public Kernel {
     __ LoadTensorAddress(a, args.a().tensor);
     __ LoadTensorAddress(b, args.b().tensor);
     __ LoadTensorAddress(c, args.c().tensor);
+    if (expr != nullptr) expr->GenerateInit(masm);
 
     // Compute inner and outer dimensions.
     int outer_step, outer_limit, inner_step, inner_limit, batch_skip;
@@ -396,11 +787,22 @@ class SIMDMatMul : public Kernel {
     Register a_end = masm->rr().alloc();
     Label l1;
     if (!outer_single) {
-      __ leaq(a_end, Operand(a, outer_limit));
+      if (begin.is_valid()) {
+        // Only compute the rows/columns in the range.
+        __ imulq(a_end, end, Immediate(outer_step));
+        __ addq(a_end, a);
+        __ imulq(a_ofs, begin, Immediate(args.c().stride()));
+        __ addq(c, a_ofs);
+        __ imulq(a_ofs, begin, Immediate(outer_step));
+        __ addq(a, a_ofs);
+      } else {
+        __ leaq(a_end, Operand(a, outer_limit));
+      }
       __ bind(&l1);
     }
 
     // Compute dot product between row/column in A and column blocks in B.
+    int advance = 0;
     for (auto &phase : strategy.phases()) {
       auto *gen = phase.generator;
       int vecsize = gen->VectorSize();
@@ -463,6 +865,7 @@ class SIMDMatMul : public Kernel {
           }
         }
         __ addq(c, Immediate(blksize));
+        advance += phase.repeat * blksize;
 
         // Next block.
         __ addq(col_ofs, Immediate(blksize));
@@ -516,6 +919,7 @@ class SIMDMatMul : public Kernel {
 
         if (!last || !outer_single) {
           __ addq(c, Immediate(blksize));
+          advance += blksize;
         }
       } else {
         // Masked phase.
@@ -552,10 +956,17 @@ class SIMDMatMul : public Kernel {
         }
         if (!last || !outer_single) {
           __ addq(c, Immediate(phase.masked * dsize));
+          advance += phase.masked * dsize;
         }
       }
     }
 
+    // Compute fused expression on row in C.
+    if (expr != nullptr) {
+      __ leaq(b_ptr, Operand(c, -advance));
+      expr->GenerateRow(masm, b_ptr, col_ofs);
+    }
+
     // Next row/column in A.
     if (!outer_single) {
       if (args.c().padding() > 0) {
@@ -1136,16 +1547,150 @@ class SIMDMatMul : public Kernel {
     int64 ops = args.c().tensor->elements();
     ops *= args.a().columns();
     ops *= 2;
+    if (fused_) {
+      Express expr;
+      expr.Parse(step->GetAttr("expr"));
+      ops += args.c().tensor->elements() * expr.Complexity();
+    }
     return  ops;
   }
 
  private:
   bool accumulate_;  // matmul with assignment
+  bool fused_;       // matmul with fused element-wise expression
+};
+
+// Fuse element-wise ops into the matrix multiplication that produces their
+// input, so the expression can be computed on the result of the matrix
+// multiplication while it is still in the cache. The other inputs to the
+// element-wise ops must be scalars or row vectors, e.g. a bias vector followed
+// by an activation function. The fused op is a FusedMatMul op where the "expr"
+// attribute has the expression computed on the result.
+class FusedMatMulTransformer : public Transformer {
+ public:
+  string Name() override { return "FusedMatMulTransformer"; }
+
+  bool Transform(Flow *flow) override {
+    int num_fused = 0;
+    bool again = true;
+    while (again) {
+      again = false;
+      for (Flow::Operation *op : flow->ops()) {
+        if (op->type != "MatMul" && op->type != "FusedMatMul") continue;
+        if (Fuse(flow, op)) {
+          num_fused++;
+          again = true;
+          break;
+        }
+      }
+    }
+    return num_fused > 0;
+  }
+
+  // Try to fuse the consumer of the matmul result into the matmul.
+  bool Fuse(Flow *flow, Flow::Operation *matmul) {
+    // Check matmul.
+    if (matmul->outdegree() != 1) return false;
+    if (matmul->type == "MatMul" && matmul->indegree() != 2) return false;
+    if (matmul->GetAttr("nomerge", false)) return false;
+    Flow::Variable *a = matmul->inputs[0];
+    Flow::Variable *b = matmul->inputs[1];
+    Flow::Variable *c = matmul->outputs[0];
+    Type type = c->type;
+    if (type != DT_FLOAT && type != DT_DOUBLE) return false;
+    if (a->type != type || b->type != type) return false;
+    if (a->rank() != 2 || b->rank() != 2 || c->rank() != 2) return false;
+
+    // The element-wise op must be the sole consumer of the result.
+    if (c->usages() != 1 || c->out()) return false;
+    Flow::Operation *op = c->consumers[0];
+    if (!IsCalculateOp(op)) return false;
+    if (op->func != matmul->func) return false;
+    if (op->GetAttr("nomerge", false)) return false;
+    if (op->HasAttr("axis")) return false;
+    if (op->outdegree() != 1) return false;
+    Flow::Variable *output = op->outputs[0];
+    if (output->type != type || output->shape != c->shape) return false;
+
+    // Other inputs must be scalars or row vectors.
+    int width = c->dim(1);
+    int inputs = 0;
+    for (Flow::Variable *input : op->inputs) {
+      if (input == c) continue;
+      if (input->type != type) return false;
+      if (matmul->IsInput(input)) return false;
+      if (input->DependsOn(matmul)) return false;
+      if (input->elements() != 1) {
+        if (input->elements() != width) return false;
+        if (input->dim(input->rank() - 1) != width) return false;
+      }
+      if (!input->constant() || input->elements() != 1) inputs++;
+    }
+    for (int i = 2; i < matmul->indegree(); ++i) {
+      Flow::Variable *input = matmul->inputs[i];
+      if (!input->constant() || input->elements() != 1) inputs++;
+    }
+
+    // Build expression for the matmul result. Input 0 in the expression is the
+    // result of the matrix multiplication and input i > 0 is input i + 1 of
+    // the fused op.
+    Express expr;
+    const string &recipe = matmul->GetAttr("expr");
+    expr.Parse(recipe.empty() ? "@0=Id(%0)" : recipe);
+    Express::Var *result = expr.Variable(Express::OUTPUT, 0);
+    result->type = Express::TEMP;
+    result->id = -1;
+
+    // Map the variables in the element-wise expression to the fused
+    // expression. The inputs from the element-wise op are added after the
+    // existing inputs to the matmul.
+    Express opexpr;
+    InitExpression(op, &opexpr);
+    Express::Map mapping;
+    int next = matmul->indegree() - 1;
+    for (int i = 0; i < op->indegree(); ++i) {
+      Flow::Variable *input = op->inputs[i];
+      Express::Var *var = opexpr.Lookup(Express::INPUT, i);
+      if (var == nullptr) var = opexpr.Lookup(Express::CONST, i);
+      if (input == c) {
+        if (var != nullptr) mapping[var] = result;
+      } else {
+        if (var != nullptr) mapping[var] = expr.Variable(var->type, next);
+        next++;
+      }
+    }
+    mapping[opexpr.Variable(Express::OUTPUT, 0)] =
+        expr.Variable(Express::OUTPUT, 0);
+    expr.CompactTempVars();
+    opexpr.CompactTempVars();
+    expr.Merge(&opexpr, mapping);
+
+    // Reductions are not supported in the fused expression.
+    for (Express::Op *o : expr.ops()) {
+      if (o->reduction()) return false;
+    }
+
+    // Check that the matmul kernel can compute the fused expression.
+    expr.EliminateRedundantMoves();
+    if (!FusedExpression::Fits(expr, type, width, inputs, Options())) {
+      return false;
+    }
+
+    // Fuse the element-wise op into the matmul.
+    Flow::Operation *fused = flow->Fuse(matmul, op, "FusedMatMul", false);
+    fused->SetAttr("expr", expr.AsRecipe());
+    return true;
+  }
 };
 
 void RegisterSIMDMatMulLibrary(Library *library) {
   library->Register(new SIMDMatMul(true));
   library->Register(new SIMDMatMul(false));
+  library->Register(new SIMDMatMul(false, true));
+}
+
+void RegisterSIMDMatMulTransforms(Library *library) {
+  library->RegisterTransformer(new FusedMatMulTransformer());
 }
 
 }  // namespace myelin
@@ -1655,7 +1655,7 @@ void MacroAssembler::Reduce(Reduction op, Type type,
 
 void MacroAssembler::UpdateCounter(int64 *counter, int64 value) {
   CHECK(!rr_.used(rdi));
-  movp(rdi, counter);
+  load_extern(rdi, counter, "myelin_flops");
   lock();
   addq(Operand(rdi), Immediate(value));
 }
@@ -1701,6 +1701,53 @@ void MacroAssembler::WaitForMainTask() {
   CallInstanceFunction(runtime_->SyncMainFunc(), "myelin_sync_main");
 }
 
+void MacroAssembler::ParallelLoop(int64 size, int64 grain,
+                                  Register begin, Register end,
+                                  const std::function<void()> &body) {
+  // Call runtime to run loop body function in parallel.
+  CHECK(SupportsParallelLoops())
+      << "Runtime does not support parallel loops";
+  Label entry, done;
+  leaq(arg_reg_1, Operand(&entry));
+  movq(arg_reg_2, datareg);
+  movq(arg_reg_3, size);
+  movq(arg_reg_4, grain);
+  void *target = reinterpret_cast<void *>(runtime_->ParallelLoopFunc());
+  call_extern(target, "myelin_parallel_loop");
+  jmp(&done);
+
+  // Generate loop body function. All callee-saved registers are saved since
+  // the body can use any of the registers reserved for the cell. The stack is
+  // kept 16-byte aligned.
+  bind(&entry);
+  pushq(rbx);
+  pushq(rbp);
+  pushq(r12);
+  pushq(r13);
+  pushq(r14);
+  pushq(r15);
+  subq(rsp, Immediate(8));
+  movq(datareg, arg_reg_1);
+  pushq(arg_reg_3);
+  movq(begin, arg_reg_2);
+  popq(end);
+
+  body();
+
+  addq(rsp, Immediate(8));
+  popq(r15);
+  popq(r14);
+  popq(r13);
+  popq(r12);
+  popq(rbp);
+  popq(rbx);
+  if (CPU::VZeroNeeded() && Enabled(AVX)) {
+    vzeroupper();
+  }
+  ret(0);
+  bind(&done);
+}
+
 void MacroAssembler::CallInstanceFunction(void (*func)(void *),
                                           const string &symbol) {
   if (func != nullptr) {
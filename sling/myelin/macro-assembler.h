@@ -15,6 +15,7 @@
 #ifndef SLING_MYELIN_MACRO_ASSEMBLER_H_
 #define SLING_MYELIN_MACRO_ASSEMBLER_H_
 
+#include <functional>
 #include <limits>
 
 #include "sling/myelin/compute.h"
@@ -455,6 +456,21 @@ class MacroAssembler : public jit::Assembler {
   // Wait for main task to complete.
   void WaitForMainTask();
 
+  // Check if runtime supports parallel loops.
+  bool SupportsParallelLoops() const {
+    return runtime_->ParallelLoopFunc() != nullptr;
+  }
+
+  // Generate parallel loop over [0;size). The body is generated as a separate
+  // function that the runtime calls with sub-ranges of at least grain
+  // iterations, possibly in several threads at the same time. The begin and
+  // end registers hold the sub-range in the body. All registers available to
+  // the cell can be used in the body, but the body cannot use values computed
+  // outside it except for the instance data. Kernels that use fixed scratch
+  // registers should allocate begin and end with alloc_preserved().
+  void ParallelLoop(int64 size, int64 grain, Register begin, Register end,
+                    const std::function<void()> &body);
+
   // Reset register usage.
   void ResetRegisterUsage();
 
@@ -15,8 +15,11 @@
 #include "sling/myelin/multi-process.h"
 
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
 
 #include "sling/base/logging.h"
+#include "sling/string/printf.h"
 
 namespace sling {
 namespace myelin {
@@ -114,6 +117,161 @@ class Worker {
   std::thread thread_;
 };
 
+// Worker pool for parallel loops in kernels. The caller publishes a loop and
+// takes part in running it. Workers claim chunks of the loop range until it
+// is exhausted. Idle workers spin for a while waiting for the next loop before
+// parking, so back-to-back loops in a cell computation are dispatched with low
+// latency without burning cores when the network is idle.
+class LoopPool {
+ public:
+  // Start loop workers. The calling thread is also used for running loops, so
+  // this starts one less worker than the number of threads.
+  explicit LoopPool(int threads) : threads_(threads) {
+    for (int i = 0; i < threads - 1; ++i) {
+      std::thread(&LoopPool::Worker, this).detach();
+    }
+  }
+
+  // Run loop body over [0;size) in chunks of at least grain iterations.
+  void Run(Runtime::LoopFunc body, void *data, int64 size, int64 grain) {
+    // Run small loops in the calling thread. The pool only runs one loop at a
+    // time, so loops started while the pool is busy, e.g. nested loops or
+    // loops in concurrent cell computations, are also run directly.
+    int64 chunks = std::min<int64>(threads_, size / std::max<int64>(grain, 1));
+    bool idle = false;
+    if (chunks < 2 ||
+        !busy_.compare_exchange_strong(idle, true, std::memory_order_acquire)) {
+      body(data, 0, size);
+      return;
+    }
+
+    // Publish loop to workers.
+    body_ = body;
+    data_ = data;
+    size_ = size;
+    chunk_ = (size + chunks - 1) / chunks;
+    next_.store(0, std::memory_order_relaxed);
+    remaining_.store(size, std::memory_order_relaxed);
+    uint64 generation = generation_.load(std::memory_order_relaxed) + 1;
+    generation_.store(generation);
+    if (parked_.load() > 0) {
+      std::lock_guard<std::mutex> lock(park_mu_);
+      park_cv_.notify_all();
+    }
+
+    // Help running the loop and wait until all chunks are done.
+    Work();
+    int spins = 0;
+    while (remaining_.load(std::memory_order_acquire) > 0) Backoff(&spins);
+
+    // Close loop and wait for workers to leave it.
+    generation_.store(generation + 1);
+    while (active_.load() > 0) Backoff(&spins);
+    busy_.store(false, std::memory_order_release);
+  }
+
+ private:
+  // Number of spin iterations before an idle worker is parked.
+  static const int kSpinIterations = 4096;
+
+  // Loop worker. The loop generation is odd while a loop is open.
+  void Worker() {
+    uint64 seen = 0;
+    int spins = 0;
+    for (;;) {
+      uint64 generation = generation_.load(std::memory_order_acquire);
+      if (generation != seen && (generation & 1)) {
+        // Join loop unless it was closed in the meantime.
+        seen = generation;
+        active_.fetch_add(1);
+        if (generation_.load() == generation) Work();
+        active_.fetch_sub(1);
+        spins = 0;
+      } else if (++spins < kSpinIterations) {
+        // Spin waiting for next loop.
+        Pause();
+      } else {
+        // Park until next loop is published.
+        std::unique_lock<std::mutex> lock(park_mu_);
+        parked_.fetch_add(1);
+        while (generation_.load() == generation) park_cv_.wait(lock);
+        parked_.fetch_sub(1);
+        spins = 0;
+      }
+    }
+  }
+
+  // Run chunks of the current loop until the loop range is exhausted.
+  void Work() {
+    for (;;) {
+      int64 begin = next_.fetch_add(chunk_);
+      if (begin >= size_) break;
+      int64 end = std::min(begin + chunk_, size_);
+      body_(data_, begin, end);
+      remaining_.fetch_sub(end - begin, std::memory_order_release);
+    }
+  }
+
+  // Spin waiting for other threads.
+  static void Pause() { __builtin_ia32_pause(); }
+
+  // Spin for a while and then yield to other threads, e.g. when workers are
+  // preempted while running chunks.
+  static void Backoff(int *spins) {
+    if (++*spins < kSpinIterations) {
+      Pause();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  // Number of threads running loops, including the calling thread.
+  int threads_;
+
+  // Set while a loop is running in the pool.
+  std::atomic<bool> busy_{false};
+
+  // Current loop.
+  Runtime::LoopFunc body_ = nullptr;
+  void *data_ = nullptr;
+  int64 size_ = 0;
+  int64 chunk_ = 0;
+
+  // Start of the next unclaimed chunk and number of unfinished iterations.
+  std::atomic<int64> next_{0};
+  std::atomic<int64> remaining_{0};
+
+  // Loop generation and number of workers in current loop.
+  std::atomic<uint64> generation_{0};
+  std::atomic<int> active_{0};
+
+  // Signal for waking up parked workers.
+  std::mutex park_mu_;
+  std::condition_variable park_cv_;
+  std::atomic<int> parked_{0};
+};
+
+// Loop worker pool shared by all multi-processor runtimes.
+static std::mutex loop_pool_mu;
+static LoopPool *loop_pool = nullptr;
+
+// Run parallel loop in loop worker pool.
+static void RunParallelLoop(Runtime::LoopFunc body, void *data,
+                            int64 size, int64 grain) {
+  loop_pool->Run(body, data, size, grain);
+}
+
+MultiProcessorRuntime::MultiProcessorRuntime(int loop_threads) {
+  if (loop_threads == 0) loop_threads = std::thread::hardware_concurrency();
+  loop_threads_ = std::max(loop_threads, 1);
+
+  // Start loop worker pool.
+  if (loop_threads_ > 1) {
+    std::lock_guard<std::mutex> lock(loop_pool_mu);
+    if (loop_pool == nullptr) loop_pool = new LoopPool(loop_threads_);
+  }
+}
+
 MultiProcessorRuntime::~MultiProcessorRuntime() {
   // Stop all workers.
   for (auto *w : workers_) delete w;
@@ -186,6 +344,11 @@ void MultiProcessorRuntime::FreeChannel(char *data, Placement placement) {
   free(data);
 }
 
+string MultiProcessorRuntime::Description() {
+  if (loop_threads_ == 1) return "Multi-processor";
+  return StringPrintf("Multi-processor with %d loop threads", loop_threads_);
+}
+
 Runtime::TaskFunc MultiProcessorRuntime::StartTaskFunc() {
   return Worker::Start;
 }
@@ -194,6 +357,9 @@ Runtime::TaskFunc MultiProcessorRuntime::WaitTaskFunc() {
   return Worker::Wait;
 }
 
+Runtime::ParallelFunc MultiProcessorRuntime::ParallelLoopFunc() {
+  return loop_threads_ > 1 ? RunParallelLoop : nullptr;
+}
+
 }  // namespace myelin
 }  // namespace sling
-
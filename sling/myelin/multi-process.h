@@ -26,11 +26,19 @@ namespace myelin {
 
 class Worker;
 
-// Myelin runtime for multi-processor execution.
+// Myelin runtime for multi-processor execution. Steps assigned to separate
+// tasks in the flow run in parallel on dedicated task workers. Kernels can
+// also split large loops across a shared pool of loop workers (intra-op
+// parallelism).
 class MultiProcessorRuntime : public Runtime {
  public:
+  // Initialize runtime with the number of threads for parallel loops,
+  // including the calling thread. One disables parallel loops and zero means
+  // one thread per CPU core. The loop worker pool is shared by all runtimes
+  // and is sized by the first runtime that uses it.
+  explicit MultiProcessorRuntime(int loop_threads = 1);
   ~MultiProcessorRuntime();
-  string Description() override { return "Multi-processor"; }
+  string Description() override;
 
   // Instance data allocation.
   void AllocateInstance(Instance *instance) override;
@@ -52,8 +60,12 @@ class MultiProcessorRuntime : public Runtime {
   bool SupportsAsync() override { return true; }
   TaskFunc StartTaskFunc() override;
   TaskFunc WaitTaskFunc() override;
+  ParallelFunc ParallelLoopFunc() override;
 
  private:
+  // Number of threads for parallel loops.
+  int loop_threads_;
+
   // Mutex for synchronizing access to worker pool.
   std::mutex mu_;
 
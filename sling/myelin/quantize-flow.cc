@@ -0,0 +1,164 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Quantization tool that quantizes the constant weight matrices in a flow file
+// to int8 and reports the quantization error for each matrix, both for the
+// weights themselves and for the matrix multiplication output on random inputs.
+// This can be used for checking if a model is suitable for int8 inference
+// before enabling --quantize. The quantized flow can optionally be saved.
+
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sling/base/init.h"
+#include "sling/base/flags.h"
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/myelin/compute.h"
+#include "sling/myelin/flow.h"
+#include "sling/myelin/kernel/library.h"
+#include "sling/util/random.h"
+
+DEFINE_string(flow, "", "Myelin flow file");
+DEFINE_string(o, "", "Output file for quantized flow");
+DEFINE_int32(samples, 100, "Number of random input samples");
+
+using namespace sling;
+using namespace sling::myelin;
+
+// Original float weight matrix.
+struct Weights {
+  std::vector<float> data;
+  bool transposed;
+};
+
+// Compute y = x * Q^T * diag(S) for an input vector x in the same way as the
+// quantized matmul kernel, i.e. the input is quantized to int8 with a
+// symmetric scale and the dot products are computed with integer arithmetic.
+void QuantizedMatMul(const std::vector<float> &x, const int8 *q,
+                     const float *scales, int kpad, std::vector<float> *y) {
+  int k = x.size();
+  int n = y->size();
+  float maxabs = 1e-30;
+  for (int i = 0; i < k; ++i) maxabs = std::max(maxabs, fabsf(x[i]));
+  float inverse = 127.0 / maxabs;
+  std::vector<int32> qx(k);
+  for (int i = 0; i < k; ++i) qx[i] = lrintf(x[i] * inverse);
+  for (int j = 0; j < n; ++j) {
+    const int8 *row = q + j * kpad;
+    int32 dot = 0;
+    for (int i = 0; i < k; ++i) dot += qx[i] * row[i];
+    (*y)[j] = dot * scales[j] * (maxabs / 127.0);
+  }
+}
+
+// Return relative root-mean-square error.
+double RelativeError(double error, double norm) {
+  return norm == 0.0 ? 0.0 : sqrt(error / norm);
+}
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+
+  // Load flow.
+  Flow flow;
+  CHECK(flow.Load(FLAGS_flow));
+
+  // Save original weights for all matrix multiplications with constant weights.
+  std::unordered_map<string, Weights> original;
+  for (Flow::Operation *op : flow.Find("MatMul")) {
+    if (op->indegree() != 2) continue;
+    Flow::Variable *b = op->inputs[1];
+    if (b->type != DT_FLOAT || !b->constant()) continue;
+    const float *data = reinterpret_cast<const float *>(b->data);
+    Weights &weights = original[op->name];
+    weights.data.assign(data, data + b->size / sizeof(float));
+    weights.transposed = op->GetAttr("transpose_b", false);
+  }
+
+  // Analyze flow with weight quantization enabled.
+  Library library;
+  RegisterStandardLibrary(&library);
+  RegisterQuantizeTransforms(&library);
+  flow.Analyze(library);
+
+  // Compute quantization error for quantized matrix multiplications.
+  Random rnd;
+  int64 float_bytes = 0;
+  int64 quantized_bytes = 0;
+  for (Flow::Operation *op : flow.Find("QuantizedMatMul")) {
+    auto f = original.find(op->name);
+    if (f == original.end()) continue;
+    const Weights &weights = f->second;
+    Flow::Variable *q = op->inputs[1];
+    Flow::Variable *s = op->inputs[2];
+    int n = q->dim(0);
+    int kpad = q->dim(1);
+    int k = op->inputs[0]->dim(1);
+    const int8 *quantized = reinterpret_cast<const int8 *>(q->data);
+    const float *scales = reinterpret_cast<const float *>(s->data);
+    float_bytes += weights.data.size() * sizeof(float);
+    quantized_bytes += q->size + s->size + op->inputs[3]->size;
+
+    // Compute weight error.
+    std::vector<float> b(k * n);
+    double werror = 0.0;
+    double wnorm = 0.0;
+    float wmax = 0.0;
+    for (int i = 0; i < k; ++i) {
+      for (int j = 0; j < n; ++j) {
+        float w = weights.data[weights.transposed ? j * k + i : i * n + j];
+        float d = w - quantized[j * kpad + i] * scales[j];
+        b[i * n + j] = w;
+        werror += d * d;
+        wnorm += w * w;
+        wmax = std::max(wmax, fabsf(d));
+      }
+    }
+
+    // Compute output error on random inputs.
+    std::vector<float> x(k);
+    std::vector<float> y(n);
+    double yerror = 0.0;
+    double ynorm = 0.0;
+    for (int sample = 0; sample < FLAGS_samples; ++sample) {
+      for (int i = 0; i < k; ++i) x[i] = rnd.UniformFloat(2.0, -1.0);
+      QuantizedMatMul(x, quantized, scales, kpad, &y);
+      for (int j = 0; j < n; ++j) {
+        double sum = 0.0;
+        for (int i = 0; i < k; ++i) sum += x[i] * b[i * n + j];
+        double d = sum - y[j];
+        yerror += d * d;
+        ynorm += sum * sum;
+      }
+    }
+
+    LOG(INFO) << op->name << " [" << k << "x" << n << "]"
+              << " weight error: " << RelativeError(werror, wnorm)
+              << " max: " << wmax
+              << " output error: " << RelativeError(yerror, ynorm);
+  }
+  LOG(INFO) << "Weights reduced from " << float_bytes << " to "
+            << quantized_bytes << " bytes";
+
+  // Save quantized flow.
+  if (!FLAGS_o.empty()) {
+    flow.Save(FLAGS_o);
+  }
+
+  return 0;
+}
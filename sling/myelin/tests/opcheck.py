@@ -16,6 +16,7 @@
 """Compare Myelin flow computations with NumPy."""
 
 import sling
+import sling.pysling as api
 import sling.flags as flags
 import sling.myelin as myelin
 import sling.myelin.simulator as simulator
@@ -55,17 +56,36 @@ tests = {}
 # Initialize myelin compiler.
 compiler = myelin.Compiler()
 
+# Create compiler with C++ flags set for the transformations and runtimes being
+# tested. The flags are restored after the compiler has been initialized.
+def custom_compiler(**options):
+  for name, value in options.items(): api.set_flag(name, value)
+  custom = myelin.Compiler()
+  for name in options: api.set_flag(name, getattr(flags.arg, name))
+  return custom
+
+# Compilers for int8 and half-precision weights and for parallel loops.
+quantize_compiler = custom_compiler(quantize=True)
+half_compilers = {
+  "float16": custom_compiler(weight_type="float16"),
+  "bfloat16": custom_compiler(weight_type="bfloat16"),
+}
+parallel_compiler = custom_compiler(loop_threads=4)
+
 # Compare flow functions against numpy.
-def check(flow, variant, lo=-10.0, hi=10.0, rtol=1e-5, atol=1e-8, check=None):
-  # Ensure that inputs are not overwritten.
-  for i in flow.inputs(): i.output = True
+def check(flow, variant, lo=-10.0, hi=10.0, rtol=1e-5, atol=1e-8, check=None,
+          comp=None):
+  # Ensure that inputs are not overwritten. Constants are not marked, since
+  # weight transformations only apply to constants that are not outputs.
+  for i in flow.inputs(const=False): i.output = True
 
   if flags.arg.v >= 2:
     for f in flow.funcs.values():
       print("Compiling %s %s" % (f.name, str(variant)))
 
   # Compile flow.
-  net = compiler.compile(flow)
+  if comp is None: comp = compiler
+  net = comp.compile(flow)
 
   # Run all functions and compare results.
   for f in flow.funcs.values():
@@ -176,6 +196,65 @@ def matmul_add_relu_test(m, k, n):
   y = f.relu(f.add(f.matmul(x, W), b))
   check(flow, (m, k, n), -10, 10)
 
+def fused_matmul_test(m, k, n, act, ta=False, tb=False):
+  flow = myelin.Flow()
+  f = flow.define("fused_matmul_" + act)
+  x = f.var("x", dt, [k, m] if ta else [m, k])
+  W = f.var("W", dt, [n, k] if tb else [k, n])
+  b = f.var("b", dt, [n])
+  if ta: x = f.t(x)
+  if tb: W = f.t(W)
+  y = getattr(f, act)(f.add(f.matmul(x, W), b))
+  check(flow, (m, k, n, act, ta, tb), -1.0, 1.0, rtol=1e-4, atol=1e-5)
+
+def quantized_matmul_test(m, k, n):
+  flow = myelin.Flow()
+  f = flow.define("quantized_matmul")
+  x = f.var("x", dt, [m, k])
+  W = f.array("W", (np.random.ranf((k, n)) * 2 - 1).astype(np.float32))
+  y = f.matmul(x, W)
+  check(flow, (m, k, n), -1.0, 1.0, rtol=1e-2, atol=2e-1,
+        comp=quantize_compiler)
+
+def half_matmul_test(m, k, n, wt):
+  flow = myelin.Flow()
+  f = flow.define("half_matmul")
+  x = f.var("x", dt, [m, k])
+  W = f.array("W", (np.random.ranf((k, n)) * 2 - 1).astype(np.float32))
+  y = f.matmul(x, W)
+  atol = 1e-2 if wt == "float16" else 1e-1
+  check(flow, (m, k, n, wt), -1.0, 1.0, rtol=1e-2, atol=atol,
+        comp=half_compilers[wt])
+
+def half_gather_test(n, d, s, wt, pooling=None):
+  flow = myelin.Flow()
+  f = flow.define("half_gather" if pooling is None else "half_" + pooling)
+  emb = f.array("emb", np.random.ranf((n, d)).astype(np.float32))
+  ind = f.var("ind", myelin.DT_INT32, [s, 1])
+  if pooling is None:
+    v = f.gather(emb, ind)
+  else:
+    v = getattr(f, pooling)(emb, ind)
+  check(flow, (n, d, s, wt, pooling), 0, n, rtol=1e-2, atol=1e-2,
+        comp=half_compilers[wt])
+
+def parallel_matmul_test(m, k, n, ta=False):
+  flow = myelin.Flow()
+  f = flow.define("parallel_matmul")
+  A = f.var("A", dt, [k, m] if ta else [m, k])
+  B = f.var("B", dt, [k, n])
+  if ta: A = f.t(A)
+  C = f.matmul(A, B, name="C")
+  check(flow, (m, k, n, ta), -10, 10, comp=parallel_compiler)
+
+def parallel_gather_sum_test(n, d, s, b):
+  flow = myelin.Flow()
+  f = flow.define("parallel_gather_sum")
+  emb = f.array("emb", np.random.ranf((n, d)).astype(simulator.nptypes[dt]))
+  ind = f.var("ind", myelin.DT_INT32, [b, s, 1])
+  v = f.gather_sum(emb, ind, batch=1)
+  check(flow, (n, d, s, b), 0, n, comp=parallel_compiler)
+
 def matmul_transpose_test(m, n, k=1):
   flow = myelin.Flow()
   f = flow.define("matmul_transpose")
@@ -1138,6 +1217,32 @@ for i in sizes:
 if flags.arg.thorough:
   matmul_test(1024, 1024, 1024)
 
+# Fused matmuls, int8 and half-precision weights, and parallel loops.
+if dt == myelin.DT_FLOAT:
+  for i in [1, 5, 32]:
+    for j in [16, 100, 256]:
+      for k in [8, 33, 128]:
+        quantized_matmul_test(i, j, k)
+        for wt in ["float16", "bfloat16"]:
+          half_matmul_test(i, j, k, wt)
+        for act in ["relu", "tanh", "sigmoid"]:
+          for ta in [False, True]:
+            for tb in [False, True]:
+              fused_matmul_test(i, j, k, act, ta, tb)
+
+  for wt in ["float16", "bfloat16"]:
+    for s in [1, 2, 5]:
+      half_gather_test(100, 32, s, wt)
+      for pooling in ["gather_sum", "gather_max", "gather_avg"]:
+        half_gather_test(100, 32, s, wt, pooling)
+
+  for ta in [False, True]:
+    parallel_matmul_test(256, 256, 16, ta)
+    parallel_matmul_test(1000, 64, 64, ta)
+    parallel_matmul_test(333, 128, 100, ta)
+  parallel_gather_sum_test(100, 64, 16, 64)
+  parallel_gather_sum_test(100, 128, 20, 33)
+
 # Output test results.
 print("Test results")
 print("============")
@@ -0,0 +1,135 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/frame/object.h"
+#include "sling/frame/store.h"
+#include "sling/net/http-server.h"
+#include "sling/net/web-service.h"
+#include "sling/nlp/embedding/vector-index.h"
+#include "sling/util/mutex.h"
+
+DEFINE_int32(port, 8080, "HTTP server port");
+DEFINE_string(index, "", "Vector index repository");
+DEFINE_int32(ef, 100, "Number of candidates for nearest neighbor search");
+
+using namespace sling;
+using namespace sling::nlp;
+
+// Web service for finding similar items using vector index.
+class SimilarityService {
+ public:
+  SimilarityService(Store *commons, const VectorIndex *index)
+      : commons_(commons), index_(index) {}
+
+  ~SimilarityService() {
+    for (auto *searcher : searchers_) delete searcher;
+  }
+
+  // Register similarity service.
+  void Register(HTTPServer *http) {
+    http->Register("/similar", this, &SimilarityService::HandleSimilar);
+  }
+
+  // Handle similarity queries.
+  void HandleSimilar(HTTPRequest *request, HTTPResponse *response) {
+    WebService ws(commons_, request, response);
+
+    // Get query.
+    Text query = ws.Get("q");
+    int k = ws.Get("k", 10);
+    int ef = ws.Get("ef", FLAGS_ef);
+    int index = index_->Lookup(query);
+    if (index == -1) {
+      response->SendError(404, nullptr, "Unknown item");
+      return;
+    }
+
+    // Find similar items.
+    VectorIndex::Matches matches;
+    VectorIndex::Searcher *searcher = AcquireSearcher();
+    searcher->Similar(index, k, ef, &matches);
+    ReleaseSearcher(searcher);
+
+    // Generate response.
+    Handles results(ws.store());
+    for (const VectorIndex::Match &match : matches) {
+      Builder b(ws.store());
+      b.Add("item", index_->id(match.index));
+      b.Add("score", match.score);
+      results.push_back(b.Create().handle());
+    }
+    Builder b(ws.store());
+    b.Add("query", query);
+    b.Add("matches", Array(ws.store(), results));
+    ws.set_output(b.Create());
+  }
+
+ private:
+  // Get searcher from pool or create a new one.
+  VectorIndex::Searcher *AcquireSearcher() {
+    MutexLock lock(&mu_);
+    if (searchers_.empty()) return new VectorIndex::Searcher(index_);
+    VectorIndex::Searcher *searcher = searchers_.back();
+    searchers_.pop_back();
+    return searcher;
+  }
+
+  // Return searcher to pool.
+  void ReleaseSearcher(VectorIndex::Searcher *searcher) {
+    MutexLock lock(&mu_);
+    searchers_.push_back(searcher);
+  }
+
+  // Global store.
+  Store *commons_;
+
+  // Vector index.
+  const VectorIndex *index_;
+
+  // Idle searchers.
+  std::vector<VectorIndex::Searcher *> searchers_;
+  Mutex mu_;
+};
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+  CHECK(!FLAGS_index.empty()) << "No vector index";
+
+  LOG(INFO) << "Loading vector index from " << FLAGS_index;
+  VectorIndex index;
+  index.Load(FLAGS_index);
+  Store commons;
+  commons.Freeze();
+
+  LOG(INFO) << "Start HTTP server on port " << FLAGS_port;
+  SocketServerOptions options;
+  HTTPServer http(options, FLAGS_port);
+
+  SimilarityService service(&commons, &index);
+  service.Register(&http);
+
+  CHECK(http.Start());
+
+  LOG(INFO) << "HTTP server running";
+  http.Wait();
+
+  LOG(INFO) << "HTTP server done";
+  return 0;
+}
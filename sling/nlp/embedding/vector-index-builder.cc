@@ -0,0 +1,65 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "sling/base/logging.h"
+#include "sling/nlp/embedding/vector-index.h"
+#include "sling/task/process.h"
+#include "sling/util/embeddings.h"
+
+namespace sling {
+namespace nlp {
+
+using namespace task;
+
+// Build approximate nearest neighbor index from embeddings in word2vec format,
+// e.g. word embeddings or fact and category embeddings.
+class VectorIndexBuilderTask : public Process {
+ public:
+  void Run(Task *task) override {
+    // Get parameters.
+    int neighbors = task->Get("neighbors", 16);
+    int ef_construction = task->Get("ef_construction", 200);
+    int threads = task->Get("threads", 8);
+    bool normalize = task->Get("normalize", true);
+    Counter *num_vectors = task->GetCounter("vectors");
+
+    // Read embeddings.
+    const string &embeddings = task->GetInputFile("embeddings");
+    LOG(INFO) << "Reading embeddings from " << embeddings;
+    EmbeddingReader reader(embeddings);
+    reader.set_normalize(normalize);
+    VectorIndexBuilder builder(reader.dim(), neighbors, ef_construction);
+    while (reader.Next()) {
+      builder.Add(reader.word(), reader.embedding().data());
+      num_vectors->Increment();
+    }
+
+    // Build nearest neighbor graph.
+    LOG(INFO) << "Building index for " << builder.size() << " vectors";
+    builder.Build(threads);
+
+    // Write vector index repository.
+    const string &filename = task->GetOutputFile("repository");
+    LOG(INFO) << "Write vector index to " << filename;
+    builder.Write(filename);
+    LOG(INFO) << "Vector index done";
+  }
+};
+
+REGISTER_TASK_PROCESSOR("vector-index-builder", VectorIndexBuilderTask);
+
+}  // namespace nlp
+}  // namespace sling
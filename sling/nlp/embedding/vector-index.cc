@@ -0,0 +1,474 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/nlp/embedding/vector-index.h"
+
+#include <immintrin.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+#include "sling/base/logging.h"
+#include "sling/util/fingerprint.h"
+#include "sling/util/random.h"
+#include "sling/util/thread.h"
+
+namespace sling {
+namespace nlp {
+
+namespace {
+
+typedef VectorIndex::Match Match;
+typedef VectorIndex::Matches Matches;
+
+// Maximum number of levels in graph.
+const int kMaxLevels = 16;
+
+// Heap orderings for matches. With the Worse ordering the best match is at
+// the top of the heap, and with the Better ordering the worst match is at the
+// top of the heap.
+struct Worse {
+  bool operator()(const Match &a, const Match &b) const {
+    return a.score < b.score;
+  }
+};
+
+struct Better {
+  bool operator()(const Match &a, const Match &b) const {
+    return a.score > b.score;
+  }
+};
+
+// Portable version of dot product.
+float DotProductGeneric(const float *a, const float *b, int n) {
+  float sum = 0.0;
+  for (int i = 0; i < n; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+// AVX2 version of dot product using fused multiply-add with two accumulators.
+__attribute__((target("avx2,fma")))
+float DotProductAVX2(const float *a, const float *b, int n) {
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i),
+                           _mm256_loadu_ps(b + i), sum0);
+    sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),
+                           _mm256_loadu_ps(b + i + 8), sum1);
+  }
+  if (i + 8 <= n) {
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i),
+                           _mm256_loadu_ps(b + i), sum0);
+    i += 8;
+  }
+
+  // Horizontal sum of accumulators.
+  __m256 sum = _mm256_add_ps(sum0, sum1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum),
+                           _mm256_extractf128_ps(sum, 1));
+  half = _mm_hadd_ps(half, half);
+  half = _mm_hadd_ps(half, half);
+  float result = _mm_cvtss_f32(half);
+
+  // Add remaining elements.
+  for (; i < n; ++i) result += a[i] * b[i];
+  return result;
+}
+
+const bool has_avx2 =
+    __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+// Greedy search at one level of the graph. Moves to the neighbor most similar
+// to the query until no neighbor is more similar than the current vector.
+template<class GRAPH> Match SearchGreedy(GRAPH *graph,
+                                         const float *query,
+                                         Match entry,
+                                         int level,
+                                         VectorSearchState *state) {
+  std::vector<uint32> *neighbors = state->neighbors();
+  int dims = graph->dims();
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    graph->GetNeighbors(entry.index, level, neighbors);
+    for (uint32 neighbor : *neighbors) {
+      float score = DotProduct(query, graph->vector(neighbor), dims);
+      if (score > entry.score) {
+        entry = Match(neighbor, score);
+        changed = true;
+      }
+    }
+  }
+  return entry;
+}
+
+// Best-first search at one level of the graph keeping the ef best matches.
+// The results are returned in descending order of similarity.
+template<class GRAPH> void SearchLayer(GRAPH *graph,
+                                       const float *query,
+                                       Match entry,
+                                       int ef,
+                                       int level,
+                                       VectorSearchState *state,
+                                       Matches *results) {
+  std::vector<uint32> *neighbors = state->neighbors();
+  int dims = graph->dims();
+  Matches candidates;
+  results->clear();
+  state->Visit(entry.index);
+  candidates.push_back(entry);
+  results->push_back(entry);
+  while (!candidates.empty()) {
+    // Get best candidate. Stop when it is worse than all current results.
+    std::pop_heap(candidates.begin(), candidates.end(), Worse());
+    Match current = candidates.back();
+    candidates.pop_back();
+    if (results->size() >= ef && current.score < results->front().score) break;
+
+    // Prefetch unvisited neighbor vectors before scoring them.
+    graph->GetNeighbors(current.index, level, neighbors);
+    for (uint32 neighbor : *neighbors) {
+      __builtin_prefetch(graph->vector(neighbor));
+    }
+
+    // Add neighbors that are better than the worst result.
+    for (uint32 neighbor : *neighbors) {
+      if (!state->Visit(neighbor)) continue;
+      float score = DotProduct(query, graph->vector(neighbor), dims);
+      if (results->size() < ef || score > results->front().score) {
+        candidates.emplace_back(neighbor, score);
+        std::push_heap(candidates.begin(), candidates.end(), Worse());
+        results->emplace_back(neighbor, score);
+        std::push_heap(results->begin(), results->end(), Better());
+        if (results->size() > ef) {
+          std::pop_heap(results->begin(), results->end(), Better());
+          results->pop_back();
+        }
+      }
+    }
+  }
+  std::sort(results->begin(), results->end(), Better());
+}
+
+}  // namespace
+
+float DotProduct(const float *a, const float *b, int n) {
+  return has_avx2 ? DotProductAVX2(a, b, n) : DotProductGeneric(a, b, n);
+}
+
+void VectorSearchState::Reset(int size) {
+  if (visited_.size() < size) visited_.resize(size);
+  if (++epoch_ == 0) {
+    std::fill(visited_.begin(), visited_.end(), 0);
+    epoch_ = 1;
+  }
+}
+
+void VectorIndex::Load(const string &filename) {
+  // Load vector index repository from file.
+  repository_.Read(filename);
+
+  // Check vector index header information.
+  repository_.FetchBlock("VectorHeader", &header_);
+  CHECK(header_ != nullptr) << "Invalid vector index: " << filename;
+  CHECK_EQ(header_->version, VERSION) << "Unsupported vector index: "
+                                      << filename;
+
+  // Get vectors, ids, and graph.
+  repository_.FetchBlock("VectorData", &vectors_);
+  repository_.FetchBlock("VectorIdOffsets", &id_offsets_);
+  repository_.FetchBlock("VectorIds", &ids_);
+  repository_.FetchBlock("VectorLinks", &links_);
+  repository_.FetchBlock("VectorUpperOffsets", &upper_offsets_);
+  repository_.FetchBlock("VectorUpperLinks", &upper_links_);
+  CHECK(id_offsets_ != nullptr) << "No vector ids in " << filename;
+  id_map_.Initialize(repository_);
+}
+
+int VectorIndex::Lookup(Text id) const {
+  if (id_map_.num_buckets() == 0) return -1;
+  uint64 fp = Fingerprint(id.data(), id.size());
+  int bucket = fp % id_map_.num_buckets();
+  const IdEntry *entry = id_map_.GetBucket(bucket);
+  const IdEntry *end = id_map_.GetBucket(bucket + 1);
+  while (entry < end) {
+    if (entry->fingerprint == fp && this->id(entry->index) == id) {
+      return entry->index;
+    }
+    entry++;
+  }
+  return -1;
+}
+
+void VectorIndex::GetNeighbors(int index, int level,
+                               std::vector<uint32> *neighbors) const {
+  int m = header_->neighbors;
+  const uint32 *list;
+  if (level == 0) {
+    list = links_ + static_cast<size_t>(index) * (2 * m + 1);
+  } else {
+    list = upper_links_ + upper_offsets_[index] + (level - 1) * (m + 1);
+  }
+  neighbors->assign(list + 1, list + 1 + list[0]);
+}
+
+const VectorIndex *VectorIndex::Acquire(AssetManager *assets,
+                                        const string &filename) {
+  return assets->Acquire<VectorIndex>(filename, [&]() {
+    VectorIndex *index = new VectorIndex();
+    index->Load(filename);
+    return index;
+  });
+}
+
+VectorIndex::Searcher::Searcher(const VectorIndex *index) : index_(index) {}
+
+void VectorIndex::Searcher::Search(const float *query, int k, int ef,
+                                   Matches *matches) {
+  matches->clear();
+  const Header *header = index_->header_;
+  if (header->size == 0 || k <= 0) return;
+
+  // Find entry point for the bottom level by greedy search from the top.
+  int entry = header->entry;
+  Match ep(entry, DotProduct(query, index_->vector(entry), header->dims));
+  for (int level = header->levels - 1; level > 0; --level) {
+    ep = SearchGreedy(index_, query, ep, level, &state_);
+  }
+
+  // Search bottom level for the nearest neighbors.
+  state_.Reset(header->size);
+  SearchLayer(index_, query, ep, std::max(ef, k), 0, &state_, matches);
+  if (matches->size() > k) matches->resize(k);
+}
+
+void VectorIndex::Searcher::Similar(int index, int k, int ef,
+                                    Matches *matches) {
+  Search(index_->vector(index), k + 1, ef, matches);
+  for (int i = 0; i < matches->size(); ++i) {
+    if ((*matches)[i].index == index) {
+      matches->erase(matches->begin() + i);
+      break;
+    }
+  }
+  if (matches->size() > k) matches->resize(k);
+}
+
+VectorIndexBuilder::VectorIndexBuilder(int dims,
+                                       int neighbors,
+                                       int ef_construction)
+    : dims_(dims),
+      neighbors_(neighbors),
+      ef_construction_(ef_construction) {}
+
+void VectorIndexBuilder::Add(const string &id, const float *vector) {
+  ids_.push_back(id);
+  vectors_.insert(vectors_.end(), vector, vector + dims_);
+}
+
+void VectorIndexBuilder::Build(int threads) {
+  int size = ids_.size();
+  if (size == 0) return;
+
+  // Assign random levels to vectors with exponentially decaying probability.
+  Random rnd;
+  double mult = 1.0 / log(neighbors_);
+  levels_.resize(size);
+  for (int i = 0; i < size; ++i) {
+    int level = -log(1.0 - rnd.UniformProb()) * mult;
+    levels_[i] = std::min(level, kMaxLevels - 1);
+  }
+
+  // Allocate neighbor lists.
+  links_.assign(static_cast<size_t>(size) * (2 * neighbors_ + 1), 0);
+  upper_links_.resize(size);
+  for (int i = 0; i < size; ++i) {
+    upper_links_[i].assign(levels_[i] * (neighbors_ + 1), 0);
+  }
+  delete [] locks_;
+  locks_ = new Mutex[size];
+
+  // The first vector is the initial entry point. Insert the remaining vectors
+  // in parallel.
+  entry_ = 0;
+  top_ = levels_[0];
+  std::atomic<int> next(1);
+  WorkerPool pool;
+  pool.Start(threads, [&](int worker) {
+    VectorSearchState state;
+    for (;;) {
+      int index = next++;
+      if (index >= size) break;
+      Insert(index, &state);
+      if (index % 100000 == 0) {
+        VLOG(1) << index << " vectors inserted into graph";
+      }
+    }
+  });
+  pool.Join();
+}
+
+void VectorIndexBuilder::GetNeighbors(int index, int level,
+                                      std::vector<uint32> *neighbors) {
+  MutexLock lock(&locks_[index]);
+  uint32 *list = links(index, level);
+  neighbors->assign(list + 1, list + 1 + list[0]);
+}
+
+void VectorIndexBuilder::Insert(int index, VectorSearchState *state) {
+  const float *query = vector(index);
+  int level = levels_[index];
+
+  // Get current entry point. If the new vector is above the top level, the
+  // global lock is held during insertion and the vector becomes the new entry
+  // point.
+  mu_.Lock();
+  int entry = entry_;
+  int top = top_;
+  bool raise = level > top;
+  if (!raise) mu_.Unlock();
+
+  // Find entry point for the level of the new vector.
+  Match ep(entry, DotProduct(query, vector(entry), dims_));
+  for (int l = top; l > level; --l) {
+    ep = SearchGreedy(this, query, ep, l, state);
+  }
+
+  // Link vector to its nearest neighbors at each level.
+  Matches candidates;
+  std::vector<uint32> selected;
+  for (int l = std::min(level, top); l >= 0; --l) {
+    state->Reset(size());
+    SearchLayer(this, query, ep, ef_construction_, l, state, &candidates);
+    SelectNeighbors(candidates, neighbors_, &selected);
+    {
+      MutexLock lock(&locks_[index]);
+      uint32 *list = links(index, l);
+      list[0] = selected.size();
+      std::copy(selected.begin(), selected.end(), list + 1);
+    }
+    for (uint32 neighbor : selected) Connect(neighbor, index, l);
+    ep = candidates[0];
+  }
+
+  if (raise) {
+    entry_ = index;
+    top_ = level;
+    mu_.Unlock();
+  }
+}
+
+void VectorIndexBuilder::SelectNeighbors(const VectorIndex::Matches &candidates,
+                                         int max_neighbors,
+                                         std::vector<uint32> *selected) const {
+  selected->clear();
+  for (const Match &candidate : candidates) {
+    if (selected->size() >= max_neighbors) break;
+    const float *v = vector(candidate.index);
+    bool keep = true;
+    for (uint32 s : *selected) {
+      if (DotProduct(v, vector(s), dims_) > candidate.score) {
+        keep = false;
+        break;
+      }
+    }
+    if (keep) selected->push_back(candidate.index);
+  }
+}
+
+void VectorIndexBuilder::Connect(int index, int neighbor, int level) {
+  MutexLock lock(&locks_[index]);
+  uint32 *list = links(index, level);
+  int max_neighbors = level == 0 ? 2 * neighbors_ : neighbors_;
+  if (list[0] < max_neighbors) {
+    list[++list[0]] = neighbor;
+    return;
+  }
+
+  // Prune neighbor list by selecting diverse neighbors among the existing
+  // neighbors and the new neighbor.
+  const float *base = vector(index);
+  Matches candidates;
+  for (int i = 1; i <= list[0]; ++i) {
+    candidates.emplace_back(list[i], DotProduct(base, vector(list[i]), dims_));
+  }
+  candidates.emplace_back(neighbor, DotProduct(base, vector(neighbor), dims_));
+  std::sort(candidates.begin(), candidates.end(), Better());
+  std::vector<uint32> selected;
+  SelectNeighbors(candidates, max_neighbors, &selected);
+  list[0] = selected.size();
+  std::copy(selected.begin(), selected.end(), list + 1);
+}
+
+void VectorIndexBuilder::Write(const string &filename) {
+  Repository repository;
+  int size = ids_.size();
+
+  // Write header.
+  VectorIndex::Header header;
+  memset(&header, 0, sizeof(VectorIndex::Header));
+  header.version = VectorIndex::VERSION;
+  header.dims = dims_;
+  header.size = size;
+  header.neighbors = neighbors_;
+  header.levels = top_ + 1;
+  header.entry = entry_;
+  repository.AddBlock("VectorHeader", &header, sizeof(VectorIndex::Header));
+
+  // Write vectors.
+  File *data_block = repository.AddBlock("VectorData");
+  data_block->WriteOrDie(vectors_.data(), vectors_.size() * sizeof(float));
+
+  // Write ids.
+  File *id_offset_block = repository.AddBlock("VectorIdOffsets");
+  File *id_block = repository.AddBlock("VectorIds");
+  uint64 offset = 0;
+  for (const string &id : ids_) {
+    id_offset_block->WriteOrDie(&offset, sizeof(uint64));
+    id_block->WriteOrDie(id.data(), id.size());
+    offset += id.size();
+  }
+  id_offset_block->WriteOrDie(&offset, sizeof(uint64));
+
+  // Write id map.
+  std::vector<RepositoryMapItem *> items;
+  for (int i = 0; i < size; ++i) {
+    items.push_back(new IdItem(Fingerprint(ids_[i].data(), ids_[i].size()), i));
+  }
+  int num_buckets = (size + 8) / 8;
+  repository.WriteMap("VectorId", &items, num_buckets);
+  for (auto *item : items) delete item;
+
+  // Write neighbor lists.
+  File *link_block = repository.AddBlock("VectorLinks");
+  link_block->WriteOrDie(links_.data(), links_.size() * sizeof(uint32));
+  File *upper_offset_block = repository.AddBlock("VectorUpperOffsets");
+  File *upper_link_block = repository.AddBlock("VectorUpperLinks");
+  uint64 upper_offset = 0;
+  for (const std::vector<uint32> &upper : upper_links_) {
+    upper_offset_block->WriteOrDie(&upper_offset, sizeof(uint64));
+    upper_link_block->WriteOrDie(upper.data(), upper.size() * sizeof(uint32));
+    upper_offset += upper.size();
+  }
+  upper_offset_block->WriteOrDie(&upper_offset, sizeof(uint64));
+
+  // Write repository to file.
+  repository.Write(filename);
+}
+
+}  // namespace nlp
+}  // namespace sling
@@ -0,0 +1,291 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_NLP_EMBEDDING_VECTOR_INDEX_H_
+#define SLING_NLP_EMBEDDING_VECTOR_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "sling/base/port.h"
+#include "sling/base/types.h"
+#include "sling/file/repository.h"
+#include "sling/string/text.h"
+#include "sling/util/asset.h"
+#include "sling/util/mutex.h"
+
+namespace sling {
+namespace nlp {
+
+// Compute dot product between two vectors.
+float DotProduct(const float *a, const float *b, int n);
+
+// Scratch space for searching a vector graph.
+class VectorSearchState {
+ public:
+  // Start new search in graph with a number of vectors.
+  void Reset(int size);
+
+  // Mark vector as visited. Returns false if it has already been visited.
+  bool Visit(int index) {
+    if (visited_[index] == epoch_) return false;
+    visited_[index] = epoch_;
+    return true;
+  }
+
+  // Buffer for neighbor lists.
+  std::vector<uint32> *neighbors() { return &neighbors_; }
+
+ private:
+  // Visited vectors are marked with the current epoch.
+  std::vector<uint32> visited_;
+  uint32 epoch_ = 0;
+
+  // Neighbor buffer.
+  std::vector<uint32> neighbors_;
+};
+
+// Approximate nearest neighbor index for embedding vectors. The vectors are
+// organized in a hierarchical navigable small world (HNSW) graph, where each
+// level is a proximity graph over a random subset of the vectors in the level
+// below. A search starts at the top level and greedily moves towards the query
+// vector, using the closest vector found as the entry point for the next level.
+// The similarity between vectors is the dot product, so the vectors should be
+// normalized to unit length for cosine similarity. The vectors, ids, and graph
+// are stored in a repository and are memory-mapped from the repository when
+// the index is loaded. The index is read-only after it has been loaded, so it
+// can be shared between threads.
+class VectorIndex : public Asset {
+ public:
+  // Vector index repository header information.
+  static const int VERSION = 1;
+  struct Header {
+    int version;      // repository format version
+    int dims;         // number of dimensions in vectors
+    int size;         // number of vectors in index
+    int neighbors;    // maximum number of neighbors in upper levels
+    int levels;       // number of levels in graph
+    int entry;        // entry point for searching the graph
+  };
+
+  // Search result with vector index and similarity score.
+  struct Match {
+    Match() {}
+    Match(int index, float score) : index(index), score(score) {}
+    int index;
+    float score;
+  };
+  typedef std::vector<Match> Matches;
+
+  // Load vector index repository from file.
+  void Load(const string &filename);
+
+  // Number of vectors in index.
+  int size() const { return header_->size; }
+
+  // Number of dimensions in vectors.
+  int dims() const { return header_->dims; }
+
+  // Return vector in index.
+  const float *vector(int index) const {
+    return vectors_ + static_cast<size_t>(index) * header_->dims;
+  }
+
+  // Return id for vector in index.
+  Text id(int index) const {
+    return Text(ids_ + id_offsets_[index],
+                id_offsets_[index + 1] - id_offsets_[index]);
+  }
+
+  // Return index of vector with id, or -1 if id is not in the index.
+  int Lookup(Text id) const;
+
+  // A searcher holds the scratch space for searching the index. Searchers are
+  // not thread-safe, so each thread should use its own searcher.
+  class Searcher {
+   public:
+    Searcher(const VectorIndex *index);
+
+    // Find the k vectors in the index most similar to the query vector in
+    // descending order of similarity. The search keeps a list of the ef best
+    // candidates, so larger values of ef increase accuracy at the expense of
+    // speed.
+    void Search(const float *query, int k, int ef, Matches *matches);
+
+    // Find the k vectors most similar to a vector in the index, excluding the
+    // vector itself.
+    void Similar(int index, int k, int ef, Matches *matches);
+
+   private:
+    const VectorIndex *index_;
+    VectorSearchState state_;
+  };
+
+  // Get neighbors of vector at level in the graph.
+  void GetNeighbors(int index, int level, std::vector<uint32> *neighbors) const;
+
+  // Acquire shared vector index.
+  static const VectorIndex *Acquire(AssetManager *assets,
+                                    const string &filename);
+
+ private:
+  // Entry in id map.
+  struct IdEntry {
+    uint64 fingerprint;
+    uint32 index;
+  } ABSL_ATTRIBUTE_PACKED;
+
+  // Id map in repository.
+  class IdMap : public RepositoryMap<IdEntry> {
+   public:
+    // Initialize id map.
+    void Initialize(const Repository &repository) {
+      Init(repository, "VectorId");
+    }
+
+    // Return first element in bucket.
+    const IdEntry *GetBucket(int bucket) const { return GetObject(bucket); }
+  };
+
+  // Repository with vector index.
+  Repository repository_;
+
+  // Vector index header information.
+  const Header *header_ = nullptr;
+
+  // Vector data.
+  const float *vectors_ = nullptr;
+
+  // Vector ids.
+  const uint64 *id_offsets_ = nullptr;
+  const char *ids_ = nullptr;
+
+  // Map from id fingerprint to vector index.
+  IdMap id_map_;
+
+  // Neighbor lists for the bottom level. Each vector has a neighbor count
+  // followed by room for twice the maximum number of neighbors.
+  const uint32 *links_ = nullptr;
+
+  // Neighbor lists for the upper levels. Each vector has a neighbor count and
+  // room for the maximum number of neighbors for each level above the bottom.
+  const uint64 *upper_offsets_ = nullptr;
+  const uint32 *upper_links_ = nullptr;
+};
+
+// Builder for constructing vector index. The graph is constructed by inserting
+// the vectors one by one, linking each new vector to its nearest neighbors at
+// each level. Vectors can be inserted in parallel.
+class VectorIndexBuilder {
+ public:
+  // Initialize vector index builder.
+  VectorIndexBuilder(int dims, int neighbors, int ef_construction);
+  ~VectorIndexBuilder() { delete [] locks_; }
+
+  // Add vector with id to index. The vectors are inserted into the graph when
+  // the index is built.
+  void Add(const string &id, const float *vector);
+
+  // Number of vectors added to builder.
+  int size() const { return ids_.size(); }
+
+  // Build graph using a number of worker threads.
+  void Build(int threads);
+
+  // Write vector index repository to file.
+  void Write(const string &filename);
+
+  // Number of dimensions in vectors.
+  int dims() const { return dims_; }
+
+  // Return vector.
+  const float *vector(int index) const {
+    return vectors_.data() + static_cast<size_t>(index) * dims_;
+  }
+
+  // Get neighbors of vector at level in the graph.
+  void GetNeighbors(int index, int level, std::vector<uint32> *neighbors);
+
+ private:
+  // Entry in id map.
+  struct IdItem : public RepositoryMapItem {
+    IdItem(uint64 fingerprint, uint32 index)
+        : fingerprint(fingerprint), index(index) {}
+
+    // Write id entry to repository.
+    int Write(File *file) const override {
+      file->WriteOrDie(&fingerprint, sizeof(uint64));
+      file->WriteOrDie(&index, sizeof(uint32));
+      return sizeof(uint64) + sizeof(uint32);
+    }
+
+    // Use id fingerprint as the hash code.
+    uint64 Hash() const override { return fingerprint; }
+
+    uint64 fingerprint;
+    uint32 index;
+  };
+
+  // Insert vector into graph.
+  void Insert(int index, VectorSearchState *state);
+
+  // Select diverse neighbors among candidates sorted by descending similarity.
+  // Candidates that are more similar to an already selected neighbor than to
+  // the base vector are skipped.
+  void SelectNeighbors(const VectorIndex::Matches &candidates,
+                       int max_neighbors,
+                       std::vector<uint32> *selected) const;
+
+  // Add link from vector to neighbor, pruning the neighbor list of the vector
+  // if it overflows.
+  void Connect(int index, int neighbor, int level);
+
+  // Return neighbor list for vector at level.
+  uint32 *links(int index, int level) {
+    if (level == 0) {
+      return links_.data() + static_cast<size_t>(index) * (2 * neighbors_ + 1);
+    } else {
+      return upper_links_[index].data() + (level - 1) * (neighbors_ + 1);
+    }
+  }
+
+  // Index parameters.
+  int dims_;
+  int neighbors_;
+  int ef_construction_;
+
+  // Vector data and ids.
+  std::vector<float> vectors_;
+  std::vector<string> ids_;
+
+  // Level for each vector.
+  std::vector<uint8> levels_;
+
+  // Neighbor lists for bottom and upper levels.
+  std::vector<uint32> links_;
+  std::vector<std::vector<uint32>> upper_links_;
+
+  // Current entry point and top level.
+  int entry_ = -1;
+  int top_ = -1;
+  Mutex mu_;
+
+  // Locks for neighbor lists of each vector.
+  Mutex *locks_ = nullptr;
+};
+
+}  // namespace nlp
+}  // namespace sling
+
+#endif  // SLING_NLP_EMBEDDING_VECTOR_INDEX_H_
@@ -8,6 +8,7 @@
 #include "sling/base/logging.h"
 #include "sling/myelin/builder.h"
 #include "sling/myelin/compiler.h"
+#include "sling/nlp/embedding/vector-index.h"
 #include "sling/util/embeddings.h"
 #include "sling/util/top.h"
 
@@ -15,9 +16,12 @@ DEFINE_string(embeddings,
               "local/data/e/wiki/en/word-embeddings.vec",
               "Word embeddings");
 DEFINE_int32(topk, 15, "Number of similar words to list");
+DEFINE_string(index, "", "Vector index for approximate similarity search");
+DEFINE_int32(ef, 100, "Number of candidates for approximate search");
 
 using namespace sling;
 using namespace sling::myelin;
+using sling::nlp::VectorIndex;
 
 Network net;
 std::vector<string> lexicon;
@@ -64,9 +68,44 @@ void BuildModel(const string &embeddings_file) {
   compiler.Compile(&flow, &net);
 }
 
+void SearchIndex(const string &filename) {
+  LOG(INFO) << "Loading vector index from " << filename;
+  VectorIndex index;
+  index.Load(filename);
+  VectorIndex::Searcher searcher(&index);
+
+  for (;;) {
+    // Get word.
+    string word;
+    std::cout << "word: ";
+    std::getline(std::cin, word);
+    if (word == "q") break;
+
+    // Look up word in index.
+    int i = index.Lookup(word);
+    if (i == -1) {
+      std::cout << "Unknown word\n";
+      continue;
+    }
+
+    // Find approximate top-k similar words.
+    VectorIndex::Matches matches;
+    searcher.Similar(i, FLAGS_topk, FLAGS_ef, &matches);
+    for (int j = 0; j < matches.size(); ++j) {
+      std::cout << j << ": " << matches[j].score << " "
+                << index.id(matches[j].index) << "\n";
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   InitProgram(&argc, &argv);
 
+  if (!FLAGS_index.empty()) {
+    SearchIndex(FLAGS_index);
+    return 0;
+  }
+
   BuildModel(FLAGS_embeddings);
   if (FLAGS_topk > lexicon.size()) FLAGS_topk = lexicon.size();
   for (int i = 0; i < lexicon.size(); ++i) {
@@ -173,6 +173,12 @@ Taxonomy *FactCatalog::CreateEntityTaxonomy() {
 bool FactCatalog::ItemInClosure(Handle property, Handle coarse, Handle fine) {
   if (coarse == fine) return true;
 
+  // Use precomputed type closure for subclass queries.
+  if (closure_ != nullptr && property == p_subclass_of_ && !IsBaseItem(fine)) {
+    int index = closure_->Lookup(fine);
+    if (index != -1) return closure_->Contains(index, coarse);
+  }
+
   Handles closure(store_);
   closure.push_back(fine);
   int current = 0;
@@ -204,6 +210,21 @@ void FactCatalog::ExtractItemTypes(Handle item, std::vector<Handle> *types) {
     }
   }
 
+  // Add superclasses from precomputed type closure.
+  if (closure_ != nullptr) {
+    HandleSet known(types->begin(), types->end());
+    std::vector<Handle> superclasses;
+    int num_direct = types->size();
+    for (int i = 0; i < num_direct; ++i) {
+      superclasses.clear();
+      ExtractSuperclasses((*types)[i], &superclasses);
+      for (Handle superclass : superclasses) {
+        if (known.insert(superclass).second) types->push_back(superclass);
+      }
+    }
+    return;
+  }
+
   // Build type closure.
   int current = 0;
   while (current < types->size()) {
@@ -238,6 +259,15 @@ bool FactCatalog::InstanceOf(Handle item, Handle type) {
     }
   }
 
+  // Check superclasses using precomputed type closure.
+  if (closure_ != nullptr) {
+    for (Handle t : types) {
+      if (IsBaseItem(t)) continue;
+      if (ItemInClosure(p_subclass_of_.handle(), type, t)) return true;
+    }
+    return false;
+  }
+
   // Check type closure.
   int current = 0;
   while (current < types.size()) {
@@ -257,6 +287,38 @@ bool FactCatalog::InstanceOf(Handle item, Handle type) {
   return false;
 }
 
+void FactCatalog::ExtractSuperclasses(Handle type,
+                                      std::vector<Handle> *superclasses) {
+  // Look up superclasses in precomputed type closure.
+  if (closure_ != nullptr) {
+    int index = closure_->Lookup(type);
+    if (index != -1) {
+      closure_->GetSuperclasses(index, superclasses);
+      return;
+    }
+  }
+
+  // Build superclass closure. Base items are not expanded.
+  Handles closure(store_);
+  HandleSet known;
+  closure.push_back(type);
+  known.insert(type);
+  int current = 0;
+  while (current < closure.size()) {
+    Frame f(store_, closure[current++]);
+    if (IsBaseItem(f.handle())) continue;
+    for (const Slot &s : f) {
+      if (s.name != p_subclass_of_) continue;
+
+      // Add new superclass unless it is already known.
+      Handle superclass = store_->Resolve(s.value);
+      if (!known.insert(superclass).second) continue;
+      closure.push_back(superclass);
+      superclasses->push_back(superclass);
+    }
+  }
+}
+
 void Facts::Extract(Handle item) {
   // Extract facts from the properties of the item.
   auto &extractors = catalog_->property_extractors_;
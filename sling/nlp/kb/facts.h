@@ -18,6 +18,7 @@
 #include "sling/frame/store.h"
 #include "sling/frame/object.h"
 #include "sling/nlp/kb/calendar.h"
+#include "sling/nlp/kb/type-closure.h"
 
 namespace sling {
 namespace nlp {
@@ -51,6 +52,13 @@ class FactCatalog {
   // Check if item is a direct or indirect instance of of a type.
   bool InstanceOf(Handle item, Handle type);
 
+  // Add direct and indirect superclasses (P279) of type to list.
+  void ExtractSuperclasses(Handle type, std::vector<Handle> *superclasses);
+
+  // Set precomputed type closure for answering type queries without graph
+  // traversal. Types not in the type closure fall back to traversal.
+  void set_type_closure(const TypeClosure *closure) { closure_ = closure; }
+
  private:
   // Set extractor for property type.
   void SetExtractor(Handle property, Extractor extractor) {
@@ -78,6 +86,9 @@ class FactCatalog {
   // Items that stop closure expansion.
   HandleSet base_items_;
 
+  // Precomputed type closure (optional).
+  const TypeClosure *closure_ = nullptr;
+
   // Symbols.
   Names names_;
   Name p_role_{names_, "role"};
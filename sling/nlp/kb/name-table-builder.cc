@@ -12,9 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "sling/base/logging.h"
 #include "sling/base/types.h"
@@ -38,11 +41,16 @@ class NameTableBuilder : public task::FrameProcessor {
     // Set name normalization.
     normalization_ = ParseNormalization(task->Get("normalization", "lcp"));
 
+    // Get parameters for prefix completion index.
+    task->Fetch("completion_threshold", &completion_threshold_);
+    task->Fetch("completion_size", &completion_size_);
+
     // Statistics.
     num_aliases_ = task->GetCounter("aliases");
     num_names_ = task->GetCounter("names");
     num_entities_ = task->GetCounter("entities");
     num_instances_ = task->GetCounter("instances");
+    num_completions_ = task->GetCounter("completions");
   }
 
   void Process(Slice key, const Frame &frame) override {
@@ -77,10 +85,15 @@ class NameTableBuilder : public task::FrameProcessor {
         if (normalized.empty()) continue;
         if (normalized.size() > 127) continue;
 
-        // Add alias for entity to name table.
+        // Add alias for entity to name table. Aliases for the entity that
+        // have the same normalized name are merged.
         std::vector<EntityName> &entities = name_table_[normalized];
         if (entities.empty()) num_names_->Increment();
-        entities.emplace_back(index, count);
+        if (!entities.empty() && entities.back().index == index) {
+          entities.back().count += count;
+        } else {
+          entities.emplace_back(index, count);
+        }
 
         // Add alias count to entity frequency.
         entity_table_[index].count += count;
@@ -151,6 +164,25 @@ class NameTableBuilder : public task::FrameProcessor {
       offset += sizeof(uint8) + namelen + sizeof(uint32) + entity_array_size;
     }
 
+    // Write completion index with top-ranked entities for name prefixes.
+    if (completion_size_ > 0) {
+      LOG(INFO) << "Build completion index";
+      CompletionParams params;
+      params.threshold = completion_threshold_;
+      params.size = completion_size_;
+      repository.AddBlock("completion", &params, sizeof(CompletionParams));
+      completion_index_block_ = repository.AddBlock("CompletionIndex");
+      completion_block_ = repository.AddBlock("Completions");
+      completion_offset_ = 0;
+      name_list_.clear();
+      name_list_.reserve(name_table_.size());
+      for (const auto &it : name_table_) name_list_.push_back(&it);
+      if (name_list_.size() > completion_threshold_) {
+        AddCompletions(0, name_list_.size(), 0);
+      }
+      name_list_.clear();
+    }
+
     // Write repository to file.
     const string &filename = task->GetOutput("repository")->resource()->name();
     LOG(INFO) << "Write name repository to " << filename;
@@ -179,6 +211,115 @@ class NameTableBuilder : public task::FrameProcessor {
     uint32 count;
   };
 
+  // Name with entities.
+  typedef std::pair<const string, std::vector<EntityName>> NameEntry;
+
+  // Completion parameters in repository.
+  struct CompletionParams {
+    uint32 threshold;
+    uint32 size;
+  };
+
+  // Add completions for all prefixes of the names in the range [begin;end)
+  // that match more than the threshold number of names. All the names in the
+  // range share the first depth bytes. The completions are added in pre-order
+  // so the completion index is sorted by prefix.
+  void AddCompletions(int begin, int end, int depth) {
+    // Add completion for prefix unless it ends inside a UTF-8 sequence.
+    const string &first = name_list_[begin]->first;
+    if (depth > 0 &&
+        (depth == first.size() || (first[depth] & 0xC0) != 0x80)) {
+      AddCompletion(begin, end, depth);
+    }
+
+    // Names equal to the prefix come first. Split the rest of the range into
+    // groups with the same next byte and add completions for large groups.
+    int index = begin;
+    while (index < end && name_list_[index]->first.size() == depth) index++;
+    while (index < end) {
+      int group = index;
+      char next = name_list_[index]->first[depth];
+      while (index < end && name_list_[index]->first[depth] == next) index++;
+      if (index - group > completion_threshold_) {
+        AddCompletions(group, index, depth + 1);
+      }
+    }
+  }
+
+  // Add completion for the prefix shared by all names in the range.
+  void AddCompletion(int begin, int end, int depth) {
+    // Sum entity frequencies over all names with the prefix.
+    entity_counts_.clear();
+    for (int i = begin; i < end; ++i) {
+      for (const EntityName &entity : name_list_[i]->second) {
+        entity_counts_[entity.index] += entity.count;
+      }
+    }
+
+    // Select the top-ranked entities for the prefix.
+    top_.clear();
+    for (const auto &it : entity_counts_) {
+      top_.emplace_back(it.second, it.first);
+    }
+    SelectTop(&top_);
+
+    // Select the top-ranked entities for the name equal to the prefix.
+    exact_.clear();
+    if (name_list_[begin]->first.size() == depth) {
+      for (const EntityName &entity : name_list_[begin]->second) {
+        exact_.emplace_back(entity_counts_[entity.index], entity.index);
+      }
+      std::sort(exact_.begin(), exact_.end(), [](const Rank &a, const Rank &b) {
+        return a.second < b.second;
+      });
+      exact_.erase(std::unique(exact_.begin(), exact_.end()), exact_.end());
+      SelectTop(&exact_);
+    }
+
+    // Write completion offset to index.
+    completion_index_block_->WriteOrDie(&completion_offset_, sizeof(uint64));
+
+    // Write prefix and entity lists to completion block.
+    uint8 prefixlen = depth;
+    completion_block_->WriteOrDie(&prefixlen, sizeof(uint8));
+    completion_block_->WriteOrDie(name_list_[begin]->first.data(), prefixlen);
+    WriteRanking(top_);
+    WriteRanking(exact_);
+    completion_offset_ += sizeof(uint8) + prefixlen +
+                          2 * sizeof(uint32) +
+                          (top_.size() + exact_.size()) * 2 * sizeof(uint32);
+    num_completions_->Increment();
+  }
+
+  // Entity index with total frequency for prefix.
+  typedef std::pair<uint32, uint32> Rank;
+
+  // Sort entities by decreasing frequency and keep the top-ranked entities.
+  void SelectTop(std::vector<Rank> *ranking) {
+    auto order = [](const Rank &a, const Rank &b) {
+      if (a.first != b.first) return a.first > b.first;
+      return a.second < b.second;
+    };
+    if (ranking->size() > completion_size_) {
+      std::partial_sort(ranking->begin(),
+                        ranking->begin() + completion_size_,
+                        ranking->end(), order);
+      ranking->resize(completion_size_);
+    } else {
+      std::sort(ranking->begin(), ranking->end(), order);
+    }
+  }
+
+  // Write entity ranking to completion block.
+  void WriteRanking(const std::vector<Rank> &ranking) {
+    uint32 size = ranking.size();
+    completion_block_->WriteOrDie(&size, sizeof(uint32));
+    for (const Rank &rank : ranking) {
+      uint32 entry[2] = {entity_table_[rank.second].offset, rank.first};
+      completion_block_->WriteOrDie(entry, sizeof(entry));
+    }
+  }
+
   // Symbols.
   Name n_lang_{names_, "lang"};
   Name n_name_{names_, "name"};
@@ -200,11 +341,33 @@ class NameTableBuilder : public task::FrameProcessor {
   // Mapping of entity id to entity index in entity table.
   std::unordered_map<string, int> entity_mapping_;
 
+  // Prefixes matching more than this number of names get a precomputed
+  // completion with the top-ranked entities.
+  int completion_threshold_ = 256;
+
+  // Maximum number of entities in each completion list. The completion index
+  // is not built if this is zero.
+  int completion_size_ = 32;
+
+  // Sorted list of names used for building completion index.
+  std::vector<const NameEntry *> name_list_;
+
+  // Entity frequencies and rankings for current prefix.
+  std::unordered_map<uint32, uint32> entity_counts_;
+  std::vector<Rank> top_;
+  std::vector<Rank> exact_;
+
+  // Output blocks for completion index.
+  File *completion_index_block_ = nullptr;
+  File *completion_block_ = nullptr;
+  uint64 completion_offset_ = 0;
+
   // Statistics.
   task::Counter *num_names_ = nullptr;
   task::Counter *num_entities_ = nullptr;
   task::Counter *num_aliases_ = nullptr;
   task::Counter *num_instances_ = nullptr;
+  task::Counter *num_completions_ = nullptr;
 
   // Mutex for serializing access to repository.
   Mutex mu_;
@@ -34,6 +34,11 @@ void NameTable::Load(const string &filename) {
   // Initialize entity table.
   repository_.FetchBlock("Entities", &entity_table_);
 
+  // Initialize completion index. The index blocks are empty if no prefix
+  // matches enough names to get a completion.
+  repository_.FetchBlock("completion", &completion_params_);
+  if (completion_params_ != nullptr) completion_index_.Initialize(repository_);
+
   // Get text normalization flags.
   const char *norm = repository_.GetBlock("normalization");
   if (norm) {
@@ -50,31 +55,26 @@ void NameTable::LookupPrefix(Text prefix,
   UTF8::Normalize(prefix.data(), prefix.size(), normalization_, &normalized);
   Text normalized_prefix(normalized);
 
-  // Find first name that is greater than or equal to the prefix.
-  int lo = 0;
-  int hi = name_index_.size() - 1;
-  while (lo < hi) {
-    int mid = (lo + hi) / 2;
-    const NameItem *item = name_index_.GetName(mid);
-    if (item->name() < normalized_prefix) {
-      lo = mid + 1;
-    } else {
-      hi = mid;
-    }
+  // Find range of names matching the prefix.
+  int begin, end;
+  FindRange(normalized_prefix, &begin, &end);
+
+  // Use precomputed completion if the prefix matches many names.
+  bool complete = completion_params_ != nullptr;
+  if (complete && end - begin > completion_params_->threshold) {
+    if (LookupCompletion(normalized_prefix, limit, boost, matches)) return;
+    complete = false;
   }
 
-  // Find all names matching the prefix. Stop if we hit the limit.
+  // Find all names matching the prefix. Unless all matching names are ranked,
+  // stop if we hit the limit.
   std::unordered_map<const EntityItem *, int> entities;
-  int index = lo;
-  while (index < name_index_.size()) {
+  for (int index = begin; index < end; ++index) {
     // Check if we have reached the limit.
-    if (entities.size() > limit) break;
-
-    // Stop if the current name does not match the prefix.
-    const NameItem *item = name_index_.GetName(index);
-    if (!item->name().starts_with(normalized_prefix)) break;
+    if (!complete && entities.size() > limit) break;
 
     // Add boost for exact match.
+    const NameItem *item = name_index_.GetName(index);
     int extra = 0;
     if (item->name().size() == normalized_prefix.size()) extra = boost;
 
@@ -84,8 +84,6 @@ void NameTable::LookupPrefix(Text prefix,
       const EntityItem *entity = GetEntity(entity_names[i].offset);
       entities[entity] += entity_names[i].count + extra;
     }
-
-    index++;
   }
 
   // Sort matching entities by decreasing frequency.
@@ -98,10 +96,91 @@ void NameTable::LookupPrefix(Text prefix,
   // Copy matching entity ids to output.
   matches->clear();
   for (const auto &item : matching_entities) {
+    if (complete && matches->size() >= limit) break;
     matches->push_back(item.second->id());
   }
 }
 
+bool NameTable::LookupCompletion(Text prefix, int limit, int boost,
+                                 std::vector<Text> *matches) const {
+  // Find completion for prefix.
+  int lo = 0;
+  int hi = completion_index_.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    const CompletionItem *item = completion_index_.GetCompletion(mid);
+    if (item->prefix() < prefix) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == completion_index_.size()) return false;
+  const CompletionItem *completion = completion_index_.GetCompletion(lo);
+  if (completion->prefix() != prefix) return false;
+
+  // Merge the top entities with the boosted exact match entities. Entities in
+  // both lists always have a higher score in the exact match list, so these
+  // are skipped when they are encountered again in the top list.
+  const EntityName *top = completion->top();
+  const EntityName *exact = completion->exact();
+  int num_top = completion->num_top();
+  int num_exact = completion->num_exact();
+  int t = 0;
+  int e = 0;
+  matches->clear();
+  while (matches->size() < limit && (t < num_top || e < num_exact)) {
+    const EntityName *next;
+    if (e < num_exact &&
+        (t == num_top || int64{exact[e].count} + boost >= top[t].count)) {
+      next = &exact[e++];
+    } else {
+      next = &top[t++];
+    }
+
+    Text id = GetEntity(next->offset)->id();
+    bool known = false;
+    for (Text match : *matches) {
+      if (match.data() == id.data()) {
+        known = true;
+        break;
+      }
+    }
+    if (!known) matches->push_back(id);
+  }
+
+  return true;
+}
+
+void NameTable::FindRange(Text prefix, int *begin, int *end) const {
+  // Find first name that is greater than or equal to the prefix.
+  int lo = 0;
+  int hi = name_index_.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    const NameItem *item = name_index_.GetName(mid);
+    if (item->name() < prefix) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *begin = lo;
+
+  // Find first name after the names matching the prefix.
+  hi = name_index_.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    const NameItem *item = name_index_.GetName(mid);
+    if (item->name().starts_with(prefix)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *end = lo;
+}
+
 }  // namespace nlp
 }  // namespace sling
 
@@ -33,11 +33,24 @@ class NameTable {
   void Load(const string &filename);
 
   // Look up entities with names matching a prefix. The matches are sorted
-  // by decreasing entity frequency.
+  // by decreasing entity frequency, where the frequency of an entity is the
+  // sum of the frequencies of its names matching the prefix, and names that
+  // are equal to the prefix get an additional boost. If the name table has a
+  // completion index, the top-ranked entities are returned, but no more than
+  // the number of completions stored for each prefix. Otherwise, the lookup
+  // stops when more than limit entities have been found.
   void LookupPrefix(Text prefix, int limit, int boost,
                     std::vector<Text> *matches) const;
 
  private:
+  // Look up prefix in completion index. Returns false if there is no
+  // completion for the prefix.
+  bool LookupCompletion(Text prefix, int limit, int boost,
+                        std::vector<Text> *matches) const;
+
+  // Find range of names matching the prefix.
+  void FindRange(Text prefix, int *begin, int *end) const;
+
   // Entity name with offset and frequency.
   struct EntityName {
     uint32 offset;
@@ -98,6 +111,59 @@ class NameTable {
     }
   };
 
+  // Completion for name prefix in repository. The top list has the entities
+  // with the highest total frequency for all names with the prefix. The exact
+  // list has the highest ranking entities for the name equal to the prefix
+  // with their total frequency for the prefix, so the exact match boost can be
+  // applied at lookup time. Both lists are sorted by decreasing frequency.
+  class CompletionItem : public RepositoryObject {
+   public:
+    // Return name prefix.
+    Text prefix() const { return Text(prefix_ptr(), *prefixlen_ptr()); }
+
+    // Return top-ranked entities for prefix.
+    int num_top() const { return *toplen_ptr(); }
+    const EntityName *top() const { return top_ptr(); }
+
+    // Return top-ranked entities for exact match.
+    int num_exact() const { return *exactlen_ptr(); }
+    const EntityName *exact() const { return exact_ptr(); }
+
+   private:
+    // Name prefix.
+    REPOSITORY_FIELD(uint8, prefixlen, 1, 0);
+    REPOSITORY_FIELD(char, prefix, *prefixlen_ptr(), AFTER(prefixlen));
+
+    // Top entity list.
+    REPOSITORY_FIELD(uint32, toplen, 1, AFTER(prefix));
+    REPOSITORY_FIELD(EntityName, top, num_top(), AFTER(toplen));
+
+    // Exact match entity list.
+    REPOSITORY_FIELD(uint32, exactlen, 1, AFTER(top));
+    REPOSITORY_FIELD(EntityName, exact, num_exact(), AFTER(exactlen));
+  };
+
+  // Completion index in repository. The completions are sorted by prefix.
+  class CompletionIndex : public RepositoryIndex<uint64, CompletionItem> {
+   public:
+    // Initialize completion index. Returns false if the repository does not
+    // have a completion index.
+    bool Initialize(const Repository &repository) {
+      return Init(repository, "CompletionIndex", "Completions", true);
+    }
+
+    // Return completion from completion index.
+    const CompletionItem *GetCompletion(int index) const {
+      return GetObject(index);
+    }
+  };
+
+  // Completion parameters in repository.
+  struct CompletionParams {
+    uint32 threshold;  // minimum number of names for prefix completion
+    uint32 size;       // maximum number of entities in completion lists
+  };
+
   // Get entity from entity table.
   const EntityItem *GetEntity(uint32 offset) const {
     return reinterpret_cast<const EntityItem *>(entity_table_ + offset);
@@ -112,6 +178,10 @@ class NameTable {
   // Entity table.
   const char *entity_table_ = nullptr;
 
+  // Completion index for prefixes matching many names (optional).
+  CompletionIndex completion_index_;
+  const CompletionParams *completion_params_ = nullptr;
+
   // Text normalization flags.
   Normalization normalization_ = NORMALIZE_DEFAULT;
 };
@@ -0,0 +1,167 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/file/repository.h"
+#include "sling/frame/object.h"
+#include "sling/frame/serialization.h"
+#include "sling/frame/store.h"
+#include "sling/nlp/kb/facts.h"
+#include "sling/task/frames.h"
+#include "sling/task/process.h"
+
+namespace sling {
+namespace nlp {
+
+using namespace task;
+
+// Build type closure repository with the transitive closure of the subclass
+// of (P279) relation for all types in the knowledge base.
+class TypeClosureBuilder : public Process {
+ public:
+  void Run(Task *task) override {
+    // Set up counters.
+    Counter *num_types = task->GetCounter("types");
+    Counter *num_superclasses = task->GetCounter("superclasses");
+    Counter *num_skipped = task->GetCounter("skipped_types");
+
+    // Load knowledge base.
+    Store commons;
+    LoadStore(task->GetInputFile("kb"), &commons);
+
+    // Resolve symbols.
+    Names names;
+    Name p_instance_of(names, "P31");
+    Name p_subclass_of(names, "P279");
+    names.Bind(&commons);
+
+    // Initialize fact catalog. The catalog has no type closure, so the
+    // superclasses are computed by traversing the subclass relation.
+    FactCatalog catalog;
+    catalog.Init(&commons);
+    commons.Freeze();
+
+    // Collect all types, i.e. targets of P31 and P279 as well as items with
+    // P279 statements.
+    Handles types(&commons);
+    HandleMap<int> mapping;
+    auto add = [&](Handle type) {
+      if (mapping.find(type) == mapping.end()) {
+        mapping[type] = types.size();
+        types.push_back(type);
+      }
+    };
+    commons.ForAll([&](Handle handle) {
+      Frame item(&commons, handle);
+      for (const Slot &s : item) {
+        if (s.name == p_subclass_of) {
+          add(handle);
+          add(commons.Resolve(s.value));
+        } else if (s.name == p_instance_of) {
+          add(commons.Resolve(s.value));
+        }
+      }
+    });
+    LOG(INFO) << types.size() << " types";
+
+    // Only types with ids can be stored in the repository. Types whose
+    // closure contains types without ids are marked as incomplete, so these
+    // fall back to traversal.
+    auto storable = [&](Handle type) {
+      if (!commons.IsFrame(type)) return false;
+      Text id = commons.FrameId(type);
+      return !id.empty() && id.size() < 256;
+    };
+
+    // Compute superclass closure for all types. New superclasses found during
+    // the traversal are added to the type table.
+    std::vector<std::vector<uint32>> closures;
+    std::vector<bool> complete;
+    std::vector<Handle> superclasses;
+    for (int i = 0; i < types.size(); ++i) {
+      closures.emplace_back();
+      complete.push_back(false);
+      Handle type = types[i];
+      if (!storable(type)) continue;
+      superclasses.clear();
+      catalog.ExtractSuperclasses(type, &superclasses);
+      std::vector<uint32> &closure = closures.back();
+      for (Handle superclass : superclasses) {
+        if (!storable(superclass)) break;
+        add(superclass);
+        closure.push_back(mapping[superclass]);
+      }
+      if (closure.size() == superclasses.size()) {
+        std::sort(closure.begin(), closure.end());
+        complete.back() = true;
+      } else {
+        closure.clear();
+        num_skipped->Increment();
+      }
+    }
+
+    // Build type closure repository. Types without ids get an empty id, so
+    // they are not resolved when the repository is loaded.
+    Repository repository;
+    File *type_index_block = repository.AddBlock("TypeIndex");
+    File *type_item_block = repository.AddBlock("TypeItems");
+    uint64 offset = 0;
+    for (int i = 0; i < types.size(); ++i) {
+      // Write type index entry.
+      type_index_block->WriteOrDie(&offset, sizeof(uint64));
+
+      // Write superclasses and id to type entry.
+      const std::vector<uint32> &closure = closures[i];
+      Text id;
+      if (storable(types[i])) id = commons.FrameId(types[i]);
+      uint32 suplen = closure.size();
+      if (!complete[i]) suplen |= 1u << 31;
+      uint8 idlen = id.size();
+      type_item_block->WriteOrDie(&suplen, sizeof(uint32));
+      type_item_block->WriteOrDie(closure.data(),
+                                  closure.size() * sizeof(uint32));
+      type_item_block->WriteOrDie(&idlen, sizeof(uint8));
+      type_item_block->WriteOrDie(id.data(), idlen);
+      offset += sizeof(uint32) + closure.size() * sizeof(uint32) +
+                sizeof(uint8) + idlen;
+
+      // Align next entry to four bytes.
+      while (offset % sizeof(uint32) != 0) {
+        uint8 padding = 0;
+        type_item_block->WriteOrDie(&padding, sizeof(uint8));
+        offset++;
+      }
+
+      num_types->Increment();
+      num_superclasses->Increment(closure.size());
+    }
+
+    // Write repository to file.
+    const string &filename = task->GetOutput("repository")->resource()->name();
+    CHECK(!filename.empty());
+    LOG(INFO) << "Write type closure repository to " << filename;
+    repository.Write(filename);
+    LOG(INFO) << "Repository done";
+  }
+};
+
+REGISTER_TASK_PROCESSOR("type-closure-builder", TypeClosureBuilder);
+
+}  // namespace nlp
+}  // namespace sling
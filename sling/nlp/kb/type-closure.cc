@@ -0,0 +1,85 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/nlp/kb/type-closure.h"
+
+#include <algorithm>
+
+#include "sling/base/logging.h"
+
+namespace sling {
+namespace nlp {
+
+void TypeClosure::Load(Store *store, const string &filename) {
+  // Load type closure repository from file.
+  repository_.Read(filename);
+
+  // Initialize type index.
+  type_index_.Initialize(repository_);
+
+  // Resolve type handles. All the types are resolved up front so the lookups
+  // do not need to modify any state and the type closure can be shared.
+  int num_types = type_index_.size();
+  types_ = new Handles(store);
+  types_->resize(num_types);
+  mapping_.reserve(num_types);
+  int unresolved = 0;
+  for (int i = 0; i < num_types; ++i) {
+    Text id = type_index_.GetType(i)->id();
+    if (id.empty()) continue;
+    Handle type = store->LookupExisting(id);
+    if (type.IsNil()) {
+      VLOG(1) << "Cannot resolve " << id << " in type closure";
+      unresolved++;
+      continue;
+    }
+    (*types_)[i] = type;
+    mapping_[type] = i;
+  }
+  if (unresolved > 0) {
+    LOG(WARNING) << unresolved << " unresolved types in type closure";
+  }
+}
+
+bool TypeClosure::Contains(int index, Handle supertype) const {
+  int target = Find(supertype);
+  if (target == -1) return false;
+  const TypeItem *type = type_index_.GetType(index);
+  const uint32 *begin = type->superclasses();
+  const uint32 *end = begin + type->num_superclasses();
+  return std::binary_search(begin, end, static_cast<uint32>(target));
+}
+
+void TypeClosure::GetSuperclasses(int index,
+                                  std::vector<Handle> *superclasses) const {
+  const TypeItem *type = type_index_.GetType(index);
+  const uint32 *supers = type->superclasses();
+  for (int i = 0; i < type->num_superclasses(); ++i) {
+    Handle superclass = (*types_)[supers[i]];
+    if (!superclass.IsNil()) superclasses->push_back(superclass);
+  }
+}
+
+const TypeClosure *TypeClosure::Acquire(AssetManager *assets,
+                                        Store *store,
+                                        const string &filename) {
+  return assets->Acquire<TypeClosure>(filename, [&]() {
+    TypeClosure *closure = new TypeClosure();
+    closure->Load(store, filename);
+    return closure;
+  });
+}
+
+}  // namespace nlp
+}  // namespace sling
@@ -0,0 +1,135 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_NLP_KB_TYPE_CLOSURE_H_
+#define SLING_NLP_KB_TYPE_CLOSURE_H_
+
+#include <string>
+#include <vector>
+
+#include "sling/base/types.h"
+#include "sling/file/repository.h"
+#include "sling/frame/object.h"
+#include "sling/frame/store.h"
+#include "sling/string/text.h"
+#include "sling/util/asset.h"
+
+namespace sling {
+namespace nlp {
+
+// Precomputed transitive closure of the subclass of (P279) relation for the
+// types in the knowledge base. For each type, the repository holds the sorted
+// list of all its direct and indirect superclasses. Superclass expansion stops
+// at the base items of the fact catalog, i.e. base items are included in the
+// closure but their superclasses are not, and base types have empty closures.
+// This allows the fact catalog to answer type queries with a lookup instead of
+// a graph traversal. The type closure is read-only after it has been loaded
+// and can be shared between threads.
+class TypeClosure : public Asset {
+ public:
+  ~TypeClosure() override { delete types_; }
+
+  // Load type closure repository from file.
+  void Load(Store *store, const string &filename);
+
+  // Return the number of types in the type closure.
+  int size() const { return type_index_.size(); }
+
+  // Return index of type, or -1 if the superclass closure for the type is not
+  // in the type closure.
+  int Lookup(Handle type) const {
+    int index = Find(type);
+    if (index == -1 || !type_index_.GetType(index)->complete()) return -1;
+    return index;
+  }
+
+  // Check if supertype is in the superclass closure of the type with index.
+  bool Contains(int index, Handle supertype) const;
+
+  // Add superclasses of the type with index to list.
+  void GetSuperclasses(int index, std::vector<Handle> *superclasses) const;
+
+  // Acquire shared type closure.
+  static const TypeClosure *Acquire(AssetManager *assets,
+                                    Store *store,
+                                    const string &filename);
+
+ private:
+  // Type item in repository.
+  class TypeItem : public RepositoryObject {
+   public:
+    // Type id.
+    Text id() const { return Text(id_ptr(), *idlen_ptr()); }
+
+    // Number of superclasses for type.
+    int num_superclasses() const { return *suplen_ptr() & ~INCOMPLETE; }
+
+    // Check if the superclass closure is stored for type. Types where the
+    // closure could not be stored are only kept as superclasses of other
+    // types.
+    bool complete() const { return (*suplen_ptr() & INCOMPLETE) == 0; }
+
+    // Sorted array of type indices for superclasses.
+    const uint32 *superclasses() const { return superclasses_ptr(); }
+
+   private:
+    // Superclass list.
+    REPOSITORY_FIELD(uint32, suplen, 1, 0);
+    REPOSITORY_FIELD(uint32, superclasses, num_superclasses(), AFTER(suplen));
+
+    // Type id.
+    REPOSITORY_FIELD(uint8, idlen, 1, AFTER(superclasses));
+    REPOSITORY_FIELD(char, id, *idlen_ptr(), AFTER(idlen));
+  };
+
+  // Flag in superclass count for types without stored closure.
+  static const uint32 INCOMPLETE = 1u << 31;
+
+  // Return index of type, or -1 if type is unknown.
+  int Find(Handle type) const {
+    auto f = mapping_.find(type);
+    return f != mapping_.end() ? f->second : -1;
+  }
+
+  // Type index in repository.
+  class TypeIndex : public RepositoryIndex<uint64, TypeItem> {
+   public:
+    // Initialize type index.
+    void Initialize(const Repository &repository) {
+      Init(repository, "TypeIndex", "TypeItems", false);
+    }
+
+    // Return type from type index.
+    const TypeItem *GetType(int index) const {
+      return GetObject(index);
+    }
+  };
+
+  // Repository with type closure.
+  Repository repository_;
+
+  // Type index.
+  TypeIndex type_index_;
+
+  // Resolved handles for types.
+  Handles *types_ = nullptr;
+
+  // Mapping from type handle to type index.
+  HandleMap<int> mapping_;
+};
+
+}  // namespace nlp
+}  // namespace sling
+
+#endif  // SLING_NLP_KB_TYPE_CLOSURE_H_
@@ -23,6 +23,7 @@ namespace nlp {
 using namespace myelin;
 
 Parser::~Parser() {
+  for (Predictors *predictors : pool_) delete predictors;
   delete encoder_;
   delete decoder_;
 }
@@ -76,9 +77,10 @@ void Parser::Load(Store *store, const string &filename) {
 }
 
 void Parser::Parse(Document *document) const {
-  // Create encoder and decoder predictors.
-  ParserEncoder::Predictor *encoder = encoder_->CreatePredictor();
-  ParserDecoder::Predictor *decoder = decoder_->CreatePredictor();
+  // Get encoder and decoder predictors from pool.
+  Predictors *predictors = AcquirePredictors();
+  ParserEncoder::Predictor *encoder = predictors->encoder;
+  ParserDecoder::Predictor *decoder = predictors->decoder;
 
   // Parse each sentence of the document.
   decoder->Switch(document);
@@ -90,8 +92,30 @@ void Parser::Parse(Document *document) const {
     decoder->Decode(s.begin(), s.end(), encodings);
   }
 
-  delete encoder;
-  delete decoder;
+  // Return predictors to pool for reuse.
+  ReleasePredictors(predictors);
+}
+
+Parser::Predictors *Parser::AcquirePredictors() const {
+  {
+    MutexLock lock(&mu_);
+    if (!pool_.empty()) {
+      Predictors *predictors = pool_.back();
+      pool_.pop_back();
+      return predictors;
+    }
+  }
+
+  // Create new encoder and decoder predictors.
+  Predictors *predictors = new Predictors();
+  predictors->encoder = encoder_->CreatePredictor();
+  predictors->decoder = decoder_->CreatePredictor();
+  return predictors;
+}
+
+void Parser::ReleasePredictors(Predictors *predictors) const {
+  MutexLock lock(&mu_);
+  pool_.push_back(predictors);
 }
 
 }  // namespace nlp
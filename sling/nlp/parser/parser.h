@@ -26,6 +26,7 @@
 #include "sling/myelin/flow.h"
 #include "sling/nlp/document/document.h"
 #include "sling/nlp/parser/parser-codec.h"
+#include "sling/util/mutex.h"
 
 namespace sling {
 namespace nlp {
@@ -51,6 +52,19 @@ class Parser {
   const HyperParams &hparams() const { return hparams_; }
 
  private:
+  // Encoder and decoder predictors for parsing documents.
+  struct Predictors {
+    ~Predictors() { delete encoder; delete decoder; }
+    ParserEncoder::Predictor *encoder;
+    ParserDecoder::Predictor *decoder;
+  };
+
+  // Get predictors from pool or create new ones if the pool is empty.
+  Predictors *AcquirePredictors() const;
+
+  // Return predictors to pool.
+  void ReleasePredictors(Predictors *predictors) const;
+
   // JIT compiler.
   myelin::Compiler compiler_;
 
@@ -60,7 +74,7 @@ class Parser {
   // Parser encoder.
   ParserEncoder *encoder_ = nullptr;
 
-  // Parser encoder.
+  // Parser decoder.
   ParserDecoder *decoder_ = nullptr;
 
   // Hyperparameters for parser model.
@@ -68,6 +82,11 @@ class Parser {
 
   // Sentence skip mask. Default to skipping headings.
   int skip_mask_ = HEADING_BEGIN;
+
+  // Pool of idle predictors. Creating predictors allocates the instance data
+  // for all the cells in the model, so predictors are reused across calls.
+  mutable std::vector<Predictors *> pool_;
+  mutable Mutex mu_;
 };
 
 }  // namespace nlp
@@ -19,6 +19,7 @@
 #include "sling/nlp/document/document.h"
 #include "sling/nlp/document/fingerprinter.h"
 #include "sling/nlp/kb/facts.h"
+#include "sling/nlp/kb/type-closure.h"
 
 namespace sling {
 namespace nlp {
@@ -35,6 +36,13 @@ class AnaphoraAnnotator : public Annotator {
     // Initialize fact catalog.
     catalog_.Init(commons);
 
+    // Use precomputed type closure for type queries if available.
+    Binding *closure = task->GetInput("type_closure");
+    if (closure != nullptr) {
+      const string &filename = closure->resource()->name();
+      catalog_.set_type_closure(TypeClosure::Acquire(task, commons, filename));
+    }
+
     // Set up pronoun descriptors for language.
     string language = task->Get("language", "en");
     bool personal = task->Get("personal_reference", true);
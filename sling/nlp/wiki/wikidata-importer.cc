@@ -18,6 +18,7 @@
 #include "sling/base/logging.h"
 #include "sling/base/types.h"
 #include "sling/frame/encoder.h"
+#include "sling/frame/json.h"
 #include "sling/frame/object.h"
 #include "sling/frame/reader.h"
 #include "sling/frame/serialization.h"
@@ -79,13 +80,19 @@ class WikidataImporter : public task::Processor {
       return;
     }
 
-    // Read Wikidata item in JSON format into local SLING store.
+    // Read Wikidata item in JSON format into local SLING store. The fast JSON
+    // reader only handles strict JSON, so fall back to the SLING reader in
+    // JSON mode if it fails.
     Store store(commons_);
-    ArrayInputStream stream(message->value());
-    Input input(&stream);
-    Reader reader(&store, &input);
-    reader.set_json(true);
-    Object obj = reader.Read();
+    JSONReader json(&store);
+    Object obj = json.Read(message->value());
+    if (obj.handle().IsError()) {
+      ArrayInputStream stream(message->value());
+      Input input(&stream);
+      Reader reader(&store, &input);
+      reader.set_json(true);
+      obj = reader.Read();
+    }
     delete message;
     CHECK(obj.valid());
     CHECK(obj.IsFrame()) << message->value();
@@ -171,11 +171,11 @@ class WikipediaLinkMerger : public task::Reducer {
     // Merge links from all documents.
     HandleMap<int> links;
     Store store(&commons_);
-    for (task::Message *message : input.messages()) {
-      // Get next set of links.
-      Frame batch = DecodeMessage(&store, message);
-
+    Handles batches(&store);
+    DecodeMessages(&store, input.messages(), &batches);
+    for (Handle h : batches) {
       // Aggregate links for item.
+      Frame batch(&store, h);
       for (const Slot &s : batch) {
         Handle link = s.name;
         int count = s.value.AsInt();
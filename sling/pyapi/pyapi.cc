@@ -17,6 +17,7 @@
 #include "sling/pyapi/pyarray.h"
 #include "sling/pyapi/pybase.h"
 #include "sling/pyapi/pydate.h"
+#include "sling/pyapi/pyembedding.h"
 #include "sling/pyapi/pyframe.h"
 #include "sling/pyapi/pymyelin.h"
 #include "sling/pyapi/pyparser.h"
@@ -83,6 +84,7 @@ static PyObject *RegisterPythonModule() {
   PyFactExtractor::Define(module);
   PyTaxonomy::Define(module);
   PyPlausibility::Define(module);
+  PyVectorIndex::Define(module);
 
   PyCompiler::Define(module);
   PyNetwork::Define(module);
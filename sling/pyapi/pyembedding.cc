@@ -0,0 +1,181 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/pyapi/pyembedding.h"
+
+#include <vector>
+
+namespace sling {
+
+// Python type declarations.
+PyTypeObject PyVectorIndex::type;
+PyMethodTable PyVectorIndex::methods;
+
+void PyVectorIndex::Define(PyObject *module) {
+  InitType(&type, "sling.api.VectorIndex", sizeof(PyVectorIndex), true);
+
+  type.tp_init = method_cast<initproc>(&PyVectorIndex::Init);
+  type.tp_dealloc = method_cast<destructor>(&PyVectorIndex::Dealloc);
+
+  methods.Add("size", &PyVectorIndex::Size);
+  methods.Add("dims", &PyVectorIndex::Dims);
+  methods.AddO("lookup", &PyVectorIndex::Lookup);
+  methods.AddO("id", &PyVectorIndex::Id);
+  methods.AddO("vector", &PyVectorIndex::Vector);
+  methods.Add("search", &PyVectorIndex::Search);
+  methods.Add("similar", &PyVectorIndex::Similar);
+  type.tp_methods = methods.table();
+
+  RegisterType(&type, module, "VectorIndex");
+}
+
+int PyVectorIndex::Init(PyObject *args, PyObject *kwds) {
+  // Get vector index file name.
+  index = nullptr;
+  searcher = nullptr;
+  const char *filename = nullptr;
+  if (!PyArg_ParseTuple(args, "s", &filename)) return -1;
+
+  // Load vector index.
+  index = new nlp::VectorIndex();
+  index->Load(filename);
+  searcher = new nlp::VectorIndex::Searcher(index);
+
+  return 0;
+}
+
+void PyVectorIndex::Dealloc() {
+  delete searcher;
+  delete index;
+  Free();
+}
+
+PyObject *PyVectorIndex::Size() {
+  return PyLong_FromLong(index->size());
+}
+
+PyObject *PyVectorIndex::Dims() {
+  return PyLong_FromLong(index->dims());
+}
+
+PyObject *PyVectorIndex::Lookup(PyObject *obj) {
+  const char *id = GetString(obj);
+  if (id == nullptr) return nullptr;
+  int i = index->Lookup(id);
+  if (i == -1) Py_RETURN_NONE;
+  return PyLong_FromLong(i);
+}
+
+PyObject *PyVectorIndex::Id(PyObject *obj) {
+  int i = PyLong_AsLong(obj);
+  if (i == -1 && PyErr_Occurred()) return nullptr;
+  if (i < 0 || i >= index->size()) {
+    PyErr_SetString(PyExc_IndexError, "Vector index out of bounds");
+    return nullptr;
+  }
+  return AllocateString(index->id(i));
+}
+
+PyObject *PyVectorIndex::Vector(PyObject *obj) {
+  int i = PyLong_AsLong(obj);
+  if (i == -1 && PyErr_Occurred()) return nullptr;
+  if (i < 0 || i >= index->size()) {
+    PyErr_SetString(PyExc_IndexError, "Vector index out of bounds");
+    return nullptr;
+  }
+  const float *v = index->vector(i);
+  PyObject *result = PyList_New(index->dims());
+  for (int d = 0; d < index->dims(); ++d) {
+    PyList_SetItem(result, d, PyFloat_FromDouble(v[d]));
+  }
+  return result;
+}
+
+PyObject *PyVectorIndex::Search(PyObject *args, PyObject *kw) {
+  // Get query vector and search parameters.
+  static const char *kwlist[] = {"vector", "k", "ef", nullptr};
+  PyObject *pyvector = nullptr;
+  int k = 10;
+  int ef = 100;
+  bool ok = PyArg_ParseTupleAndKeywords(
+                args, kw, "O|ii", const_cast<char **>(kwlist),
+                &pyvector, &k, &ef);
+  if (!ok) return nullptr;
+
+  // Convert query vector.
+  PyObject *seq = PySequence_Fast(pyvector, "Vector must be a sequence");
+  if (seq == nullptr) return nullptr;
+  int dims = PySequence_Fast_GET_SIZE(seq);
+  if (dims != index->dims()) {
+    Py_DECREF(seq);
+    PyErr_SetString(PyExc_ValueError, "Vector dimension mismatch");
+    return nullptr;
+  }
+  std::vector<float> query(dims);
+  for (int d = 0; d < dims; ++d) {
+    query[d] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, d));
+  }
+  Py_DECREF(seq);
+  if (PyErr_Occurred()) return nullptr;
+
+  // Search index.
+  nlp::VectorIndex::Matches matches;
+  searcher->Search(query.data(), k, ef, &matches);
+  return PyMatches(matches);
+}
+
+PyObject *PyVectorIndex::Similar(PyObject *args, PyObject *kw) {
+  // Get id and search parameters.
+  static const char *kwlist[] = {"id", "k", "ef", nullptr};
+  PyObject *pyid = nullptr;
+  int k = 10;
+  int ef = 100;
+  bool ok = PyArg_ParseTupleAndKeywords(
+                args, kw, "O|ii", const_cast<char **>(kwlist),
+                &pyid, &k, &ef);
+  if (!ok) return nullptr;
+
+  // Look up vector. The vector can either be given by id or index.
+  int i;
+  if (PyLong_Check(pyid)) {
+    i = PyLong_AsLong(pyid);
+    if (i < 0 || i >= index->size()) {
+      PyErr_SetString(PyExc_IndexError, "Vector index out of bounds");
+      return nullptr;
+    }
+  } else {
+    const char *id = GetString(pyid);
+    if (id == nullptr) return nullptr;
+    i = index->Lookup(id);
+    if (i == -1) Py_RETURN_NONE;
+  }
+
+  // Search index.
+  nlp::VectorIndex::Matches matches;
+  searcher->Similar(i, k, ef, &matches);
+  return PyMatches(matches);
+}
+
+PyObject *PyVectorIndex::PyMatches(const nlp::VectorIndex::Matches &matches) {
+  PyObject *result = PyList_New(matches.size());
+  for (int i = 0; i < matches.size(); ++i) {
+    PyObject *match = PyTuple_New(2);
+    PyTuple_SetItem(match, 0, AllocateString(index->id(matches[i].index)));
+    PyTuple_SetItem(match, 1, PyFloat_FromDouble(matches[i].score));
+    PyList_SetItem(result, i, match);
+  }
+  return result;
+}
+
+}  // namespace sling
@@ -0,0 +1,69 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_PYAPI_PYEMBEDDING_H_
+#define SLING_PYAPI_PYEMBEDDING_H_
+
+#include "sling/nlp/embedding/vector-index.h"
+#include "sling/pyapi/pybase.h"
+
+namespace sling {
+
+// Python wrapper for vector index.
+struct PyVectorIndex : public PyBase {
+  // Initialize vector index wrapper.
+  int Init(PyObject *args, PyObject *kwds);
+
+  // Deallocate vector index wrapper.
+  void Dealloc();
+
+  // Return number of vectors in index.
+  PyObject *Size();
+
+  // Return number of dimensions in vectors.
+  PyObject *Dims();
+
+  // Look up vector index for id.
+  PyObject *Lookup(PyObject *obj);
+
+  // Return id for vector.
+  PyObject *Id(PyObject *obj);
+
+  // Return vector as list of floats.
+  PyObject *Vector(PyObject *obj);
+
+  // Find vectors most similar to query vector.
+  PyObject *Search(PyObject *args, PyObject *kw);
+
+  // Find vectors most similar to vector in index.
+  PyObject *Similar(PyObject *args, PyObject *kw);
+
+  // Return list of (id, score) tuples for matches.
+  PyObject *PyMatches(const nlp::VectorIndex::Matches &matches);
+
+  // Vector index.
+  nlp::VectorIndex *index;
+
+  // Searcher for index.
+  nlp::VectorIndex::Searcher *searcher;
+
+  // Registration.
+  static PyTypeObject type;
+  static PyMethodTable methods;
+  static void Define(PyObject *module);
+};
+
+}  // namespace sling
+
+#endif  // SLING_PYAPI_PYEMBEDDING_H_
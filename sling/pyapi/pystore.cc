@@ -40,6 +40,7 @@ void PyStore::Define(PyObject *module) {
   methods.Add("freeze", &PyStore::Freeze);
   methods.Add("load", &PyStore::Load);
   methods.Add("save", &PyStore::Save);
+  methods.Add("snapshot", &PyStore::WriteSnapshot);
   methods.Add("parse", &PyStore::Parse);
   methods.AddO("frame", &PyStore::NewFrame);
   methods.AddO("array", &PyStore::NewArray);
@@ -110,13 +111,16 @@ PyObject *PyStore::Freeze() {
 
 PyObject *PyStore::Load(PyObject *args, PyObject *kw) {
   // Parse arguments.
-  static const char *kwlist[] = {"filename", "binary", "snapshot", nullptr};
+  static const char *kwlist[] = {
+    "filename", "binary", "snapshot", "map", nullptr
+  };
   char *filename = nullptr;
   bool force_binary = false;
   bool snapshot = true;
+  bool map = false;
   bool ok = PyArg_ParseTupleAndKeywords(
-                args, kw, "s|bb", const_cast<char **>(kwlist),
-                &filename, &force_binary, &snapshot);
+                args, kw, "s|bbb", const_cast<char **>(kwlist),
+                &filename, &force_binary, &snapshot, &map);
   if (!ok) return nullptr;
 
   // Check that store is writable.
@@ -125,7 +129,8 @@ PyObject *PyStore::Load(PyObject *args, PyObject *kw) {
   // Read frames from file.
   if (snapshot && store->Pristine() && Snapshot::Valid(filename)) {
     // Load store from snapshot.
-    Status st = Snapshot::Read(store, filename);
+    Status st = map ? Snapshot::Map(store, filename)
+                    : Snapshot::Read(store, filename);
     if (!st.ok()) {
       PyErr_SetString(PyExc_IOError, st.message());
       return nullptr;
@@ -185,6 +190,32 @@ PyObject *PyStore::Save(PyObject *args, PyObject *kw) {
   Py_RETURN_NONE;
 }
 
+PyObject *PyStore::WriteSnapshot(PyObject *args) {
+  // Get arguments.
+  char *filename = nullptr;
+  if (!PyArg_ParseTuple(args, "s", &filename)) return nullptr;
+
+  // Only global stores can be snapshot.
+  if (store->globals() != nullptr) {
+    PyErr_SetString(PyExc_ValueError, "Local store cannot be snapshot");
+    return nullptr;
+  }
+  if (!Writable()) return nullptr;
+
+  // Move the symbol table to a separate heap so the other heaps can be mapped
+  // from the snapshot.
+  store->AllocateSymbolHeap();
+  store->GC();
+
+  // Write snapshot.
+  Status st = Snapshot::Write(store, filename);
+  if (!st.ok()) {
+    PyErr_SetString(PyExc_IOError, st.message());
+    return nullptr;
+  }
+  Py_RETURN_NONE;
+}
+
 PyObject *PyStore::Parse(PyObject *args, PyObject *kw) {
   // Parse arguments.
   static const char *kwlist[] = {
@@ -38,6 +38,9 @@ struct PyStore : public PyBase {
   // Save frames to file.
   PyObject *Save(PyObject *args, PyObject *kw);
 
+  // Write snapshot of store for file.
+  PyObject *WriteSnapshot(PyObject *args);
+
   // Parse string as binary or ascii encoded frames.
   PyObject *Parse(PyObject *args, PyObject *kw);
 
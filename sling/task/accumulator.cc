@@ -14,8 +14,11 @@
 
 #include "sling/task/accumulator.h"
 
+#include <algorithm>
+
 #include "sling/base/logging.h"
 #include "sling/string/numbers.h"
+#include "sling/task/combiner.h"
 #include "sling/task/reducer.h"
 #include "sling/util/fingerprint.h"
 #include "sling/util/mutex.h"
@@ -23,10 +26,16 @@
 namespace sling {
 namespace task {
 
+Accumulator::~Accumulator() {
+  delete [] shards_;
+}
+
 void Accumulator::Init(Channel *output, int num_buckets) {
   output_ = output;
-  buckets_.clear();
-  buckets_.resize(num_buckets);
+  delete [] shards_;
+  shards_ = new Shard[kShards];
+  int shard_size = std::max(num_buckets / kShards, kProbes);
+  for (int i = 0; i < kShards; ++i) shards_[i].buckets.resize(shard_size);
 
   Task *task = output->producer().task();
   num_slots_used_ = task->GetCounter("accumulator_slots_used");
@@ -35,50 +44,84 @@ void Accumulator::Init(Channel *output, int num_buckets) {
 
 void Accumulator::Increment(Text key, int64 count) {
   uint64 fp = Fingerprint(key.data(), key.size());
-  uint32 b = (fp ^ (fp >> 32)) % buckets_.size();
-  MutexLock lock(&mu_);
-  Bucket &bucket = buckets_[b];
-  if (fp != bucket.hash || key != bucket.key) {
-    if (bucket.count != 0) {
-      output_->Send(new Message(bucket.key, SimpleItoa(bucket.count)));
-      bucket.count = 0;
-      num_collisions_->Increment();
-    } else {
-      num_slots_used_->Increment();
-    }
-    bucket.hash = fp;
-    bucket.key.assign(key.data(), key.size());
-
-  }
-  bucket.count += count;
+  Add(fp, key, false, count);
 }
 
 void Accumulator::Increment(uint64 key, int64 count) {
-  uint64 b = (key ^ (key >> 32)) % buckets_.size();
-  MutexLock lock(&mu_);
-  Bucket &bucket = buckets_[b];
-  if (key != bucket.hash) {
-    if (bucket.count != 0) {
-      output_->Send(new Message(bucket.key, SimpleItoa(bucket.count)));
-      bucket.count = 0;
+  Add(key, Text(), true, count);
+}
+
+void Accumulator::Add(uint64 hash, Text key, bool numeric, int64 count) {
+  uint64 h = hash ^ (hash >> 32);
+  Shard &shard = shards_[h % kShards];
+  uint64 size = shard.buckets.size();
+  uint64 home = (h / kShards) % size;
+
+  // Evicted counts are sent to the output after the shard has been unlocked.
+  Bucket evicted;
+  {
+    MutexLock lock(&shard.mu);
+
+    // Probe for bucket with key or an empty bucket.
+    Bucket *bucket = nullptr;
+    for (int i = 0; i < kProbes; ++i) {
+      uint64 b = home + i;
+      if (b >= size) b -= size;
+      Bucket &candidate = shard.buckets[b];
+      if (candidate.count == 0) {
+        num_slots_used_->Increment();
+        bucket = &candidate;
+        break;
+      }
+      if (candidate.hash == hash && candidate.numeric == numeric &&
+          (numeric || candidate.key == key)) {
+        candidate.count += count;
+        return;
+      }
+    }
+
+    // Evict home bucket if there are no empty buckets.
+    if (bucket == nullptr) {
+      bucket = &shard.buckets[home];
+      evicted.key.swap(bucket->key);
+      evicted.hash = bucket->hash;
+      evicted.count = bucket->count;
+      evicted.numeric = bucket->numeric;
       num_collisions_->Increment();
+    }
+
+    // Add key to bucket.
+    bucket->hash = hash;
+    bucket->numeric = numeric;
+    if (numeric) {
+      bucket->key.clear();
     } else {
-      num_slots_used_->Increment();
+      bucket->key.assign(key.data(), key.size());
     }
-    bucket.hash = key;
-    bucket.key = SimpleItoa(key);
+    bucket->count = count;
+  }
+
+  if (evicted.count != 0) {
+    char buffer[kMaxCountSize];
+    output_->Send(new Message(evicted.output_key(),
+                              EncodeCount(evicted.count, buffer)));
   }
-  bucket.count += count;
 }
 
 void Accumulator::Flush() {
-  MutexLock lock(&mu_);
-  for (Bucket &bucket : buckets_) {
-    if (bucket.count != 0) {
-      output_->Send(new Message(bucket.key, SimpleItoa(bucket.count)));
-      bucket.count = 0;
+  if (shards_ == nullptr) return;
+  for (int i = 0; i < kShards; ++i) {
+    Shard &shard = shards_[i];
+    MutexLock lock(&shard.mu);
+    for (Bucket &bucket : shard.buckets) {
+      if (bucket.count != 0) {
+        char buffer[kMaxCountSize];
+        output_->Send(new Message(bucket.output_key(),
+                                  EncodeCount(bucket.count, buffer)));
+        bucket.count = 0;
+      }
+      bucket.key.clear();
     }
-    bucket.key.clear();
   }
 }
 
@@ -95,8 +138,7 @@ void SumReducer::Reduce(const ReduceInput &input) {
   int64 sum = 0;
   for (Message *m : input.messages()) {
     int64 count;
-    const Slice &value = m->value();
-    CHECK(safe_strto64_base(value.data(), value.size(), &count, 10));
+    CHECK(DecodeCount(m->value(), &count));
     sum += count;
   }
   if (sum >= threshold_) {
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "sling/base/types.h"
+#include "sling/string/numbers.h"
 #include "sling/task/message.h"
 #include "sling/task/reducer.h"
 #include "sling/task/task.h"
@@ -28,9 +29,18 @@
 namespace sling {
 namespace task {
 
-// Accumulator for collecting counts for keys.
+// Accumulator for collecting counts for keys. The counts are accumulated in a
+// hash table and sent to the output when a bucket is evicted or when the
+// accumulator is flushed, so the same key can be output multiple times and the
+// counts need to be summed by a reducer, e.g. SumReducer. The counts are
+// binary encoded (see EncodeCount()), so they can be pre-aggregated by the
+// "sum" combiner when shuffled. The hash table is split into shards that are
+// locked separately, so the accumulator can be updated from multiple worker
+// threads without contending on a single lock.
 class Accumulator {
  public:
+  ~Accumulator();
+
   // Initialize accumulator.
   void Init(Channel *output, int num_buckets = 1 << 20);
 
@@ -44,13 +54,39 @@ class Accumulator {
   void Flush();
 
  private:
+  // Number of shards in hash table.
+  static const int kShards = 64;
+
+  // Number of buckets probed before evicting a bucket.
+  static const int kProbes = 4;
+
   // Hash buckets for accumulating counts.
   struct Bucket {
     string key;
     uint64 hash = 0;
     int64 count = 0;
+    bool numeric = false;
+
+    // Return key for output.
+    string output_key() const {
+      return numeric ? SimpleItoa(hash) : key;
+    }
   };
-  std::vector<Bucket> buckets_;
+
+  // Shard with hash buckets and a lock for the shard. The shard is padded so
+  // the locks for adjacent shards are on separate cache lines.
+  struct Shard {
+    Mutex mu;
+    std::vector<Bucket> buckets;
+    char padding[64];
+  };
+
+  // Add count for key to bucket in hash table. For numeric keys, the key is
+  // the hash and the string key is only generated when the bucket is output.
+  void Add(uint64 hash, Text key, bool numeric, int64 count);
+
+  // Hash table shards.
+  Shard *shards_ = nullptr;
 
   // Output channel for accumulated counts.
   Channel *output_ = nullptr;
@@ -58,12 +94,9 @@ class Accumulator {
   // Statistics.
   Counter *num_slots_used_ = nullptr;
   Counter *num_collisions_ = nullptr;
-
-  // Mutex for serializing access to accumulator.
-  Mutex mu_;
 };
 
-// Reducer that outputs the sum of all the values for a key.
+// Reducer that outputs the sum of all the binary encoded counts for a key.
 class SumReducer : public Reducer {
  public:
   // Initialize reducer.
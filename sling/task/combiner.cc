@@ -0,0 +1,53 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/task/combiner.h"
+
+#include "sling/base/logging.h"
+#include "sling/util/varint.h"
+
+REGISTER_COMPONENT_REGISTRY("task combiner", sling::task::Combiner);
+
+namespace sling {
+namespace task {
+
+Slice EncodeCount(int64 count, char *buffer) {
+  char *end = Varint::Encode64(buffer, count);
+  return Slice(buffer, end - buffer);
+}
+
+bool DecodeCount(Slice value, int64 *count) {
+  const char *end = value.data() + value.size();
+  uint64 v;
+  const char *p = Varint::Parse64WithLimit(value.data(), end, &v);
+  if (p != end) return false;
+  *count = v;
+  return true;
+}
+
+void Combiner::Init(Task *task) {}
+
+void SumCombiner::Combine(Slice key, Slice value, string *accumulated) {
+  int64 sum, count;
+  CHECK(DecodeCount(*accumulated, &sum));
+  CHECK(DecodeCount(value, &count));
+  char buffer[kMaxCountSize];
+  Slice encoded = EncodeCount(sum + count, buffer);
+  accumulated->assign(encoded.data(), encoded.size());
+}
+
+REGISTER_TASK_COMBINER("sum", SumCombiner);
+
+}  // namespace task
+}  // namespace sling
@@ -0,0 +1,70 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_TASK_COMBINER_H_
+#define SLING_TASK_COMBINER_H_
+
+#include <string>
+
+#include "sling/base/registry.h"
+#include "sling/base/slice.h"
+#include "sling/base/types.h"
+#include "sling/task/task.h"
+
+namespace sling {
+namespace task {
+
+// Maximum size of binary encoded count.
+static const int kMaxCountSize = 10;
+
+// Encode count in binary varint encoding. The buffer must have room for at
+// least kMaxCountSize bytes. Returns slice with the encoded count.
+Slice EncodeCount(int64 count, char *buffer);
+
+// Decode binary varint-encoded count. Returns false if the value is not a
+// valid encoded count.
+bool DecodeCount(Slice value, int64 *count);
+
+// A combiner merges the values of messages with the same key. The sorter can
+// use a combiner for pre-aggregating the values for each key when writing the
+// sorted messages to merge files, when merging these files, and when sending
+// the sorted messages to the output. This reduces the shuffle volume and the
+// number of messages the reducer receives for each key, so the combined values
+// must be valid input for both the combiner and the reducer. Combiners can be
+// called from multiple threads concurrently.
+class Combiner : public Component<Combiner> {
+ public:
+  virtual ~Combiner() = default;
+
+  // Initialize combiner for task.
+  virtual void Init(Task *task);
+
+  // Combine value for key with the accumulated value for the key. The
+  // accumulated value is initialized with the first value for the key.
+  virtual void Combine(Slice key, Slice value, string *accumulated) = 0;
+};
+
+#define REGISTER_TASK_COMBINER(type, component) \
+    REGISTER_COMPONENT_TYPE(sling::task::Combiner, type, component)
+
+// Combiner that sums binary encoded counts.
+class SumCombiner : public Combiner {
+ public:
+  void Combine(Slice key, Slice value, string *accumulated) override;
+};
+
+}  // namespace task
+}  // namespace sling
+
+#endif  // SLING_TASK_COMBINER_H_
@@ -82,6 +82,10 @@ class DatabaseWriter : public Processor {
     // Flush remaining messages in queue.
     if (!queue_.empty()) WriteBatch(&queue_);
 
+    // Wait for outstanding writes.
+    Status st = db_.Wait();
+    if (!st.ok()) LOG(FATAL) << "Error writing to database: " << st;
+
     // Clear bulk mode.
     CHECK(db_.Bulk(false));
 
@@ -101,8 +105,13 @@ class DatabaseWriter : public Processor {
       recs[i].value = message->value();
     }
 
-    // Write records to database.
-    Status st = db_.Put(&recs, mode_);
+    // Write records to database. The records are sent to the server before
+    // Put() returns, but the reply is handled asynchronously, so the next batch
+    // can be sent without waiting for the server to process this batch.
+    Status st = db_.Put(recs, mode_,
+      [](const Status &status, std::vector<DBResult> *results) {
+        if (!status.ok()) LOG(FATAL) << "Error writing to database: " << status;
+      });
     if (!st.ok()) LOG(FATAL) << "Error writing to database: " << st;
 
     // Clear batch.
@@ -111,8 +120,8 @@ class DatabaseWriter : public Processor {
   }
 
  private:
-  // Database connection for writing records.
-  DBClient db_;
+  // Pipelined database connection for writing records.
+  DBAsyncClient db_;
 
   // Update mode for records written to database.
   DBMode mode_ = DBOVERWRITE;
@@ -29,6 +29,11 @@
 namespace sling {
 namespace task {
 
+FrameProcessor::~FrameProcessor() {
+  for (Store *store : stores_) delete store;
+  delete commons_;
+}
+
 void FrameProcessor::Start(Task *task) {
   // Create commons store.
   commons_ = new Store();
@@ -69,25 +74,43 @@ void FrameProcessor::Start(Task *task) {
 }
 
 void FrameProcessor::Receive(Channel *channel, Message *message) {
-  // Create store for frame.
-  Store store(commons_);
+  // Get idle local store for frame or create a new one.
+  Store *store;
+  {
+    MutexLock lock(&mu_);
+    if (stores_.empty()) {
+      store = new Store(commons_);
+    } else {
+      store = stores_.back();
+      stores_.pop_back();
+    }
+  }
 
-  // Decode frame from message.
-  Frame frame = DecodeMessage(&store, message);
-  CHECK(frame.valid());
+  {
+    // Decode frame from message.
+    Frame frame = DecodeMessage(store, message);
+    CHECK(frame.valid());
 
-  // Process frame.
-  Process(message->key(), frame);
+    // Process frame.
+    Process(message->key(), frame);
+  }
 
   // Update statistics.
   MemoryUsage usage;
-  store.GetMemoryUsage(&usage, true);
+  store->GetMemoryUsage(&usage, true);
   frame_memory_->Increment(usage.memory_used());
   frame_handles_->Increment(usage.used_handles());
   frame_symbols_->Increment(usage.num_symbols());
   frame_gcs_->Increment(usage.num_gcs);
   frame_gctime_->Increment(usage.gc_time);
 
+  // Reset local store and return it to the pool of idle stores.
+  store->Reset();
+  {
+    MutexLock lock(&mu_);
+    stores_.push_back(store);
+  }
+
   // Delete input message.
   delete message;
 }
@@ -96,6 +119,10 @@ void FrameProcessor::Done(Task *task) {
   // Flush output.
   Flush(task);
 
+  // Delete local stores.
+  for (Store *store : stores_) delete store;
+  stores_.clear();
+
   // Delete commons store.
   delete commons_;
   commons_ = nullptr;
@@ -152,6 +179,22 @@ Frame DecodeMessage(Store *store, Message *message) {
   }
 }
 
+void DecodeMessages(Store *store, const std::vector<Message *> &messages,
+                    Handles *frames) {
+  frames->reserve(frames->size() + messages.size());
+  for (Message *message : messages) {
+    ArrayInputStream stream(message->value().data(), message->value().size());
+    Input input(&stream);
+    if (input.Peek() == WIRE_BINARY_MARKER) {
+      Decoder decoder(store, &input);
+      frames->push_back(decoder.DecodeObject());
+    } else {
+      Reader reader(store, &input);
+      frames->push_back(reader.ReadObject());
+    }
+  }
+}
+
 }  // namespace task
 }  // namespace sling
 
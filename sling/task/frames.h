@@ -15,17 +15,23 @@
 #ifndef SLING_TASK_FRAMES_H_
 #define SLING_TASK_FRAMES_H_
 
+#include <vector>
+
 #include "sling/frame/object.h"
+#include "sling/frame/store.h"
 #include "sling/task/message.h"
 #include "sling/task/task.h"
+#include "sling/util/mutex.h"
 
 namespace sling {
 namespace task {
 
-// Task processor for receiving and sending frames.
+// Task processor for receiving and sending frames. Each frame is decoded into
+// a local store which is reset and reused for later frames, so the heaps and
+// handle tables of the local stores are only allocated once.
 class FrameProcessor : public Processor {
  public:
-  ~FrameProcessor() override { delete commons_; }
+  ~FrameProcessor() override;
 
   // Task processor implementation.
   void Start(Task *task) override;
@@ -67,6 +73,10 @@ class FrameProcessor : public Processor {
   // Output channel (optional).
   Channel *output_;
 
+  // Idle local stores for decoding frames.
+  std::vector<Store *> stores_;
+  Mutex mu_;
+
   // Statistics.
   Counter *frame_memory_;
   Counter *frame_handles_;
@@ -84,6 +94,12 @@ Message *CreateMessage(const Frame &frame, bool shallow = false);
 // Decode message as frame.
 Frame DecodeMessage(Store *store, Message *message);
 
+// Decode messages as frames into the same store in one pass. The handles for
+// the decoded frames are added to the frames vector, which keeps them alive
+// while the remaining messages are decoded.
+void DecodeMessages(Store *store, const std::vector<Message *> &messages,
+                    Handles *frames);
+
 }  // namespace task
 }  // namespace sling
 
@@ -79,8 +79,8 @@ void Stage::TaskCompleted(Task *task) {
 
 Job::Job() {
   // Start event dispatcher.
-  event_dispatcher_ = new ThreadPool(FLAGS_event_manager_threads,
-                                     FLAGS_event_manager_queue_size);
+  event_dispatcher_ = new WorkStealingPool(FLAGS_event_manager_threads,
+                                           FLAGS_event_manager_queue_size);
   event_dispatcher_->StartWorkers();
 }
 
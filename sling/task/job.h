@@ -213,7 +213,7 @@ class Job : public Environment {
   std::unordered_map<string, Counter *> counters_;
 
   // Worker queue for event dispatching.
-  ThreadPool *event_dispatcher_;
+  WorkStealingPool *event_dispatcher_;
 
   // Optional monitor for job.
   Monitor *monitor_ = nullptr;
@@ -44,6 +44,10 @@ class RecordFileReader : public Process {
     // Open input file.
     RecordFileOptions options;
     options.buffer_size = task->Get("buffer_size", options.buffer_size);
+    options.prefetch_chunks =
+        task->Get("prefetch_chunks", options.prefetch_chunks);
+    options.prefetch_threads =
+        task->Get("prefetch_threads", options.prefetch_threads);
     RecordReader reader(input->resource()->name(), options);
 
     // Statistics counters.
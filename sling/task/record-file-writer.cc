@@ -12,7 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string>
+#include <vector>
+
 #include "sling/base/logging.h"
+#include "sling/file/file.h"
 #include "sling/file/recordio.h"
 #include "sling/task/task.h"
 #include "sling/util/mutex.h"
@@ -20,10 +24,17 @@
 namespace sling {
 namespace task {
 
-// Write incoming messages to record file.
+// Write incoming messages to record file. The "compression" parameter selects
+// the record compression ("none", "snappy", "zstd", or "lz4"). For zstd, a
+// dictionary can be loaded from the "dictionary" file, or a dictionary of
+// "train_dictionary" bytes can be trained on the first "dictionary_samples"
+// records.
 class RecordFileWriter : public Processor {
  public:
-  ~RecordFileWriter() override { delete writer_; }
+  ~RecordFileWriter() override {
+    for (Message *message : samples_) delete message;
+    delete writer_;
+  }
 
   void Init(Task *task) override {
     // Get output file.
@@ -33,15 +44,48 @@ class RecordFileWriter : public Processor {
       return;
     }
 
-    // Open record file writer.
-    RecordFileOptions options;
-    if (task->Get("indexed", false)) options.indexed = true;
-    writer_ = new RecordWriter(output->resource()->name(), options);
+    // Get record file options.
+    filename_ = output->resource()->name();
+    if (task->Get("indexed", false)) options_.indexed = true;
+    string compression = task->Get("compression", "snappy");
+    if (compression == "none") {
+      options_.compression = RecordFile::UNCOMPRESSED;
+    } else if (compression == "snappy") {
+      options_.compression = RecordFile::SNAPPY;
+    } else if (compression == "zstd") {
+      options_.compression = RecordFile::ZSTD;
+    } else if (compression == "lz4") {
+      options_.compression = RecordFile::LZ4;
+    } else {
+      LOG(FATAL) << "Unknown record compression: " << compression;
+    }
+    task->Fetch("compression_level", &options_.compression_level);
+
+    // Get compression dictionary.
+    string dictfile = task->Get("dictionary", "");
+    if (!dictfile.empty()) {
+      CHECK(File::ReadContents(dictfile, &options_.dictionary));
+    }
+    if (options_.compression == RecordFile::ZSTD && dictfile.empty()) {
+      task->Fetch("train_dictionary", &dictionary_size_);
+      task->Fetch("dictionary_samples", &num_samples_);
+    }
+
+    // Open record file writer. If a dictionary needs to be trained, the writer
+    // is opened when the samples have been collected.
+    if (dictionary_size_ == 0) OpenWriter();
   }
 
   void Receive(Channel *channel, Message *message) override {
     MutexLock lock(&mu_);
 
+    // Collect samples for training compression dictionary.
+    if (writer_ == nullptr) {
+      samples_.push_back(message);
+      if (samples_.size() >= num_samples_) TrainDictionary();
+      return;
+    }
+
     // Write message to record file.
     CHECK(writer_->Write(message->key(), message->serial(), message->value()));
     delete message;
@@ -50,6 +94,9 @@ class RecordFileWriter : public Processor {
   void Done(Task *task) override {
     MutexLock lock(&mu_);
 
+    // Train dictionary if not enough samples have been received.
+    if (writer_ == nullptr && dictionary_size_ > 0) TrainDictionary();
+
     // Close writer.
     if (writer_ != nullptr) {
       CHECK(writer_->Close());
@@ -59,6 +106,47 @@ class RecordFileWriter : public Processor {
   }
 
  private:
+  // Open record file writer.
+  void OpenWriter() {
+    writer_ = new RecordWriter(filename_, options_);
+  }
+
+  // Train compression dictionary on samples, open the writer, and write the
+  // sample messages.
+  void TrainDictionary() {
+    std::vector<string> values;
+    for (Message *message : samples_) values.push_back(message->value().str());
+    Status st = RecordFile::TrainDictionary(values, dictionary_size_,
+                                            &options_.dictionary);
+    if (!st.ok()) {
+      LOG(WARNING) << "Compression dictionary not used for " << filename_
+                   << ": " << st;
+    }
+
+    OpenWriter();
+    for (Message *message : samples_) {
+      CHECK(writer_->Write(message->key(), message->serial(),
+                           message->value()));
+      delete message;
+    }
+    samples_.clear();
+  }
+
+  // Output file name.
+  string filename_;
+
+  // Record file options.
+  RecordFileOptions options_;
+
+  // Size of compression dictionary to train.
+  int dictionary_size_ = 0;
+
+  // Number of record samples for training compression dictionary.
+  int num_samples_ = 10000;
+
+  // Samples for training compression dictionary.
+  std::vector<Message *> samples_;
+
   // Record writer for writing to output.
   RecordWriter *writer_ = nullptr;
 
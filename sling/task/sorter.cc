@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <functional>
 #include <queue>
 #include <string>
 #include <vector>
@@ -21,8 +22,10 @@
 #include "sling/base/types.h"
 #include "sling/file/recordio.h"
 #include "sling/string/printf.h"
+#include "sling/task/combiner.h"
 #include "sling/task/task.h"
 #include "sling/util/mutex.h"
+#include "sling/util/thread.h"
 
 namespace sling {
 namespace task {
@@ -44,24 +47,101 @@ struct ItemComparator {
   }
 };
 
-// Message comparator.
-struct MessageComparator {
-  bool operator ()(const Message *a, const Message *b) const {
-    if (a->key() == b->key()) {
-      return a->serial() < b->serial();
+// Element in sort buffer. The first eight bytes of the key are stored in the
+// element in big-endian order, so most comparisons can be done without
+// accessing the message.
+struct SortItem {
+  SortItem() {}
+  explicit SortItem(Message *message) : message(message) {
+    Slice key = message->key();
+    int n = std::min(key.size(), sizeof(uint64));
+    prefix = 0;
+    for (int i = 0; i < n; ++i) {
+      prefix |= static_cast<uint64>(static_cast<uint8>(key[i])) << (56 - i * 8);
+    }
+  }
+
+  uint64 prefix;          // key prefix
+  Message *message;       // message for element
+};
+
+// Sort item comparator.
+struct SortItemComparator {
+  bool operator ()(const SortItem &a, const SortItem &b) const {
+    if (a.prefix != b.prefix) return a.prefix < b.prefix;
+    if (a.message->key() == b.message->key()) {
+      return a.message->serial() < b.message->serial();
     } else {
-      return a->key() < b->key();
+      return a.message->key() < b.message->key();
     }
   }
 };
 
+// Merger for merging records from a set of sorted merge files.
+class Merger {
+ public:
+  // Open merge files and read the first record from each file.
+  explicit Merger(const std::vector<string> &filenames) {
+    items_.resize(filenames.size());
+    for (int i = 0; i < filenames.size(); ++i) {
+      MergeItem &item = items_[i];
+      item.reader = new RecordReader(filenames[i]);
+      if (!item.reader->Done()) {
+        CHECK(item.reader->Read(&item.record));
+        queue_.push(&item);
+      }
+    }
+  }
+
+  // Close merge files.
+  ~Merger() {
+    for (auto &item : items_) {
+      CHECK(item.reader->Close());
+      delete item.reader;
+    }
+  }
+
+  // Check if all records have been merged.
+  bool done() const { return queue_.empty(); }
+
+  // Return the next record in sorted order.
+  const Record &record() const { return queue_.top()->record; }
+
+  // Move to the next record.
+  void Next() {
+    MergeItem *item = queue_.top();
+    queue_.pop();
+    if (!item->reader->Done()) {
+      CHECK(item->reader->Read(&item->record));
+      queue_.push(item);
+    }
+  }
+
+ private:
+  // Merge items for merge files.
+  std::vector<MergeItem> items_;
+
+  // Priority queue for merging files.
+  std::priority_queue<MergeItem *, std::vector<MergeItem *>,
+                      ItemComparator> queue_;
+};
+
 // Sorts all the input messages by key and output these in sorted order on the
-// output channel.
+// output channel. When the sort buffer is full, the messages are sorted and
+// written to a merge file in the background while the next sort buffer is
+// being filled. The sort buffer is sorted in parallel by sorting partitions of
+// the buffer in separate threads and merging the sorted partitions. If there
+// are too many merge files, these are merged in parallel into larger merge
+// files before the final merge. If a combiner is specified, the values for
+// messages with the same key are combined when the sorted messages are written
+// to merge files, merged, and sent to the output channel.
 class Sorter : public Processor {
  public:
   Sorter() {}
   ~Sorter() override {
+    WaitForFlush();
     for (auto *m : messages_) delete m;
+    delete combiner_;
   }
 
   void Start(Task *task) override {
@@ -69,6 +149,17 @@ class Sorter : public Processor {
     output_ = task->GetSink("output");
     CHECK(output_ != nullptr) << "Output channel missing";
     task->Fetch("sort_buffer_size", &max_buffer_size_);
+    task->Fetch("sort_threads", &sort_threads_);
+    task->Fetch("merge_fanin", &merge_fanin_);
+    CHECK_GE(sort_threads_, 1);
+    CHECK_GE(merge_fanin_, 2);
+
+    // Initialize combiner.
+    string combiner = task->Get("combiner", "");
+    if (!combiner.empty()) {
+      combiner_ = Combiner::Create(combiner);
+      combiner_->Init(task);
+    }
   }
 
   void Receive(Channel *channel, Message *message) override {
@@ -78,27 +169,24 @@ class Sorter : public Processor {
     messages_.push_back(message);
     buffer_bytes_ += message->key().size() + message->value().size();
 
-    // Sort and write buffer when buffer is full.
-    if (buffer_bytes_ > max_buffer_size_) {
-      // Sort messages in sort buffer.
-      SortMessages();
-
-      // Flush messages to merge file.
-      Flush();
-    }
+    // Sort and write buffer in the background when buffer is full.
+    if (buffer_bytes_ > max_buffer_size_) Flush();
   }
 
   void Done(Task *task) override {
     MutexLock lock(&mu_);
 
     // Send sorted messages to output channel.
-    if (next_merge_file_ == 0) {
+    if (runs_.empty()) {
       // All messages are in the sort buffer.
       SendMessageBuffer();
     } else {
       // Sort and flush remaining messages to merge file.
-      SortMessages();
       Flush();
+      WaitForFlush();
+
+      // Merge files until there are few enough for the final merge.
+      while (runs_.size() > merge_fanin_) MergeRuns();
 
       // Send messages from merge files to output channel.
       SendMergedMessages();
@@ -114,9 +202,10 @@ class Sorter : public Processor {
   // Remove temporary files.
   void RemoveTempFiles() {
     // Remove temporary merge files.
-    for (int i = 0; i < next_merge_file_; ++i) {
-      File::Delete(MergeFileName(i));
+    for (int run : runs_) {
+      File::Delete(MergeFileName(run));
     }
+    runs_.clear();
 
     // Remove directory.
     if (!tmpdir_.empty()) File::Rmdir(tmpdir_);
@@ -127,7 +216,9 @@ class Sorter : public Processor {
     return StringPrintf("%s/%05d", tmpdir_.c_str(), index);
   }
 
-  // Flush sort buffer to new merge file.
+  // Sort the messages in the sort buffer and write them to a new merge file in
+  // a background thread. This waits for the previous flush to complete, so at
+  // most two sort buffers are kept in memory.
   void Flush() {
     // Check if there are any messages to flush.
     if (messages_.empty()) return;
@@ -137,34 +228,192 @@ class Sorter : public Processor {
       CHECK(File::CreateTempDir(&tmpdir_));
     }
 
-    // Write messages to next merge file.
+    // Wait for previous flush to complete.
+    WaitForFlush();
+
+    // Hand sort buffer over to flush thread.
     int fileno = next_merge_file_++;
+    runs_.push_back(fileno);
+    flushing_.swap(messages_);
     VLOG(3) << "Flush " << buffer_bytes_ << " bytes and "
-            << messages_.size() << " messages to " << MergeFileName(fileno);
+            << flushing_.size() << " messages to " << MergeFileName(fileno);
+    buffer_bytes_ = 0;
+    flusher_ = new ClosureThread([this, fileno]() {
+      SortMessages(&flushing_);
+      CombineMessages(&flushing_);
+      WriteMergeFile(fileno, &flushing_);
+    });
+    flusher_->SetJoinable(true);
+    flusher_->Start();
+  }
+
+  // Wait for background flush to complete.
+  void WaitForFlush() {
+    if (flusher_ != nullptr) {
+      flusher_->Join();
+      delete flusher_;
+      flusher_ = nullptr;
+    }
+  }
+
+  // Write sorted messages to merge file and delete them.
+  void WriteMergeFile(int fileno, std::vector<Message *> *messages) {
     RecordFileOptions options;
     RecordWriter writer(MergeFileName(fileno), options);
-    for (Message *message : messages_) {
+    for (Message *message : *messages) {
       CHECK(writer.Write(message->key(), message->serial(), message->value()));
       delete message;
     }
     CHECK(writer.Close());
+    messages->clear();
+  }
 
-    // Clear sort buffer.
-    messages_.clear();
-    buffer_bytes_ = 0;
+  // Sort messages. The messages are partitioned and the partitions are sorted
+  // in parallel and then merged pairwise in parallel.
+  void SortMessages(std::vector<Message *> *messages) {
+    VLOG(3) << "Sort " << messages->size() << " messages";
+    std::vector<SortItem> items;
+    items.reserve(messages->size());
+    for (Message *message : *messages) items.emplace_back(message);
+
+    // Partition sort buffer. Small buffers are sorted in a single thread.
+    static const int kMinPartitionSize = 16384;
+    int parts = std::min<int64>(sort_threads_,
+                                items.size() / kMinPartitionSize + 1);
+    std::vector<size_t> bounds(parts + 1);
+    for (int i = 0; i <= parts; ++i) bounds[i] = items.size() * i / parts;
+
+    // Sort partitions.
+    SortItemComparator comparator;
+    ParallelFor(parts, [&](int i) {
+      std::sort(items.begin() + bounds[i], items.begin() + bounds[i + 1],
+                comparator);
+    });
+
+    // Merge adjacent partitions until there is only one partition left.
+    for (int width = 1; width < parts; width *= 2) {
+      int merges = (parts + 2 * width - 1) / (2 * width);
+      ParallelFor(merges, [&](int i) {
+        int first = 2 * width * i;
+        int middle = std::min(first + width, parts);
+        int last = std::min(first + 2 * width, parts);
+        if (middle == last) return;
+        std::inplace_merge(items.begin() + bounds[first],
+                           items.begin() + bounds[middle],
+                           items.begin() + bounds[last],
+                           comparator);
+      });
+    }
+
+    for (size_t i = 0; i < items.size(); ++i) {
+      (*messages)[i] = items[i].message;
+    }
+  }
+
+  // Combine the values for consecutive messages with the same key in sorted
+  // message buffer.
+  void CombineMessages(std::vector<Message *> *messages) {
+    if (combiner_ == nullptr) return;
+    string value;
+    size_t size = messages->size();
+    size_t out = 0;
+    size_t i = 0;
+    while (i < size) {
+      Message *first = (*messages)[i++];
+      Slice key = first->key();
+      if (i < size && (*messages)[i]->key() == key) {
+        Slice initial = first->value();
+        value.assign(initial.data(), initial.size());
+        while (i < size && (*messages)[i]->key() == key) {
+          combiner_->Combine(key, (*messages)[i]->value(), &value);
+          delete (*messages)[i++];
+        }
+        first->set_value(value);
+      }
+      (*messages)[out++] = first;
+    }
+    messages->resize(out);
   }
 
-  // Sort messages in sort buffer.
-  void SortMessages() {
-    VLOG(3) << "Sort " << messages_.size() << " messages";
-    MessageComparator comparator;
-    std::sort(messages_.begin(), messages_.end(), comparator);
+  // Merge records from merge files in sorted order and call the output
+  // function for each record. If there is a combiner, the values for records
+  // with the same key are combined.
+  void MergeRecords(Merger *merger,
+                    const std::function<void(const Record &)> &output) {
+    if (combiner_ == nullptr) {
+      for (; !merger->done(); merger->Next()) output(merger->record());
+      return;
+    }
+
+    // The record data is only valid until the next record is read, so the key
+    // and value are copied while combining.
+    string key;
+    string value;
+    while (!merger->done()) {
+      const Record &first = merger->record();
+      key.assign(first.key.data(), first.key.size());
+      value.assign(first.value.data(), first.value.size());
+      uint64 version = first.version;
+      for (merger->Next(); !merger->done(); merger->Next()) {
+        const Record &record = merger->record();
+        if (record.key != key) break;
+        combiner_->Combine(key, record.value, &value);
+      }
+      output(Record(key, version, value));
+    }
+  }
+
+  // Run function for indices 0 to n-1 in parallel using up to sort_threads_
+  // threads.
+  void ParallelFor(int n, const std::function<void(int)> &func) {
+    if (n <= 1 || sort_threads_ <= 1) {
+      for (int i = 0; i < n; ++i) func(i);
+      return;
+    }
+    int threads = std::min(n, sort_threads_);
+    WorkerPool pool;
+    pool.Start(threads, [&](int worker) {
+      for (int i = worker; i < n; i += threads) func(i);
+    });
+    pool.Join();
+  }
+
+  // Merge groups of merge_fanin_ merge files into new merge files in
+  // parallel.
+  void MergeRuns() {
+    // Divide the merge files into groups.
+    std::vector<std::vector<int>> groups;
+    std::vector<int> outputs;
+    for (int i = 0; i < runs_.size(); i += merge_fanin_) {
+      int last = std::min<int>(i + merge_fanin_, runs_.size());
+      groups.emplace_back(runs_.begin() + i, runs_.begin() + last);
+      outputs.push_back(next_merge_file_++);
+    }
+    VLOG(3) << "Merge " << runs_.size() << " files into " << groups.size();
+
+    // Merge each group into a new merge file.
+    ParallelFor(groups.size(), [&](int g) {
+      std::vector<string> filenames;
+      for (int run : groups[g]) filenames.push_back(MergeFileName(run));
+      {
+        Merger merger(filenames);
+        RecordFileOptions options;
+        RecordWriter writer(MergeFileName(outputs[g]), options);
+        MergeRecords(&merger, [&](const Record &record) {
+          CHECK(writer.Write(record));
+        });
+        CHECK(writer.Close());
+      }
+      for (const string &filename : filenames) File::Delete(filename);
+    });
+    runs_ = outputs;
   }
 
   // Send messages in sort buffer to output channel.
   void SendMessageBuffer() {
-    // Sort the messages in the buffer.
-    SortMessages();
+    // Sort and combine the messages in the buffer.
+    SortMessages(&messages_);
+    CombineMessages(&messages_);
 
     // Send messages to output.
     VLOG(3) << "Output " << messages_.size() << " messages";
@@ -176,51 +425,18 @@ class Sorter : public Processor {
 
   // Send messages in merge files to output channel.
   void SendMergedMessages() {
-    // Priority queue for merging files.
-    typedef std::vector<MergeItem *> MergeItemArray;
-    std::priority_queue<MergeItem *, MergeItemArray, ItemComparator> merger;
-
     // Open merge files.
-    int num_files = next_merge_file_;
-    std::vector<MergeItem> items(num_files);
-    for (int i = 0; i < num_files; ++i) {
-      // Open reader for merge file.
-      MergeItem &item = items[i];
-      item.reader = new RecordReader(MergeFileName(i));
-
-      // Add first record to sort queue.
-      if (!item.reader->Done()) {
-        CHECK(item.reader->Read(&item.record));
-        merger.push(&item);
-      }
-    }
+    std::vector<string> filenames;
+    for (int run : runs_) filenames.push_back(MergeFileName(run));
+    Merger merger(filenames);
 
     // Merge files and output sorted messages to output channel.
-    VLOG(3) << "Merge " << num_files << " files";
-    while (!merger.empty()) {
-      // Get next item from queue.
-      MergeItem *item = merger.top();
-      merger.pop();
-
-      // Send message to output channel.
-      Message *message = new Message(item->record.key,
-                                     item->record.version,
-                                     item->record.value);
+    VLOG(3) << "Merge " << filenames.size() << " files";
+    MergeRecords(&merger, [&](const Record &record) {
+      Message *message = new Message(record.key, record.version, record.value);
       output_->Send(message);
-
-      // Get next item from merge file and add it to queue.
-      if (!item->reader->Done()) {
-        CHECK(item->reader->Read(&item->record));
-        merger.push(item);
-      }
-    }
-
-    // Close merge file readers.
+    });
     VLOG(3) << "Close merge files";
-    for (auto &item : items) {
-      CHECK(item.reader->Close());
-      delete item.reader;
-    }
   }
 
  private:
@@ -230,15 +446,33 @@ class Sorter : public Processor {
   // Buffer of messages that have not yet been sorted and written to merge file.
   std::vector<Message *> messages_;
 
+  // Messages being sorted and written to merge file by the flush thread.
+  std::vector<Message *> flushing_;
+
+  // Thread for sorting and writing sort buffer to merge file.
+  ClosureThread *flusher_ = nullptr;
+
   // Maximum size of messages in the sort buffer.
   int64 max_buffer_size_ = 64 * 1024 * 1024;
 
+  // Number of threads for sorting the sort buffer and merging files.
+  int sort_threads_ = 4;
+
+  // Maximum number of files merged at a time.
+  int merge_fanin_ = 64;
+
   // Size of messages in the sort buffer.
   uint64 buffer_bytes_ = 0;
 
   // Next merge file number.
   int next_merge_file_ = 0;
 
+  // Merge files with sorted runs of messages.
+  std::vector<int> runs_;
+
+  // Combiner for combining values for messages with the same key.
+  Combiner *combiner_ = nullptr;
+
   // Output channel.
   Channel *output_;
 
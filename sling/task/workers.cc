@@ -20,7 +20,10 @@ namespace task {
 
 // Create a pool of worker threads and distribute the incoming messages to
 // the output channel using the worker threads. This adds parallelism to the
-// processing of the message stream.
+// processing of the message stream. The workers steal messages from each other
+// when they run out of work, so skewed processing times do not leave workers
+// idle. Processors receiving messages from the workers can use the pool for
+// running sub-tasks in parallel, see WorkStealingPool::Current().
 class Workers : public Processor {
  public:
   ~Workers() override { delete pool_; }
@@ -34,7 +37,7 @@ class Workers : public Processor {
     int queue_size = task->Get("queue_size", num_workers * 2);
 
     // Start worker pool.
-    pool_ = new ThreadPool(num_workers, queue_size);
+    pool_ = new WorkStealingPool(num_workers, queue_size);
     pool_->StartWorkers();
   }
 
@@ -58,7 +61,7 @@ class Workers : public Processor {
 
  private:
   // Thread pool for dispatching messages.
-  ThreadPool *pool_ = nullptr;
+  WorkStealingPool *pool_ = nullptr;
 
   // Output channel.
   Channel *output_;
@@ -15,6 +15,7 @@
 #ifndef SLING_UTIL_MUTEX_H_
 #define SLING_UTIL_MUTEX_H_
 
+#include <pthread.h>
 #include <mutex>
 
 namespace sling {
@@ -46,6 +47,52 @@ class MutexLock {
   Mutex *lock_;
 };
 
+// Reader/writer lock that allows multiple readers to hold the lock at the same
+// time, while writers get exclusive access. Writers are preferred over readers
+// to prevent writer starvation.
+class SharedMutex {
+ public:
+  SharedMutex() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __linux__
+    pthread_rwlockattr_setkind_np(
+        &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&lock_, &attr);
+    pthread_rwlockattr_destroy(&attr);
+  }
+  ~SharedMutex() { pthread_rwlock_destroy(&lock_); }
+
+  // Acquire exclusive lock.
+  void Lock() { pthread_rwlock_wrlock(&lock_); }
+
+  // Acquire shared lock.
+  void LockShared() { pthread_rwlock_rdlock(&lock_); }
+
+  // Release exclusive or shared lock.
+  void Unlock() { pthread_rwlock_unlock(&lock_); }
+
+ private:
+  pthread_rwlock_t lock_;
+};
+
+// Shared lock guard.
+class SharedMutexLock {
+ public:
+  // Constructor that acquires shared lock.
+  explicit SharedMutexLock(SharedMutex *lock) : lock_(lock) {
+    lock_->LockShared();
+  }
+
+  // Destructor that releases lock.
+  ~SharedMutexLock() { lock_->Unlock(); }
+
+ private:
+  // Lock for guard.
+  SharedMutex *lock_;
+};
+
 }  // namespace sling
 
 #endif  // SLING_UTIL_MUTEX_H_
@@ -12,9 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "sling/base/logging.h"
 #include "sling/util/threadpool.h"
 
+#include <thread>
+
+#include "sling/base/logging.h"
+
 namespace sling {
 
 ThreadPool::ThreadPool(int num_workers, int queue_size)
@@ -74,5 +77,166 @@ void ThreadPool::Shutdown() {
   nonempty_.notify_all();
 }
 
+// Worker pool and index for current worker thread.
+static thread_local WorkStealingPool *current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+WorkStealingPool::WorkStealingPool(int num_workers, int queue_size)
+    : num_workers_(num_workers), queue_size_(queue_size) {
+  CHECK_GT(num_workers, 0);
+  deques_ = new Deque[num_workers];
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  // Notify all workers that we are done. The workers terminate when all the
+  // pending tasks have been completed.
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    done_ = true;
+    nonempty_.notify_all();
+  }
+
+  // Wait until all workers have terminated.
+  for (auto &t : workers_) t.Join();
+  delete [] deques_;
+}
+
+WorkStealingPool *WorkStealingPool::Current() {
+  return current_pool;
+}
+
+void WorkStealingPool::StartWorkers() {
+  // Create worker threads.
+  CHECK(workers_.empty());
+  for (int i = 0; i < num_workers_; ++i) {
+    workers_.emplace_back([this, i]() { Work(i); });
+  }
+
+  // Start worker threads.
+  for (auto &t : workers_) {
+    t.SetJoinable(true);
+    t.Start();
+  }
+}
+
+void WorkStealingPool::Schedule(Task &&task) {
+  // Tasks scheduled by workers are added to the deque for the worker.
+  if (current_pool == this) {
+    Push(current_worker, std::move(task));
+    return;
+  }
+
+  // Wait until there is room for more tasks.
+  if (pending_ >= queue_size_) {
+    std::unique_lock<std::mutex> lock(mu_);
+    blocked_++;
+    while (pending_ >= queue_size_) nonfull_.wait(lock);
+    blocked_--;
+  }
+
+  // Distribute tasks from outside the pool round-robin over the workers.
+  Push(next_++ % num_workers_, std::move(task));
+}
+
+void WorkStealingPool::Push(int index, Task &&task) {
+  Deque &deque = deques_[index];
+  {
+    std::lock_guard<std::mutex> lock(deque.mu);
+    deque.tasks.push_back(std::move(task));
+  }
+  pending_++;
+
+  // Wake up an idle worker.
+  if (idle_ > 0) {
+    std::lock_guard<std::mutex> lock(mu_);
+    nonempty_.notify_one();
+  }
+}
+
+bool WorkStealingPool::TakeTask(int index, Task *task) {
+  bool found = false;
+
+  // Take task from the back of own deque.
+  if (index != -1) {
+    Deque &deque = deques_[index];
+    std::lock_guard<std::mutex> lock(deque.mu);
+    if (!deque.tasks.empty()) {
+      *task = std::move(deque.tasks.back());
+      deque.tasks.pop_back();
+      found = true;
+    }
+  }
+
+  // Steal task from the front of the deque of another worker.
+  int start = index == -1 ? 0 : index + 1;
+  for (int i = 0; !found && i < num_workers_; ++i) {
+    Deque &victim = deques_[(start + i) % num_workers_];
+    std::lock_guard<std::mutex> lock(victim.mu);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      found = true;
+    }
+  }
+  if (!found) return false;
+
+  // Wake up blocked producer.
+  pending_--;
+  if (blocked_ > 0) {
+    std::lock_guard<std::mutex> lock(mu_);
+    nonfull_.notify_one();
+  }
+  return true;
+}
+
+void WorkStealingPool::Work(int index) {
+  current_pool = this;
+  current_worker = index;
+  Task task;
+  for (;;) {
+    if (TakeTask(index, &task)) {
+      // Run task.
+      task();
+      task = nullptr;
+    } else if (pending_ > 0) {
+      // A task is being added to one of the deques.
+      std::this_thread::yield();
+    } else {
+      // Wait for new tasks.
+      std::unique_lock<std::mutex> lock(mu_);
+      idle_++;
+      while (pending_ == 0 && !done_) nonempty_.wait(lock);
+      idle_--;
+      if (pending_ == 0 && done_) break;
+    }
+  }
+  current_pool = nullptr;
+  current_worker = -1;
+}
+
+void WorkStealingPool::ParallelFor(int n,
+                                   const std::function<void(int)> &func) {
+  // Schedule sub-tasks.
+  std::atomic<int> remaining{n};
+  for (int i = 0; i < n; ++i) {
+    Schedule([&func, &remaining, i]() {
+      func(i);
+      remaining--;
+    });
+  }
+
+  // Help executing tasks until all sub-tasks have completed.
+  int index = current_pool == this ? current_worker : -1;
+  Task task;
+  while (remaining > 0) {
+    if (TakeTask(index, &task)) {
+      task();
+      task = nullptr;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
 }  // namespace sling
 
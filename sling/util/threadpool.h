@@ -15,12 +15,15 @@
 #ifndef SLING_UTIL_THREADPOOL_H_
 #define SLING_UTIL_THREADPOOL_H_
 
+#include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <mutex>
 #include <queue>
 #include <vector>
 
+#include "sling/base/types.h"
 #include "sling/util/thread.h"
 
 namespace sling {
@@ -71,6 +74,89 @@ class ThreadPool {
   std::condition_variable nonfull_;
 };
 
+// Thread pool where each worker has its own task deque. Workers take tasks
+// from the back of their own deque and steal tasks from the front of the other
+// deques when they run out of work, so no worker is left idle while another
+// worker has a backlog of tasks. Tasks scheduled from outside the pool are
+// distributed round-robin over the workers and block when the pool has too
+// many pending tasks. Tasks scheduled from a worker thread are added to the
+// deque of the worker without blocking, so tasks can spawn sub-tasks.
+class WorkStealingPool {
+ public:
+  // Task that can be scheduled for execution.
+  typedef std::function<void()> Task;
+
+  // Initialize thread pool.
+  WorkStealingPool(int num_workers, int queue_size);
+
+  // Wait for all workers to complete.
+  ~WorkStealingPool();
+
+  // Start worker threads.
+  void StartWorkers();
+
+  // Schedule task to be executed by worker.
+  void Schedule(Task &&task);
+
+  // Run function for indices 0 to n-1 in parallel. The calling thread helps
+  // executing tasks until all the indices have been processed.
+  void ParallelFor(int n, const std::function<void(int)> &func);
+
+  // Return the number of worker threads in the pool.
+  int size() const { return num_workers_; }
+
+  // Return pool for the current worker thread, or null if the current thread
+  // is not a worker thread in a work-stealing pool.
+  static WorkStealingPool *Current();
+
+ private:
+  // Task deque for worker. The deques are padded to keep the locks for
+  // different workers on separate cache lines.
+  struct Deque {
+    std::mutex mu;
+    std::deque<Task> tasks;
+    char padding[64];
+  };
+
+  // Worker thread main loop.
+  void Work(int index);
+
+  // Try to take a task from the deque for a worker or steal one from the other
+  // workers. Worker index -1 only steals tasks.
+  bool TakeTask(int index, Task *task);
+
+  // Add task to deque and wake up an idle worker.
+  void Push(int index, Task &&task);
+
+  // Worker threads.
+  int num_workers_;
+  std::vector<ClosureThread> workers_;
+
+  // Task deques for workers.
+  Deque *deques_;
+
+  // Maximum number of pending tasks scheduled from outside the pool.
+  int queue_size_;
+
+  // Number of pending tasks.
+  std::atomic<int64> pending_{0};
+
+  // Next worker for tasks scheduled from outside the pool.
+  std::atomic<uint32> next_{0};
+
+  // Number of idle workers and blocked producers.
+  std::atomic<int> idle_{0};
+  std::atomic<int> blocked_{0};
+
+  // Are we done with adding new tasks.
+  std::atomic<bool> done_{false};
+
+  // Mutex and signals for idle workers and blocked producers.
+  std::mutex mu_;
+  std::condition_variable nonempty_;
+  std::condition_variable nonfull_;
+};
+
 }  // namespace sling
 
 #endif  // SLING_UTIL_THREADPOOL_H_
@@ -2260,6 +2260,19 @@ class Assembler : public CodeGenerator {
     vinstr(0xe6, dst, ymm0, src, k66, k0F, kWIG);
   }
 
+  void vcvtps2dq(XMMRegister dst, XMMRegister src) {
+    vinstr(0x5b, dst, xmm0, src, k66, k0F, kWIG);
+  }
+  void vcvtps2dq(XMMRegister dst, const Operand &src) {
+    vinstr(0x5b, dst, xmm0, src, k66, k0F, kWIG);
+  }
+  void vcvtps2dq(YMMRegister dst, YMMRegister src) {
+    vinstr(0x5b, dst, ymm0, src, k66, k0F, kWIG);
+  }
+  void vcvtps2dq(YMMRegister dst, const Operand &src) {
+    vinstr(0x5b, dst, ymm0, src, k66, k0F, kWIG);
+  }
+
   void vcvttps2dq(XMMRegister dst, XMMRegister src) {
     vinstr(0x5b, dst, xmm0, src, kF3, k0F, kWIG);
   }
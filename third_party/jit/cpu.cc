@@ -281,6 +281,9 @@ void CPU::Initialize() {
     if (cpu.has_avx2()) features |= 1u << AVX2;
     if (cpu.has_avx512(ProcessorInformation::AVX512F)) {
       features |= 1u << AVX512F;
+      if (cpu.has_avx512(ProcessorInformation::AVX512VNNI)) {
+        features |= 1u << AVX512VNNI;
+      }
     }
   }
 
@@ -101,7 +101,7 @@ class ProcessorInformation {
   bool has_popcnt() const { return has_popcnt_; }
   bool has_zero_idiom() const { return has_zero_idiom_; }
   bool has_one_idiom() const { return has_one_idiom_; }
-  bool has_avx512(AVX512Feature f) const { return avx512[1 << f]; }
+  bool has_avx512(AVX512Feature f) const { return avx512[f]; }
 
  private:
   char vendor_[13];
@@ -150,6 +150,7 @@ enum CpuFeature {
   AVX,
   AVX2,
   AVX512F,
+  AVX512VNNI,
   FMA3,
   SAHF,
   BMI1,
@@ -94,6 +94,7 @@ namespace jit {
   V(pcmpgtb, 66, 0F, 64)         \
   V(pcmpgtw, 66, 0F, 65)         \
   V(pcmpgtd, 66, 0F, 66)         \
+  V(pmaddwd, 66, 0F, F5)         \
   V(pmaxsw, 66, 0F, EE)          \
   V(pmaxub, 66, 0F, DE)          \
   V(pminsw, 66, 0F, EA)          \
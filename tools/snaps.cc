@@ -29,6 +29,8 @@
 DEFINE_bool(check, false, "Check for valid snapshot");
 DEFINE_bool(verify, false, "Check snapshot by reading it into memory");
 
+DECLARE_bool(map_snapshots);
+
 using namespace sling;
 
 int main(int argc, char *argv[]) {
@@ -48,7 +50,11 @@ int main(int argc, char *argv[]) {
       std::cout << file << ": " << std::flush;
       std::cout << "load " << std::flush;
       Store store;
-      CHECK(Snapshot::Read(&store, file));
+      if (FLAGS_map_snapshots) {
+        CHECK(Snapshot::Map(&store, file));
+      } else {
+        CHECK(Snapshot::Read(&store, file));
+      }
       std::cout << "done\n" << std::flush;
     } else {
       std::cout << file << ": " << std::flush;